@@ -0,0 +1,47 @@
+# Writes a random .tilemap for lib_check's ctilemap check, built so that compress_tilemap.py picks
+# the given block size for it. See the ctilemap check in src/lib_check.c.
+#
+# * 1: tiles drawn from a small set, so almost every 2x2 group is new but single tiles repeat.
+# * 2: a grid of 2x2 blocks drawn from a small set, so 4x4 groups are mostly new.
+# * 4: a grid of 4x4 blocks drawn from over 256 different ones, so indices take 2 bytes.
+#
+# Neither size is a multiple of the block size, and a block often repeats the one before it, so
+# both the padding and the repeat runs are decoded.
+
+import random
+import sys
+
+# block size: (width, height, different blocks)
+MAPS = {1: (37, 23, 16), 2: (75, 51, 16), 4: (130, 97, 300)}
+
+def random_tile():
+    return (random.randrange(1024), random.randrange(16), random.randrange(4))
+
+def main(block, output_path):
+    width, height, count = MAPS[block]
+    random.seed(block)
+    blocks = [[random_tile() for _ in range(block * block)] for _ in range(count)]
+
+    grid_width = (width + block - 1) // block
+    grid_height = (height + block - 1) // block
+    grid = []
+    for _ in range(grid_width * grid_height):
+        if len(grid) % grid_width != 0 and random.randrange(3) == 0:
+            grid.append(grid[-1])
+        else:
+            grid.append(random.randrange(count))
+
+    with open(output_path, 'w') as fw:
+        for y in range(height):
+            row = []
+            for x in range(width):
+                tile = blocks[grid[(y // block) * grid_width + x // block]][(y % block) * block +
+                                                                            x % block]
+                row.append("(%03x,%x,%x)" % tile)
+            fw.write(" ".join(row) + "\n")
+
+if __name__ == "__main__":
+    if len(sys.argv) == 3 and sys.argv[1] in ("1", "2", "4"):
+        main(int(sys.argv[1]), sys.argv[2])
+    else:
+        print("Expecting 2 arguments: <block size: 1, 2 or 4> and <dest .tilemap file>")
@@ -0,0 +1,96 @@
+# Turns a trace written by the User Library's profiler (make PROFILE=1, FPGAME_TRACE=<file>) into
+# a JSON file for chrome://tracing or https://ui.perfetto.dev
+# See src/inc/fpgame_prof.h for the trace layout.
+
+import json
+import struct
+import sys
+
+HEADER = struct.Struct("<4sHHII")
+NAME_SIZE = 24
+EVENT = struct.Struct("<QIHHII")
+FRAME = struct.Struct("<QQII4I")
+SECTIONS = ["tileram", "patternram", "paletteram", "spriteram"]
+
+# Track IDs: frames on top, then the game thread, then the APU refills (run from a signal handler),
+# then any other thread which called the library (e.g. a frame pipeline's submission thread)
+FRAME_TID = 0
+GAME_TID = 1
+APU_TID = 2
+
+def track(thread):
+    # Threads as numbered in the trace: 0 for APU refills, 1 for the thread which enabled the PPU
+    if thread == 0:
+        return APU_TID
+    if thread == 1:
+        return GAME_TID
+    return thread + 1
+
+def main(input_path, output_path):
+    data = open(input_path, 'rb').read()
+
+    magic, version, func_count, event_count, frame_count = HEADER.unpack_from(data, 0)
+    if magic != b"FPTR" or version not in (1, 2):
+        sys.exit("%s is not a version 1 or 2 FP-GAme trace" % input_path)
+    pos = HEADER.size
+
+    names = []
+    for i in range(func_count):
+        names.append(data[pos:pos+NAME_SIZE].split(b"\0")[0].decode())
+        pos += NAME_SIZE
+
+    # Times are made relative to the first record, in microseconds as chrome://tracing expects.
+    events = []
+    for i in range(event_count):
+        events.append(EVENT.unpack_from(data, pos))
+        pos += EVENT.size
+    frames = []
+    for i in range(frame_count):
+        frames.append(FRAME.unpack_from(data, pos))
+        pos += FRAME.size
+    starts = [e[0] for e in events] + [f[1] for f in frames]
+    t0 = min(starts) if starts else 0
+
+    out = [
+        {"name": "thread_name", "ph": "M", "pid": 0, "tid": FRAME_TID, "args": {"name": "frames"}},
+        {"name": "thread_name", "ph": "M", "pid": 0, "tid": GAME_TID, "args": {"name": "game"}},
+        {"name": "thread_name", "ph": "M", "pid": 0, "tid": APU_TID, "args": {"name": "apu"}},
+    ]
+    # Version 1 traces have no thread numbers, so every call but the refills is the game thread's.
+    # Other threads are named after what they do.
+    thread_names = {}
+    for start, dur, func, result, nbytes, thread in events:
+        name = names[func] if func < len(names) else "func %d" % func
+        if version == 1:
+            thread = 0 if name == "apu_refill" else 1
+        if thread > 1:
+            if name == "ppu_update":
+                thread_names[thread] = "submitter"
+            elif name == "get_con_state" and thread_names.get(thread) != "submitter":
+                thread_names[thread] = "controller"
+            else:
+                thread_names.setdefault(thread, "thread %d" % thread)
+        out.append({
+            "name": name, "ph": "X", "pid": 0, "tid": track(thread),
+            "ts": (start - t0) / 1000.0, "dur": dur / 1000.0,
+            "args": {"bytes": nbytes, "busy": bool(result)}
+        })
+    for thread, thread_name in sorted(thread_names.items()):
+        out.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": track(thread),
+                    "args": {"name": thread_name}})
+    for frame, start, dur, missed, *section_bytes in frames:
+        args = {"missed_vblanks": missed}
+        args.update(zip(SECTIONS, section_bytes))
+        out.append({
+            "name": "frame %d" % frame, "ph": "X", "pid": 0, "tid": FRAME_TID,
+            "ts": (start - t0) / 1000.0, "dur": dur / 1000.0, "args": args
+        })
+
+    fw = open(output_path, 'w')
+    json.dump({"traceEvents": out, "displayTimeUnit": "ns"}, fw)
+
+if __name__ == "__main__":
+    if len(sys.argv) == 3:
+        main(sys.argv[1], sys.argv[2])
+    else:
+        print("Expecting 2 arguments: <src trace file> and <dest .json file>")
@@ -0,0 +1,319 @@
+/* User-space emulation of the FP-GAme devices. See fpgame_emu.h for the emulated behaviour.
+ *
+ * Timing follows CLOCK_MONOTONIC, so games run at the same speed as on the console and helpers
+ *   like the frame pacer work unchanged. VBLANKs are modeled every FRAME_NS, counted from the
+ *   moment the PPU was enabled.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "fpgame_emu.h"
+#include "noway.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FRAME_NS 16666667ull
+#define DMA_DEFAULT_US 500
+#define APU_PERIOD_NS (1000000000ull * APU_BUF_MAX / APU_SAMPLE_RATE)
+#define CON_RELEASED 0xFFFF
+#define CON_MAX_EVENTS 4096
+
+typedef struct {
+    uint64_t frame;
+    int state;
+} con_event_t;
+
+// PPU: what the game has written so far, and the last frame it sent
+static int ppu_owned = 0;
+static ppu_model_t staged;
+static ppu_model_t display;
+static uint64_t frames;        // also read by controller reads, which may come from any thread
+static uint64_t epoch_ns;
+static uint64_t ready_ns;     // ppu_update is busy until this time
+static uint64_t dma_start_ns; // VRAM writes are busy from this time...
+static uint64_t dma_end_ns;   // ...until this time
+static uint64_t dma_ns;
+
+// APU
+static int apu_owned = 0;
+static void (*apu_refill)(void);
+static timer_t apu_timer;
+static struct sigaction apu_old_action;
+static int audio_fd = -1;
+
+// Controller
+static int con_loaded = 0;
+static con_event_t con_events[CON_MAX_EVENTS];
+static unsigned con_event_count = 0;
+static unsigned con_next_event = 0;
+static int con_state = CON_RELEASED;
+static pthread_mutex_t con_lock = PTHREAD_MUTEX_INITIALIZER; // guards the controller state above
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* =========== */
+/* === PPU === */
+/* =========== */
+static int emu_ppu_open(void)
+{
+    const char *dma_us = getenv("FPGAME_EMU_DMA_US");
+
+    if (ppu_owned) return -1;
+    ppu_owned = 1;
+
+    ppu_model_init(&staged);
+    ppu_model_init(&display);
+    __atomic_store_n(&frames, 0, __ATOMIC_RELAXED);
+    epoch_ns = now_ns();
+    ready_ns = dma_start_ns = dma_end_ns = 0;
+    dma_ns = (dma_us != NULL) ? strtoull(dma_us, NULL, 0) * 1000 : DMA_DEFAULT_US * 1000ull;
+    return 0;
+}
+
+static void emu_ppu_close(void)
+{
+    ppu_owned = 0;
+}
+
+static int emu_ppu_write(const void *buf, size_t len, off_t offset)
+{
+    uint64_t t = now_ns();
+
+    if (t >= dma_start_ns && t < dma_end_ns) return -1;
+
+    ppu_model_write_vram(&staged, buf, len, offset);
+    return 0;
+}
+
+static int emu_ppu_write_strided(const void *buf, size_t size, size_t count, off_t offset,
+                                 size_t stride)
+{
+    uint64_t t = now_ns();
+
+    if (t >= dma_start_ns && t < dma_end_ns) return -1;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        ppu_model_write_vram(&staged, (const uint8_t *)buf + i * size, size, offset + i * stride);
+    }
+    return 0;
+}
+
+static int emu_ppu_request(ppu_request_e request, uint32_t arg)
+{
+    uint64_t t, vblank;
+
+    switch (request)
+    {
+        case PPU_REQ_UPDATE:
+            t = now_ns();
+            if (t < ready_ns) return -1;
+
+            // The frame is displayed from the next VBLANK on, and the kernel copies it to the PPU
+            //   during that VBLANK.
+            display = staged;
+            __atomic_store_n(&frames, frames + 1, __ATOMIC_RELAXED);
+            vblank = epoch_ns + ((t - epoch_ns) / FRAME_NS + 1) * FRAME_NS;
+            ready_ns = dma_start_ns = vblank;
+            dma_end_ns = vblank + dma_ns;
+            return 0;
+        case PPU_REQ_BGCOLOR:
+            staged.bgcolor = arg;
+            return 0;
+        case PPU_REQ_BGSCROLL:
+            ppu_model_set_scroll(&staged, LAYER_BG, arg & 0xFFFF, arg >> 16);
+            return 0;
+        case PPU_REQ_FGSCROLL:
+            ppu_model_set_scroll(&staged, LAYER_FG, arg & 0xFFFF, arg >> 16);
+            return 0;
+        case PPU_REQ_LAYER_ENABLE:
+            staged.layer_enable = arg;
+            return 0;
+    }
+
+    nowaymsg(1, "Unknown PPU request!");
+    return -1;
+}
+
+const ppu_model_t *fpgame_emu_display(void)
+{
+    nowaymsg(!ppu_owned, "PPU not enabled!");
+
+    return &display;
+}
+
+/* =========== */
+/* === APU === */
+/* =========== */
+static void apu_handler(int sig)
+{
+    (void)sig;
+    apu_refill();
+}
+
+static int emu_apu_open(void (*refill)(void))
+{
+    const char *audio_file = getenv("FPGAME_EMU_AUDIO");
+    struct sigaction sa;
+    struct sigevent sev;
+    struct itimerspec its;
+
+    if (apu_owned) return -1;
+
+    if (audio_file != NULL && (audio_fd = open(audio_file, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        return -1;
+    }
+
+    apu_refill = refill;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = apu_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGRTMAX, &sa, &apu_old_action);
+
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_SIGNAL;
+    sev.sigev_signo = SIGRTMAX;
+    if (timer_create(CLOCK_MONOTONIC, &sev, &apu_timer) != 0)
+    {
+        sigaction(SIGRTMAX, &apu_old_action, NULL);
+        if (audio_fd >= 0) close(audio_fd);
+        audio_fd = -1;
+        return -1;
+    }
+
+    // The first refill is requested right away, to fill the APU's queued buffer.
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = 1;
+    its.it_interval.tv_nsec = APU_PERIOD_NS;
+    timer_settime(apu_timer, 0, &its, NULL);
+
+    apu_owned = 1;
+    return 0;
+}
+
+static void emu_apu_close(void)
+{
+    timer_delete(apu_timer);
+    sigaction(SIGRTMAX, &apu_old_action, NULL);
+
+    if (audio_fd >= 0) close(audio_fd);
+    audio_fd = -1;
+    apu_owned = 0;
+}
+
+static void emu_apu_write(const int8_t *buf, size_t len)
+{
+    static const int8_t silence[APU_BUF_MAX];
+
+    if (audio_fd < 0) return;
+
+    // Each refill plays for a whole buffer period, so pad short buffers with silence.
+    if (len > 0 && write(audio_fd, buf, len) < 0) return;
+    if (len < APU_BUF_MAX && write(audio_fd, silence, APU_BUF_MAX - len) < 0) return;
+}
+
+/* ================== */
+/* === Controller === */
+/* ================== */
+static const struct {
+    const char *name;
+    int mask;
+} con_buttons[] = {
+    { "B", CON_BUT_B }, { "Y", CON_BUT_Y }, { "SELECT", CON_BUT_SELECT },
+    { "START", CON_BUT_START }, { "UP", CON_BUT_UP }, { "DOWN", CON_BUT_DOWN },
+    { "LEFT", CON_BUT_LEFT }, { "RIGHT", CON_BUT_RIGHT }, { "A", CON_BUT_A }, { "X", CON_BUT_X },
+    { "L", CON_BUT_L }, { "R", CON_BUT_R }
+};
+
+// Parses "BUTTON+BUTTON..." or "none" into an active-low controller state
+static int parse_buttons(char *buttons)
+{
+    int state = CON_RELEASED;
+
+    if (strcmp(buttons, "none") == 0) return state;
+
+    for (char *name = strtok(buttons, "+"); name != NULL; name = strtok(NULL, "+"))
+    {
+        unsigned i;
+
+        for (i = 0; i < sizeof(con_buttons) / sizeof(con_buttons[0]); i++)
+        {
+            if (strcmp(name, con_buttons[i].name) == 0) break;
+        }
+        nowaymsg(i == sizeof(con_buttons) / sizeof(con_buttons[0]),
+                 "Unknown button in controller script!");
+        state &= ~con_buttons[i].mask;
+    }
+    return state;
+}
+
+static void load_con_script(void)
+{
+    const char *script = getenv("FPGAME_EMU_CON");
+    char line[256];
+    char buttons[128];
+    unsigned long long frame;
+    FILE *fp;
+
+    con_loaded = 1;
+    if (script == NULL) return;
+
+    nowaymsg((fp = fopen(script, "r")) == NULL, "Could not open controller script!");
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        if (line[0] == '#' || sscanf(line, "%llu %127s", &frame, buttons) != 2) continue;
+
+        nowaymsg(con_event_count == CON_MAX_EVENTS, "Controller script is too long!");
+        nowaymsg(con_event_count > 0 && frame < con_events[con_event_count - 1].frame,
+                 "Controller script is out of order!");
+        con_events[con_event_count].frame = frame;
+        con_events[con_event_count].state = parse_buttons(buttons);
+        con_event_count++;
+    }
+    fclose(fp);
+}
+
+static int emu_con_read(void)
+{
+    uint64_t frame = __atomic_load_n(&frames, __ATOMIC_RELAXED);
+    int state;
+
+    pthread_mutex_lock(&con_lock);
+    if (!con_loaded) load_con_script();
+
+    while (con_next_event < con_event_count && con_events[con_next_event].frame <= frame)
+    {
+        con_state = con_events[con_next_event++].state;
+    }
+    state = con_state;
+    pthread_mutex_unlock(&con_lock);
+    return state;
+}
+
+const fpgame_backend_t fpgame_emu_backend = {
+    .name = "emu",
+    .ppu_open = emu_ppu_open,
+    .ppu_close = emu_ppu_close,
+    .ppu_write = emu_ppu_write,
+    .ppu_write_strided = emu_ppu_write_strided,
+    .ppu_request = emu_ppu_request,
+    .apu_open = emu_apu_open,
+    .apu_close = emu_apu_close,
+    .apu_write = emu_apu_write,
+    .con_read = emu_con_read,
+};
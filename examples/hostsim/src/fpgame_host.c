@@ -0,0 +1,589 @@
+/* Host build of the FP-GAme User Library. See fpgame_host.h.
+ *
+ * Argument checks follow the documentation in ppu.h, apu.h and con.h: invalid arguments print a
+ *   console warning and exit, and busy devices make the call return -1. VRAM data is encoded
+ *   exactly as the console's library encodes it (see vram_layout.h).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "fpgame_emu.h"
+#include "fpgame_host.h"
+#include "fpgame_prof.h"
+#include "noway.h"
+#include "vram_layout.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const fpgame_backend_t *backend = &fpgame_emu_backend;
+static int ppu_enabled = 0;
+static int apu_enabled = 0;
+
+static void (*apu_user_callback)(const int8_t **buf, int *buf_size) = NULL;
+
+// Statistics. The totals are counted with atomic adds, as the library may be used from several
+//   threads at once: a frame pipeline's submission thread talks to the PPU (see frame_pipeline.h
+//   in the techdemo) while a controller sampler calls get_con_state and the game thread takes APU
+//   refills in a signal handler. The last frame's statistics are made by the thread which sends
+//   the frames, and may be read by any other, so they are guarded by stats_lock.
+static fpgame_stats_t total;
+static fpgame_stats_t frame_start;
+static fpgame_stats_t last_frame;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t cpu_start_ns;
+static FILE *stats_fp = NULL;
+
+/* ======================= */
+/* === Device Wrappers === */
+/* ======================= */
+static uint64_t cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void stat_add(uint64_t *counter, uint64_t n)
+{
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static void snapshot(fpgame_stats_t *stats)
+{
+    stats->frames = __atomic_load_n(&total.frames, __ATOMIC_RELAXED);
+    stats->ppu_calls = __atomic_load_n(&total.ppu_calls, __ATOMIC_RELAXED);
+    stats->ppu_busy = __atomic_load_n(&total.ppu_busy, __ATOMIC_RELAXED);
+    stats->vram_bytes = __atomic_load_n(&total.vram_bytes, __ATOMIC_RELAXED);
+    stats->con_calls = __atomic_load_n(&total.con_calls, __ATOMIC_RELAXED);
+    stats->apu_refills = __atomic_load_n(&total.apu_refills, __ATOMIC_RELAXED);
+    stats->cpu_ns = cpu_ns() - cpu_start_ns;
+}
+
+static int dev_write(const void *buf, size_t len, off_t offset)
+{
+    int result = backend->ppu_write(buf, len, offset);
+
+    stat_add(&total.ppu_calls, 1);
+    if (result == -1)
+    {
+        stat_add(&total.ppu_busy, 1);
+        return result;
+    }
+
+    stat_add(&total.vram_bytes, len);
+    FPGAME_PROF_BYTES(offset, len);
+    return result;
+}
+
+static int dev_write_strided(const void *buf, size_t size, size_t count, off_t offset,
+                             size_t stride)
+{
+    int result = backend->ppu_write_strided(buf, size, count, offset, stride);
+
+    stat_add(&total.ppu_calls, 1);
+    if (result == -1)
+    {
+        stat_add(&total.ppu_busy, 1);
+        return result;
+    }
+
+    stat_add(&total.vram_bytes, size * count);
+    FPGAME_PROF_BYTES(offset, size * count);
+    return result;
+}
+
+static int dev_request(ppu_request_e request, uint32_t arg)
+{
+    int result = backend->ppu_request(request, arg);
+
+    stat_add(&total.ppu_calls, 1);
+    if (result == -1) stat_add(&total.ppu_busy, 1);
+    return result;
+}
+
+// Closes the statistics of the frame which was just accepted
+static void end_frame(void)
+{
+    fpgame_stats_t now;
+
+    FPGAME_PROF_FRAME_END();
+    stat_add(&total.frames, 1);
+
+    pthread_mutex_lock(&stats_lock);
+    snapshot(&now);
+    last_frame.frames = now.frames;
+    last_frame.cpu_ns = now.cpu_ns - frame_start.cpu_ns;
+    last_frame.ppu_calls = now.ppu_calls - frame_start.ppu_calls;
+    last_frame.ppu_busy = now.ppu_busy - frame_start.ppu_busy;
+    last_frame.vram_bytes = now.vram_bytes - frame_start.vram_bytes;
+    last_frame.con_calls = now.con_calls - frame_start.con_calls;
+    last_frame.apu_refills = now.apu_refills - frame_start.apu_refills;
+    frame_start = now;
+
+    if (stats_fp != NULL)
+    {
+        fprintf(stats_fp, "%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+                (unsigned long long)last_frame.frames,
+                (unsigned long long)last_frame.cpu_ns / 1000,
+                (unsigned long long)last_frame.ppu_calls,
+                (unsigned long long)last_frame.ppu_busy,
+                (unsigned long long)last_frame.vram_bytes,
+                (unsigned long long)last_frame.con_calls,
+                (unsigned long long)last_frame.apu_refills);
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void fpgame_set_backend(const fpgame_backend_t *new_backend)
+{
+    nowaymsg(ppu_enabled || apu_enabled, "Cannot change backend while a device is enabled!");
+
+    backend = (new_backend == NULL) ? &fpgame_emu_backend : new_backend;
+}
+
+void fpgame_last_frame_stats(fpgame_stats_t *stats)
+{
+    nowaymsg(stats == NULL, "Stats is NULL!");
+
+    pthread_mutex_lock(&stats_lock);
+    *stats = last_frame;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void fpgame_total_stats(fpgame_stats_t *stats)
+{
+    nowaymsg(stats == NULL, "Stats is NULL!");
+
+    snapshot(stats);
+}
+
+/* ========================= */
+/* === PPU Main Controls === */
+/* ========================= */
+int ppu_enable(void)
+{
+    const char *stats_file = getenv("FPGAME_STATS");
+
+    nowaymsg(ppu_enabled, "PPU already enabled!");
+
+    if (backend->ppu_open() == -1) return -1;
+    ppu_enabled = 1;
+
+    memset(&total, 0, sizeof(total));
+    memset(&last_frame, 0, sizeof(last_frame));
+    cpu_start_ns = cpu_ns();
+    snapshot(&frame_start);
+    FPGAME_PROF_RESET();
+
+    if (stats_file != NULL && (stats_fp = fopen(stats_file, "w")) != NULL)
+    {
+        fprintf(stats_fp, "frame,cpu_us,ppu_calls,ppu_busy,vram_bytes,con_calls,apu_refills\n");
+    }
+    return 0;
+}
+
+void ppu_disable(void)
+{
+    fpgame_stats_t stats;
+
+    nowaymsg(!ppu_enabled, "PPU not enabled!");
+
+    snapshot(&stats);
+    if (stats.frames != 0)
+    {
+        fprintf(stderr, "[%s] %llu frames, per frame: %.1f us CPU, %.1f PPU calls (%.1f busy), "
+                "%.0f VRAM bytes, %.1f controller reads\n", backend->name,
+                (unsigned long long)stats.frames, stats.cpu_ns / 1e3 / stats.frames,
+                (double)stats.ppu_calls / stats.frames, (double)stats.ppu_busy / stats.frames,
+                (double)stats.vram_bytes / stats.frames, (double)stats.con_calls / stats.frames);
+    }
+
+    if (stats_fp != NULL)
+    {
+        fclose(stats_fp);
+        stats_fp = NULL;
+    }
+    FPGAME_PROF_FINISH();
+
+    backend->ppu_close();
+    ppu_enabled = 0;
+}
+
+static int update(void)
+{
+    if (dev_request(PPU_REQ_UPDATE, 0) == -1) return -1;
+
+    end_frame();
+    return 0;
+}
+
+int ppu_update(void)
+{
+    nowaymsg(!ppu_enabled, "PPU not enabled!");
+
+    FPGAME_PROF_RETURN(FPGAME_PROF_PPU_UPDATE, update());
+}
+
+int ppu_write_vram(const void *buf, size_t len, off_t offset)
+{
+    nowaymsg(!ppu_enabled, "PPU not enabled!");
+    nowaymsg(buf == NULL, "VRAM buffer is NULL!");
+    nowaymsg(offset < 0 || offset > VRAM_BSIZE || len > (size_t)(VRAM_BSIZE - offset),
+             "VRAM write out of bounds!");
+
+    FPGAME_PROF_RETURN(FPGAME_PROF_PPU_WRITE_VRAM, dev_write(buf, len, offset));
+}
+
+/* =========================== */
+/* === PPU Data Generators === */
+/* =========================== */
+pattern_addr_t ppu_pattern_addr(unsigned x, unsigned y)
+{
+    nowaymsg(x >= PATTERNRAM_WIDTH || y >= PATTERNRAM_HEIGHT, "Pattern address out of range!");
+
+    return vram_pattern_addr(x, y);
+}
+
+tile_t ppu_make_tile(pattern_addr_t pattern_addr, unsigned palette_id, mirror_e mirror)
+{
+    nowaymsg(pattern_addr >= PATTERNRAM_WIDTH * PATTERNRAM_HEIGHT, "Invalid pattern address!");
+    nowaymsg(palette_id >= TILELAYER_MAX_PALETTES, "Invalid palette id!");
+    nowaymsg((unsigned)mirror > MIRROR_XY, "Invalid mirror!");
+
+    return vram_tile(pattern_addr, palette_id, mirror);
+}
+
+void ppu_load_tilemap(tile_t *tilemap, unsigned len, const char *file)
+{
+    FILE *fp;
+    unsigned pattern_addr, palette_id, mirror;
+
+    nowaymsg(tilemap == NULL, "Tilemap is NULL!");
+    nowaymsg(file == NULL, "Tilemap file name is NULL!");
+    nowaymsg((fp = fopen(file, "r")) == NULL, "Could not open tilemap file!");
+
+    for (unsigned i = 0; i < len; i++)
+    {
+        nowaymsg(fscanf(fp, " (%x,%x,%x)", &pattern_addr, &palette_id, &mirror) != 3,
+                 "Tilemap file is too short or malformed!");
+        tilemap[i] = ppu_make_tile(pattern_addr, palette_id, (mirror_e)mirror);
+    }
+
+    fclose(fp);
+}
+
+void ppu_load_pattern(pattern_t *pattern, const char *file, unsigned width, unsigned height)
+{
+    FILE *fp;
+    char pixel[2] = { 0, 0 };
+
+    nowaymsg(pattern == NULL, "Pattern is NULL!");
+    nowaymsg(file == NULL, "Pattern file name is NULL!");
+    nowaymsg(width == 0 || height == 0, "Pattern width and height must be at least 1!");
+    nowaymsg((fp = fopen(file, "r")) == NULL, "Could not open pattern file!");
+
+    memset(pattern, 0, width * height * sizeof(pattern_t));
+    for (unsigned y = 0; y < height * TILEPATTERN_HEIGHT; y++)
+    {
+        for (unsigned x = 0; x < width * 8; x++)
+        {
+            nowaymsg(fscanf(fp, " %1[0-9a-fA-F]", pixel) != 1,
+                     "Pattern file is too short or malformed!");
+
+            pattern_t *tile = &pattern[(y / TILEPATTERN_HEIGHT) * width + x / 8];
+            tile->pxrow[y % TILEPATTERN_HEIGHT] |= strtoul(pixel, NULL, 16) << (4 * (x % 8));
+        }
+    }
+
+    fclose(fp);
+}
+
+void ppu_load_palette(palette_t *palette, const char *file)
+{
+    FILE *fp;
+    unsigned color;
+
+    nowaymsg(palette == NULL, "Palette is NULL!");
+    nowaymsg(file == NULL, "Palette file name is NULL!");
+    nowaymsg((fp = fopen(file, "r")) == NULL, "Could not open palette file!");
+
+    // The first color is the transparent color, which has no entry in palette_t.
+    nowaymsg(fscanf(fp, " %x", &color) != 1, "Palette file is too short or malformed!");
+    for (unsigned i = 0; i < 15; i++)
+    {
+        nowaymsg(fscanf(fp, " %x", &color) != 1, "Palette file is too short or malformed!");
+        palette->color[i] = color;
+    }
+
+    fclose(fp);
+}
+
+/* =========================== */
+/* === PPU Write Functions === */
+/* =========================== */
+static int write_tiles_horizontal(const tile_t *tiles, unsigned len, layer_e layer, unsigned x_i,
+                                  unsigned y_i, unsigned count)
+{
+    tile_t row[TILELAYER_WIDTH];
+
+    nowaymsg(!ppu_enabled, "PPU not enabled!");
+    nowaymsg(tiles == NULL || len == 0, "Tiles buffer is empty!");
+    nowaymsg(layer != LAYER_BG && layer != LAYER_FG, "Layer must be LAYER_BG or LAYER_FG!");
+    nowaymsg(x_i >= TILELAYER_WIDTH || y_i >= TILELAYER_HEIGHT, "Tile position out of range!");
+
+    len = (len > TILELAYER_WIDTH) ? TILELAYER_WIDTH : len;
+    count = (count > TILELAYER_WIDTH) ? TILELAYER_WIDTH : count;
+    for (unsigned i = 0; i < count; i++) row[i] = tiles[i % len];
+
+    // one write up to the right edge of the layer, and one for the part that wraps around
+    unsigned first = (count < TILELAYER_WIDTH - x_i) ? count : TILELAYER_WIDTH - x_i;
+    if (dev_write(row, first * sizeof(tile_t), vram_tile_offset(layer, x_i, y_i)) == -1)
+    {
+        return -1;
+    }
+    if (count > first &&
+        dev_write(&row[first], (count - first) * sizeof(tile_t), vram_tile_offset(layer, 0, y_i))
+        == -1)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+int ppu_write_tiles_horizontal(const tile_t *tiles, unsigned len, layer_e layer, unsigned x_i,
+                               unsigned y_i, unsigned count)
+{
+    FPGAME_PROF_RETURN(FPGAME_PROF_PPU_WRITE_TILES_HORIZONTAL,
+                       write_tiles_horizontal(tiles, len, layer, x_i, y_i, count));
+}
+
+static int write_tiles_vertical(const tile_t *tiles, unsigned len, layer_e layer, unsigned x_i,
+                                unsigned y_i, unsigned count)
+{
+    tile_t column[TILELAYER_HEIGHT];
+
+    nowaymsg(!ppu_enabled, "PPU not enabled!");
+    nowaymsg(tiles == NULL || len == 0, "Tiles buffer is empty!");
+    nowaymsg(layer != LAYER_BG && layer != LAYER_FG, "Layer must be LAYER_BG or LAYER_FG!");
+    nowaymsg(x_i >= TILELAYER_WIDTH || y_i >= TILELAYER_HEIGHT, "Tile position out of range!");
+
+    len = (len > TILELAYER_HEIGHT) ? TILELAYER_HEIGHT : len;
+    count = (count > TILELAYER_HEIGHT) ? TILELAYER_HEIGHT : count;
+    for (unsigned i = 0; i < count; i++) column[i] = tiles[i % len];
+
+    // Tiles in a column are one Tile RAM row apart, so the column is sent as strided transfers:
+    //   one down to the bottom edge of the layer, and one for the part that wraps around.
+    size_t stride = vram_tile_offset(layer, x_i, 1) - vram_tile_offset(layer, x_i, 0);
+    unsigned first = (count < TILELAYER_HEIGHT - y_i) ? count : TILELAYER_HEIGHT - y_i;
+    if (dev_write_strided(column, sizeof(tile_t), first, vram_tile_offset(layer, x_i, y_i),
+                          stride) == -1)
+    {
+        return -1;
+    }
+    if (count > first &&
+        dev_write_strided(&column[first], sizeof(tile_t), count - first,
+                          vram_tile_offset(layer, x_i, 0), stride) == -1)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+int ppu_write_tiles_vertical(const tile_t *tiles, unsigned len, layer_e layer, unsigned x_i,
+                             unsigned y_i, unsigned count)
+{
+    FPGAME_PROF_RETURN(FPGAME_PROF_PPU_WRITE_TILES_VERTICAL,
+                       write_tiles_vertical(tiles, len, layer, x_i, y_i, count));
+}
+
+static int write_pattern(const pattern_t *pattern, unsigned width, unsigned height,
+                         pattern_addr_t pattern_addr)
+{
+    nowaymsg(!ppu_enabled, "PPU not enabled!");
+    nowaymsg(pattern == NULL, "Pattern is NULL!");
+    nowaymsg(width == 0 || height == 0, "Pattern width and height must be at least 1!");
+    nowaymsg(pattern_addr >= PATTERNRAM_WIDTH * PATTERNRAM_HEIGHT, "Invalid pattern address!");
+
+    for (unsigned y = 0; y < height; y++)
+    {
+        for (unsigned x = 0; x < width; x++)
+        {
+            pattern_addr_t addr = vram_pattern_addr((pattern_addr + x) % PATTERNRAM_WIDTH,
+                                                    ((pattern_addr >> 5) + y) % PATTERNRAM_HEIGHT);
+            if (dev_write(&pattern[y * width + x], sizeof(pattern_t),
+                          vram_pattern_offset(addr)) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int ppu_write_pattern(const pattern_t *pattern, unsigned width, unsigned height,
+                      pattern_addr_t pattern_addr)
+{
+    FPGAME_PROF_RETURN(FPGAME_PROF_PPU_WRITE_PATTERN,
+                       write_pattern(pattern, width, height, pattern_addr));
+}
+
+int ppu_write_palette(const palette_t *palette, layer_e layer_id, unsigned palette_id)
+{
+    unsigned max = (layer_id == LAYER_SPR) ? SPRLAYER_MAX_PALETTES : TILELAYER_MAX_PALETTES;
+
+    nowaymsg(!ppu_enabled, "PPU not enabled!");
+    nowaymsg(palette == NULL, "Palette is NULL!");
+    nowaymsg(palette_id >= max, "Invalid palette id!");
+
+    FPGAME_PROF_RETURN(FPGAME_PROF_PPU_WRITE_PALETTE,
+                       dev_write(palette, sizeof(palette_t),
+                                 vram_palette_offset(layer_id, palette_id)));
+}
+
+static int write_sprites(const sprite_t *sprites, unsigned len, unsigned sprite_id_i)
+{
+    uint32_t words[SPRITE_MAXCOUNT];
+    uint8_t extras[SPRITE_MAXCOUNT];
+
+    nowaymsg(!ppu_enabled, "PPU not enabled!");
+    nowaymsg(sprites == NULL, "Sprites is NULL!");
+    nowaymsg(len == 0 || sprite_id_i + len > SPRITE_MAXCOUNT, "Sprite ids out of range!");
+
+    for (unsigned i = 0; i < len; i++)
+    {
+        const sprite_t *sprite = &sprites[i];
+
+        nowaymsg(sprite->pattern_addr >= PATTERNRAM_WIDTH * PATTERNRAM_HEIGHT,
+                 "Invalid sprite pattern address!");
+        nowaymsg(sprite->palette_id >= SPRLAYER_MAX_PALETTES, "Invalid sprite palette id!");
+        nowaymsg((unsigned)sprite->mirror > MIRROR_XY, "Invalid sprite mirror!");
+        nowaymsg((unsigned)sprite->prio > PRIO_IN_FRONT, "Invalid sprite priority!");
+        nowaymsg(sprite->x > SPRITE_MAXX || sprite->y > SPRITE_MAXY, "Sprite out of range!");
+        nowaymsg(sprite->width < 1 || sprite->width > 4 || sprite->height < 1 ||
+                 sprite->height > 4, "Invalid sprite size!");
+
+        words[i] = vram_sprite_word(sprite);
+        extras[i] = vram_sprite_extra(sprite);
+    }
+
+    if (dev_write(words, len * SPRITE_BSIZE, VRAM_SPRITESOFFSET + sprite_id_i * SPRITE_BSIZE)
+        == -1)
+    {
+        return -1;
+    }
+    return dev_write(extras, len, VRAM_SPRITESOFFSET + SPRRAM_EXTRAOFFSET + sprite_id_i);
+}
+
+int ppu_write_sprites(const sprite_t *sprites, unsigned len, unsigned sprite_id_i)
+{
+    FPGAME_PROF_RETURN(FPGAME_PROF_PPU_WRITE_SPRITES, write_sprites(sprites, len, sprite_id_i));
+}
+
+int ppu_set_bgcolor(unsigned color)
+{
+    nowaymsg(!ppu_enabled, "PPU not enabled!");
+
+    FPGAME_PROF_RETURN(FPGAME_PROF_PPU_SET_BGCOLOR, dev_request(PPU_REQ_BGCOLOR, color & 0xFFFFFF));
+}
+
+int ppu_set_scroll(layer_e tile_layer, unsigned scroll_x, unsigned scroll_y)
+{
+    nowaymsg(!ppu_enabled, "PPU not enabled!");
+    nowaymsg(tile_layer != LAYER_BG && tile_layer != LAYER_FG,
+             "Layer must be LAYER_BG or LAYER_FG!");
+    nowaymsg(scroll_x > 511 || scroll_y > 511, "Scroll out of range!");
+
+    FPGAME_PROF_RETURN(FPGAME_PROF_PPU_SET_SCROLL,
+                       dev_request((tile_layer == LAYER_FG) ? PPU_REQ_FGSCROLL : PPU_REQ_BGSCROLL,
+                                   scroll_y << 16 | scroll_x));
+}
+
+int ppu_set_layer_enable(unsigned enable_mask)
+{
+    nowaymsg(!ppu_enabled, "PPU not enabled!");
+
+    FPGAME_PROF_RETURN(FPGAME_PROF_PPU_SET_LAYER_ENABLE,
+                       dev_request(PPU_REQ_LAYER_ENABLE,
+                                   enable_mask & (LAYER_BG | LAYER_FG | LAYER_SPR)));
+}
+
+/* =========== */
+/* === APU === */
+/* =========== */
+// Gets samples from the game's callback and queues them. Returns the number of samples queued.
+static int refill_samples(void)
+{
+    const int8_t *buf = NULL;
+    int len = 0;
+
+    apu_user_callback(&buf, &len);
+    nowaymsg(buf == NULL, "APU callback returned a NULL buffer!");
+    nowaymsg(len < 0 || len > APU_BUF_MAX, "APU callback returned an invalid buffer size!");
+
+    backend->apu_write(buf, len);
+    // lock-free, so safe in the signal handler
+    stat_add(&total.apu_refills, 1);
+    return len;
+}
+
+// Called by the backend (from SIGRTMAX) whenever the APU needs samples
+static void apu_refill(void)
+{
+    FPGAME_PROF_REFILL(refill_samples());
+}
+
+static void apu_mask_callback(int how)
+{
+    sigset_t set;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGRTMAX);
+    // games may run threads of their own, and sigprocmask is unspecified in multithreaded programs
+    pthread_sigmask(how, &set, NULL);
+}
+
+int apu_enable(void (*callback)(const int8_t **buf, int *buf_size))
+{
+    nowaymsg(apu_enabled, "APU already enabled!");
+    nowaymsg(callback == NULL, "APU callback is NULL!");
+
+    apu_user_callback = callback;
+    if (backend->apu_open(apu_refill) == -1) return -1;
+
+    apu_enabled = 1;
+    return 0;
+}
+
+void apu_disable(void)
+{
+    nowaymsg(!apu_enabled, "APU not enabled!");
+
+    backend->apu_close();
+    apu_enabled = 0;
+}
+
+void apu_callback_enable(void)
+{
+    apu_mask_callback(SIG_UNBLOCK);
+}
+
+void apu_callback_disable(void)
+{
+    apu_mask_callback(SIG_BLOCK);
+}
+
+/* ================== */
+/* === Controller === */
+/* ================== */
+// May be called from any thread, e.g. a controller sampler, as the backends' con_read must allow
+int get_con_state(void)
+{
+    stat_add(&total.con_calls, 1);
+    FPGAME_PROF_RETURN(FPGAME_PROF_GET_CON_STATE, backend->con_read());
+}
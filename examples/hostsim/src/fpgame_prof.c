@@ -0,0 +1,321 @@
+/* Optional profiler of the host User Library. See fpgame_prof.h.
+ *
+ * Calls may come from several threads at once: the game thread, threads of the game's own (a
+ *   frame pipeline's submission thread sends the frames, a controller sampler calls
+ *   get_con_state), and the SIGRTMAX handler, which makes the APU refills. Nothing is locked, so
+ *   the handler never waits:
+ *   * Function totals are updated with atomic operations, since any thread may call any function.
+ *   * Event slots are claimed with an atomic increment.
+ *   * Bytes written by a call are collected in the calling thread's own pending_bytes until the
+ *     call ends. The handler never touches them.
+ *   * The frame being recorded is only touched by VRAM writes and ppu_update, which games make
+ *     from one thread at a time (the frame pipeline only talks to the PPU from its thread).
+ *
+ * Each event records which thread made it: 0 for the APU refills, 1 for the thread which enabled
+ *   the PPU, and 2, 3, ... for other threads, in the order of their first call.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "fpgame_prof.h"
+
+#ifdef FPGAME_PROFILE
+
+#include "noway.h"
+#include "vram_layout.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FRAME_NS 16666667ull
+#define NAME_BSIZE 24
+#define HEADER_BSIZE 16
+#define EVENT_BSIZE 24
+#define FRAME_BSIZE 40
+
+#if FPGAME_PROF_EVENTS & (FPGAME_PROF_EVENTS - 1)
+#error "FPGAME_PROF_EVENTS must be a power of 2"
+#endif
+
+typedef struct {
+    uint64_t start_ns;
+    uint32_t ns;
+    uint16_t func;
+    uint16_t result;
+    uint32_t bytes;
+    uint32_t thread;
+} event_t;
+
+static const char *const func_names[FPGAME_PROF_FUNCS] = {
+    "ppu_update",
+    "ppu_write_vram",
+    "ppu_write_tiles_horizontal",
+    "ppu_write_tiles_vertical",
+    "ppu_write_pattern",
+    "ppu_write_palette",
+    "ppu_write_sprites",
+    "ppu_set_bgcolor",
+    "ppu_set_scroll",
+    "ppu_set_layer_enable",
+    "apu_refill",
+    "get_con_state"
+};
+
+static fpgame_prof_func_t funcs[FPGAME_PROF_FUNCS];
+static event_t events[FPGAME_PROF_EVENTS];
+static uint32_t event_head;     // total events logged; the ring holds the last FPGAME_PROF_EVENTS
+static fpgame_prof_frame_t frames[FPGAME_PROF_FRAMES];
+static uint64_t frame_count;
+static fpgame_prof_frame_t frame;  // the frame being recorded
+static uint32_t thread_count;            // threads numbered so far
+static __thread uint32_t thread_id;      // this thread's number, 0 until its first call
+static __thread size_t pending_bytes;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t current_thread(void)
+{
+    if (thread_id == 0) thread_id = __atomic_add_fetch(&thread_count, 1, __ATOMIC_RELAXED);
+    return thread_id;
+}
+
+static void log_event(fpgame_prof_func_e func, uint64_t start_ns, uint64_t ns, int result,
+                      size_t bytes, uint32_t thread)
+{
+    uint32_t slot = __atomic_fetch_add(&event_head, 1, __ATOMIC_RELAXED);
+    event_t *event = &events[slot & (FPGAME_PROF_EVENTS - 1)];
+
+    event->start_ns = start_ns;
+    event->ns = (ns > UINT32_MAX) ? UINT32_MAX : (uint32_t)ns;
+    event->func = func;
+    event->result = (result == -1);
+    event->bytes = (uint32_t)bytes;
+    event->thread = thread;
+}
+
+static void count_call(fpgame_prof_func_e func, uint64_t start_ns, int result, size_t bytes,
+                       uint32_t thread)
+{
+    fpgame_prof_func_t *stats = &funcs[func];
+    uint64_t ns = now_ns() - start_ns;
+    uint64_t max_ns = __atomic_load_n(&stats->max_ns, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&stats->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->bytes, bytes, __ATOMIC_RELAXED);
+    while (ns > max_ns && !__atomic_compare_exchange_n(&stats->max_ns, &max_ns, ns, 1,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+    if (result == -1)
+    {
+        __atomic_fetch_add(&stats->retries, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&stats->busy_ns, ns, __ATOMIC_RELAXED);
+    }
+    log_event(func, start_ns, ns, result, bytes, thread);
+}
+
+static void load_func(fpgame_prof_func_e func, fpgame_prof_func_t *stats)
+{
+    stats->calls = __atomic_load_n(&funcs[func].calls, __ATOMIC_RELAXED);
+    stats->retries = __atomic_load_n(&funcs[func].retries, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&funcs[func].bytes, __ATOMIC_RELAXED);
+    stats->ns = __atomic_load_n(&funcs[func].ns, __ATOMIC_RELAXED);
+    stats->busy_ns = __atomic_load_n(&funcs[func].busy_ns, __ATOMIC_RELAXED);
+    stats->max_ns = __atomic_load_n(&funcs[func].max_ns, __ATOMIC_RELAXED);
+}
+
+const char *fpgame_prof_func_name(fpgame_prof_func_e func)
+{
+    nowaymsg((unsigned)func >= FPGAME_PROF_FUNCS, "Profiled function out of range!");
+
+    return func_names[func];
+}
+
+void fpgame_prof_func_stats(fpgame_prof_func_e func, fpgame_prof_func_t *stats)
+{
+    nowaymsg((unsigned)func >= FPGAME_PROF_FUNCS, "Profiled function out of range!");
+    nowaymsg(stats == NULL, "Stats is NULL!");
+
+    load_func(func, stats);
+}
+
+unsigned fpgame_prof_frames(fpgame_prof_frame_t *dst, unsigned max)
+{
+    uint64_t kept = (frame_count < FPGAME_PROF_FRAMES) ? frame_count : FPGAME_PROF_FRAMES;
+    unsigned count = (kept < max) ? (unsigned)kept : max;
+
+    nowaymsg(dst == NULL && max != 0, "Frames is NULL!");
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        dst[i] = frames[(frame_count - count + i) % FPGAME_PROF_FRAMES];
+    }
+    return count;
+}
+
+static void put_le(uint8_t *buf, uint64_t value, unsigned bsize)
+{
+    for (unsigned i = 0; i < bsize; i++) buf[i] = (uint8_t)(value >> (8 * i));
+}
+
+int fpgame_prof_write_trace(const char *file)
+{
+    uint32_t head = __atomic_load_n(&event_head, __ATOMIC_ACQUIRE);
+    uint32_t event_total = (head < FPGAME_PROF_EVENTS) ? head : FPGAME_PROF_EVENTS;
+    uint32_t frame_total = (frame_count < FPGAME_PROF_FRAMES) ? frame_count : FPGAME_PROF_FRAMES;
+    uint8_t buf[HEADER_BSIZE + FPGAME_PROF_FUNCS * NAME_BSIZE];
+    int ok;
+    FILE *fp;
+
+    nowaymsg(file == NULL, "Trace file name is NULL!");
+    if ((fp = fopen(file, "wb")) == NULL) return -1;
+
+    memcpy(buf, "FPTR", 4);
+    put_le(&buf[4], FPGAME_PROF_TRACE_VERSION, 2);
+    put_le(&buf[6], FPGAME_PROF_FUNCS, 2);
+    put_le(&buf[8], event_total, 4);
+    put_le(&buf[12], frame_total, 4);
+    memset(&buf[HEADER_BSIZE], 0, FPGAME_PROF_FUNCS * NAME_BSIZE);
+    for (unsigned i = 0; i < FPGAME_PROF_FUNCS; i++)
+    {
+        strncpy((char *)&buf[HEADER_BSIZE + i * NAME_BSIZE], func_names[i], NAME_BSIZE - 1);
+    }
+    ok = fwrite(buf, sizeof(buf), 1, fp) == 1;
+
+    for (uint32_t i = 0; ok && i < event_total; i++)
+    {
+        const event_t *event = &events[(head - event_total + i) & (FPGAME_PROF_EVENTS - 1)];
+        uint8_t record[EVENT_BSIZE] = {0};
+
+        put_le(&record[0], event->start_ns, 8);
+        put_le(&record[8], event->ns, 4);
+        put_le(&record[12], event->func, 2);
+        put_le(&record[14], event->result, 2);
+        put_le(&record[16], event->bytes, 4);
+        put_le(&record[20], event->thread, 4);
+        ok = fwrite(record, sizeof(record), 1, fp) == 1;
+    }
+
+    for (uint32_t i = 0; ok && i < frame_total; i++)
+    {
+        const fpgame_prof_frame_t *rec = &frames[(frame_count - frame_total + i) %
+                                                 FPGAME_PROF_FRAMES];
+        uint8_t record[FRAME_BSIZE];
+
+        put_le(&record[0], rec->frame, 8);
+        put_le(&record[8], rec->start_ns, 8);
+        put_le(&record[16], rec->ns, 4);
+        put_le(&record[20], rec->missed, 4);
+        for (unsigned s = 0; s < FPGAME_PROF_SECTIONS; s++)
+        {
+            put_le(&record[24 + 4 * s], rec->section_bytes[s], 4);
+        }
+        ok = fwrite(record, sizeof(record), 1, fp) == 1;
+    }
+
+    if (fclose(fp) != 0) ok = 0;
+    return ok ? 0 : -1;
+}
+
+void fpgame_prof_reset(void)
+{
+    memset(funcs, 0, sizeof(funcs));
+    __atomic_store_n(&event_head, 0, __ATOMIC_RELEASE);
+    frame_count = 0;
+    memset(&frame, 0, sizeof(frame));
+    frame.start_ns = now_ns();
+    pending_bytes = 0;
+    current_thread();
+}
+
+uint64_t fpgame_prof_begin(void)
+{
+    return now_ns();
+}
+
+void fpgame_prof_end(fpgame_prof_func_e func, uint64_t start_ns, int result)
+{
+    size_t bytes = pending_bytes;
+
+    pending_bytes = 0;
+    count_call(func, start_ns, result, bytes, current_thread());
+}
+
+void fpgame_prof_apu_end(uint64_t start_ns, int len)
+{
+    count_call(FPGAME_PROF_APU_REFILL, start_ns, 0, (len > 0) ? (size_t)len : 0, 0);
+}
+
+void fpgame_prof_bytes(off_t offset, size_t len)
+{
+    fpgame_prof_section_e section = (offset < VRAM_PATTERNOFFSET) ? FPGAME_PROF_TILERAM :
+                                    (offset < VRAM_PALETTEOFFSET) ? FPGAME_PROF_PATTERNRAM :
+                                    (offset < VRAM_SPRITESOFFSET) ? FPGAME_PROF_PALETTERAM :
+                                                                    FPGAME_PROF_SPRITERAM;
+
+    pending_bytes += len;
+    frame.section_bytes[section] += len;
+}
+
+void fpgame_prof_frame_end(void)
+{
+    uint64_t t = now_ns();
+    uint64_t ns = t - frame.start_ns;
+
+    frame.frame = frame_count + 1;
+    frame.ns = (ns > UINT32_MAX) ? UINT32_MAX : (uint32_t)ns;
+    // frames are shown at VBLANKs, so a frame which took n periods missed n - 1 of them
+    frame.missed = (ns + FRAME_NS / 2) / FRAME_NS;
+    frame.missed = (frame.missed > 1) ? frame.missed - 1 : 0;
+    frames[frame_count++ % FPGAME_PROF_FRAMES] = frame;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.start_ns = t;
+}
+
+void fpgame_prof_finish(void)
+{
+    const char *trace_file = getenv("FPGAME_TRACE");
+    uint64_t missed = 0;
+    fpgame_prof_frame_t rec;
+
+    if (trace_file == NULL) return;
+
+    for (unsigned i = 0; i < FPGAME_PROF_FUNCS; i++)
+    {
+        fpgame_prof_func_t func;
+
+        load_func((fpgame_prof_func_e)i, &func);
+        if (func.calls == 0) continue;
+        fprintf(stderr, "[prof] %-26s %8llu calls %7llu retries %10llu bytes %10.1f us "
+                "(%.1f us busy, %.1f us max)\n", func_names[i],
+                (unsigned long long)func.calls, (unsigned long long)func.retries,
+                (unsigned long long)func.bytes, func.ns / 1e3, func.busy_ns / 1e3,
+                func.max_ns / 1e3);
+    }
+    for (uint64_t i = 0; i < frame_count && i < FPGAME_PROF_FRAMES; i++)
+    {
+        rec = frames[(frame_count - 1 - i) % FPGAME_PROF_FRAMES];
+        missed += rec.missed;
+    }
+    fprintf(stderr, "[prof] %llu missed VBLANKs in the last %llu frames\n",
+            (unsigned long long)missed,
+            (unsigned long long)((frame_count < FPGAME_PROF_FRAMES) ? frame_count :
+                                                                     FPGAME_PROF_FRAMES));
+
+    if (fpgame_prof_write_trace(trace_file) == -1)
+    {
+        fprintf(stderr, "[prof] Could not write trace to %s!\n", trace_file);
+    }
+}
+
+#endif /* FPGAME_PROFILE */
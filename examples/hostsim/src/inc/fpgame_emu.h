@@ -0,0 +1,44 @@
+/** @file fpgame_emu.h
+ * @brief User-space emulation of the FP-GAme devices
+ *
+ * The default backend of the host User Library (see fpgame_host.h). It behaves like the kernel
+ *   drivers as seen from a game:
+ *   * PPU: VRAM writes and settings are staged, and ppu_update hands them to the PPU model. After
+ *     an accepted update, further updates are busy until the next 60Hz VBLANK. VRAM writes are
+ *     busy for a short window after each VBLANK in which a frame was sent, while the kernel copies
+ *     VRAM to the PPU (FPGAME_EMU_DMA_US microseconds, 500 by default).
+ *   * APU: a SIGRTMAX timer calls the refill callback once per APU_BUF_MAX samples at
+ *     APU_SAMPLE_RATE (every 16ms), like the APU driver does. If FPGAME_EMU_AUDIO names a file,
+ *     the samples (padded with silence to whole buffers) are appended to it as raw 8-bit PCM.
+ *   * Controller: if FPGAME_EMU_CON names a script file, get_con_state replays it. Otherwise no
+ *     buttons are ever pressed. get_con_state may be called from any thread, for example a
+ *     controller sampler, while another thread sends frames.
+ *
+ * A controller script holds one event per line: the frame number (counted in accepted
+ *   ppu_update calls) from which the buttons are held, followed by the buttons joined with '+',
+ *   or "none". Button names are those of con.h without the CON_BUT_ prefix. Events must be in
+ *   frame order. Lines starting with '#' are comments. For example:
+ *
+ *   0   none
+ *   60  RIGHT
+ *   90  RIGHT+B
+ *   120 START
+ */
+
+#ifndef _HOSTSIM_FPGAME_EMU_H_
+#define _HOSTSIM_FPGAME_EMU_H_
+
+#include "fpgame_host.h"
+#include "ppu_model.h"
+
+extern const fpgame_backend_t fpgame_emu_backend; ///< The emulated device backend
+
+/** @brief Gets the PPU state of the last frame accepted by ppu_update
+ *
+ * Render it with @ref ppu_model_render or @ref ppu_model_render_fast to see what the PPU displays.
+ *
+ * @return The displayed PPU state. Valid until the PPU is disabled.
+ */
+const ppu_model_t *fpgame_emu_display(void);
+
+#endif /* _HOSTSIM_FPGAME_EMU_H_ */
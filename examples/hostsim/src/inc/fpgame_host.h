@@ -0,0 +1,98 @@
+/** @file fpgame_host.h
+ * @brief Host build of the FP-GAme User Library, with pluggable device backends
+ *
+ * fpgame_host.c implements everything declared in ppu.h, apu.h and con.h for a regular Linux PC,
+ *   so that unmodified games (like the techdemo) can be built and run without a DE10-Nano.
+ *
+ * On the console, the User Library talks to the kernel through /dev/fp_game_ppu, /dev/fp_game_apu
+ *   and /dev/fp_game_con: pwrite for VRAM, ioctl for updates and settings, read for controller
+ *   input, and SIGRTMAX for audio refill callbacks. The host library keeps the library side of
+ *   that split (argument checks, data encoding, file loading) and sends every device operation to
+ *   a backend instead. By default this is the emulated device in fpgame_emu.h; another backend
+ *   can be installed with @ref fpgame_set_backend before the PPU or APU is enabled.
+ *
+ * Every device operation is counted, as each one costs a system call on the console. Together
+ *   with the process CPU time, this gives the per-frame cost of a game (see @ref fpgame_stats_t).
+ *   If the FPGAME_STATS environment variable names a file, one CSV line per frame is written to
+ *   it, and a summary is printed to stderr when the PPU is disabled.
+ */
+
+#ifndef _HOSTSIM_FPGAME_HOST_H_
+#define _HOSTSIM_FPGAME_HOST_H_
+
+#include <fp-game/apu.h>
+#include <fp-game/con.h>
+#include <fp-game/ppu.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** @brief PPU device requests other than VRAM writes (the ioctls of /dev/fp_game_ppu) */
+typedef enum {
+    PPU_REQ_UPDATE,       ///< Send the current frame. Argument unused.
+    PPU_REQ_BGCOLOR,      ///< Set the background color. Argument is 0xRRGGBB.
+    PPU_REQ_BGSCROLL,     ///< Set the BG layer scroll. Argument is y << 16 | x.
+    PPU_REQ_FGSCROLL,     ///< Set the FG layer scroll. Argument is y << 16 | x.
+    PPU_REQ_LAYER_ENABLE  ///< Set the layer enable mask. Argument is the mask.
+} ppu_request_e;
+
+/** @brief A device backend. All functions are required. */
+typedef struct {
+    const char *name; ///< Backend name, for messages
+
+    /** @brief Claims the PPU. @return 0 on success; -1 if already owned */
+    int (*ppu_open)(void);
+    /** @brief Releases the PPU */
+    void (*ppu_close)(void);
+    /** @brief Writes @p len bytes to VRAM at @p offset. @return 0 on success; -1 if busy */
+    int (*ppu_write)(const void *buf, size_t len, off_t offset);
+    /** @brief Writes @p count elements of @p size bytes from @p buf as one transfer, the i-th at
+     *    VRAM offset @p offset + i * @p stride. @return 0 on success; -1 if busy */
+    int (*ppu_write_strided)(const void *buf, size_t size, size_t count, off_t offset,
+                             size_t stride);
+    /** @brief Performs a PPU request. @return 0 on success; -1 if busy */
+    int (*ppu_request)(ppu_request_e request, uint32_t arg);
+
+    /** @brief Claims the APU, and starts calling @p refill (from SIGRTMAX) whenever the APU
+     *    needs samples. @return 0 on success; -1 if already owned */
+    int (*apu_open)(void (*refill)(void));
+    /** @brief Stops refill calls and releases the APU */
+    void (*apu_close)(void);
+    /** @brief Queues @p len samples. Called from within refill. Must be async-signal-safe. */
+    void (*apu_write)(const int8_t *buf, size_t len);
+
+    /** @brief Reads the controller state, active low as in con.h. May be called from any thread,
+     *    also while another thread uses the PPU. @return state; -1 on error */
+    int (*con_read)(void);
+} fpgame_backend_t;
+
+/** @brief Device operation counts and CPU time, either in total or for a single frame */
+typedef struct {
+    uint64_t frames;       ///< Number of frames accepted by ppu_update
+    uint64_t cpu_ns;       ///< Process CPU time used
+    uint64_t ppu_calls;    ///< PPU device operations (VRAM writes and requests), busy or not
+    uint64_t ppu_busy;     ///< PPU device operations which returned busy
+    uint64_t vram_bytes;   ///< Bytes written to VRAM
+    uint64_t con_calls;    ///< Controller reads
+    uint64_t apu_refills;  ///< APU refill callbacks
+} fpgame_stats_t;
+
+/** @brief Installs a device backend
+ *
+ * @pre Neither the PPU nor the APU is enabled.
+ * @param backend Backend to use from now on. NULL restores the emulated device.
+ */
+void fpgame_set_backend(const fpgame_backend_t *backend);
+
+/** @brief Gets the statistics of the frame which was last accepted by ppu_update
+ * @param stats Location to copy the statistics to. Its frames member is the frame's number.
+ */
+void fpgame_last_frame_stats(fpgame_stats_t *stats);
+
+/** @brief Gets the statistics since the PPU was enabled
+ * @param stats Location to copy the statistics to.
+ */
+void fpgame_total_stats(fpgame_stats_t *stats);
+
+#endif /* _HOSTSIM_FPGAME_HOST_H_ */
@@ -0,0 +1,150 @@
+/** @file fpgame_prof.h
+ * @brief Optional profiler built into the host User Library
+ *
+ * The statistics in fpgame_host.h count device operations per frame. The profiler goes further,
+ *   and is only compiled in when the library is built with FPGAME_PROFILE defined (make PROFILE=1).
+ *   Without it, every hook below is an empty macro and none of the functions exist.
+ *
+ * With the profiler compiled in:
+ *   * Every ppu_write_x, ppu_set_x, ppu_update and get_con_state call, and every APU refill
+ *     callback, is timed. Per function, the profiler keeps the number of calls, the number of
+ *     retries (calls which returned -1, e.g. because the PPU was busy), bytes written, and total,
+ *     busy and worst-case time in nanoseconds (see @ref fpgame_prof_func_stats).
+ *   * Each frame accepted by ppu_update gets a record with its wall-clock time, the VRAM bytes
+ *     written to each VRAM section and the number of VBLANKs it missed. The last
+ *     FPGAME_PROF_FRAMES records are kept (see @ref fpgame_prof_frames).
+ *   * Every call is also logged as an event in a ring of the last FPGAME_PROF_EVENTS calls. If the
+ *     FPGAME_TRACE environment variable names a file, the events and frame records are written to
+ *     it as a binary trace when the PPU is disabled, and a per-function summary is printed to
+ *     stderr. scripts/trace_to_chrome.py converts the trace for chrome://tracing or Perfetto.
+ *
+ * Trace file layout (all integers little-endian, times in ns of CLOCK_MONOTONIC):
+ *   * Header (16B): magic "FPTR", u16 version, u16 function count, u32 event count,
+ *     u32 frame count.
+ *   * Function names: 24B each, NUL-padded, in fpgame_prof_func_e order.
+ *   * Events (24B each, oldest first): u64 start, u32 duration, u16 function, u16 result (0 ok,
+ *     1 returned -1), u32 bytes, u32 thread (0 for APU refills, 1 for the thread which enabled
+ *     the PPU, 2 and up for other threads in the order of their first call).
+ *   * Frames (40B each, oldest first): u64 frame number, u64 start, u32 duration, u32 missed
+ *     VBLANKs, u32 bytes for each of Tile, Pattern, Palette and Sprite RAM.
+ */
+
+#ifndef _HOSTSIM_FPGAME_PROF_H_
+#define _HOSTSIM_FPGAME_PROF_H_
+
+#ifdef FPGAME_PROFILE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define FPGAME_PROF_FRAMES 256     ///< Number of frame records kept
+#define FPGAME_PROF_EVENTS 65536   ///< Number of events kept. Must be a power of 2.
+#define FPGAME_PROF_TRACE_VERSION 2
+
+/** @brief The profiled User Library functions */
+typedef enum {
+    FPGAME_PROF_PPU_UPDATE,
+    FPGAME_PROF_PPU_WRITE_VRAM,
+    FPGAME_PROF_PPU_WRITE_TILES_HORIZONTAL,
+    FPGAME_PROF_PPU_WRITE_TILES_VERTICAL,
+    FPGAME_PROF_PPU_WRITE_PATTERN,
+    FPGAME_PROF_PPU_WRITE_PALETTE,
+    FPGAME_PROF_PPU_WRITE_SPRITES,
+    FPGAME_PROF_PPU_SET_BGCOLOR,
+    FPGAME_PROF_PPU_SET_SCROLL,
+    FPGAME_PROF_PPU_SET_LAYER_ENABLE,
+    FPGAME_PROF_APU_REFILL,        ///< The APU refill callback, including the game's callback
+    FPGAME_PROF_GET_CON_STATE,
+    FPGAME_PROF_FUNCS
+} fpgame_prof_func_e;
+
+/** @brief VRAM sections, for the per-frame byte counts */
+typedef enum {
+    FPGAME_PROF_TILERAM,
+    FPGAME_PROF_PATTERNRAM,
+    FPGAME_PROF_PALETTERAM,
+    FPGAME_PROF_SPRITERAM,
+    FPGAME_PROF_SECTIONS
+} fpgame_prof_section_e;
+
+/** @brief Totals for one function since the PPU was enabled */
+typedef struct {
+    uint64_t calls;
+    uint64_t retries;  ///< Calls which returned -1
+    uint64_t bytes;    ///< Bytes written to VRAM (or queued to the APU)
+    uint64_t ns;       ///< Time spent in the function
+    uint64_t busy_ns;  ///< Part of ns spent in calls which returned -1
+    uint64_t max_ns;   ///< Longest single call
+} fpgame_prof_func_t;
+
+/** @brief Record of one frame accepted by ppu_update */
+typedef struct {
+    uint64_t frame;     ///< Frame number, as in fpgame_stats_t
+    uint64_t start_ns;  ///< When the previous frame was accepted
+    uint32_t ns;        ///< Time from the previous frame to this one
+    uint32_t missed;    ///< VBLANKs which passed without a new frame
+    uint32_t section_bytes[FPGAME_PROF_SECTIONS];
+} fpgame_prof_frame_t;
+
+/** @brief Gets the name of a profiled function, e.g. "ppu_update" */
+const char *fpgame_prof_func_name(fpgame_prof_func_e func);
+
+/** @brief Gets the totals of one function since the PPU was enabled */
+void fpgame_prof_func_stats(fpgame_prof_func_e func, fpgame_prof_func_t *stats);
+
+/** @brief Copies the most recent frame records, oldest first
+ * @return Number of records copied, at most @p max
+ */
+unsigned fpgame_prof_frames(fpgame_prof_frame_t *frames, unsigned max);
+
+/** @brief Writes the kept events and frame records to @p file. See above for the layout.
+ * @return 0 on success; -1 if the file could not be written
+ */
+int fpgame_prof_write_trace(const char *file);
+
+// Hooks used by fpgame_host.c. Not part of the game-facing API.
+void fpgame_prof_reset(void);
+uint64_t fpgame_prof_begin(void);
+void fpgame_prof_end(fpgame_prof_func_e func, uint64_t start_ns, int result);
+void fpgame_prof_apu_end(uint64_t start_ns, int len);
+void fpgame_prof_bytes(off_t offset, size_t len);
+void fpgame_prof_frame_end(void);
+void fpgame_prof_finish(void);
+
+#define FPGAME_PROF_RESET() fpgame_prof_reset()
+#define FPGAME_PROF_BYTES(offset, len) fpgame_prof_bytes((offset), (len))
+#define FPGAME_PROF_FRAME_END() fpgame_prof_frame_end()
+#define FPGAME_PROF_FINISH() fpgame_prof_finish()
+
+/** @brief Returns the result of @p call from the enclosing function, timed as @p func */
+#define FPGAME_PROF_RETURN(func, call)                       \
+    do                                                       \
+    {                                                        \
+        uint64_t prof_start_ns = fpgame_prof_begin();        \
+        int prof_result = (call);                            \
+        fpgame_prof_end((func), prof_start_ns, prof_result); \
+        return prof_result;                                  \
+    } while (0)
+
+/** @brief Runs the APU refill @p call, which returns the number of samples queued, timed */
+#define FPGAME_PROF_REFILL(call)                      \
+    do                                                \
+    {                                                 \
+        uint64_t prof_start_ns = fpgame_prof_begin(); \
+        int prof_len = (call);                        \
+        fpgame_prof_apu_end(prof_start_ns, prof_len); \
+    } while (0)
+
+#else
+
+#define FPGAME_PROF_RESET() ((void)0)
+#define FPGAME_PROF_BYTES(offset, len) ((void)0)
+#define FPGAME_PROF_FRAME_END() ((void)0)
+#define FPGAME_PROF_FINISH() ((void)0)
+#define FPGAME_PROF_RETURN(func, call) return (call)
+#define FPGAME_PROF_REFILL(call) ((void)(call))
+
+#endif /* FPGAME_PROFILE */
+
+#endif /* _HOSTSIM_FPGAME_PROF_H_ */
@@ -0,0 +1,95 @@
+/** @file ppu_model.h
+ * @brief Software reference model of the FP-GAme PPU
+ *
+ * Renders the 64KiB VRAM image described in ppu.h (and vram_layout.h) into 320x240 frames on the
+ *   host, so that VRAM contents can be inspected, diffed and benchmarked without a DE10-Nano.
+ *
+ * The model follows the PPU as documented by the User Library:
+ *   * Two 64x64-tile (512x512 pixel) tile layers, BG and FG, each with its own scroll. Both layers
+ *     wrap around at their edges.
+ *   * 32x32 patterns at 4bpp. Color index 0 is transparent in every pattern.
+ *   * 16 palettes per tile layer and 32 sprite palettes, 15 colors each.
+ *   * 64 sprites of 1-4 by 1-4 tiles. A sprite of w by h tiles uses the w by h block of Pattern RAM
+ *     whose top-left tile is its pattern address, and mirroring flips the whole sprite.
+ *   * Sprite priority (render_prio_e) places a sprite behind both tile layers, between them, or in
+ *     front of both. Where sprites overlap, the sprite with the lowest id is drawn.
+ *   * Per-layer enables, and the universal background color where all layers are transparent.
+ *
+ * Details the documentation leaves open are modeled the way the Sprite RAM encoding suggests:
+ *   sprite x coordinates wrap at 512 and y coordinates at 256, so sprites may enter the screen
+ *   from its left and top edges. There is no per-scanline sprite limit.
+ */
+
+#ifndef _HOSTSIM_PPU_MODEL_H_
+#define _HOSTSIM_PPU_MODEL_H_
+
+#include "vram_layout.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PPU_SCREEN_WIDTH 320  ///< Width (in pixels) of a rendered frame
+#define PPU_SCREEN_HEIGHT 240 ///< Height (in pixels) of a rendered frame
+
+/** @brief State of the modeled PPU. Initialize using @ref ppu_model_init. */
+typedef struct {
+    uint8_t vram[VRAM_BSIZE];  ///< VRAM image, laid out as described in vram_layout.h
+    uint32_t bgcolor;          ///< Universal background color (0xRRGGBB)
+    unsigned scroll_x[2];      ///< Horizontal pixel scroll of the BG (0) and FG (1) tile layers
+    unsigned scroll_y[2];      ///< Vertical pixel scroll of the BG (0) and FG (1) tile layers
+    unsigned layer_enable;     ///< Mask of enabled layers. See @ref ppu_set_layer_enable.
+} ppu_model_t;
+
+/** @brief Resets the model: zeroed VRAM, black background, no scroll and all layers enabled
+ * @param ppu Model instance to initialize.
+ */
+void ppu_model_init(ppu_model_t *ppu);
+
+/** @brief Copies @p len bytes from @p buf to VRAM at @p offset, like @ref ppu_write_vram
+ *
+ * @param ppu Model instance.
+ * @param buf Data to copy.
+ * @param len Size of buf in bytes.
+ * @param offset Byte offset into VRAM. The write must fit within VRAM.
+ */
+void ppu_model_write_vram(ppu_model_t *ppu, const void *buf, size_t len, size_t offset);
+
+/** @brief Sets the pixel scroll of a tile layer, like @ref ppu_set_scroll
+ *
+ * @param ppu Model instance.
+ * @param tile_layer Either LAYER_BG or LAYER_FG.
+ * @param scroll_x Horizontal pixel scroll. Values must be [0, 511].
+ * @param scroll_y Vertical pixel scroll. Values must be [0, 511].
+ */
+void ppu_model_set_scroll(ppu_model_t *ppu, layer_e tile_layer, unsigned scroll_x,
+                          unsigned scroll_y);
+
+/** @brief Renders a single scanline
+ *
+ * @param ppu Model instance.
+ * @param y Scanline to render. Must be in the range [0, 239].
+ * @param line Output of PPU_SCREEN_WIDTH pixels, as 0xRRGGBB.
+ */
+void ppu_model_render_line(const ppu_model_t *ppu, unsigned y, uint32_t *line);
+
+/** @brief Renders a full frame
+ *
+ * @param ppu Model instance.
+ * @param frame Output of PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT pixels, row by row, as 0xRRGGBB.
+ */
+void ppu_model_render(const ppu_model_t *ppu, uint32_t *frame);
+
+/** @brief Renders a full frame using the fast, vectorized renderer
+ *
+ * Produces exactly the same frame as @ref ppu_model_render, several times faster. Uses SSE2 on
+ *   x86-64 and NEON on ARM, or plain C when built with PPU_MODEL_NO_SIMD (or on other targets).
+ *
+ * @param ppu Model instance.
+ * @param frame Output of PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT pixels, row by row, as 0xRRGGBB.
+ */
+void ppu_model_render_fast(const ppu_model_t *ppu, uint32_t *frame);
+
+/** @brief Names the instruction set of @ref ppu_model_render_fast: "SSE2", "NEON" or "scalar" */
+const char *ppu_model_fast_isa(void);
+
+#endif /* _HOSTSIM_PPU_MODEL_H_ */
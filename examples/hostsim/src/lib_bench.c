@@ -0,0 +1,382 @@
+/* Benchmark suite of the host User Library.
+ *
+ * Runs the library against a null device backend, which is never busy and only copies the data it
+ *   is given (like the kernel drivers' copy from user space), so that only the library's own work
+ *   is timed (argument checks, encoding, splitting writes into device operations, file parsing).
+ *   Each benchmark performs one operation repeatedly: a batch of n operations is timed BENCH_REPS
+ *   times, and the median batch is reported together with the spread of all batches, so that a
+ *   change can be told apart from noise. Per benchmark, it reports:
+ *   * ops/s and MB/s: operations, and bytes written to the device (or parsed from files), per
+ *     second of the median batch.
+ *   * calls/op: device operations per operation. Each one is a system call on the console.
+ *   * allocs/op: heap allocations per operation, including those made by the C library on the
+ *     library's behalf (e.g. by fopen in the loaders).
+ *   * spread: (slowest - fastest) / median batch time.
+ *
+ * Allocations are counted by replacing malloc, calloc and realloc with versions which count and
+ *   then call glibc's own allocator.
+ *
+ * Usage (from examples/hostsim):
+ *   lib_bench <n>    Time batches of n operations of each benchmark (fewer for the slow ones).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "fpgame_host.h"
+#include "vram_layout.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_REPS 9
+#define PATTERN_BLOCK_MAX 4 // pattern blocks are timed at every sprite size, up to 4x4
+
+#define TILEMAP_FILE "../techdemo/assets/the_mall.tilemap"
+#define PATTERN_FILE "../techdemo/assets/scotty_front-0.pattern"
+#define PALETTE_FILE "../techdemo/assets/the_mall.palette"
+
+typedef struct {
+    const char *name;
+    size_t (*op)(unsigned i); ///< Performs operation i. Returns the bytes it wrote or parsed.
+    unsigned ops_div;         ///< Batches are n / ops_div operations, for slow operations
+} bench_t;
+
+// glibc's allocator, which the replacements below forward to
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+static volatile uint64_t allocs;
+
+void *malloc(size_t size)
+{
+    allocs++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    allocs++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+/* =========================== */
+/* === Null device backend === */
+/* =========================== */
+static uint64_t dev_calls;
+static void (*dev_refill)(void);
+
+// Not static: nothing reads them, and the compiler would otherwise leave out the copies
+uint8_t dev_vram[VRAM_BSIZE];
+int8_t dev_samples[APU_BUF_MAX];
+
+static int null_open(void)
+{
+    return 0;
+}
+
+static void null_close(void)
+{
+}
+
+static int null_write(const void *buf, size_t len, off_t offset)
+{
+    memcpy(&dev_vram[offset], buf, len);
+    dev_calls++;
+    return 0;
+}
+
+static int null_write_strided(const void *buf, size_t size, size_t count, off_t offset,
+                              size_t stride)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        memcpy(&dev_vram[offset + i * stride], (const uint8_t *)buf + i * size, size);
+    }
+    dev_calls++;
+    return 0;
+}
+
+static int null_request(ppu_request_e request, uint32_t arg)
+{
+    (void)request;
+    (void)arg;
+    dev_calls++;
+    return 0;
+}
+
+// Refills are run by the benchmark itself instead of from a timer
+static int null_apu_open(void (*refill)(void))
+{
+    dev_refill = refill;
+    return 0;
+}
+
+static void null_apu_close(void)
+{
+    dev_refill = NULL;
+}
+
+static void null_apu_write(const int8_t *buf, size_t len)
+{
+    memcpy(dev_samples, buf, len);
+    dev_calls++;
+}
+
+static int null_con_read(void)
+{
+    dev_calls++;
+    return 0xFFFF;
+}
+
+static const fpgame_backend_t null_backend = {
+    .name = "null",
+    .ppu_open = null_open,
+    .ppu_close = null_close,
+    .ppu_write = null_write,
+    .ppu_write_strided = null_write_strided,
+    .ppu_request = null_request,
+    .apu_open = null_apu_open,
+    .apu_close = null_apu_close,
+    .apu_write = null_apu_write,
+    .con_read = null_con_read
+};
+
+/* ================== */
+/* === Benchmarks === */
+/* ================== */
+static tile_t tiles[TILELAYER_WIDTH * TILELAYER_HEIGHT];
+static pattern_t patterns[PATTERN_BLOCK_MAX * PATTERN_BLOCK_MAX];
+static palette_t palette;
+static sprite_t sprites[SPRITE_MAXCOUNT];
+static int8_t samples[APU_BUF_MAX];
+static unsigned pattern_width, pattern_height;
+
+static size_t tile_row(unsigned i)
+{
+    ppu_write_tiles_horizontal(tiles, TILELAYER_WIDTH, LAYER_BG, i % TILELAYER_WIDTH,
+                               i % TILELAYER_HEIGHT, TILELAYER_WIDTH);
+    return TILELAYER_WIDTH * sizeof(tile_t);
+}
+
+static size_t tile_column(unsigned i)
+{
+    ppu_write_tiles_vertical(tiles, TILELAYER_HEIGHT, LAYER_BG, i % TILELAYER_WIDTH,
+                             i % TILELAYER_HEIGHT, TILELAYER_HEIGHT);
+    return TILELAYER_HEIGHT * sizeof(tile_t);
+}
+
+static size_t tile_layer_rows(unsigned i)
+{
+    layer_e layer = (i & 1) ? LAYER_FG : LAYER_BG;
+
+    for (unsigned y = 0; y < TILELAYER_HEIGHT; y++)
+    {
+        ppu_write_tiles_horizontal(&tiles[y * TILELAYER_WIDTH], TILELAYER_WIDTH, layer, 0, y,
+                                   TILELAYER_WIDTH);
+    }
+    return sizeof(tiles);
+}
+
+static size_t tile_layer_vram(unsigned i)
+{
+    ppu_write_vram(tiles, sizeof(tiles), vram_tile_offset((i & 1) ? LAYER_FG : LAYER_BG, 0, 0));
+    return sizeof(tiles);
+}
+
+static size_t pattern_block(unsigned i)
+{
+    ppu_write_pattern(patterns, pattern_width, pattern_height,
+                      vram_pattern_addr(i % PATTERNRAM_WIDTH, i % PATTERNRAM_HEIGHT));
+    return pattern_width * pattern_height * sizeof(pattern_t);
+}
+
+static size_t palette_write(unsigned i)
+{
+    ppu_write_palette(&palette, LAYER_SPR, i % SPRLAYER_MAX_PALETTES);
+    return sizeof(palette_t);
+}
+
+static size_t sprite_one(unsigned i)
+{
+    ppu_write_sprites(&sprites[i % SPRITE_MAXCOUNT], 1, i % SPRITE_MAXCOUNT);
+    return SPRITE_BSIZE + 1;
+}
+
+static size_t sprite_all(unsigned i)
+{
+    (void)i;
+    ppu_write_sprites(sprites, SPRITE_MAXCOUNT, 0);
+    return SPRITE_MAXCOUNT * (SPRITE_BSIZE + 1);
+}
+
+static size_t frame_update(unsigned i)
+{
+    (void)i;
+    ppu_update();
+    return 0;
+}
+
+static size_t load_tilemap(unsigned i)
+{
+    (void)i;
+    ppu_load_tilemap(tiles, TILELAYER_WIDTH * TILELAYER_HEIGHT, TILEMAP_FILE);
+    return sizeof(tiles);
+}
+
+static size_t load_pattern(unsigned i)
+{
+    (void)i;
+    ppu_load_pattern(patterns, PATTERN_FILE, 2, 2);
+    return 4 * sizeof(pattern_t);
+}
+
+static size_t load_palette(unsigned i)
+{
+    (void)i;
+    ppu_load_palette(&palette, PALETTE_FILE);
+    return sizeof(palette_t);
+}
+
+static void audio_callback(const int8_t **buf, int *buf_size)
+{
+    *buf = samples;
+    *buf_size = APU_BUF_MAX;
+}
+
+static size_t audio_refill(unsigned i)
+{
+    (void)i;
+    dev_refill();
+    return APU_BUF_MAX;
+}
+
+static const bench_t benches[] = {
+    { "tile row (64)", tile_row, 1 },
+    { "tile column (64)", tile_column, 1 },
+    { "tile layer, by rows", tile_layer_rows, 16 },
+    { "tile layer, one write", tile_layer_vram, 1 },
+    { "palette", palette_write, 1 },
+    { "sprite, one", sprite_one, 1 },
+    { "sprites, all 64", sprite_all, 1 },
+    { "ppu_update", frame_update, 1 },
+    { "load tilemap (64x64)", load_tilemap, 1000 },
+    { "load pattern (2x2)", load_pattern, 50 },
+    { "load palette", load_palette, 10 },
+    { "audio refill (512)", audio_refill, 1 }
+};
+
+#define BENCH_COUNT (sizeof(benches) / sizeof(benches[0]))
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare_ns(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void run(const char *name, size_t (*op)(unsigned i), long ops)
+{
+    uint64_t batch_ns[BENCH_REPS];
+    uint64_t calls = dev_calls, alloc_count = allocs;
+    size_t bytes = 0;
+    double median_s;
+
+    op(0); // warm up caches (and the loaders' files)
+    calls = dev_calls;
+    alloc_count = allocs;
+
+    for (unsigned r = 0; r < BENCH_REPS; r++)
+    {
+        uint64_t start = now_ns();
+
+        bytes = 0;
+        for (long n = 0; n < ops; n++) bytes += op((unsigned)n);
+        batch_ns[r] = now_ns() - start;
+    }
+    calls = dev_calls - calls;
+    alloc_count = allocs - alloc_count;
+
+    qsort(batch_ns, BENCH_REPS, sizeof(batch_ns[0]), compare_ns);
+    median_s = batch_ns[BENCH_REPS / 2] / 1e9;
+
+    printf("%-24s %12.0f ops/s %9.1f MB/s %7.2f calls/op %7.2f allocs/op %6.1f%% spread\n", name,
+           ops / median_s, bytes / median_s / 1e6, (double)calls / (ops * BENCH_REPS),
+           (double)alloc_count / (ops * BENCH_REPS),
+           100.0 * (batch_ns[BENCH_REPS - 1] - batch_ns[0]) / batch_ns[BENCH_REPS / 2]);
+}
+
+int main(int argc, char **argv)
+{
+    long ops;
+
+    if (argc != 2 || (ops = strtol(argv[1], NULL, 0)) <= 0)
+    {
+        printf("Usage: %s <ops per batch>\n", argv[0]);
+        return 2;
+    }
+
+    for (unsigned i = 0; i < TILELAYER_WIDTH * TILELAYER_HEIGHT; i++)
+    {
+        tiles[i] = vram_tile(i % (PATTERNRAM_WIDTH * PATTERNRAM_HEIGHT), i % 16, i % 4);
+    }
+    for (unsigned i = 0; i < PATTERN_BLOCK_MAX * PATTERN_BLOCK_MAX; i++)
+    {
+        for (unsigned y = 0; y < TILEPATTERN_HEIGHT; y++) patterns[i].pxrow[y] = i * 0x11111111u;
+    }
+    for (unsigned i = 0; i < 15; i++) palette.color[i] = i * 0x111111;
+    for (unsigned i = 0; i < SPRITE_MAXCOUNT; i++)
+    {
+        sprites[i] = (sprite_t){ .x = i * 5, .y = i * 3, .pattern_addr = i, .palette_id = i % 32,
+                                 .mirror = i % 4, .prio = i % (PRIO_IN_FRONT + 1),
+                                 .width = 1 + i % 4, .height = 1 + (i / 4) % 4 };
+    }
+
+    fpgame_set_backend(&null_backend);
+    ppu_enable();
+    apu_enable(audio_callback);
+
+    for (unsigned b = 0; b < BENCH_COUNT; b++)
+    {
+        long bench_ops = ops / benches[b].ops_div;
+
+        run(benches[b].name, benches[b].op, (bench_ops > 0) ? bench_ops : 1);
+    }
+    for (pattern_height = 1; pattern_height <= PATTERN_BLOCK_MAX; pattern_height++)
+    {
+        for (pattern_width = 1; pattern_width <= PATTERN_BLOCK_MAX; pattern_width++)
+        {
+            char name[32];
+
+            snprintf(name, sizeof(name), "pattern %ux%u", pattern_width, pattern_height);
+            run(name, pattern_block, ops);
+        }
+    }
+
+    apu_disable();
+    ppu_disable();
+    fpgame_set_backend(NULL);
+    return 0;
+}
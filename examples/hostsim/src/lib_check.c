@@ -0,0 +1,1129 @@
+/* Checks of the techdemo's helper modules.
+ *
+ * Each check drives one helper module through its public API, on top of the host User Library,
+ *   and compares what it did against an independent model of what it should have done. A check
+ *   prints one line of results, and the program fails on the first check which does not pass.
+ *
+ * Usage (from examples/hostsim):
+ *   lib_check adpcm <.bin> <.adpcm>   Stream <.adpcm> (encoded from the raw PCM file <.bin> with
+ *                                     user_tools/pcm_to_adpcm.py) and compare it to <.bin>.
+ *   lib_check tilemap_stream          Scroll a camera over a large map, and compare the screen
+ *                                     with the map after every frame.
+ *   lib_check pattern_cache           Acquire and release random graphics through a pattern
+ *                                     cache, and check that held graphics never overlap and stay
+ *                                     in Pattern RAM.
+ *   lib_check pattern_dedup           Deduplicate patterns with known mirrored copies, and check
+ *                                     that a rewritten tilemap draws the same screens.
+ *   lib_check ctilemap <.tilemap> <.ctilemap> <block>
+ *                                     Decode random spans of <.ctilemap> (compressed from
+ *                                     <.tilemap> with user_tools/compress_tilemap.py), compare
+ *                                     them to <.tilemap>, and check that <block>x<block> blocks
+ *                                     were used and that broken copies do not open.
+ *   lib_check metatile                Stamp random metatiles over both tile layers, wrapping
+ *                                     around their edges, and compare the layers with a
+ *                                     reference after every flush.
+ *   lib_check sprite_pool             Move, reorder, add and remove sprites in a sprite pool, and
+ *                                     compare Sprite RAM with the sprites which should be shown
+ *                                     after every submit, with and without multiplexing.
+ *
+ * Checks which draw run against a model backend: a PPU which is never busy and applies every
+ *   write and request to a PPU model right away, so VRAM can be compared after each frame without
+ *   waiting for the emulated VBLANKs.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "audio_stream.h"
+#include "ctilemap.h"
+#include "fpgame_host.h"
+#include "metatile.h"
+#include "pattern_alloc.h"
+#include "pattern_cache.h"
+#include "pattern_dedup.h"
+#include "ppu_model.h"
+#include "sprite_pool.h"
+#include "tilemap_stream.h"
+#include "vram_batch.h"
+#include "vram_layout.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// The ADPCM round trip must give back nearly every sample exactly, and the rest closely
+#define ADPCM_MIN_EXACT 0.99
+#define ADPCM_MAX_ERROR 4
+
+// Tilemap stream: a camera moving at up to 16 pixels per frame, with a budget of 2 preloaded
+//   lines, writes at most 2 rows and 2 columns the screen needs plus the budget
+#define STREAM_MAP_WIDTH 300
+#define STREAM_MAP_HEIGHT 200
+#define STREAM_FRAMES 600
+#define STREAM_LINES_PER_FRAME 2
+#define STREAM_MAX_LINES (2 + 2 + STREAM_LINES_PER_FRAME)
+#define STREAM_TELEPORT_FRAME 300
+
+// Pattern cache: random 1x1 to 4x4 graphics, at most CACHE_HELD_MAX referenced at once, so they
+//   always fit in Pattern RAM however it is fragmented
+#define CACHE_GRAPHICS 300
+#define CACHE_OPS 200000
+#define CACHE_OPS_PER_FRAME 100
+#define CACHE_HELD_MAX 40
+
+// Pattern dedup: DEDUP_UNIQUE random patterns, followed by copies of them, each as is or mirrored
+//   in X, Y or XY. The tilemap uses the set at DEDUP_FROM, plus a few patterns outside of it at
+//   DEDUP_OTHER, and the kept patterns are uploaded to DEDUP_TO.
+#define DEDUP_UNIQUE 64
+#define DEDUP_PATTERNS 256
+#define DEDUP_OTHER_PATTERNS 32
+#define DEDUP_FROM 0
+#define DEDUP_TO 512
+#define DEDUP_OTHER 768
+#define DEDUP_SCREENS 6  ///< 2x3 screens cover the whole 512x512 layer
+
+// Compressed tilemap: random spans of the map are decoded (every whole row first), and a valid
+//   file is broken in each of CTILEMAP_CORRUPTIONS ways and truncated to every shorter size
+#define CTILEMAP_SPANS 10000
+#define CTILEMAP_CORRUPTIONS 10
+
+// Metatiles: random stamps on both layers every frame, and every METATILE_FULL_EVERY frames
+//   enough of them to fill whole rows
+#define METATILE_DEFS 32
+#define METATILE_FRAMES 300
+#define METATILE_STAMPS_MAX 24
+#define METATILE_FULL_EVERY 50
+#define METATILE_FULL_STAMPS 400
+
+// Sprite pool: POOL_SPRITES random sprites, moving and replaced one at a time, with multiplexing
+//   turned on between POOL_MULTIPLEX_FRAME and POOL_FEW_FRAME. From POOL_FEW_FRAME on, only
+//   POOL_FEW_SPRITES are left, so some sprite IDs go unused.
+#define POOL_SPRITES 200
+#define POOL_FRAMES 400
+#define POOL_MULTIPLEX_FRAME 100
+#define POOL_FEW_FRAME 300
+#define POOL_FEW_SPRITES 50
+#define POOL_DEPTHS 8 ///< Few depths, so sprites often tie and keep the order they were added in
+
+typedef struct {
+    const char *name;
+    const char *usage;    ///< Arguments of the check, for the usage message
+    int argc;             ///< Number of arguments
+    int (*run)(char **argv);
+} check_t;
+
+static void sleep_ms(unsigned ms)
+{
+    struct timespec ts = { 0, ms * 1000000l };
+
+    nanosleep(&ts, NULL);
+}
+
+// Reads a whole file, with a NUL after its contents so text files can be parsed as strings
+static void *read_file(const char *file, size_t *len)
+{
+    FILE *fp = fopen(file, "rb");
+    char *data = NULL;
+    long size;
+
+    if (fp == NULL) return NULL;
+    if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) > 0 && fseek(fp, 0, SEEK_SET) == 0 &&
+        (data = malloc(size + 1)) != NULL)
+    {
+        *len = fread(data, 1, size, fp);
+        data[*len] = '\0';
+    }
+    fclose(fp);
+    return data;
+}
+
+/* ===================== */
+/* === Model backend === */
+/* ===================== */
+static ppu_model_t model;
+
+static int model_ppu_open(void)
+{
+    ppu_model_init(&model);
+    return 0;
+}
+
+static void model_ppu_close(void)
+{
+}
+
+static int model_ppu_write(const void *buf, size_t len, off_t offset)
+{
+    ppu_model_write_vram(&model, buf, len, offset);
+    return 0;
+}
+
+static int model_ppu_write_strided(const void *buf, size_t size, size_t count, off_t offset,
+                                   size_t stride)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        ppu_model_write_vram(&model, (const uint8_t *)buf + i * size, size, offset + i * stride);
+    }
+    return 0;
+}
+
+static int model_ppu_request(ppu_request_e request, uint32_t arg)
+{
+    switch (request)
+    {
+        case PPU_REQ_BGCOLOR: model.bgcolor = arg; break;
+        case PPU_REQ_BGSCROLL:
+        case PPU_REQ_FGSCROLL:
+            ppu_model_set_scroll(&model, (request == PPU_REQ_FGSCROLL) ? LAYER_FG : LAYER_BG,
+                                 arg & 0xFFFF, arg >> 16);
+            break;
+        case PPU_REQ_LAYER_ENABLE: model.layer_enable = arg; break;
+        default: break;
+    }
+    return 0;
+}
+
+static int model_apu_open(void (*refill)(void))
+{
+    (void)refill;
+    return -1;
+}
+
+static void model_apu_close(void)
+{
+}
+
+static void model_apu_write(const int8_t *buf, size_t len)
+{
+    (void)buf;
+    (void)len;
+}
+
+static int model_con_read(void)
+{
+    return 0xFFFF;
+}
+
+static const fpgame_backend_t model_backend = {
+    .name = "model",
+    .ppu_open = model_ppu_open,
+    .ppu_close = model_ppu_close,
+    .ppu_write = model_ppu_write,
+    .ppu_write_strided = model_ppu_write_strided,
+    .ppu_request = model_ppu_request,
+    .apu_open = model_apu_open,
+    .apu_close = model_apu_close,
+    .apu_write = model_apu_write,
+    .con_read = model_con_read,
+};
+
+static int model_enable(void)
+{
+    fpgame_set_backend(&model_backend);
+    return ppu_enable();
+}
+
+static tile_t model_tile(layer_e layer, unsigned x, unsigned y)
+{
+    tile_t tile;
+
+    memcpy(&tile, &model.vram[vram_tile_offset(layer, x, y)], sizeof(tile));
+    return tile;
+}
+
+/* ============= */
+/* === ADPCM === */
+/* ============= */
+static int check_adpcm(char **argv)
+{
+    static audio_stream_t stream;
+    int8_t buf[1024];
+    size_t len = 0, pos = 0, exact = 0;
+    int max_error = 0;
+    int8_t *pcm;
+    int n;
+
+    if ((pcm = read_file(argv[0], &len)) == NULL)
+    {
+        printf("adpcm          could not read %s\n", argv[0]);
+        return -1;
+    }
+    if (audio_stream_open(&stream, argv[1], 0) == -1)
+    {
+        printf("adpcm          could not open %s\n", argv[1]);
+        free(pcm);
+        return -1;
+    }
+
+    // the reader thread decodes ahead of us, so an empty read only means it has not caught up yet
+    while ((n = audio_stream_read(&stream, buf, sizeof(buf))) != -1)
+    {
+        if (n == 0) sleep_ms(1);
+        for (int i = 0; i < n && pos < len; i++, pos++)
+        {
+            int error = abs(buf[i] - pcm[pos]);
+
+            if (error == 0) exact++;
+            if (error > max_error) max_error = error;
+        }
+    }
+    audio_stream_close(&stream);
+
+    printf("adpcm          %zu samples, %.1f%% exact, max error %d", pos,
+           len ? 100.0 * exact / len : 0, max_error);
+    free(pcm);
+    if (pos != len || exact < ADPCM_MIN_EXACT * len || max_error > ADPCM_MAX_ERROR)
+    {
+        printf("  FAILED (expected %zu samples, %.0f%% exact, max error %d)\n", len,
+               100 * ADPCM_MIN_EXACT, ADPCM_MAX_ERROR);
+        return -1;
+    }
+    printf("  ok\n");
+    return 0;
+}
+
+/* ====================== */
+/* === Tilemap stream === */
+/* ====================== */
+// Returns the number of on-screen tiles, or scroll coordinates, which do not match the map
+static unsigned stream_mismatches(const tile_t *map, unsigned camera_x, unsigned camera_y)
+{
+    unsigned mismatches = (model.scroll_x[0] != camera_x % 512) +
+                          (model.scroll_y[0] != camera_y % 512);
+
+    for (unsigned y = camera_y / 8; y <= (camera_y + PPU_SCREEN_HEIGHT - 1) / 8; y++)
+    {
+        for (unsigned x = camera_x / 8; x <= (camera_x + PPU_SCREEN_WIDTH - 1) / 8; x++)
+        {
+            mismatches += model_tile(LAYER_BG, x % TILELAYER_WIDTH, y % TILELAYER_HEIGHT) !=
+                          map[y * STREAM_MAP_WIDTH + x];
+        }
+    }
+    return mismatches;
+}
+
+static int check_tilemap_stream(char **argv)
+{
+    static tile_t map[STREAM_MAP_WIDTH * STREAM_MAP_HEIGHT];
+    const int max_x = STREAM_MAP_WIDTH * 8 - PPU_SCREEN_WIDTH;
+    const int max_y = STREAM_MAP_HEIGHT * 8 - PPU_SCREEN_HEIGHT;
+    tilemap_stream_t stream;
+    int camera_x = 0, camera_y = 0, speed_x = 0, speed_y = 0;
+    unsigned mismatches = 0, max_lines = 0, bad_frames = 0;
+
+    (void)argv;
+
+    // every tile of the map is different, so a tile written to the wrong place always shows
+    for (unsigned i = 0; i < STREAM_MAP_WIDTH * STREAM_MAP_HEIGHT; i++)
+    {
+        map[i] = vram_tile(i >> 6, (i >> 2) & 0xF, (mirror_e)(i & 0x3));
+    }
+
+    if (model_enable() == -1) return -1;
+    tilemap_stream_init(&stream, map, STREAM_MAP_WIDTH, STREAM_MAP_HEIGHT, LAYER_BG,
+                        STREAM_LINES_PER_FRAME);
+    srand(12);
+
+    for (unsigned frame = 0; frame < STREAM_FRAMES; frame++)
+    {
+        unsigned lines, frame_mismatches;
+
+        // change direction and speed every 20 frames, bouncing off the edges of the map
+        if (frame % 20 == 0)
+        {
+            speed_x = rand() % 33 - 16;
+            speed_y = rand() % 33 - 16;
+        }
+        if (frame == STREAM_TELEPORT_FRAME)
+        {
+            camera_x = max_x - camera_x;
+            camera_y = max_y - camera_y;
+        }
+        camera_x += speed_x;
+        camera_y += speed_y;
+        if (camera_x < 0 || camera_x > max_x) speed_x = -speed_x;
+        if (camera_y < 0 || camera_y > max_y) speed_y = -speed_y;
+        camera_x = (camera_x < 0) ? 0 : (camera_x > max_x) ? max_x : camera_x;
+        camera_y = (camera_y < 0) ? 0 : (camera_y > max_y) ? max_y : camera_y;
+
+        vram_batch_begin();
+        lines = tilemap_stream_update(&stream, camera_x, camera_y);
+        if (vram_batch_update() == -1) return -1;
+
+        frame_mismatches = stream_mismatches(map, camera_x, camera_y);
+        mismatches += frame_mismatches;
+        bad_frames += (frame_mismatches != 0);
+        // the first frame and the teleport load a whole window
+        if (frame != 0 && frame != STREAM_TELEPORT_FRAME && lines > max_lines) max_lines = lines;
+    }
+    ppu_disable();
+
+    printf("tilemap_stream %u frames, %u mismatches in %u frames, at most %u lines per frame",
+           STREAM_FRAMES, mismatches, bad_frames, max_lines);
+    if (mismatches != 0 || max_lines > STREAM_MAX_LINES)
+    {
+        printf("  FAILED (expected no mismatches, at most %u lines)\n", STREAM_MAX_LINES);
+        return -1;
+    }
+    printf("  ok\n");
+    return 0;
+}
+
+/* ===================== */
+/* === Pattern cache === */
+/* ===================== */
+// Returns the number of patterns of held graphics which overlap another one, or differ from the
+//   graphic in VRAM
+static unsigned cache_mismatches(const pattern_cache_t *cache, const unsigned *held,
+                                 unsigned held_count)
+{
+    uint8_t owners[PATTERNRAM_HEIGHT][PATTERNRAM_WIDTH] = {{0}};
+    uint8_t seen[CACHE_GRAPHICS] = {0};
+    unsigned mismatches = 0;
+
+    for (unsigned h = 0; h < held_count; h++)
+    {
+        const pattern_source_t *graphic = &cache->pool[held[h]];
+        pattern_addr_t addr = cache->slots[held[h]].pattern_addr;
+
+        // a graphic may be held more than once, but is only stored once
+        if (seen[held[h]]++) continue;
+
+        for (unsigned j = 0; j < graphic->height; j++)
+        {
+            for (unsigned i = 0; i < graphic->width; i++)
+            {
+                unsigned x = (addr % PATTERNRAM_WIDTH + i) % PATTERNRAM_WIDTH;
+                unsigned y = (addr / PATTERNRAM_WIDTH + j) % PATTERNRAM_HEIGHT;
+                const uint8_t *vram = &model.vram[vram_pattern_offset(vram_pattern_addr(x, y))];
+
+                mismatches += (owners[y][x]++ != 0) ||
+                              memcmp(vram, &graphic->patterns[j * graphic->width + i],
+                                     sizeof(pattern_t)) != 0;
+            }
+        }
+    }
+    return mismatches;
+}
+
+static int check_pattern_cache(char **argv)
+{
+    static pattern_t patterns[CACHE_GRAPHICS][PATTERN_BLOCK_MAX * PATTERN_BLOCK_MAX];
+    static pattern_source_t pool[CACHE_GRAPHICS];
+    pattern_cache_t cache;
+    unsigned held[CACHE_HELD_MAX];
+    unsigned held_count = 0, failed = 0, mismatches = 0, free_count;
+
+    (void)argv;
+
+    srand(13);
+    for (unsigned g = 0; g < CACHE_GRAPHICS; g++)
+    {
+        pool[g].patterns = patterns[g];
+        pool[g].width = 1 + rand() % PATTERN_BLOCK_MAX;
+        pool[g].height = 1 + rand() % PATTERN_BLOCK_MAX;
+        for (unsigned p = 0; p < pool[g].width * pool[g].height; p++)
+        {
+            for (unsigned r = 0; r < 8; r++) patterns[g][p].pxrow[r] = (uint32_t)rand() * 2 + 1;
+        }
+    }
+
+    if (model_enable() == -1) return -1;
+    pattern_alloc_reset();
+    if (pattern_cache_init(&cache, pool, CACHE_GRAPHICS) == -1) return -1;
+    vram_batch_begin();
+
+    for (unsigned op = 1; op <= CACHE_OPS; op++)
+    {
+        // acquire more often than release while few are held, so the count wanders up and down
+        if (held_count < CACHE_HELD_MAX && (held_count == 0 || rand() % 2))
+        {
+            unsigned id = rand() % CACHE_GRAPHICS;
+            pattern_addr_t addr;
+
+            if (pattern_cache_acquire(&cache, id, &addr) == -1) failed++;
+            else held[held_count++] = id;
+        }
+        else
+        {
+            unsigned h = rand() % held_count;
+
+            pattern_cache_release(&cache, held[h]);
+            held[h] = held[--held_count];
+        }
+
+        if (op % CACHE_OPS_PER_FRAME == 0)
+        {
+            if (vram_batch_update() == -1) return -1;
+            mismatches += cache_mismatches(&cache, held, held_count);
+            vram_batch_begin();
+        }
+    }
+
+    while (held_count > 0) pattern_cache_release(&cache, held[--held_count]);
+    pattern_cache_destroy(&cache);
+    free_count = pattern_alloc_free_count();
+    ppu_disable();
+
+    printf("pattern_cache  %u operations, %u uploads, %u evictions, %u failed acquires, "
+           "%u bad patterns, %u free after destroy", CACHE_OPS, cache.uploads, cache.evictions,
+           failed, mismatches, free_count);
+    if (failed != 0 || mismatches != 0 || free_count != PATTERNRAM_WIDTH * PATTERNRAM_HEIGHT - 1)
+    {
+        printf("  FAILED (expected no failures, %u free)\n",
+               PATTERNRAM_WIDTH * PATTERNRAM_HEIGHT - 1);
+        return -1;
+    }
+    printf("  ok\n");
+    return 0;
+}
+
+/* ===================== */
+/* === Pattern dedup === */
+/* ===================== */
+// Pixel (x, y) of a pattern drawn with the given mirror bits
+static unsigned dedup_pixel(const pattern_t *pattern, mirror_e mirror, unsigned x, unsigned y)
+{
+    if (mirror & MIRROR_X) x = 7 - x;
+    if (mirror & MIRROR_Y) y = 7 - y;
+    return (pattern->pxrow[y] >> (4 * x)) & 0xF;
+}
+
+static void dedup_random_pattern(pattern_t *pattern)
+{
+    for (unsigned r = 0; r < 8; r++) pattern->pxrow[r] = (uint32_t)rand() * 2 + (rand() & 1);
+}
+
+// Submits what was recorded, and renders the BG layer at scrolls covering all of it into frames
+static int dedup_render(uint32_t (*frames)[PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT])
+{
+    for (unsigned i = 0; i < DEDUP_SCREENS; i++)
+    {
+        vram_batch_scroll(LAYER_BG, (i % 2) * PPU_SCREEN_WIDTH, (i / 2) * PPU_SCREEN_HEIGHT);
+        if (vram_batch_update() == -1) return -1;
+        ppu_model_render(&model, frames[i]);
+        vram_batch_begin();
+    }
+    return 0;
+}
+
+static int check_pattern_dedup(char **argv)
+{
+    static pattern_t set[DEDUP_PATTERNS], kept[DEDUP_PATTERNS], other[DEDUP_OTHER_PATTERNS];
+    static pattern_t blank[DEDUP_PATTERNS];
+    static tile_t tiles[TILELAYER_WIDTH * TILELAYER_HEIGHT];
+    static uint32_t before[DEDUP_SCREENS][PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT];
+    static uint32_t after[DEDUP_SCREENS][PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT];
+    pattern_dedup_map_t map[DEDUP_PATTERNS];
+    unsigned source[DEDUP_PATTERNS];
+    mirror_e mirror[DEDUP_PATTERNS];
+    unsigned copies[4] = {0}, bad_map = 0, bad_kept = 0, bad_tiles = 0, bad_pixels = 0;
+    int kept_count;
+
+    (void)argv;
+
+    // copies are made pixel by pixel, independently of pattern_mirror
+    srand(14);
+    for (unsigned i = 0; i < DEDUP_PATTERNS; i++)
+    {
+        source[i] = (i < DEDUP_UNIQUE) ? i : (unsigned)rand() % DEDUP_UNIQUE;
+        mirror[i] = (i < DEDUP_UNIQUE) ? MIRROR_NONE : (mirror_e)(rand() % 4);
+        if (i < DEDUP_UNIQUE)
+        {
+            dedup_random_pattern(&set[i]);
+            continue;
+        }
+        copies[mirror[i]]++;
+        memset(&set[i], 0, sizeof(pattern_t));
+        for (unsigned y = 0; y < 8; y++)
+        {
+            for (unsigned x = 0; x < 8; x++)
+            {
+                set[i].pxrow[y] |= dedup_pixel(&set[source[i]], mirror[i], x, y) << (4 * x);
+            }
+        }
+    }
+    for (unsigned i = 0; i < DEDUP_OTHER_PATTERNS; i++) dedup_random_pattern(&other[i]);
+
+    if ((kept_count = pattern_dedup_patterns(set, DEDUP_PATTERNS, kept, map)) == -1) return -1;
+    for (unsigned i = 0; i < DEDUP_PATTERNS; i++)
+    {
+        bad_map += map[i].index != source[i] || map[i].mirror != mirror[i];
+    }
+    for (int k = 0; k < kept_count && k < DEDUP_UNIQUE; k++)
+    {
+        bad_kept += memcmp(&kept[k], &set[k], sizeof(pattern_t)) != 0;
+    }
+
+    // one tile in 8 points outside of the set, and must be left as it is
+    for (unsigned i = 0; i < TILELAYER_WIDTH * TILELAYER_HEIGHT; i++)
+    {
+        pattern_addr_t addr = (rand() % 8) ? DEDUP_FROM + rand() % DEDUP_PATTERNS
+                                           : DEDUP_OTHER + rand() % DEDUP_OTHER_PATTERNS;
+
+        tiles[i] = vram_tile(addr, rand() % TILELAYER_MAX_PALETTES, (mirror_e)(rand() % 4));
+    }
+
+    if (model_enable() == -1) return -1;
+    vram_batch_begin();
+    for (unsigned p = 0; p < TILELAYER_MAX_PALETTES; p++)
+    {
+        palette_t palette;
+
+        for (unsigned c = 0; c < 15; c++) palette.color[c] = rand() & 0xFFFFFF;
+        vram_batch_palette(&palette, LAYER_BG, p);
+    }
+    vram_batch_vram(set, sizeof(set), vram_pattern_offset(DEDUP_FROM));
+    vram_batch_vram(other, sizeof(other), vram_pattern_offset(DEDUP_OTHER));
+    for (unsigned y = 0; y < TILELAYER_HEIGHT; y++)
+    {
+        vram_batch_tiles_horizontal(&tiles[y * TILELAYER_WIDTH], TILELAYER_WIDTH, LAYER_BG, 0, y,
+                                    TILELAYER_WIDTH);
+    }
+    vram_batch_layer_enable(LAYER_BG);
+    if (dedup_render(before) == -1) return -1;
+
+    // rewrite in place, and clear the original set, so only the kept patterns can draw the tiles
+    pattern_dedup_tiles(map, DEDUP_PATTERNS, DEDUP_FROM, DEDUP_TO, tiles, tiles,
+                        TILELAYER_WIDTH * TILELAYER_HEIGHT);
+    vram_batch_vram(blank, sizeof(blank), vram_pattern_offset(DEDUP_FROM));
+    vram_batch_vram(kept, kept_count * sizeof(pattern_t), vram_pattern_offset(DEDUP_TO));
+    for (unsigned y = 0; y < TILELAYER_HEIGHT; y++)
+    {
+        vram_batch_tiles_horizontal(&tiles[y * TILELAYER_WIDTH], TILELAYER_WIDTH, LAYER_BG, 0, y,
+                                    TILELAYER_WIDTH);
+    }
+    if (dedup_render(after) == -1) return -1;
+    ppu_disable();
+
+    for (unsigned i = 0; i < TILELAYER_WIDTH * TILELAYER_HEIGHT; i++)
+    {
+        unsigned addr = tiles[i] >> 6;
+
+        bad_tiles += (addr < DEDUP_TO || addr >= DEDUP_TO + (unsigned)kept_count) &&
+                     (addr < DEDUP_OTHER || addr >= DEDUP_OTHER + DEDUP_OTHER_PATTERNS);
+    }
+    for (unsigned i = 0; i < DEDUP_SCREENS; i++)
+    {
+        for (unsigned p = 0; p < PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT; p++)
+        {
+            bad_pixels += before[i][p] != after[i][p];
+        }
+    }
+
+    printf("pattern_dedup  %u patterns -> %d kept (%u exact, %u X, %u Y, %u XY copies), "
+           "%u bad map entries, %u bad kept, %u bad tiles, %u bad pixels", DEDUP_PATTERNS,
+           kept_count, copies[MIRROR_NONE], copies[MIRROR_X], copies[MIRROR_Y], copies[MIRROR_XY],
+           bad_map, bad_kept, bad_tiles, bad_pixels);
+    if (kept_count != DEDUP_UNIQUE || bad_map != 0 || bad_kept != 0 || bad_tiles != 0 ||
+        bad_pixels != 0)
+    {
+        printf("  FAILED (expected %u kept and nothing bad)\n", DEDUP_UNIQUE);
+        return -1;
+    }
+    printf("  ok\n");
+    return 0;
+}
+
+/* =========================== */
+/* === Compressed tilemaps === */
+/* =========================== */
+// Reads a .tilemap text file: rows of (pattern address, palette ID, mirror) in hex, like
+//   compress_tilemap.py reads them. Returns NULL if the file cannot be read or is not a rectangle.
+static tile_t *ctilemap_read_source(const char *file, unsigned *width, unsigned *height)
+{
+    char *text, *line, *next;
+    tile_t *tiles;
+    size_t len, count = 0;
+
+    if ((text = read_file(file, &len)) == NULL) return NULL;
+    // every tile takes at least the 7 characters of "(0,0,0)"
+    if ((tiles = malloc((len / 7 + 1) * sizeof(tile_t))) == NULL)
+    {
+        free(text);
+        return NULL;
+    }
+
+    *width = *height = 0;
+    for (line = text; line != NULL; line = next)
+    {
+        unsigned pattern_addr, palette_id, mirror, row_width = 0;
+        int used;
+
+        if ((next = strchr(line, '\n')) != NULL) *next++ = '\0';
+        while (sscanf(line, " (%x,%x,%x)%n", &pattern_addr, &palette_id, &mirror, &used) == 3)
+        {
+            tiles[count++] = vram_tile(pattern_addr, palette_id, (mirror_e)mirror);
+            line += used;
+            row_width++;
+        }
+        if (row_width == 0) continue;
+        if (*height != 0 && row_width != *width)
+        {
+            free(tiles);
+            tiles = NULL;
+            break;
+        }
+        *width = row_width;
+        (*height)++;
+    }
+    free(text);
+    return tiles;
+}
+
+// Breaks a copy of a valid compressed tilemap in one of CTILEMAP_CORRUPTIONS ways, each of which
+//   ctilemap_open must reject. Returns 0 if the way cannot be applied to this map.
+static int ctilemap_corrupt(uint8_t *data, const ctilemap_t *map, const uint8_t *valid,
+                            unsigned way)
+{
+    size_t row_table = map->row_table - valid, runs = map->runs - valid;
+    unsigned grid_height = (map->height + map->block - 1) / map->block;
+    uint32_t end;
+
+    switch (way)
+    {
+        case 0: data[0] ^= 0xFF; break;               // magic
+        case 1: data[4]++; break;                     // version
+        case 2: data[10] = 3; break;                  // block size
+        case 3: data[11] = 3; break;                  // index size
+        case 4: data[6] = data[7] = 0; break;         // width
+        case 5: data[12] = data[13] = 0; break;       // empty dictionary
+        case 6: data[12] = data[13] = 0xFF; break;    // dictionary past the end of the file
+        case 7: memset(&data[row_table + 4], 0xFF, 4); break; // row 0 ending past the runs
+        case 8:
+            // the first run's index, past the end of the dictionary
+            if (map->dict_count > (map->index_size == 1 ? 0xFFu : 0xFFFFu)) return 0;
+            memset(&data[runs + 1], 0xFF, map->index_size);
+            break;
+        default:
+            // the last row, one byte short of its last index
+            memcpy(&end, &data[row_table + grid_height * 4], sizeof(end));
+            end--;
+            memcpy(&data[row_table + grid_height * 4], &end, sizeof(end));
+            break;
+    }
+    return 1;
+}
+
+static int check_ctilemap(char **argv)
+{
+    ctilemap_t map, broken;
+    tile_t *tiles, *row = NULL;
+    uint8_t *data, *copy = NULL;
+    size_t size;
+    unsigned width, height, block = atoi(argv[2]);
+    unsigned bad_tiles = 0, corruptions = 0, rejected = 0, truncations = 0;
+    int result = -1;
+
+    if ((tiles = ctilemap_read_source(argv[0], &width, &height)) == NULL)
+    {
+        printf("ctilemap       could not read %s\n", argv[0]);
+        return -1;
+    }
+    if ((data = read_file(argv[1], &size)) == NULL || ctilemap_open(&map, data, size) == -1)
+    {
+        printf("ctilemap       could not open %s\n", argv[1]);
+        goto done;
+    }
+    if ((row = malloc(width * sizeof(tile_t))) == NULL || (copy = malloc(size)) == NULL) goto done;
+
+    srand(15);
+    for (unsigned i = 0; i < CTILEMAP_SPANS && map.width == width && map.height == height; i++)
+    {
+        unsigned y = (i < height) ? i : rand() % height;
+        unsigned x = (i < height) ? 0 : rand() % width;
+        unsigned count = (i < height) ? width : 1 + rand() % (width - x);
+
+        ctilemap_decode_row(&map, x, y, count, row);
+        for (unsigned j = 0; j < count; j++) bad_tiles += row[j] != tiles[y * width + x + j];
+    }
+
+    for (unsigned way = 0; way < CTILEMAP_CORRUPTIONS; way++)
+    {
+        memcpy(copy, data, size);
+        if (!ctilemap_corrupt(copy, &map, data, way)) continue;
+        corruptions++;
+        rejected += ctilemap_open(&broken, copy, size) == -1;
+    }
+    for (size_t len = 0; len < size; len++) truncations += ctilemap_open(&broken, data, len) == -1;
+
+    printf("ctilemap       %ux%u tiles in %ux%u blocks (%u different), %u spans, %u bad tiles, "
+           "%u of %u corruptions and %u of %zu truncations rejected", map.width, map.height,
+           map.block, map.block, map.dict_count, CTILEMAP_SPANS, bad_tiles, rejected,
+           corruptions, truncations, size);
+    if (map.width != width || map.height != height || map.block != block || bad_tiles != 0 ||
+        rejected != corruptions || truncations != size)
+    {
+        printf("  FAILED (expected %ux%u tiles in %ux%u blocks, no bad tiles, all rejected)\n",
+               width, height, block, block);
+        goto done;
+    }
+    printf("  ok\n");
+    result = 0;
+
+done:
+    free(tiles);
+    free(data);
+    free(row);
+    free(copy);
+    return result;
+}
+
+/* ================= */
+/* === Metatiles === */
+/* ================= */
+// Number of spans covering the marked tiles of one row, counting a span which wraps past column
+//   63 once
+static unsigned metatile_row_spans(const uint8_t *marked)
+{
+    unsigned spans = 0, count = 0;
+
+    for (unsigned x = 0; x < TILELAYER_WIDTH; x++)
+    {
+        count += marked[x];
+        spans += marked[x] && !marked[(x + TILELAYER_WIDTH - 1) % TILELAYER_WIDTH];
+    }
+    return (count == TILELAYER_WIDTH) ? 1 : spans;
+}
+
+static int check_metatile(char **argv)
+{
+    static tile_t tiles[METATILE_DEFS][METATILE_MAX_SIZE * METATILE_MAX_SIZE];
+    static tile_t expected[2][TILELAYER_HEIGHT][TILELAYER_WIDTH];
+    unsigned width[METATILE_DEFS], height[METATILE_DEFS];
+    metatile_set_t set;
+    unsigned stamps = 0, spans = 0, bad_tiles = 0, bad_frames = 0;
+
+    (void)argv;
+
+    srand(16);
+    if (model_enable() == -1) return -1;
+    if (metatile_init(&set, METATILE_DEFS) == -1) return -1;
+    for (unsigned d = 0; d < METATILE_DEFS; d++)
+    {
+        width[d] = 1 + rand() % METATILE_MAX_SIZE;
+        height[d] = 1 + rand() % METATILE_MAX_SIZE;
+        for (unsigned i = 0; i < width[d] * height[d]; i++)
+        {
+            tiles[d][i] = vram_tile(rand() % (PATTERNRAM_WIDTH * PATTERNRAM_HEIGHT),
+                                    rand() % TILELAYER_MAX_PALETTES, (mirror_e)(rand() % 4));
+        }
+        if (metatile_define(&set, tiles[d], width[d], height[d]) != (int)d) return -1;
+    }
+
+    // the reference starts from the layers as they are, and is stamped tile by tile
+    for (unsigned l = 0; l < 2; l++)
+    {
+        for (unsigned y = 0; y < TILELAYER_HEIGHT; y++)
+        {
+            for (unsigned x = 0; x < TILELAYER_WIDTH; x++)
+            {
+                expected[l][y][x] = model_tile(l ? LAYER_FG : LAYER_BG, x, y);
+            }
+        }
+    }
+
+    for (unsigned frame = 0; frame < METATILE_FRAMES; frame++)
+    {
+        uint8_t marked[2][TILELAYER_HEIGHT][TILELAYER_WIDTH] = {{{0}}};
+        unsigned count = (frame % METATILE_FULL_EVERY == METATILE_FULL_EVERY - 1) ?
+                         METATILE_FULL_STAMPS : 1 + rand() % METATILE_STAMPS_MAX;
+        unsigned frame_spans, expected_spans = 0;
+
+        vram_batch_begin();
+        for (unsigned s = 0; s < count; s++)
+        {
+            unsigned d = rand() % METATILE_DEFS, l = rand() % 2;
+            unsigned x_i = rand() % TILELAYER_WIDTH, y_i = rand() % TILELAYER_HEIGHT;
+
+            metatile_stamp(&set, d, l ? LAYER_FG : LAYER_BG, x_i, y_i);
+            for (unsigned j = 0; j < height[d]; j++)
+            {
+                for (unsigned i = 0; i < width[d]; i++)
+                {
+                    unsigned x = (x_i + i) % TILELAYER_WIDTH, y = (y_i + j) % TILELAYER_HEIGHT;
+
+                    expected[l][y][x] = tiles[d][j * width[d] + i];
+                    marked[l][y][x] = 1;
+                }
+            }
+        }
+        frame_spans = metatile_flush(&set);
+        if (vram_batch_update() == -1) return -1;
+
+        for (unsigned l = 0; l < 2; l++)
+        {
+            for (unsigned y = 0; y < TILELAYER_HEIGHT; y++)
+            {
+                expected_spans += metatile_row_spans(marked[l][y]);
+                for (unsigned x = 0; x < TILELAYER_WIDTH; x++)
+                {
+                    bad_tiles += model_tile(l ? LAYER_FG : LAYER_BG, x, y) != expected[l][y][x];
+                }
+            }
+        }
+        bad_frames += frame_spans != expected_spans;
+        stamps += count;
+        spans += frame_spans;
+    }
+    metatile_destroy(&set);
+    ppu_disable();
+
+    printf("metatile       %u frames, %u stamps in %u spans, %u bad tiles, "
+           "%u frames with the wrong span count", METATILE_FRAMES, stamps, spans, bad_tiles,
+           bad_frames);
+    if (bad_tiles != 0 || bad_frames != 0)
+    {
+        printf("  FAILED (expected no bad tiles or frames)\n");
+        return -1;
+    }
+    printf("  ok\n");
+    return 0;
+}
+
+/* =================== */
+/* === Sprite pool === */
+/* =================== */
+typedef struct {
+    sprite_handle_t handle;
+    sprite_t sprite;
+    int depth;
+    unsigned serial; ///< Order in which the sprite was added
+    int live;
+} pool_sprite_t;
+
+static pool_sprite_t pool_sprites[POOL_SPRITES];
+static unsigned pool_serial;
+
+// Whether any pixel of a sprite lands on screen, with coordinates wrapping like the PPU's
+static int pool_visible(unsigned x, unsigned y, unsigned width, unsigned height)
+{
+    int visible_x = 0, visible_y = 0;
+
+    for (unsigned i = 0; i < width * 8; i++) visible_x |= (x + i) % 512 < PPU_SCREEN_WIDTH;
+    for (unsigned j = 0; j < height * 8; j++) visible_y |= (y + j) % 256 < PPU_SCREEN_HEIGHT;
+    return visible_x && visible_y;
+}
+
+// Whether sprite a is drawn on top of sprite b
+static int pool_before(const pool_sprite_t *a, const pool_sprite_t *b)
+{
+    if (a->sprite.prio != b->sprite.prio) return a->sprite.prio > b->sprite.prio;
+    if (a->depth != b->depth) return a->depth < b->depth;
+    return a->serial < b->serial;
+}
+
+static int pool_add(pool_sprite_t *ps)
+{
+    ps->sprite.pattern_addr = rand() % (PATTERNRAM_WIDTH * PATTERNRAM_HEIGHT);
+    ps->sprite.palette_id = rand() % SPRLAYER_MAX_PALETTES;
+    ps->sprite.mirror = (mirror_e)(rand() % 4);
+    ps->sprite.prio = (render_prio_e)(rand() % 3);
+    ps->sprite.x = rand() % (SPRITE_MAXX + 1);
+    ps->sprite.y = rand() % (SPRITE_MAXY + 1);
+    ps->sprite.width = 1 + rand() % 4;
+    ps->sprite.height = 1 + rand() % 4;
+    ps->depth = rand() % POOL_DEPTHS;
+    ps->serial = pool_serial++;
+    ps->live = (ps->handle = sprite_pool_add(&ps->sprite, ps->depth)) != -1;
+    return ps->live;
+}
+
+// Removes a sprite, and returns whether its handle went stale
+static int pool_remove(pool_sprite_t *ps)
+{
+    sprite_pool_remove(ps->handle);
+    ps->live = 0;
+    return sprite_pool_get(ps->handle) == NULL;
+}
+
+// Returns the number of sprite IDs which do not hold what the pool should have shown, given the
+//   sprites on screen in drawing order, and the sorted positions in that order of those shown
+static unsigned pool_mismatches(const unsigned *order, const unsigned *shown, unsigned shown_count)
+{
+    unsigned mismatches = 0;
+
+    for (unsigned id = 0; id < SPRITE_MAXCOUNT; id++)
+    {
+        uint32_t word;
+        uint8_t extra = model.vram[VRAM_SPRITESOFFSET + SPRRAM_EXTRAOFFSET + id];
+
+        memcpy(&word, &model.vram[VRAM_SPRITESOFFSET + id * SPRITE_BSIZE], sizeof(word));
+        if (id < shown_count)
+        {
+            const sprite_t *sprite = &pool_sprites[order[shown[id]]].sprite;
+
+            mismatches += word != vram_sprite_word(sprite) || extra != vram_sprite_extra(sprite);
+        }
+        else
+        {
+            // unused IDs may hold anything, as long as it is not drawn
+            mismatches += pool_visible((word >> SPRITE_WORD_X_SHIFT) & SPRITE_WORD_X_MASK,
+                                       (word >> SPRITE_WORD_Y_SHIFT) & SPRITE_WORD_Y_MASK,
+                                       ((extra >> SPRITE_EXTRA_WIDTH_SHIFT) &
+                                        SPRITE_EXTRA_WIDTH_MASK) + 1,
+                                       ((extra >> SPRITE_EXTRA_HEIGHT_SHIFT) &
+                                        SPRITE_EXTRA_HEIGHT_MASK) + 1);
+        }
+    }
+    return mismatches;
+}
+
+static int check_sprite_pool(char **argv)
+{
+    unsigned order[POOL_SPRITES], shown[SPRITE_MAXCOUNT];
+    unsigned rotation = 0, max_on_screen = 0, min_on_screen = POOL_SPRITES;
+    unsigned mismatches = 0, bad_frames = 0, bad_counts = 0, bad_handles = 0;
+    int multiplex = 0;
+
+    (void)argv;
+
+    srand(17);
+    if (model_enable() == -1) return -1;
+    sprite_pool_reset();
+    for (unsigned i = 0; i < POOL_SPRITES; i++)
+    {
+        if (!pool_add(&pool_sprites[i])) return -1;
+    }
+
+    for (unsigned frame = 0; frame < POOL_FRAMES; frame++)
+    {
+        unsigned count = 0, shown_count = 0, returned, frame_mismatches;
+        pool_sprite_t *replaced;
+
+        if (frame == POOL_MULTIPLEX_FRAME || frame == POOL_FEW_FRAME)
+        {
+            multiplex = (frame == POOL_MULTIPLEX_FRAME);
+            sprite_pool_set_multiplex(multiplex);
+            rotation = 0;
+        }
+        if (frame == POOL_FEW_FRAME)
+        {
+            for (unsigned i = POOL_FEW_SPRITES; i < POOL_SPRITES; i++)
+            {
+                bad_handles += !pool_remove(&pool_sprites[i]);
+            }
+        }
+
+        // move a quarter of the sprites, reorder a few, and replace one
+        for (unsigned i = 0; i < POOL_SPRITES; i++)
+        {
+            pool_sprite_t *ps = &pool_sprites[i];
+            sprite_t *sprite;
+
+            if (!ps->live) continue;
+            if ((sprite = sprite_pool_get(ps->handle)) == NULL)
+            {
+                bad_handles++;
+                continue;
+            }
+            if (rand() % 4 == 0)
+            {
+                ps->sprite.x = (ps->sprite.x + 512 + rand() % 17 - 8) % 512;
+                ps->sprite.y = (ps->sprite.y + 256 + rand() % 17 - 8) % 256;
+                *sprite = ps->sprite;
+            }
+            if (rand() % 50 == 0)
+            {
+                ps->depth = rand() % POOL_DEPTHS;
+                sprite_pool_set_depth(ps->handle, ps->depth);
+            }
+        }
+        replaced = &pool_sprites[rand() % POOL_SPRITES];
+        if (replaced->live) bad_handles += !pool_remove(replaced) || !pool_add(replaced);
+
+        vram_batch_begin();
+        returned = sprite_pool_submit();
+        if (vram_batch_update() == -1) return -1;
+
+        // the sprites on screen, sorted into drawing order
+        for (unsigned i = 0; i < POOL_SPRITES; i++)
+        {
+            const pool_sprite_t *ps = &pool_sprites[i];
+            unsigned j;
+
+            if (!ps->live || !pool_visible(ps->sprite.x, ps->sprite.y, ps->sprite.width,
+                                           ps->sprite.height))
+            {
+                continue;
+            }
+            for (j = count++; j > 0 && pool_before(ps, &pool_sprites[order[j - 1]]); j--)
+            {
+                order[j] = order[j - 1];
+            }
+            order[j] = i;
+        }
+
+        // multiplexing shows the next 64 of the order each frame, wrapping around its end
+        if (multiplex && count > SPRITE_MAXCOUNT)
+        {
+            unsigned start = rotation % count;
+
+            for (unsigned k = 0; k < count; k++)
+            {
+                if ((k + count - start) % count < SPRITE_MAXCOUNT) shown[shown_count++] = k;
+            }
+            rotation = start + SPRITE_MAXCOUNT;
+        }
+        else
+        {
+            for (; shown_count < count && shown_count < SPRITE_MAXCOUNT; shown_count++)
+            {
+                shown[shown_count] = shown_count;
+            }
+        }
+
+        frame_mismatches = pool_mismatches(order, shown, shown_count);
+        mismatches += frame_mismatches;
+        bad_frames += frame_mismatches != 0;
+        bad_counts += returned != count;
+        if (count > max_on_screen) max_on_screen = count;
+        if (count < min_on_screen) min_on_screen = count;
+    }
+    sprite_pool_reset();
+    ppu_disable();
+
+    printf("sprite_pool    %u frames, %u to %u sprites on screen, %u bad sprite IDs in %u frames, "
+           "%u bad counts, %u bad handles", POOL_FRAMES, min_on_screen, max_on_screen, mismatches,
+           bad_frames, bad_counts, bad_handles);
+    if (mismatches != 0 || bad_counts != 0 || bad_handles != 0 ||
+        max_on_screen <= SPRITE_MAXCOUNT || min_on_screen >= SPRITE_MAXCOUNT)
+    {
+        printf("  FAILED (expected nothing bad, and both more and fewer than %u on screen)\n",
+               SPRITE_MAXCOUNT);
+        return -1;
+    }
+    printf("  ok\n");
+    return 0;
+}
+
+static const check_t checks[] = {
+    { "adpcm", "<.bin> <.adpcm>", 2, check_adpcm },
+    { "tilemap_stream", "", 0, check_tilemap_stream },
+    { "pattern_cache", "", 0, check_pattern_cache },
+    { "pattern_dedup", "", 0, check_pattern_dedup },
+    { "ctilemap", "<.tilemap> <.ctilemap> <block>", 3, check_ctilemap },
+    { "metatile", "", 0, check_metatile },
+    { "sprite_pool", "", 0, check_sprite_pool },
+};
+
+#define CHECK_COUNT (sizeof(checks) / sizeof(checks[0]))
+
+int main(int argc, char **argv)
+{
+    for (unsigned i = 0; argc >= 2 && i < CHECK_COUNT; i++)
+    {
+        if (strcmp(argv[1], checks[i].name) == 0 && argc == checks[i].argc + 2)
+        {
+            return (checks[i].run(&argv[2]) == 0) ? 0 : 1;
+        }
+    }
+
+    printf("Usage:\n");
+    for (unsigned i = 0; i < CHECK_COUNT; i++)
+    {
+        printf("  %s %s %s\n", argv[0], checks[i].name, checks[i].usage);
+    }
+    return 2;
+}
@@ -0,0 +1,389 @@
+/* Golden-image regression harness for the PPU model.
+ *
+ * Builds a set of VRAM scenes from the techdemo's assets, renders them with the PPU model and
+ *   compares the frames against the reference images in golden/. Each scene exercises a different
+ *   part of the PPU: scrolling and wrap-around of both tile layers, sprite sizes, mirroring and
+ *   priorities, palettes, layer enables and the background color.
+ *
+ * Usage (from examples/hostsim):
+ *   ppu_golden check <dir>    Compare every scene, rendered by both the reference and the fast
+ *                             renderer, against <dir>/<scene>.ppm. On a mismatch, the rendered
+ *                             frame and a diff image are written next to the golden image.
+ *   ppu_golden update <dir>   Re-render every scene into <dir>/<scene>.ppm with the reference
+ *                             renderer.
+ *   ppu_golden bench <n>      Render each scene n times with each renderer and report the
+ *                             average time per frame.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "asset_pack.h"
+#include "ppu_model.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define GOLDEN_PACK_FILE "../techdemo/assets/techdemo.fpak"
+
+// Pixels which differ from the golden image are drawn in this color in the diff image
+#define DIFF_COLOR 0xFF0000
+
+// Techdemo palette and pattern placement (see load_the_mall in examples/techdemo/src/main.c)
+#define THE_MALL_PALETTE_ID 0
+#define SCOTTY_PALETTE_ID 0
+#define SCOTTY_FRAME(state, frame) vram_pattern_addr(2*4*(state) + 2*(frame), 1)
+
+typedef struct {
+    const char *name;
+    void (*build)(ppu_model_t *ppu, const asset_pack_t *pack);
+} scene_t;
+
+typedef struct {
+    const char *name;
+    void (*render)(const ppu_model_t *ppu, uint32_t *frame);
+} renderer_t;
+
+static const char *the_mall_pattern_names[] = {
+    "1-grass-%u", "2-grass_angled-%u", "3-grass_horizontal-%u", "4-grass_corner-%u",
+    "5-grass_vertical-%u", "6-gravel", "7-pavement", "8-pink_bush_base-%u",
+    "9-pink_bush_branch-%u"
+};
+
+static const char *scotty_pattern_names[] = { "scotty_front", "scotty_back", "scotty_side" };
+
+static const void *need(const void *asset, const char *name)
+{
+    if (asset == NULL)
+    {
+        printf("Asset %s missing from %s!\n", name, GOLDEN_PACK_FILE);
+        exit(1);
+    }
+    return asset;
+}
+
+static void write_pattern(ppu_model_t *ppu, const asset_pack_t *pack, const char *name,
+                          unsigned width, unsigned height, pattern_addr_t pattern_addr)
+{
+    const pattern_t *pattern = need(asset_pack_pattern(pack, name, NULL, NULL), name);
+
+    for (unsigned y = 0; y < height; y++)
+    {
+        for (unsigned x = 0; x < width; x++)
+        {
+            pattern_addr_t addr = (((pattern_addr >> 5) + y) % PATTERNRAM_HEIGHT) << 5 |
+                                  ((pattern_addr + x) % PATTERNRAM_WIDTH);
+            ppu_model_write_vram(ppu, &pattern[y * width + x], sizeof(pattern_t),
+                                 vram_pattern_offset(addr));
+        }
+    }
+}
+
+static void write_sprite(ppu_model_t *ppu, unsigned id, pattern_addr_t pattern_addr,
+                         unsigned palette_id, mirror_e mirror, render_prio_e prio, unsigned x,
+                         unsigned y, unsigned width, unsigned height)
+{
+    sprite_t sprite = { pattern_addr, palette_id, mirror, prio, x, y, height, width };
+    uint32_t word = vram_sprite_word(&sprite);
+    uint8_t extra = vram_sprite_extra(&sprite);
+
+    ppu_model_write_vram(ppu, &word, sizeof(word), VRAM_SPRITESOFFSET + id * SPRITE_BSIZE);
+    ppu_model_write_vram(ppu, &extra, sizeof(extra), VRAM_SPRITESOFFSET + SPRRAM_EXTRAOFFSET + id);
+}
+
+// The techdemo's world, with its animated tiles showing animation frame @p anim_frame
+static void load_the_mall(ppu_model_t *ppu, const asset_pack_t *pack, unsigned anim_frame)
+{
+    char name[ASSET_PACK_NAMELEN];
+
+    ppu_model_init(ppu);
+
+    const tile_t *tiles = need(asset_pack_tilemap(pack, "the_mall", NULL, NULL), "the_mall");
+    ppu_model_write_vram(ppu, tiles, 64 * 64 * sizeof(tile_t), 0);
+
+    // the pink bush: 4 rows of 5 branch tiles, with the base tile at (50, 29)
+    tile_t branch = vram_tile(vram_pattern_addr(9, 0), THE_MALL_PALETTE_ID, MIRROR_NONE);
+    tile_t base = vram_tile(vram_pattern_addr(8, 0), THE_MALL_PALETTE_ID, MIRROR_NONE);
+    for (unsigned y = 26; y < 30; y++)
+    {
+        for (unsigned x = 48; x < 53; x++)
+        {
+            ppu_model_write_vram(ppu, &branch, sizeof(tile_t), vram_tile_offset(LAYER_FG, x, y));
+        }
+    }
+    ppu_model_write_vram(ppu, &base, sizeof(tile_t), vram_tile_offset(LAYER_FG, 50, 29));
+
+    const palette_t *the_mall = need(asset_pack_palette(pack, "the_mall"), "the_mall");
+    const palette_t *scotty = need(asset_pack_palette(pack, "scotty"), "scotty");
+    ppu_model_write_vram(ppu, the_mall, sizeof(palette_t),
+                         vram_palette_offset(LAYER_BG, THE_MALL_PALETTE_ID));
+    ppu_model_write_vram(ppu, the_mall, sizeof(palette_t),
+                         vram_palette_offset(LAYER_FG, THE_MALL_PALETTE_ID));
+    ppu_model_write_vram(ppu, scotty, sizeof(palette_t),
+                         vram_palette_offset(LAYER_SPR, SCOTTY_PALETTE_ID));
+
+    for (unsigned i = 0; i < 9; i++)
+    {
+        snprintf(name, sizeof(name), the_mall_pattern_names[i], anim_frame);
+        write_pattern(ppu, pack, name, 1, 1, vram_pattern_addr(i + 1, 0));
+    }
+    for (unsigned state = 0; state < 3; state++)
+    {
+        for (unsigned frame = 0; frame < 4; frame++)
+        {
+            snprintf(name, sizeof(name), "%s-%u", scotty_pattern_names[state], frame);
+            write_pattern(ppu, pack, name, 2, 2, SCOTTY_FRAME(state, frame));
+        }
+    }
+}
+
+// The techdemo's first frame
+static void scene_mall_start(ppu_model_t *ppu, const asset_pack_t *pack)
+{
+    load_the_mall(ppu, pack, 0);
+    write_sprite(ppu, 0, SCOTTY_FRAME(0, 0), SCOTTY_PALETTE_ID, MIRROR_NONE, PRIO_IN_MIDDLE,
+                 0, 0, 2, 2);
+}
+
+// Sprites of every priority around the foreground pink bush, overlapping each other
+static void scene_mall_bush(ppu_model_t *ppu, const asset_pack_t *pack)
+{
+    load_the_mall(ppu, pack, 1);
+    ppu_model_set_scroll(ppu, LAYER_BG, 256, 120);
+    ppu_model_set_scroll(ppu, LAYER_FG, 256, 120);
+    write_sprite(ppu, 0, SCOTTY_FRAME(2, 1), SCOTTY_PALETTE_ID, MIRROR_X, PRIO_IN_MIDDLE,
+                 140, 100, 2, 2);
+    write_sprite(ppu, 1, SCOTTY_FRAME(1, 2), SCOTTY_PALETTE_ID, MIRROR_NONE, PRIO_IN_FRONT,
+                 150, 96, 2, 2);
+    write_sprite(ppu, 2, SCOTTY_FRAME(0, 3), SCOTTY_PALETTE_ID, MIRROR_NONE, PRIO_IN_BACK,
+                 60, 60, 2, 2);
+    write_sprite(ppu, 3, SCOTTY_FRAME(2, 3), SCOTTY_PALETTE_ID, MIRROR_NONE, PRIO_IN_FRONT,
+                 120, 104, 2, 2);
+}
+
+// Independent layer scrolls that wrap around the tile layers, and sprites that wrap around or
+//   are clipped by the screen edges
+static void scene_wrap(ppu_model_t *ppu, const asset_pack_t *pack)
+{
+    load_the_mall(ppu, pack, 0);
+    ppu_model_set_scroll(ppu, LAYER_BG, 400, 380);
+    ppu_model_set_scroll(ppu, LAYER_FG, 300, 150);
+    write_sprite(ppu, 0, SCOTTY_FRAME(0, 0), SCOTTY_PALETTE_ID, MIRROR_XY, PRIO_IN_FRONT,
+                 500, 250, 4, 4);
+    write_sprite(ppu, 1, SCOTTY_FRAME(1, 0), SCOTTY_PALETTE_ID, MIRROR_NONE, PRIO_IN_FRONT,
+                 306, 120, 3, 1);
+    write_sprite(ppu, 2, SCOTTY_FRAME(2, 2), SCOTTY_PALETTE_ID, MIRROR_Y, PRIO_IN_MIDDLE,
+                 310, 230, 2, 2);
+    write_sprite(ppu, 3, vram_pattern_addr(31, 0), SCOTTY_PALETTE_ID, MIRROR_NONE, PRIO_IN_FRONT,
+                 200, 20, 2, 2);
+}
+
+// Background layer disabled over a background color, and sprites in every mirror mode, size and
+//   a second palette
+static void scene_layers(ppu_model_t *ppu, const asset_pack_t *pack)
+{
+    const palette_t *the_mall = need(asset_pack_palette(pack, "the_mall"), "the_mall");
+
+    load_the_mall(ppu, pack, 0);
+    ppu_model_write_vram(ppu, the_mall, sizeof(palette_t), vram_palette_offset(LAYER_SPR, 31));
+    ppu->layer_enable = LAYER_FG | LAYER_SPR;
+    ppu->bgcolor = 0x3050A0;
+    ppu_model_set_scroll(ppu, LAYER_FG, 284, 128);
+
+    for (unsigned i = 0; i < 16; i++)
+    {
+        unsigned palette_id = (i % 5 == 4) ? 31 : SCOTTY_PALETTE_ID;
+
+        write_sprite(ppu, 4 + i, SCOTTY_FRAME(i % 3, i % 4), palette_id, (mirror_e)(i % 4),
+                     (render_prio_e)(i % 3), 8 + 36 * (i % 8), 140 + 40 * (i / 8), 1 + i % 4,
+                     1 + (i / 4) % 4);
+    }
+}
+
+static const scene_t scenes[] = {
+    { "mall_start", scene_mall_start },
+    { "mall_bush", scene_mall_bush },
+    { "wrap", scene_wrap },
+    { "layers", scene_layers },
+};
+
+#define SCENE_COUNT (sizeof(scenes) / sizeof(scenes[0]))
+
+// The reference renderer comes first: it is the one used to update the golden images.
+static const renderer_t renderers[] = {
+    { "reference", ppu_model_render },
+    { "fast", ppu_model_render_fast },
+};
+
+#define RENDERER_COUNT (sizeof(renderers) / sizeof(renderers[0]))
+
+static int write_ppm(const char *path, const uint32_t *frame)
+{
+    FILE *fp;
+
+    if ((fp = fopen(path, "wb")) == NULL) return -1;
+
+    fprintf(fp, "P6\n%d %d\n255\n", PPU_SCREEN_WIDTH, PPU_SCREEN_HEIGHT);
+    for (unsigned i = 0; i < PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT; i++)
+    {
+        uint8_t rgb[3] = { frame[i] >> 16, frame[i] >> 8, frame[i] };
+        fwrite(rgb, 1, sizeof(rgb), fp);
+    }
+
+    return (fclose(fp) == 0) ? 0 : -1;
+}
+
+static int read_ppm(const char *path, uint32_t *frame)
+{
+    FILE *fp;
+    int width, height, maxval;
+    int result = -1;
+
+    if ((fp = fopen(path, "rb")) == NULL) return -1;
+
+    if (fscanf(fp, "P6 %d %d %d", &width, &height, &maxval) == 3 && fgetc(fp) != EOF &&
+        width == PPU_SCREEN_WIDTH && height == PPU_SCREEN_HEIGHT && maxval == 255)
+    {
+        uint8_t rgb[3];
+        unsigned i;
+
+        for (i = 0; i < PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT; i++)
+        {
+            if (fread(rgb, 1, sizeof(rgb), fp) != sizeof(rgb)) break;
+            frame[i] = (uint32_t)rgb[0] << 16 | (uint32_t)rgb[1] << 8 | rgb[2];
+        }
+        if (i == PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT) result = 0;
+    }
+
+    fclose(fp);
+    return result;
+}
+
+// Compares a scene rendered by @p renderer against its golden image. Returns the number of
+//   differing pixels, or -1 if the golden image could not be read.
+static long check_scene(const char *dir, const char *name, const char *renderer,
+                        const uint32_t *frame)
+{
+    static uint32_t golden[PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT];
+    static uint32_t diff[PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT];
+    char path[512];
+    long mismatches = 0;
+
+    snprintf(path, sizeof(path), "%s/%s.ppm", dir, name);
+    if (read_ppm(path, golden) == -1) return -1;
+
+    for (unsigned i = 0; i < PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT; i++)
+    {
+        // matching pixels are dimmed, so the differences stand out
+        diff[i] = (frame[i] == golden[i]) ? (golden[i] >> 2) & 0x3F3F3F : DIFF_COLOR;
+        mismatches += (frame[i] != golden[i]);
+    }
+
+    if (mismatches != 0)
+    {
+        snprintf(path, sizeof(path), "%s/%s-%s.actual.ppm", dir, name, renderer);
+        write_ppm(path, frame);
+        snprintf(path, sizeof(path), "%s/%s-%s.diff.ppm", dir, name, renderer);
+        write_ppm(path, diff);
+    }
+    return mismatches;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    static ppu_model_t ppu;
+    static uint32_t frame[PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT];
+    asset_pack_t pack;
+    int failed = 0;
+
+    if (argc != 3 || (strcmp(argv[1], "check") && strcmp(argv[1], "update") &&
+                      strcmp(argv[1], "bench")))
+    {
+        printf("Usage: %s check <golden dir> | update <golden dir> | bench <frames>\n", argv[0]);
+        return 2;
+    }
+
+    if (asset_pack_open(&pack, GOLDEN_PACK_FILE) == -1)
+    {
+        printf("Asset Pack %s Failed To Open!\n", GOLDEN_PACK_FILE);
+        return 2;
+    }
+    printf("Fast renderer: %s\n", ppu_model_fast_isa());
+
+    for (unsigned i = 0; i < SCENE_COUNT; i++)
+    {
+        scenes[i].build(&ppu, &pack);
+
+        if (strcmp(argv[1], "bench") == 0)
+        {
+            long frames = strtol(argv[2], NULL, 0);
+
+            for (unsigned r = 0; r < RENDERER_COUNT; r++)
+            {
+                uint64_t start = now_ns();
+
+                for (long n = 0; n < frames; n++) renderers[r].render(&ppu, frame);
+
+                double frame_ms = (frames > 0) ? (now_ns() - start) / 1e6 / frames : 0;
+                printf("%-12s %-10s %8.3f ms/frame (%.0fx real time)\n", scenes[i].name,
+                       renderers[r].name, frame_ms, (frame_ms > 0) ? (1000.0 / 60) / frame_ms : 0);
+            }
+            continue;
+        }
+
+        if (strcmp(argv[1], "update") == 0)
+        {
+            ppu_model_render(&ppu, frame);
+
+            char path[512];
+
+            snprintf(path, sizeof(path), "%s/%s.ppm", argv[2], scenes[i].name);
+            if (write_ppm(path, frame) == -1)
+            {
+                printf("%-12s FAILED to write %s\n", scenes[i].name, path);
+                failed = 1;
+            }
+            else
+            {
+                printf("%-12s updated\n", scenes[i].name);
+            }
+            continue;
+        }
+
+        for (unsigned r = 0; r < RENDERER_COUNT; r++)
+        {
+            renderers[r].render(&ppu, frame);
+
+            long mismatches = check_scene(argv[2], scenes[i].name, renderers[r].name, frame);
+            if (mismatches == -1)
+            {
+                printf("%-12s %-10s FAILED: no golden image in %s\n", scenes[i].name,
+                       renderers[r].name, argv[2]);
+                failed = 1;
+            }
+            else if (mismatches != 0)
+            {
+                printf("%-12s %-10s FAILED: %ld pixels differ (see %s/%s-%s.diff.ppm)\n",
+                       scenes[i].name, renderers[r].name, mismatches, argv[2], scenes[i].name,
+                       renderers[r].name);
+                failed = 1;
+            }
+            else
+            {
+                printf("%-12s %-10s ok\n", scenes[i].name, renderers[r].name);
+            }
+        }
+    }
+
+    asset_pack_close(&pack);
+    return failed;
+}
@@ -0,0 +1,175 @@
+/* Software reference model of the FP-GAme PPU. See ppu_model.h for the modeled behaviour.
+ *
+ * Frames are rendered one scanline at a time. Each layer is first rendered into its own line
+ *   buffer, with transparent pixels marked by PIXEL_CLEAR, and the line buffers are then composited
+ *   back to front. This is the reference implementation: it favours being obviously correct over
+ *   being fast, and faster renderers are checked against it.
+ */
+
+#include "ppu_model.h"
+#include "noway.h"
+
+#include <string.h>
+
+// Marks a transparent pixel in a layer's line buffer. Colors only use the low 24 bits.
+#define PIXEL_CLEAR 0x80000000u
+
+#define COLOR_MASK 0xFFFFFFu
+#define LAYER_PX 512 // Width and height (in pixels) of a tile layer
+#define SPRITE_WRAP_X 512
+#define SPRITE_WRAP_Y 256
+
+static inline uint16_t load16(const ppu_model_t *ppu, uint32_t offset)
+{
+    uint16_t value;
+
+    memcpy(&value, &ppu->vram[offset], sizeof(value));
+    return value;
+}
+
+static inline uint32_t load32(const ppu_model_t *ppu, uint32_t offset)
+{
+    uint32_t value;
+
+    memcpy(&value, &ppu->vram[offset], sizeof(value));
+    return value;
+}
+
+// Looks up color index @p index (1-15) of a palette, given the palette's color 1 offset
+static inline uint32_t palette_color(const ppu_model_t *ppu, uint32_t palette, unsigned index)
+{
+    return load32(ppu, palette + (index - 1) * sizeof(uint32_t)) & COLOR_MASK;
+}
+
+void ppu_model_init(ppu_model_t *ppu)
+{
+    nowaymsg(ppu == NULL, "PPU model is NULL!");
+
+    memset(ppu, 0, sizeof(*ppu));
+    ppu->layer_enable = LAYER_BG | LAYER_FG | LAYER_SPR;
+}
+
+void ppu_model_write_vram(ppu_model_t *ppu, const void *buf, size_t len, size_t offset)
+{
+    nowaymsg(ppu == NULL, "PPU model is NULL!");
+    nowaymsg(buf == NULL, "VRAM write buffer is NULL!");
+    nowaymsg(offset > VRAM_BSIZE || len > VRAM_BSIZE - offset, "VRAM write out of bounds!");
+
+    memcpy(&ppu->vram[offset], buf, len);
+}
+
+void ppu_model_set_scroll(ppu_model_t *ppu, layer_e tile_layer, unsigned scroll_x,
+                          unsigned scroll_y)
+{
+    nowaymsg(ppu == NULL, "PPU model is NULL!");
+    nowaymsg(tile_layer != LAYER_BG && tile_layer != LAYER_FG, "Only tile layers can scroll!");
+    nowaymsg(scroll_x >= LAYER_PX || scroll_y >= LAYER_PX, "Scroll out of range!");
+
+    ppu->scroll_x[tile_layer == LAYER_FG] = scroll_x;
+    ppu->scroll_y[tile_layer == LAYER_FG] = scroll_y;
+}
+
+// Renders scanline @p y of tile layer @p layer
+static void render_tile_line(const ppu_model_t *ppu, layer_e layer, unsigned y, uint32_t *line)
+{
+    unsigned fg = (layer == LAYER_FG);
+    unsigned layer_y = (y + ppu->scroll_y[fg]) % LAYER_PX;
+
+    for (unsigned x = 0; x < PPU_SCREEN_WIDTH; x++)
+    {
+        unsigned layer_x = (x + ppu->scroll_x[fg]) % LAYER_PX;
+        tile_t tile = load16(ppu, vram_tile_offset(layer, layer_x / 8, layer_y / 8));
+        unsigned mirror = tile & 0x3;
+        unsigned px = (mirror & MIRROR_X) ? 7 - layer_x % 8 : layer_x % 8;
+        unsigned py = (mirror & MIRROR_Y) ? 7 - layer_y % 8 : layer_y % 8;
+        uint32_t pxrow = load32(ppu, vram_pattern_offset(tile >> 6) + py * sizeof(uint32_t));
+        unsigned index = (pxrow >> (4 * px)) & 0xF;
+
+        line[x] = (index == 0) ? PIXEL_CLEAR :
+                  palette_color(ppu, vram_palette_offset(layer, (tile >> 2) & 0xF), index);
+    }
+}
+
+// Renders scanline @p y of the sprite layer, along with the priority of each opaque pixel
+static void render_sprite_line(const ppu_model_t *ppu, unsigned y, uint32_t *line, uint8_t *prio)
+{
+    for (unsigned x = 0; x < PPU_SCREEN_WIDTH; x++) line[x] = PIXEL_CLEAR;
+
+    // Draw from the highest id down, so that lower ids end up in front.
+    for (int id = SPRITE_MAXCOUNT - 1; id >= 0; id--)
+    {
+        uint32_t word = load32(ppu, VRAM_SPRITESOFFSET + id * SPRITE_BSIZE);
+        uint8_t extra = ppu->vram[VRAM_SPRITESOFFSET + SPRRAM_EXTRAOFFSET + id];
+        unsigned sprite_x = word & 0x1FF;
+        unsigned sprite_y = (word >> 9) & 0xFF;
+        unsigned palette_id = (word >> 17) & 0x1F;
+        pattern_addr_t pattern_addr = word >> 22;
+        unsigned mirror = extra >> 6;
+        unsigned height = 8 * (((extra >> 4) & 0x3) + 1);
+        unsigned width = 8 * (((extra >> 2) & 0x3) + 1);
+        uint32_t palette = vram_palette_offset(LAYER_SPR, palette_id);
+
+        unsigned v = (y + SPRITE_WRAP_Y - sprite_y) % SPRITE_WRAP_Y;
+        if (v >= height) continue;
+        if (mirror & MIRROR_Y) v = height - 1 - v;
+
+        for (unsigned u = 0; u < width; u++)
+        {
+            unsigned x = (sprite_x + u) % SPRITE_WRAP_X;
+            if (x >= PPU_SCREEN_WIDTH) continue;
+
+            unsigned su = (mirror & MIRROR_X) ? width - 1 - u : u;
+            pattern_addr_t addr = (((pattern_addr >> 5) + v / 8) % PATTERNRAM_HEIGHT) << 5 |
+                                  ((pattern_addr + su / 8) % PATTERNRAM_WIDTH);
+            uint32_t pxrow = load32(ppu, vram_pattern_offset(addr) + (v % 8) * sizeof(uint32_t));
+            unsigned index = (pxrow >> (4 * (su % 8))) & 0xF;
+
+            if (index == 0) continue;
+            line[x] = palette_color(ppu, palette, index);
+            prio[x] = extra & 0x3;
+        }
+    }
+}
+
+void ppu_model_render_line(const ppu_model_t *ppu, unsigned y, uint32_t *line)
+{
+    uint32_t bg[PPU_SCREEN_WIDTH];
+    uint32_t fg[PPU_SCREEN_WIDTH];
+    uint32_t spr[PPU_SCREEN_WIDTH];
+    uint8_t prio[PPU_SCREEN_WIDTH];
+
+    nowaymsg(ppu == NULL, "PPU model is NULL!");
+    nowaymsg(line == NULL, "Line buffer is NULL!");
+    nowaymsg(y >= PPU_SCREEN_HEIGHT, "Scanline out of range!");
+
+    for (unsigned x = 0; x < PPU_SCREEN_WIDTH; x++) bg[x] = fg[x] = spr[x] = PIXEL_CLEAR;
+
+    if (ppu->layer_enable & LAYER_BG) render_tile_line(ppu, LAYER_BG, y, bg);
+    if (ppu->layer_enable & LAYER_FG) render_tile_line(ppu, LAYER_FG, y, fg);
+    if (ppu->layer_enable & LAYER_SPR) render_sprite_line(ppu, y, spr, prio);
+
+    // Back to front: bgcolor, sprites in back, BG, sprites in the middle, FG, sprites in front.
+    for (unsigned x = 0; x < PPU_SCREEN_WIDTH; x++)
+    {
+        uint32_t color = ppu->bgcolor & COLOR_MASK;
+        unsigned sprite_prio = (spr[x] == PIXEL_CLEAR) ? 0 : prio[x];
+
+        if (spr[x] != PIXEL_CLEAR && sprite_prio == PRIO_IN_BACK) color = spr[x];
+        if (bg[x] != PIXEL_CLEAR) color = bg[x];
+        if (spr[x] != PIXEL_CLEAR && sprite_prio == PRIO_IN_MIDDLE) color = spr[x];
+        if (fg[x] != PIXEL_CLEAR) color = fg[x];
+        if (spr[x] != PIXEL_CLEAR && sprite_prio >= PRIO_IN_FRONT) color = spr[x];
+
+        line[x] = color;
+    }
+}
+
+void ppu_model_render(const ppu_model_t *ppu, uint32_t *frame)
+{
+    nowaymsg(frame == NULL, "Frame buffer is NULL!");
+
+    for (unsigned y = 0; y < PPU_SCREEN_HEIGHT; y++)
+    {
+        ppu_model_render_line(ppu, y, &frame[y * PPU_SCREEN_WIDTH]);
+    }
+}
@@ -0,0 +1,245 @@
+/* Fast, vectorized renderer for the PPU model. See ppu_model_render_fast in ppu_model.h.
+ *
+ * Instead of colors, each layer is rendered into a line of 16-bit color slots. A slot indexes a
+ *   1024-entry color table built once per frame from Palette RAM:
+ *     BG palettes  -> slots 0x000-0x0FF  (palette << 4 | color index)
+ *     FG palettes  -> slots 0x100-0x1FF
+ *     SPR palettes -> slots 0x200-0x3FF
+ *   A slot with color index 0 is transparent, and slot 0 itself holds the background color. That
+ *   way, decoding a pattern row is a nibble unpack plus one add, compositing is a handful of
+ *   compare/select operations on 8 slots at a time, and only the final pixel goes through the
+ *   color table.
+ *
+ * The vector helpers have SSE2 (any x86-64) and NEON versions, plus a plain C version which is
+ *   used on other targets or when built with PPU_MODEL_NO_SIMD. All versions produce the same
+ *   output as ppu_model_render, bit for bit.
+ */
+
+#include "ppu_model.h"
+#include "noway.h"
+
+#include <string.h>
+
+#if !defined(PPU_MODEL_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define PPU_MODEL_SSE2
+#elif !defined(PPU_MODEL_NO_SIMD) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PPU_MODEL_NEON
+#endif
+
+#define SLOT_FG 0x100
+#define SLOT_SPR 0x200
+#define SLOT_COUNT 0x400
+
+#define LAYER_TILES 64
+#define LINE_TILES (PPU_SCREEN_WIDTH / 8 + 1) // tiles touched by a scrolled line
+#define SPRITE_WRAP_X 512
+#define SPRITE_WRAP_Y 256
+
+static inline uint16_t load16(const ppu_model_t *ppu, uint32_t offset)
+{
+    uint16_t value;
+
+    memcpy(&value, &ppu->vram[offset], sizeof(value));
+    return value;
+}
+
+static inline uint32_t load32(const ppu_model_t *ppu, uint32_t offset)
+{
+    uint32_t value;
+
+    memcpy(&value, &ppu->vram[offset], sizeof(value));
+    return value;
+}
+
+// Reverses the order of the 8 pixels in a pattern row (horizontal mirroring)
+static inline uint32_t mirror_pxrow(uint32_t pxrow)
+{
+    pxrow = (pxrow >> 16) | (pxrow << 16);
+    pxrow = ((pxrow & 0x00FF00FFu) << 8) | ((pxrow >> 8) & 0x00FF00FFu);
+    return ((pxrow & 0x0F0F0F0Fu) << 4) | ((pxrow >> 4) & 0x0F0F0F0Fu);
+}
+
+// Unpacks the 8 pixels of a pattern row into 8 color slots, adding @p base to each
+static inline void unpack_pxrow(uint32_t pxrow, uint16_t base, uint16_t *slots)
+{
+#if defined(PPU_MODEL_SSE2)
+    // even pixels are in the low nibbles, odd pixels in the high nibbles; interleave them
+    __m128i even = _mm_cvtsi32_si128(pxrow & 0x0F0F0F0Fu);
+    __m128i odd = _mm_cvtsi32_si128((pxrow >> 4) & 0x0F0F0F0Fu);
+    __m128i index = _mm_unpacklo_epi8(_mm_unpacklo_epi8(even, odd), _mm_setzero_si128());
+    _mm_storeu_si128((__m128i *)slots, _mm_add_epi16(index, _mm_set1_epi16(base)));
+#elif defined(PPU_MODEL_NEON)
+    uint8x8_t even = vreinterpret_u8_u32(vdup_n_u32(pxrow & 0x0F0F0F0Fu));
+    uint8x8_t odd = vreinterpret_u8_u32(vdup_n_u32((pxrow >> 4) & 0x0F0F0F0Fu));
+    uint16x8_t index = vmovl_u8(vzip_u8(even, odd).val[0]);
+    vst1q_u16(slots, vaddq_u16(index, vdupq_n_u16(base)));
+#else
+    for (unsigned x = 0; x < 8; x++) slots[x] = base + ((pxrow >> (4 * x)) & 0xF);
+#endif
+}
+
+// Composites 8 pixels: each opaque slot of @p over replaces the slot in @p under
+static inline void composite8(uint16_t *under, const uint16_t *over)
+{
+#if defined(PPU_MODEL_SSE2)
+    __m128i u = _mm_loadu_si128((const __m128i *)under);
+    __m128i o = _mm_loadu_si128((const __m128i *)over);
+    __m128i clear = _mm_cmpeq_epi16(_mm_and_si128(o, _mm_set1_epi16(0xF)), _mm_setzero_si128());
+    _mm_storeu_si128((__m128i *)under, _mm_or_si128(_mm_and_si128(clear, u),
+                                                    _mm_andnot_si128(clear, o)));
+#elif defined(PPU_MODEL_NEON)
+    uint16x8_t u = vld1q_u16(under);
+    uint16x8_t o = vld1q_u16(over);
+    uint16x8_t opaque = vtstq_u16(o, vdupq_n_u16(0xF));
+    vst1q_u16(under, vbslq_u16(opaque, o, u));
+#else
+    for (unsigned x = 0; x < 8; x++)
+    {
+        if (over[x] & 0xF) under[x] = over[x];
+    }
+#endif
+}
+
+// Builds the color table for the current Palette RAM contents and background color
+static void build_colors(const ppu_model_t *ppu, uint32_t *colors)
+{
+    for (unsigned slot = 0; slot < SLOT_COUNT; slot++)
+    {
+        unsigned index = slot & 0xF;
+        uint32_t palette = (slot < SLOT_FG) ? vram_palette_offset(LAYER_BG, slot >> 4) :
+                           (slot < SLOT_SPR) ? vram_palette_offset(LAYER_FG, (slot >> 4) & 0xF) :
+                           vram_palette_offset(LAYER_SPR, (slot >> 4) & 0x1F);
+
+        colors[slot] = (index == 0) ? 0 :
+                       load32(ppu, palette + (index - 1) * sizeof(uint32_t)) & 0xFFFFFF;
+    }
+    colors[0] = ppu->bgcolor & 0xFFFFFF;
+}
+
+// Renders the visible part of scanline @p y of a tile layer into @p line
+static void render_tile_line(const ppu_model_t *ppu, layer_e layer, unsigned y, uint16_t *line)
+{
+    uint16_t tiles[LINE_TILES * 8];
+    unsigned fg = (layer == LAYER_FG);
+    unsigned layer_y = (y + ppu->scroll_y[fg]) % (LAYER_TILES * 8);
+    unsigned tile_x = ppu->scroll_x[fg] / 8;
+    uint16_t section = fg ? SLOT_FG : 0;
+
+    for (unsigned i = 0; i < LINE_TILES; i++)
+    {
+        tile_t tile = load16(ppu, vram_tile_offset(layer, (tile_x + i) % LAYER_TILES,
+                                                   layer_y / 8));
+        unsigned mirror = tile & 0x3;
+        unsigned py = (mirror & MIRROR_Y) ? 7 - layer_y % 8 : layer_y % 8;
+        uint32_t pxrow = load32(ppu, vram_pattern_offset(tile >> 6) + py * sizeof(uint32_t));
+
+        if (mirror & MIRROR_X) pxrow = mirror_pxrow(pxrow);
+        unpack_pxrow(pxrow, section | (((tile >> 2) & 0xF) << 4), &tiles[i * 8]);
+    }
+
+    memcpy(line, &tiles[ppu->scroll_x[fg] % 8], PPU_SCREEN_WIDTH * sizeof(uint16_t));
+}
+
+// Renders scanline @p y of the sprite layer into one line per render_prio_e. Each opaque sprite
+//   pixel ends up in exactly one of the lines.
+static void render_sprite_lines(const ppu_model_t *ppu, unsigned y,
+                                uint16_t lines[3][PPU_SCREEN_WIDTH])
+{
+    // Draw from the highest id down, so that lower ids end up in front.
+    for (int id = SPRITE_MAXCOUNT - 1; id >= 0; id--)
+    {
+        uint32_t word = load32(ppu, VRAM_SPRITESOFFSET + id * SPRITE_BSIZE);
+        uint8_t extra = ppu->vram[VRAM_SPRITESOFFSET + SPRRAM_EXTRAOFFSET + id];
+        unsigned sprite_x = word & 0x1FF;
+        unsigned sprite_y = (word >> 9) & 0xFF;
+        pattern_addr_t pattern_addr = word >> 22;
+        unsigned mirror = extra >> 6;
+        unsigned height = 8 * (((extra >> 4) & 0x3) + 1);
+        unsigned width = 8 * (((extra >> 2) & 0x3) + 1);
+        unsigned prio = (extra & 0x3) > PRIO_IN_FRONT ? PRIO_IN_FRONT : (extra & 0x3);
+        uint16_t base = SLOT_SPR | (((word >> 17) & 0x1F) << 4);
+        uint16_t slots[8];
+
+        unsigned v = (y + SPRITE_WRAP_Y - sprite_y) % SPRITE_WRAP_Y;
+        if (v >= height) continue;
+        if (mirror & MIRROR_Y) v = height - 1 - v;
+
+        for (unsigned tx = 0; tx < width / 8; tx++)
+        {
+            // pattern column of this 8-pixel span, counted from the sprite's unmirrored left edge
+            unsigned column = (mirror & MIRROR_X) ? width / 8 - 1 - tx : tx;
+            pattern_addr_t addr = (((pattern_addr >> 5) + v / 8) % PATTERNRAM_HEIGHT) << 5 |
+                                  ((pattern_addr + column) % PATTERNRAM_WIDTH);
+            uint32_t pxrow = load32(ppu, vram_pattern_offset(addr) + (v % 8) * sizeof(uint32_t));
+
+            if (pxrow == 0) continue;
+            if (mirror & MIRROR_X) pxrow = mirror_pxrow(pxrow);
+            unpack_pxrow(pxrow, base, slots);
+
+            for (unsigned u = 0; u < 8; u++)
+            {
+                unsigned x = (sprite_x + tx * 8 + u) % SPRITE_WRAP_X;
+                if (x >= PPU_SCREEN_WIDTH || (slots[u] & 0xF) == 0) continue;
+
+                lines[PRIO_IN_BACK][x] = lines[PRIO_IN_MIDDLE][x] = lines[PRIO_IN_FRONT][x] = 0;
+                lines[prio][x] = slots[u];
+            }
+        }
+    }
+}
+
+void ppu_model_render_fast(const ppu_model_t *ppu, uint32_t *frame)
+{
+    uint32_t colors[SLOT_COUNT];
+    uint16_t line[PPU_SCREEN_WIDTH];
+    uint16_t bg[PPU_SCREEN_WIDTH];
+    uint16_t fg[PPU_SCREEN_WIDTH];
+    uint16_t spr[3][PPU_SCREEN_WIDTH];
+
+    nowaymsg(ppu == NULL, "PPU model is NULL!");
+    nowaymsg(frame == NULL, "Frame buffer is NULL!");
+
+    build_colors(ppu, colors);
+
+    for (unsigned y = 0; y < PPU_SCREEN_HEIGHT; y++)
+    {
+        unsigned sprites = ppu->layer_enable & LAYER_SPR;
+
+        if (sprites)
+        {
+            memset(spr, 0, sizeof(spr));
+            render_sprite_lines(ppu, y, spr);
+        }
+        if (ppu->layer_enable & LAYER_BG) render_tile_line(ppu, LAYER_BG, y, bg);
+        if (ppu->layer_enable & LAYER_FG) render_tile_line(ppu, LAYER_FG, y, fg);
+
+        // Back to front: bgcolor, sprites in back, BG, sprites in the middle, FG, sprites in front.
+        //   An empty line of sprites in back is all slot 0, which is the background color.
+        if (sprites) memcpy(line, spr[PRIO_IN_BACK], sizeof(line));
+        else memset(line, 0, sizeof(line));
+
+        for (unsigned x = 0; x < PPU_SCREEN_WIDTH; x += 8)
+        {
+            if (ppu->layer_enable & LAYER_BG) composite8(&line[x], &bg[x]);
+            if (sprites) composite8(&line[x], &spr[PRIO_IN_MIDDLE][x]);
+            if (ppu->layer_enable & LAYER_FG) composite8(&line[x], &fg[x]);
+            if (sprites) composite8(&line[x], &spr[PRIO_IN_FRONT][x]);
+        }
+
+        uint32_t *out = &frame[y * PPU_SCREEN_WIDTH];
+        for (unsigned x = 0; x < PPU_SCREEN_WIDTH; x++) out[x] = colors[line[x]];
+    }
+}
+
+const char *ppu_model_fast_isa(void)
+{
+#if defined(PPU_MODEL_SSE2)
+    return "SSE2";
+#elif defined(PPU_MODEL_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
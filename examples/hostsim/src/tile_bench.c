@@ -0,0 +1,113 @@
+/* Micro-benchmark of the Tile RAM write functions of the host User Library.
+ *
+ * Writes full 64-tile rows with ppu_write_tiles_horizontal and full 64-tile columns with
+ *   ppu_write_tiles_vertical, starting at every position along the layer so that most writes wrap
+ *   around, and reports the time and the number of device operations (system calls on the
+ *   console) per write. Then checks that both functions repeat short buffers and wrap around as
+ *   documented in ppu.h.
+ *
+ * Usage (from examples/hostsim):
+ *   tile_bench <n>    Time n writes in each orientation.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "fpgame_emu.h"
+#include "fpgame_host.h"
+#include "vram_layout.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    const char *name;
+    int (*write)(const tile_t *tiles, unsigned len, layer_e layer, unsigned x_i, unsigned y_i,
+                 unsigned count);
+} orientation_t;
+
+static const orientation_t orientations[] = {
+    { "horizontal", ppu_write_tiles_horizontal },
+    { "vertical", ppu_write_tiles_vertical }
+};
+
+#define ORIENTATION_COUNT (sizeof(orientations) / sizeof(orientations[0]))
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Checks a displayed row (vertical = 0) or column (vertical = 1) written from tiles[len]
+static int check_line(const ppu_model_t *ppu, const tile_t *tiles, unsigned len, layer_e layer,
+                      unsigned x_i, unsigned y_i, unsigned count, int vertical)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        unsigned x = vertical ? x_i : (x_i + i) % TILELAYER_WIDTH;
+        unsigned y = vertical ? (y_i + i) % TILELAYER_HEIGHT : y_i;
+        tile_t tile;
+
+        memcpy(&tile, &ppu->vram[vram_tile_offset(layer, x, y)], sizeof(tile));
+        if (tile != tiles[i % len]) return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    tile_t tiles[TILELAYER_WIDTH];
+    long writes;
+    int failed = 0;
+
+    if (argc != 2 || (writes = strtol(argv[1], NULL, 0)) <= 0)
+    {
+        printf("Usage: %s <writes>\n", argv[0]);
+        return 2;
+    }
+
+    for (unsigned i = 0; i < TILELAYER_WIDTH; i++) tiles[i] = vram_tile(i, i % 16, i % 4);
+
+    ppu_enable();
+    for (unsigned o = 0; o < ORIENTATION_COUNT; o++)
+    {
+        fpgame_stats_t before, after;
+        uint64_t start = now_ns();
+
+        fpgame_total_stats(&before);
+        for (long n = 0; n < writes; n++)
+        {
+            unsigned pos = n % TILELAYER_WIDTH;
+            orientations[o].write(tiles, TILELAYER_WIDTH, LAYER_BG, pos, pos, TILELAYER_WIDTH);
+        }
+        fpgame_total_stats(&after);
+
+        printf("%-10s 64 tiles: %8.1f ns/write, %.2f device calls/write\n", orientations[o].name,
+               (double)(now_ns() - start) / writes,
+               (double)(after.ppu_calls - before.ppu_calls) / writes);
+    }
+
+    // A 5-tile buffer repeated over a whole row and column, both wrapping around the layer
+    ppu_write_tiles_horizontal(tiles, 5, LAYER_FG, 60, 9, TILELAYER_WIDTH);
+    ppu_write_tiles_vertical(tiles, 5, LAYER_BG, 7, 60, TILELAYER_HEIGHT);
+    ppu_update();
+    for (unsigned o = 0; o < ORIENTATION_COUNT; o++)
+    {
+        int vertical = (orientations[o].write == ppu_write_tiles_vertical);
+
+        if (!check_line(fpgame_emu_display(), tiles, 5, vertical ? LAYER_BG : LAYER_FG,
+                        vertical ? 7 : 60, vertical ? 60 : 9, TILELAYER_WIDTH, vertical))
+        {
+            printf("%-10s FAILED: tiles do not repeat or wrap around correctly\n",
+                   orientations[o].name);
+            failed = 1;
+        }
+    }
+    ppu_disable();
+
+    return failed;
+}
@@ -16,7 +16,7 @@ BINS = bins/scottybark.o
 override INC += src/inc usr/inc
 
 # Libraries to be linked to the binary.
-LIBS = -Lusr/ -lfpgame
+LIBS = -Lusr/ -lfpgame -lpthread
 
 # The compiler to be used and its C flags.
 CC = arm-none-linux-gnueabihf-gcc
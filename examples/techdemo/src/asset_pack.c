@@ -0,0 +1,189 @@
+/* Binary asset pack loader. See asset_pack.h for usage, and user_tools/pack_assets.py for the
+ *   file layout.
+ *
+ * The whole pack is validated once when it is opened (header, table of contents bounds and
+ *   payload sizes), so lookups can hand out pointers into the mapping without further checks.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "asset_pack.h"
+#include "noway.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PACK_VERSION 1
+#define PACK_ALIGN 32
+
+// Pack header, exactly as stored in the file
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t count;
+    uint32_t toc_offset;
+    uint32_t reserved;
+} pack_header_t;
+
+// Returns the payload size an entry must have, or 0 if its type is unknown. Compressed tilemaps
+//   have no fixed size, and only must not be empty.
+static size_t payload_size(const asset_pack_entry_t *entry)
+{
+    switch (entry->type)
+    {
+        case ASSET_TILEMAP: return (size_t)entry->width * entry->height * sizeof(tile_t);
+        case ASSET_PATTERN: return (size_t)entry->width * entry->height * sizeof(pattern_t);
+        case ASSET_PALETTE: return sizeof(palette_t);
+        case ASSET_CTILEMAP: return entry->size;
+        default: return 0;
+    }
+}
+
+// Orders table of contents entries by name, then type
+static int entry_order(const char *name, uint32_t type, const asset_pack_entry_t *entry)
+{
+    int order = strcmp(name, entry->name);
+
+    if (order != 0) return order;
+    return (type > entry->type) - (type < entry->type);
+}
+
+static int pack_valid(const uint8_t *base, size_t size)
+{
+    const pack_header_t *header = (const pack_header_t *)base;
+    const asset_pack_entry_t *toc;
+
+    if (size < sizeof(pack_header_t)) return 0;
+    if (memcmp(header->magic, "FPAK", 4) != 0 || header->version != PACK_VERSION) return 0;
+    if (header->toc_offset % sizeof(uint32_t) != 0 || header->toc_offset > size ||
+        (size - header->toc_offset) / sizeof(asset_pack_entry_t) < header->count) return 0;
+
+    toc = (const asset_pack_entry_t *)(base + header->toc_offset);
+    for (unsigned i = 0; i < header->count; i++)
+    {
+        const asset_pack_entry_t *entry = &toc[i];
+        size_t expected = payload_size(entry);
+
+        if (memchr(entry->name, '\0', ASSET_PACK_NAMELEN) == NULL) return 0;
+        if (i > 0 && entry_order(entry->name, entry->type, &toc[i - 1]) <= 0) return 0;
+        if (expected == 0 || entry->size != expected) return 0;
+        if (entry->offset % PACK_ALIGN != 0 || entry->offset > size ||
+            size - entry->offset < entry->size) return 0;
+    }
+
+    return 1;
+}
+
+int asset_pack_open(asset_pack_t *pack, const char *file)
+{
+    const pack_header_t *header;
+    struct stat st;
+    void *base;
+    int fd;
+
+    nowaymsg(pack == NULL, "Asset pack is NULL!");
+    nowaymsg(file == NULL, "Asset pack file name is NULL!");
+
+    if ((fd = open(file, O_RDONLY | O_CLOEXEC)) < 0) return -1;
+    if (fstat(fd, &st) < 0 || st.st_size == 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file alive
+    if (base == MAP_FAILED) return -1;
+
+    if (!pack_valid(base, st.st_size))
+    {
+        munmap(base, st.st_size);
+        return -1;
+    }
+
+    header = base;
+    pack->base = base;
+    pack->size = st.st_size;
+    pack->toc = (const asset_pack_entry_t *)(pack->base + header->toc_offset);
+    pack->count = header->count;
+    return 0;
+}
+
+void asset_pack_close(asset_pack_t *pack)
+{
+    nowaymsg(pack == NULL || pack->base == NULL, "Asset pack is not open!");
+
+    munmap((void *)pack->base, pack->size);
+    memset(pack, 0, sizeof(*pack));
+}
+
+// Lookup key for bsearch
+typedef struct {
+    const char *name;
+    uint32_t type;
+} entry_key_t;
+
+static int entry_cmp(const void *key, const void *entry)
+{
+    const entry_key_t *k = key;
+
+    return entry_order(k->name, k->type, entry);
+}
+
+const asset_pack_entry_t *asset_pack_find(const asset_pack_t *pack, const char *name,
+                                          asset_type_e type)
+{
+    entry_key_t key;
+
+    nowaymsg(pack == NULL || pack->base == NULL, "Asset pack is not open!");
+    nowaymsg(name == NULL, "Asset name is NULL!");
+
+    key.name = name;
+    key.type = type;
+    return bsearch(&key, pack->toc, pack->count, sizeof(asset_pack_entry_t), entry_cmp);
+}
+
+// Looks up an asset, returning a pointer to its payload and optionally its dimensions
+static const void *find_payload(const asset_pack_t *pack, const char *name, asset_type_e type,
+                                unsigned *width, unsigned *height)
+{
+    const asset_pack_entry_t *entry = asset_pack_find(pack, name, type);
+
+    if (entry == NULL) return NULL;
+    if (width != NULL) *width = entry->width;
+    if (height != NULL) *height = entry->height;
+    return pack->base + entry->offset;
+}
+
+const tile_t *asset_pack_tilemap(const asset_pack_t *pack, const char *name, unsigned *width,
+                                 unsigned *height)
+{
+    return find_payload(pack, name, ASSET_TILEMAP, width, height);
+}
+
+const void *asset_pack_ctilemap(const asset_pack_t *pack, const char *name, size_t *size)
+{
+    const asset_pack_entry_t *entry = asset_pack_find(pack, name, ASSET_CTILEMAP);
+
+    nowaymsg(size == NULL, "Size is NULL!");
+
+    if (entry == NULL) return NULL;
+    *size = entry->size;
+    return pack->base + entry->offset;
+}
+
+const pattern_t *asset_pack_pattern(const asset_pack_t *pack, const char *name, unsigned *width,
+                                    unsigned *height)
+{
+    return find_payload(pack, name, ASSET_PATTERN, width, height);
+}
+
+const palette_t *asset_pack_palette(const asset_pack_t *pack, const char *name)
+{
+    return find_payload(pack, name, ASSET_PALETTE, NULL, NULL);
+}
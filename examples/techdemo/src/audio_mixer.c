@@ -0,0 +1,354 @@
+/* Multi-voice software audio mixer. See audio_mixer.h for usage.
+ *
+ * The mixer thread keeps MIXER_QUEUE samples queued in the audio ring. Whenever a whole block has
+ *   been played, it mixes the next APU_BUF_MAX samples of every active voice (from memory, or from
+ *   an audio stream's prefetch window) into a 16-bit accumulator and narrows the result back to 8
+ *   bits with saturation. Voices are shared with the game thread under a mutex, which is only held
+ *   while one block is mixed.
+ *
+ * The vector helpers have SSE2 (any x86-64) and NEON versions, plus a plain C version which is
+ *   used on other targets or when built with AUDIO_MIXER_NO_SIMD. All versions produce the same
+ *   samples.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "apu_thread.h"
+#include "audio_mixer.h"
+#include "audio_ring.h"
+#include "noway.h"
+
+#include <fp-game/apu.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#if !defined(AUDIO_MIXER_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define AUDIO_MIXER_SSE2
+#elif !defined(AUDIO_MIXER_NO_SIMD) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define AUDIO_MIXER_NEON
+#endif
+
+// Samples kept queued ahead of the APU (32ms at 32KHz): one block playing, one block ready.
+#define MIXER_QUEUE (2 * APU_BUF_MAX)
+
+// How often the mixer thread checks whether a block was played (a quarter of a block).
+#define MIXER_POLL_NS (1000000000l / 4 * APU_BUF_MAX / APU_SAMPLE_RATE)
+
+// Handles are a play serial number and a voice index, so stale handles never match a new sound.
+#define HANDLE_SERIAL_MASK 0x7FFFFF
+
+#if APU_BUF_MAX % 16 != 0
+#error "APU_BUF_MAX must be a multiple of the vector size"
+#endif
+
+typedef struct {
+    const int8_t *samples;
+    size_t len;
+    audio_stream_t *stream; // plays the stream instead of samples if not NULL
+    size_t pos;         // next sample to be mixed
+    int16_t volume;
+    unsigned priority;
+    int loop;
+    int active;
+    uint32_t serial;    // order in which sounds were started
+    audio_voice_t handle;
+} voice_t;
+
+static voice_t voices[AUDIO_MIXER_VOICES];
+static uint32_t next_serial = 0;
+static pthread_mutex_t voice_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t mixer;
+static int mixer_running = 0; // cleared to stop the mixer thread
+static int mixer_enabled = 0;
+
+// Only used by the mixer thread
+static int16_t accum[APU_BUF_MAX];
+static int8_t block[APU_BUF_MAX];
+static int8_t stream_samples[APU_BUF_MAX];
+
+static int16_t clip16(int sample)
+{
+    return (sample < INT16_MIN) ? INT16_MIN : (sample > INT16_MAX) ? INT16_MAX : sample;
+}
+
+#if !defined(AUDIO_MIXER_SSE2) && !defined(AUDIO_MIXER_NEON)
+static int8_t clip8(int sample)
+{
+    return (sample < INT8_MIN) ? INT8_MIN : (sample > INT8_MAX) ? INT8_MAX : sample;
+}
+#endif
+
+// dst[i] += src[i] * volume / 256, saturating
+static void mix_samples(int16_t *dst, const int8_t *src, size_t n, int16_t volume)
+{
+    size_t i = 0;
+
+#if defined(AUDIO_MIXER_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vol = _mm_set1_epi16(volume);
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i *)&src[i]);
+        // sign-extend by unpacking into the high byte, then shifting back down
+        __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(zero, s), 8);
+        __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(zero, s), 8);
+        lo = _mm_srai_epi16(_mm_mullo_epi16(lo, vol), 8);
+        hi = _mm_srai_epi16(_mm_mullo_epi16(hi, vol), 8);
+        _mm_storeu_si128((__m128i *)&dst[i],
+                         _mm_adds_epi16(_mm_loadu_si128((const __m128i *)&dst[i]), lo));
+        _mm_storeu_si128((__m128i *)&dst[i + 8],
+                         _mm_adds_epi16(_mm_loadu_si128((const __m128i *)&dst[i + 8]), hi));
+    }
+#elif defined(AUDIO_MIXER_NEON)
+    for (; i + 16 <= n; i += 16)
+    {
+        int8x16_t s = vld1q_s8(&src[i]);
+        int16x8_t lo = vshrq_n_s16(vmulq_n_s16(vmovl_s8(vget_low_s8(s)), volume), 8);
+        int16x8_t hi = vshrq_n_s16(vmulq_n_s16(vmovl_s8(vget_high_s8(s)), volume), 8);
+        vst1q_s16(&dst[i], vqaddq_s16(vld1q_s16(&dst[i]), lo));
+        vst1q_s16(&dst[i + 8], vqaddq_s16(vld1q_s16(&dst[i + 8]), hi));
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        dst[i] = clip16(dst[i] + ((src[i] * volume) >> 8));
+    }
+}
+
+// Narrows the accumulated block to 8 bits, saturating. Blocks are a whole number of vectors.
+static void narrow_block(void)
+{
+#if defined(AUDIO_MIXER_SSE2)
+    for (size_t i = 0; i < APU_BUF_MAX; i += 16)
+    {
+        __m128i lo = _mm_loadu_si128((const __m128i *)&accum[i]);
+        __m128i hi = _mm_loadu_si128((const __m128i *)&accum[i + 8]);
+        _mm_storeu_si128((__m128i *)&block[i], _mm_packs_epi16(lo, hi));
+    }
+#elif defined(AUDIO_MIXER_NEON)
+    for (size_t i = 0; i < APU_BUF_MAX; i += 16)
+    {
+        vst1q_s8(&block[i], vcombine_s8(vqmovn_s16(vld1q_s16(&accum[i])),
+                                        vqmovn_s16(vld1q_s16(&accum[i + 8]))));
+    }
+#else
+    for (size_t i = 0; i < APU_BUF_MAX; i++)
+    {
+        block[i] = clip8(accum[i]);
+    }
+#endif
+}
+
+// Mixes the next APU_BUF_MAX samples of all voices into block
+static void mix_block(void)
+{
+    memset(accum, 0, sizeof(accum));
+
+    pthread_mutex_lock(&voice_lock);
+    for (unsigned i = 0; i < AUDIO_MIXER_VOICES; i++)
+    {
+        voice_t *v = &voices[i];
+        size_t done = 0;
+
+        if (v->active && v->stream != NULL)
+        {
+            // a stream which has fallen behind is silent for this block
+            int n = audio_stream_read(v->stream, stream_samples, APU_BUF_MAX);
+            if (n < 0) v->active = 0;
+            else mix_samples(accum, stream_samples, n, v->volume);
+            continue;
+        }
+
+        while (v->active && done < APU_BUF_MAX)
+        {
+            size_t n = v->len - v->pos;
+            if (n > APU_BUF_MAX - done) n = APU_BUF_MAX - done;
+
+            mix_samples(&accum[done], &v->samples[v->pos], n, v->volume);
+            done += n;
+            v->pos += n;
+
+            if (v->pos == v->len)
+            {
+                v->pos = 0;
+                v->active = v->loop;
+            }
+        }
+    }
+    pthread_mutex_unlock(&voice_lock);
+
+    narrow_block();
+}
+
+static void *mixer_thread(void *arg)
+{
+    const struct timespec poll = { 0, MIXER_POLL_NS };
+
+    (void)arg;
+
+    while (__atomic_load_n(&mixer_running, __ATOMIC_ACQUIRE))
+    {
+        while (AUDIO_RING_SIZE - audio_ring_space() + APU_BUF_MAX <= MIXER_QUEUE)
+        {
+            mix_block();
+            audio_ring_write(block, APU_BUF_MAX);
+        }
+        nanosleep(&poll, NULL);
+    }
+    return NULL;
+}
+
+// Looks up a playing sound. voice_lock must be held.
+static voice_t *find_voice(audio_voice_t voice)
+{
+    voice_t *v;
+
+    if (voice < 0) return NULL;
+
+    v = &voices[voice % AUDIO_MIXER_VOICES];
+    return (v->active && v->handle == voice) ? v : NULL;
+}
+
+int audio_mixer_enable(void)
+{
+    nowaymsg(mixer_enabled, "Audio mixer already enabled!");
+
+    memset(voices, 0, sizeof(voices));
+    if (audio_ring_enable() == -1) return -1;
+
+    __atomic_store_n(&mixer_running, 1, __ATOMIC_RELEASE);
+    if (thread_start_without_apu_signal(&mixer, mixer_thread, NULL) != 0)
+    {
+        audio_ring_disable();
+        return -1;
+    }
+
+    mixer_enabled = 1;
+    return 0;
+}
+
+void audio_mixer_disable(void)
+{
+    nowaymsg(!mixer_enabled, "Audio mixer not enabled!");
+
+    __atomic_store_n(&mixer_running, 0, __ATOMIC_RELEASE);
+    pthread_join(mixer, NULL);
+    audio_ring_disable();
+    mixer_enabled = 0;
+}
+
+// Claims a free voice, or steals the lowest priority sound, preferring the oldest among equals.
+//   Returns NULL if all voices play higher priority sounds. voice_lock must be held.
+static voice_t *claim_voice(unsigned priority)
+{
+    voice_t *v = NULL;
+
+    for (unsigned i = 0; i < AUDIO_MIXER_VOICES; i++)
+    {
+        voice_t *c = &voices[i];
+
+        if (!c->active) return c;
+        if (c->priority > priority) continue;
+        if (v == NULL || c->priority < v->priority ||
+            (c->priority == v->priority && (int32_t)(c->serial - v->serial) < 0))
+        {
+            v = c;
+        }
+    }
+    return v;
+}
+
+// Starts a claimed voice and returns its new handle. voice_lock must be held.
+static audio_voice_t start_voice(voice_t *v, unsigned volume, unsigned priority)
+{
+    v->pos = 0;
+    v->volume = volume;
+    v->priority = priority;
+    v->active = 1;
+    v->serial = next_serial++;
+    v->handle = (audio_voice_t)((v->serial & HANDLE_SERIAL_MASK) * AUDIO_MIXER_VOICES
+                                + (v - voices));
+    return v->handle;
+}
+
+audio_voice_t audio_mixer_play(const int8_t *samples, size_t len, unsigned volume,
+                               unsigned priority, int loop)
+{
+    voice_t *v;
+    audio_voice_t handle = -1;
+
+    nowaymsg(samples == NULL || len == 0, "Sound has no samples!");
+    nowaymsg(volume > AUDIO_MIXER_VOLUME_MAX, "Volume out of range!");
+
+    pthread_mutex_lock(&voice_lock);
+    if ((v = claim_voice(priority)) != NULL)
+    {
+        v->samples = samples;
+        v->len = len;
+        v->loop = loop;
+        v->stream = NULL;
+        handle = start_voice(v, volume, priority);
+    }
+    pthread_mutex_unlock(&voice_lock);
+
+    return handle;
+}
+
+audio_voice_t audio_mixer_play_stream(audio_stream_t *stream, unsigned volume, unsigned priority)
+{
+    voice_t *v;
+    audio_voice_t handle = -1;
+
+    nowaymsg(stream == NULL, "Audio stream is NULL!");
+    nowaymsg(volume > AUDIO_MIXER_VOLUME_MAX, "Volume out of range!");
+
+    pthread_mutex_lock(&voice_lock);
+    if ((v = claim_voice(priority)) != NULL)
+    {
+        v->samples = NULL;
+        v->len = 0;
+        v->loop = 0;
+        v->stream = stream;
+        handle = start_voice(v, volume, priority);
+    }
+    pthread_mutex_unlock(&voice_lock);
+
+    return handle;
+}
+
+void audio_mixer_stop(audio_voice_t voice)
+{
+    voice_t *v;
+
+    pthread_mutex_lock(&voice_lock);
+    if ((v = find_voice(voice)) != NULL) v->active = 0;
+    pthread_mutex_unlock(&voice_lock);
+}
+
+void audio_mixer_set_volume(audio_voice_t voice, unsigned volume)
+{
+    voice_t *v;
+
+    nowaymsg(volume > AUDIO_MIXER_VOLUME_MAX, "Volume out of range!");
+
+    pthread_mutex_lock(&voice_lock);
+    if ((v = find_voice(voice)) != NULL) v->volume = volume;
+    pthread_mutex_unlock(&voice_lock);
+}
+
+int audio_mixer_playing(audio_voice_t voice)
+{
+    int playing;
+
+    pthread_mutex_lock(&voice_lock);
+    playing = (find_voice(voice) != NULL);
+    pthread_mutex_unlock(&voice_lock);
+
+    return playing;
+}
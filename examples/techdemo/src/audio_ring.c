@@ -0,0 +1,93 @@
+/* Lock-free audio ring. See audio_ring.h for usage.
+ *
+ * head and tail are free-running sample counters: the producer only advances head, the consumer
+ *   (the APU callback) only advances tail, and head - tail is the number of queued samples. Each
+ *   side publishes its counter with a release store after touching the samples, and reads the
+ *   other side's counter with an acquire load, so a sample is never read before it was written or
+ *   overwritten before it was read.
+ *
+ * The callback copies the samples out of the ring into its own buffer before advancing tail,
+ *   since the APU driver reads the buffer after the callback has returned.
+ */
+
+#include "audio_ring.h"
+#include "noway.h"
+
+#include <fp-game/apu.h>
+
+#include <string.h>
+
+#define RING_MASK (AUDIO_RING_SIZE - 1)
+
+#if (AUDIO_RING_SIZE & RING_MASK) != 0
+#error "AUDIO_RING_SIZE must be a power of two"
+#endif
+
+static int8_t ring[AUDIO_RING_SIZE];
+static uint32_t head = 0; // written by the producer only
+static uint32_t tail = 0; // written by the APU callback only
+static int ring_enabled = 0;
+
+// Runs in the SIGRTMAX handler: only touches the ring, its counters and a static buffer.
+static void ring_callback(const int8_t **buf, int *buf_size)
+{
+    static int8_t out[APU_BUF_MAX];
+    uint32_t t = tail;
+    uint32_t n = __atomic_load_n(&head, __ATOMIC_ACQUIRE) - t;
+    uint32_t first;
+
+    if (n > APU_BUF_MAX) n = APU_BUF_MAX;
+    first = AUDIO_RING_SIZE - (t & RING_MASK);
+    if (first > n) first = n;
+
+    memcpy(out, &ring[t & RING_MASK], first);
+    memcpy(&out[first], ring, n - first);
+    __atomic_store_n(&tail, t + n, __ATOMIC_RELEASE);
+
+    *buf = out;
+    *buf_size = n;
+}
+
+int audio_ring_enable(void)
+{
+    nowaymsg(ring_enabled, "Audio ring already enabled!");
+
+    head = tail = 0;
+    if (apu_enable(ring_callback) == -1) return -1;
+
+    ring_enabled = 1;
+    return 0;
+}
+
+void audio_ring_disable(void)
+{
+    nowaymsg(!ring_enabled, "Audio ring not enabled!");
+
+    apu_disable();
+    ring_enabled = 0;
+}
+
+size_t audio_ring_space(void)
+{
+    return AUDIO_RING_SIZE - (head - __atomic_load_n(&tail, __ATOMIC_ACQUIRE));
+}
+
+size_t audio_ring_write(const int8_t *samples, size_t len)
+{
+    uint32_t h = head;
+    size_t space = AUDIO_RING_SIZE - (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE));
+    size_t first;
+
+    nowaymsg(samples == NULL && len != 0, "Samples are NULL!");
+
+    if (len > space) len = space;
+    if (len == 0) return 0;
+    first = AUDIO_RING_SIZE - (h & RING_MASK);
+    if (first > len) first = len;
+
+    memcpy(&ring[h & RING_MASK], samples, first);
+    memcpy(ring, &samples[first], len - first);
+    __atomic_store_n(&head, h + (uint32_t)len, __ATOMIC_RELEASE);
+
+    return len;
+}
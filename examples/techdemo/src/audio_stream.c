@@ -0,0 +1,205 @@
+/* IMA-ADPCM audio streaming. See audio_stream.h for usage, and user_tools/pcm_to_adpcm.py for the
+ *   file layout.
+ *
+ * The window is a ring of decoded samples with free-running head and tail counters, like the
+ *   audio ring: the reader only advances head, the player only advances tail. The reader decodes
+ *   a whole block whenever the window has room for one, and otherwise sleeps.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "apu_thread.h"
+#include "audio_stream.h"
+#include "noway.h"
+
+#include <fp-game/apu.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ADPCM_VERSION 1
+#define BLOCK_HEADER_SIZE 4
+#define WINDOW_MASK (AUDIO_STREAM_WINDOW - 1)
+
+#if (AUDIO_STREAM_WINDOW & WINDOW_MASK) != 0
+#error "AUDIO_STREAM_WINDOW must be a power of two"
+#endif
+
+#if AUDIO_STREAM_BLOCK_MAX > AUDIO_STREAM_WINDOW
+#error "AUDIO_STREAM_WINDOW must hold at least one block"
+#endif
+
+// How often the reader checks for room in the window (an eighth of the window).
+#define READER_POLL_NS (1000000000l / 8 * AUDIO_STREAM_WINDOW / APU_SAMPLE_RATE)
+
+// File header, exactly as stored in the file
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t block_samples;
+    uint32_t sample_count;
+    uint32_t reserved;
+} adpcm_header_t;
+
+static const int16_t step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66,
+    73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449,
+    494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272,
+    2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493,
+    10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t index_table[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static size_t block_size(uint32_t block_samples)
+{
+    return BLOCK_HEADER_SIZE + block_samples / 2;
+}
+
+// Decodes the first n samples of a block, keeping the top 8 bits of each predicted sample
+static void decode_block(const uint8_t *block, int8_t *pcm, uint32_t n)
+{
+    int predictor = (int16_t)(block[0] | block[1] << 8);
+    int index = (block[2] < 89) ? block[2] : 88;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        unsigned code = (block[BLOCK_HEADER_SIZE + i / 2] >> ((i & 1) * 4)) & 0xF;
+        int step = step_table[index];
+        int diff = step >> 3;
+
+        if (code & 1) diff += step >> 2;
+        if (code & 2) diff += step >> 1;
+        if (code & 4) diff += step;
+        predictor += (code & 8) ? -diff : diff;
+        predictor = (predictor < INT16_MIN) ? INT16_MIN : (predictor > INT16_MAX) ? INT16_MAX
+                                                                                    : predictor;
+
+        index += index_table[code & 7];
+        index = (index < 0) ? 0 : (index > 88) ? 88 : index;
+
+        pcm[i] = (int8_t)(predictor >> 8);
+    }
+}
+
+// Reads and decodes the next block into the window, using the reader's block and pcm buffers.
+//   Returns 0 at the end of the file or on error.
+static int decode_next_block(audio_stream_t *stream, uint8_t *block, int8_t *pcm)
+{
+    size_t size = block_size(stream->block_samples);
+    off_t offset = sizeof(adpcm_header_t) + (off_t)stream->next_block * size;
+    uint32_t first_sample = stream->next_block * stream->block_samples;
+    uint32_t n = stream->sample_count - first_sample;
+    uint32_t h = stream->head;
+    uint32_t first;
+
+    if (n > stream->block_samples) n = stream->block_samples;
+    if (pread(stream->fd, block, size, offset) != (ssize_t)size) return 0;
+    decode_block(block, pcm, n);
+
+    first = AUDIO_STREAM_WINDOW - (h & WINDOW_MASK);
+    if (first > n) first = n;
+    memcpy(&stream->window[h & WINDOW_MASK], pcm, first);
+    memcpy(stream->window, &pcm[first], n - first);
+    __atomic_store_n(&stream->head, h + n, __ATOMIC_RELEASE);
+
+    if (++stream->next_block < stream->block_count) return 1;
+    stream->next_block = 0;
+    return stream->loop;
+}
+
+static void *reader_thread(void *arg)
+{
+    const struct timespec poll = { 0, READER_POLL_NS };
+    audio_stream_t *stream = arg;
+    uint8_t block[BLOCK_HEADER_SIZE + AUDIO_STREAM_BLOCK_MAX / 2];
+    int8_t pcm[AUDIO_STREAM_BLOCK_MAX];
+
+    while (__atomic_load_n(&stream->running, __ATOMIC_ACQUIRE))
+    {
+        uint32_t queued = stream->head - __atomic_load_n(&stream->tail, __ATOMIC_ACQUIRE);
+
+        if (AUDIO_STREAM_WINDOW - queued < stream->block_samples)
+        {
+            nanosleep(&poll, NULL);
+        }
+        else if (!decode_next_block(stream, block, pcm))
+        {
+            __atomic_store_n(&stream->finished, 1, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+    return NULL;
+}
+
+int audio_stream_open(audio_stream_t *stream, const char *file, int loop)
+{
+    adpcm_header_t header;
+    struct stat st;
+
+    nowaymsg(stream == NULL, "Audio stream is NULL!");
+    nowaymsg(file == NULL, "Audio stream file name is NULL!");
+
+    memset(stream, 0, sizeof(*stream));
+    if ((stream->fd = open(file, O_RDONLY | O_CLOEXEC)) < 0) return -1;
+
+    if (fstat(stream->fd, &st) < 0 ||
+        pread(stream->fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, "FADP", 4) != 0 || header.version != ADPCM_VERSION ||
+        header.block_samples == 0 || header.block_samples % 2 != 0 ||
+        header.block_samples > AUDIO_STREAM_BLOCK_MAX || header.sample_count == 0)
+    {
+        close(stream->fd);
+        return -1;
+    }
+
+    stream->loop = loop;
+    stream->sample_count = header.sample_count;
+    stream->block_samples = header.block_samples;
+    stream->block_count = (header.sample_count + header.block_samples - 1) / header.block_samples;
+    if ((st.st_size - sizeof(header)) / block_size(header.block_samples) < stream->block_count)
+    {
+        close(stream->fd);
+        return -1;
+    }
+
+    stream->running = 1;
+    if (thread_start_without_apu_signal(&stream->reader, reader_thread, stream) != 0)
+    {
+        close(stream->fd);
+        return -1;
+    }
+    return 0;
+}
+
+void audio_stream_close(audio_stream_t *stream)
+{
+    nowaymsg(stream == NULL || !stream->running, "Audio stream is not open!");
+
+    __atomic_store_n(&stream->running, 0, __ATOMIC_RELEASE);
+    pthread_join(stream->reader, NULL);
+    close(stream->fd);
+    memset(stream, 0, sizeof(*stream));
+}
+
+int audio_stream_read(audio_stream_t *stream, int8_t *samples, size_t len)
+{
+    int finished = __atomic_load_n(&stream->finished, __ATOMIC_ACQUIRE);
+    uint32_t t = stream->tail;
+    uint32_t n = __atomic_load_n(&stream->head, __ATOMIC_ACQUIRE) - t;
+    uint32_t first;
+
+    if (n == 0 && finished) return -1;
+    if (n > len) n = len;
+    first = AUDIO_STREAM_WINDOW - (t & WINDOW_MASK);
+    if (first > n) first = n;
+
+    memcpy(samples, &stream->window[t & WINDOW_MASK], first);
+    memcpy(&samples[first], stream->window, n - first);
+    __atomic_store_n(&stream->tail, t + n, __ATOMIC_RELEASE);
+
+    return n;
+}
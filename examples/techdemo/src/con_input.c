@@ -0,0 +1,200 @@
+/* Background controller sampling. See con_input.h for usage.
+ *
+ * The sampler thread wakes at absolute deadlines, so its rate does not drift with the time a read
+ *   takes. It only queues an event once the ring has room, and only then treats the new state as
+ *   published: if the ring is full, the next sample compares against the last queued state again,
+ *   and the change goes out (merged with any later ones) as soon as the game catches up.
+ *
+ * head and tail are free-running event counters, published with release stores and read with
+ *   acquire loads, as in audio_ring.c.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "apu_thread.h"
+#include "con_input.h"
+#include "noway.h"
+
+#include <fp-game/con.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#define QUEUE_MASK (CON_INPUT_QUEUE_SIZE - 1)
+#define RATE_MAX 100000
+
+#if (CON_INPUT_QUEUE_SIZE & QUEUE_MASK) != 0
+#error "CON_INPUT_QUEUE_SIZE must be a power of two"
+#endif
+
+static con_event_t queue[CON_INPUT_QUEUE_SIZE];
+static uint32_t head = 0; // written by the sampler only
+static uint32_t tail = 0; // written by the game only
+static uint64_t dropped = 0;
+static int read_failed = 0;
+static int sampler_failed = 0;  // set if the sampler thread stopped on an error
+
+static pthread_t sampler;
+static int sampler_running = 0; // cleared to stop the sampler thread
+static int input_enabled = 0;
+static uint64_t period_ns;
+static int sampled_state;       // last state queued, only used by the sampler after enabling
+
+// Only used by the game thread
+static con_event_t frame_events[CON_INPUT_QUEUE_SIZE];
+static unsigned frame_event_count = 0;
+static int state;
+static int pressed = 0;
+static int released = 0;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sample(void)
+{
+    int s = get_con_state();
+    uint32_t h = head;
+    con_event_t *event;
+
+    if (s < 0)
+    {
+        __atomic_store_n(&read_failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (s == sampled_state) return;
+    if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == CON_INPUT_QUEUE_SIZE)
+    {
+        __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    event = &queue[h & QUEUE_MASK];
+    event->timestamp_ns = now_ns();
+    event->changed = (uint16_t)(s ^ sampled_state);
+    event->state = (uint16_t)s;
+    __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+    sampled_state = s;
+}
+
+static void *sampler_thread(void *arg)
+{
+    uint64_t deadline = now_ns();
+
+    (void)arg;
+
+    while (__atomic_load_n(&sampler_running, __ATOMIC_ACQUIRE))
+    {
+        struct timespec ts;
+        uint64_t now;
+        int result;
+
+        deadline += period_ns;
+        // after a stall (e.g. the process was stopped), restart from now instead of catching up
+        if ((now = now_ns()) > deadline + period_ns) deadline = now;
+
+        ts.tv_sec = deadline / 1000000000ull;
+        ts.tv_nsec = deadline % 1000000000ull;
+        while ((result = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) == EINTR)
+        {
+        }
+        if (result != 0)
+        {
+            __atomic_store_n(&sampler_failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        sample();
+    }
+    return NULL;
+}
+
+int con_input_enable(unsigned rate_hz)
+{
+    nowaymsg(input_enabled, "Controller input already enabled!");
+    nowaymsg(rate_hz == 0 || rate_hz > RATE_MAX, "Controller sample rate out of range!");
+
+    if ((state = get_con_state()) < 0) return -1;
+
+    sampled_state = state;
+    head = tail = 0;
+    dropped = 0;
+    read_failed = 0;
+    sampler_failed = 0;
+    frame_event_count = 0;
+    pressed = released = 0;
+    period_ns = 1000000000ull / rate_hz;
+
+    __atomic_store_n(&sampler_running, 1, __ATOMIC_RELEASE);
+    if (thread_start_without_apu_signal(&sampler, sampler_thread, NULL) != 0) return -1;
+
+    input_enabled = 1;
+    return 0;
+}
+
+void con_input_disable(void)
+{
+    nowaymsg(!input_enabled, "Controller input not enabled!");
+
+    __atomic_store_n(&sampler_running, 0, __ATOMIC_RELEASE);
+    pthread_join(sampler, NULL);
+    input_enabled = 0;
+}
+
+int con_input_update(void)
+{
+    uint32_t t = tail;
+    uint32_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+
+    nowaymsg(!input_enabled, "Controller input not enabled!");
+
+    frame_event_count = 0;
+    pressed = released = 0;
+    for (; t != h; t++)
+    {
+        const con_event_t *event = &queue[t & QUEUE_MASK];
+
+        frame_events[frame_event_count++] = *event;
+        // active low: a changed bit which is now 0 was pressed
+        pressed |= event->changed & ~event->state;
+        released |= event->changed & event->state;
+        state = event->state;
+    }
+    __atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+
+    if (__atomic_exchange_n(&read_failed, 0, __ATOMIC_RELAXED)) return -1;
+    if (__atomic_load_n(&sampler_failed, __ATOMIC_RELAXED)) return -1;
+    return frame_event_count;
+}
+
+int con_input_state(void)
+{
+    return state;
+}
+
+int con_input_pressed_this_frame(int buttons)
+{
+    return (pressed & buttons) != 0;
+}
+
+int con_input_released_this_frame(int buttons)
+{
+    return (released & buttons) != 0;
+}
+
+unsigned con_input_events(const con_event_t **events)
+{
+    nowaymsg(events == NULL, "Events is NULL!");
+
+    *events = frame_events;
+    return frame_event_count;
+}
+
+uint64_t con_input_dropped(void)
+{
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,178 @@
+/* Compressed tilemap decoding. See ctilemap.h for usage, and user_tools/compress_tilemap.py for
+ *   the file layout.
+ *
+ * ctilemap_open decodes every row of metatiles once to check that it holds exactly one index per
+ *   metatile column, each within the dictionary, and ends where the row table says. Decoding can
+ *   then follow the runs without any bounds checks.
+ *
+ * Both kinds of run cover (c & 0x7F) + 1 metatiles: c + 1 literals for c < 0x80, and c - 0x7F
+ *   repeats otherwise.
+ */
+
+#include "ctilemap.h"
+#include "noway.h"
+#include "vram_batch.h"
+#include "vram_layout.h"
+
+#include <string.h>
+
+#define CTILEMAP_VERSION 1
+#define HEADER_BSIZE 16
+#define REPEAT_RUN 0x80
+
+// The file is little-endian and not aligned for wider loads, so fields are read a byte at a time
+static unsigned read_u16(const uint8_t *p)
+{
+    return p[0] | (unsigned)p[1] << 8;
+}
+
+static uint32_t read_u32(const uint8_t *p)
+{
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static unsigned read_index(const ctilemap_t *map, const uint8_t *p)
+{
+    return (map->index_size == 1) ? p[0] : read_u16(p);
+}
+
+// Bytes taken by the indices of a run after its control byte
+static size_t run_bsize(const ctilemap_t *map, unsigned control)
+{
+    return (control & REPEAT_RUN) ? map->index_size : ((control & 0x7F) + 1) * map->index_size;
+}
+
+// Checks that runs [p, end) decode to exactly grid_width valid indices
+static int row_valid(const ctilemap_t *map, const uint8_t *p, const uint8_t *end,
+                     unsigned grid_width)
+{
+    unsigned count = 0;
+
+    while (p < end)
+    {
+        unsigned control = *p++;
+        size_t len = run_bsize(map, control);
+
+        if ((size_t)(end - p) < len) return 0;
+        for (size_t i = 0; i < len; i += map->index_size)
+        {
+            if (read_index(map, p + i) >= map->dict_count) return 0;
+        }
+        count += (control & 0x7F) + 1;
+        p += len;
+    }
+    return count == grid_width;
+}
+
+int ctilemap_open(ctilemap_t *map, const void *data, size_t size)
+{
+    const uint8_t *base = data;
+    unsigned grid_width, grid_height;
+    size_t dict_bsize, table_bsize, runs_bsize;
+
+    nowaymsg(map == NULL, "Compressed tilemap is NULL!");
+    nowaymsg(data == NULL, "Compressed tilemap data is NULL!");
+
+    if (size < HEADER_BSIZE) return -1;
+    if (memcmp(base, "FPTM", 4) != 0 || read_u16(base + 4) != CTILEMAP_VERSION) return -1;
+
+    map->width = read_u16(base + 6);
+    map->height = read_u16(base + 8);
+    map->block = base[10];
+    map->index_size = base[11];
+    map->dict_count = read_u16(base + 12);
+    if (map->width == 0 || map->height == 0 || map->dict_count == 0) return -1;
+    if (map->block != 1 && map->block != 2 && map->block != 4) return -1;
+    if (map->index_size != 1 && map->index_size != 2) return -1;
+
+    grid_width = (map->width + map->block - 1) / map->block;
+    grid_height = (map->height + map->block - 1) / map->block;
+    dict_bsize = (size_t)map->dict_count * map->block * map->block * sizeof(tile_t);
+    table_bsize = ((size_t)grid_height + 1) * sizeof(uint32_t);
+    if (size - HEADER_BSIZE < dict_bsize + table_bsize) return -1;
+
+    map->dict = base + HEADER_BSIZE;
+    map->row_table = map->dict + dict_bsize;
+    map->runs = map->row_table + table_bsize;
+    runs_bsize = size - HEADER_BSIZE - dict_bsize - table_bsize;
+
+    for (unsigned by = 0; by < grid_height; by++)
+    {
+        uint32_t start = read_u32(map->row_table + by * sizeof(uint32_t));
+        uint32_t end = read_u32(map->row_table + (by + 1) * sizeof(uint32_t));
+
+        if (start > end || end > runs_bsize) return -1;
+        if (!row_valid(map, map->runs + start, map->runs + end, grid_width)) return -1;
+    }
+    return 0;
+}
+
+// Copies the part of metatile column bx's tile row which falls within [x, x + count)
+static void copy_block_row(const ctilemap_t *map, unsigned index, unsigned row, unsigned bx,
+                           unsigned x, unsigned count, tile_t *tiles)
+{
+    unsigned start = MAX(bx * map->block, x);
+    unsigned end = MIN((bx + 1) * map->block, x + count);
+    const uint8_t *src = map->dict + ((index * map->block + row) * map->block +
+                                      (start - bx * map->block)) * sizeof(tile_t);
+
+    memcpy(&tiles[start - x], src, (end - start) * sizeof(tile_t));
+}
+
+void ctilemap_decode_row(const ctilemap_t *map, unsigned x, unsigned y, unsigned count,
+                         tile_t *tiles)
+{
+    const uint8_t *p;
+    unsigned first, last, row;
+    unsigned bx = 0;
+
+    nowaymsg(map == NULL || map->dict == NULL, "Compressed tilemap is not open!");
+    nowaymsg(tiles == NULL, "Tile array is NULL!");
+    nowaymsg(count == 0, "Tile count cannot be 0!");
+    nowaymsg(x >= map->width || count > map->width - x || y >= map->height,
+             "Tile row out of bounds!");
+
+    p = map->runs + read_u32(map->row_table + (y / map->block) * sizeof(uint32_t));
+    row = y % map->block;
+    first = x / map->block;
+    last = (x + count - 1) / map->block;
+
+    while (bx <= last)
+    {
+        unsigned control = *p++;
+        unsigned len = (control & 0x7F) + 1;
+
+        // runs entirely left of the span are only skipped
+        if (bx + len > first)
+        {
+            for (unsigned i = MAX(bx, first) - bx; i < len && bx + i <= last; i++)
+            {
+                const uint8_t *index = (control & REPEAT_RUN) ? p : p + i * map->index_size;
+
+                copy_block_row(map, read_index(map, index), row, bx + i, x, count, tiles);
+            }
+        }
+        bx += len;
+        p += run_bsize(map, control);
+    }
+}
+
+void ctilemap_write_layer(const ctilemap_t *map, layer_e layer, unsigned x, unsigned y,
+                          unsigned width, unsigned height)
+{
+    tile_t row[TILELAYER_WIDTH];
+
+    nowaymsg(map == NULL || map->dict == NULL, "Compressed tilemap is not open!");
+    nowaymsg(layer != LAYER_BG && layer != LAYER_FG, "Layer must be LAYER_BG or LAYER_FG!");
+    nowaymsg(width == 0 || width > TILELAYER_WIDTH || height == 0 || height > TILELAYER_HEIGHT,
+             "Rectangle must be 1x1 to 64x64 tiles!");
+    nowaymsg(x >= map->width || width > map->width - x || y >= map->height ||
+             height > map->height - y, "Rectangle out of bounds!");
+
+    for (unsigned i = 0; i < height; i++)
+    {
+        ctilemap_decode_row(map, x, y + i, width, row);
+        vram_batch_tiles_horizontal(row, width, layer, x % TILELAYER_WIDTH,
+                                    (y + i) % TILELAYER_HEIGHT, width);
+    }
+}
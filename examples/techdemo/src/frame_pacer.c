@@ -0,0 +1,160 @@
+/* Frame pacer. See frame_pacer.h for usage.
+ *
+ * The PPU accepts a new frame once per VBLANK. A successful update therefore marks (within the
+ *   time it takes to poll) the start of a frame period, and the next update cannot succeed before
+ *   one period has passed. The pacer arms a CLOCK_MONOTONIC timerfd for shortly before that point,
+ *   and falls back to short retry intervals if the PPU is still busy when the timer fires.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "frame_pacer.h"
+#include "noway.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+// How early to wake up before the predicted frame boundary, to absorb scheduler latency
+#define FRAME_WAKE_EARLY_NS 1000000
+
+// How long to sleep between retries while the PPU is still busy
+#define FRAME_RETRY_NS 250000
+
+static int pacer_fd = -1;
+static frame_info_t pacer_info; // written by the presenting thread only, read from any thread
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Arms the timer to fire at the absolute CLOCK_MONOTONIC time t_ns
+static void arm_at(uint64_t t_ns)
+{
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = t_ns / 1000000000ull;
+    its.it_value.tv_nsec = t_ns % 1000000000ull;
+    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) its.it_value.tv_nsec = 1;
+
+    timerfd_settime(pacer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+int frame_pacer_enable(void)
+{
+    nowaymsg(pacer_fd != -1, "Frame pacer already enabled!");
+
+    if ((pacer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+    {
+        pacer_fd = -1;
+        return -1;
+    }
+
+    memset(&pacer_info, 0, sizeof(pacer_info));
+
+    // Nothing has been sent yet, so the first frame may be attempted right away.
+    arm_at(now_ns());
+    return 0;
+}
+
+void frame_pacer_disable(void)
+{
+    nowaymsg(pacer_fd == -1, "Frame pacer already disabled!");
+
+    close(pacer_fd);
+    pacer_fd = -1;
+}
+
+int frame_pacer_fd(void)
+{
+    nowaymsg(pacer_fd == -1, "Frame pacer not enabled!");
+
+    return pacer_fd;
+}
+
+int frame_pacer_wait(int timeout_ms)
+{
+    struct pollfd pfd;
+    int result;
+
+    nowaymsg(pacer_fd == -1, "Frame pacer not enabled!");
+
+    pfd.fd = pacer_fd;
+    pfd.events = POLLIN;
+    while ((result = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR); // e.g. the APU callback
+
+    return (result > 0) ? 0 : -1;
+}
+
+int frame_pacer_present(int (*update)(void))
+{
+    uint64_t expirations;
+    uint64_t t;
+
+    nowaymsg(pacer_fd == -1, "Frame pacer not enabled!");
+    nowaymsg(update == NULL, "Update function is NULL!");
+
+    // Consume any pending expiration, so the fd only becomes readable again once re-armed.
+    if (read(pacer_fd, &expirations, sizeof(expirations)) < 0) expirations = 0;
+
+    if (update() != 0)
+    {
+        arm_at(now_ns() + FRAME_RETRY_NS);
+        return -1;
+    }
+
+    t = now_ns();
+    if (pacer_info.frames != 0)
+    {
+        // Round the time since the last accepted frame to whole frame periods. Every period
+        //   beyond the first is a VBLANK which went by without a new frame.
+        uint64_t periods = (t - pacer_info.timestamp_ns + FRAME_PERIOD_NS / 2) / FRAME_PERIOD_NS;
+        if (periods > 1)
+        {
+            __atomic_store_n(&pacer_info.missed, pacer_info.missed + periods - 1,
+                             __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_store_n(&pacer_info.frames, pacer_info.frames + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&pacer_info.timestamp_ns, t, __ATOMIC_RELAXED);
+
+    arm_at(t + FRAME_PERIOD_NS - FRAME_WAKE_EARLY_NS);
+    return 0;
+}
+
+int frame_pacer_present_wait(int (*update)(void), int timeout_ms)
+{
+    uint64_t deadline = (timeout_ms < 0) ? 0 : now_ns() + (uint64_t)timeout_ms * 1000000ull;
+    int remaining_ms = timeout_ms;
+
+    for (;;)
+    {
+        if (frame_pacer_wait(remaining_ms) != 0) return -1;
+        if (frame_pacer_present(update) == 0) return 0;
+
+        if (timeout_ms >= 0)
+        {
+            uint64_t t = now_ns();
+            if (t >= deadline) return -1;
+            remaining_ms = (int)((deadline - t + 999999) / 1000000);
+        }
+    }
+}
+
+void frame_pacer_info(frame_info_t *info)
+{
+    nowaymsg(info == NULL, "Frame info is NULL!");
+
+    info->frames = __atomic_load_n(&pacer_info.frames, __ATOMIC_RELAXED);
+    info->missed = __atomic_load_n(&pacer_info.missed, __ATOMIC_RELAXED);
+    info->timestamp_ns = __atomic_load_n(&pacer_info.timestamp_ns, __ATOMIC_RELAXED);
+}
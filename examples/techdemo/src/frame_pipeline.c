@@ -0,0 +1,184 @@
+/* Pipelined frame submission. See frame_pipeline.h for usage.
+ *
+ * The two frame buffers are used in turn. free_frames counts the buffers the game may fill, and
+ *   ready_frames the buffers waiting for the submission thread, so each buffer belongs to exactly
+ *   one thread at a time: the game only touches a buffer after taking it from free_frames, and
+ *   the thread only after taking it from ready_frames. The semaphores also order the memory
+ *   accesses, so a buffer is always seen whole.
+ *
+ * Only the submission thread talks to the PPU, and it sleeps in the frame pacer until each frame
+ *   is accepted before it hands the buffer back.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "apu_thread.h"
+#include "frame_pipeline.h"
+#include "frame_pacer.h"
+#include "noway.h"
+#include "vram_batch.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <string.h>
+#include <time.h>
+
+#define PIPELINE_FRAMES 2
+
+static vram_frame_t frames[PIPELINE_FRAMES];
+static sem_t free_frames;
+static sem_t ready_frames;
+
+static pthread_t submitter;
+static int submitter_stopping = 0;
+static int pipeline_enabled = 0;
+static frame_pipeline_mode_e pipeline_mode;
+static frame_pipeline_stats_t stats; // shown is written by the submitter, the rest by the game
+
+// Only used by the game thread
+static unsigned game_frame = 0;
+static int carry_over = 0; // the last present was dropped, so its changes are still recorded
+
+// Only used by the submission thread
+static unsigned submit_frame = 0;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sem_wait_retry(sem_t *sem)
+{
+    while (sem_wait(sem) != 0 && errno == EINTR)
+    {
+    }
+}
+
+static int update(void)
+{
+    if (vram_frame_submit(&frames[submit_frame]) != 0) return -1;
+    return ppu_update();
+}
+
+static void *submitter_thread(void *arg)
+{
+
+    (void)arg;
+
+    for (;;)
+    {
+        sem_wait_retry(&ready_frames);
+        if (__atomic_load_n(&submitter_stopping, __ATOMIC_ACQUIRE)) break;
+
+        frame_pacer_present_wait(update, -1);
+        __atomic_fetch_add(&stats.shown, 1, __ATOMIC_RELAXED);
+
+        submit_frame = (submit_frame + 1) % PIPELINE_FRAMES;
+        sem_post(&free_frames);
+    }
+    return NULL;
+}
+
+int frame_pipeline_enable(frame_pipeline_mode_e mode)
+{
+    nowaymsg(pipeline_enabled, "Frame pipeline already enabled!");
+    nowaymsg(mode != FRAME_PIPELINE_BLOCK && mode != FRAME_PIPELINE_DROP,
+             "Invalid frame pipeline mode!");
+
+    if (sem_init(&free_frames, 0, PIPELINE_FRAMES) != 0) return -1;
+    if (sem_init(&ready_frames, 0, 0) != 0)
+    {
+        sem_destroy(&free_frames);
+        return -1;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    pipeline_mode = mode;
+    game_frame = submit_frame = 0;
+    carry_over = 0;
+
+    __atomic_store_n(&submitter_stopping, 0, __ATOMIC_RELEASE);
+    if (thread_start_without_apu_signal(&submitter, submitter_thread, NULL) != 0)
+    {
+        sem_destroy(&ready_frames);
+        sem_destroy(&free_frames);
+        return -1;
+    }
+
+    pipeline_enabled = 1;
+    return 0;
+}
+
+void frame_pipeline_disable(void)
+{
+    nowaymsg(!pipeline_enabled, "Frame pipeline not enabled!");
+
+    // changes carried over from a dropped present are still sent
+    if (carry_over)
+    {
+        pipeline_mode = FRAME_PIPELINE_BLOCK;
+        frame_pipeline_present();
+    }
+
+    // once every buffer is free again, every presented frame has been shown
+    for (unsigned i = 0; i < PIPELINE_FRAMES; i++) sem_wait_retry(&free_frames);
+
+    __atomic_store_n(&submitter_stopping, 1, __ATOMIC_RELEASE);
+    sem_post(&ready_frames);
+    pthread_join(submitter, NULL);
+
+    sem_destroy(&ready_frames);
+    sem_destroy(&free_frames);
+    pipeline_enabled = 0;
+}
+
+void frame_pipeline_begin(void)
+{
+    nowaymsg(!pipeline_enabled, "Frame pipeline not enabled!");
+
+    if (!carry_over) vram_batch_begin();
+    carry_over = 0;
+}
+
+int frame_pipeline_present(void)
+{
+    nowaymsg(!pipeline_enabled, "Frame pipeline not enabled!");
+
+    if (pipeline_mode == FRAME_PIPELINE_DROP)
+    {
+        if (sem_trywait(&free_frames) != 0)
+        {
+            stats.dropped++;
+            carry_over = 1;
+            return -1;
+        }
+    }
+    else
+    {
+        uint64_t start = now_ns();
+
+        sem_wait_retry(&free_frames);
+        stats.wait_ns += now_ns() - start;
+    }
+
+    vram_batch_take(&frames[game_frame]);
+    game_frame = (game_frame + 1) % PIPELINE_FRAMES;
+    stats.presented++;
+
+    sem_post(&ready_frames);
+    return 0;
+}
+
+void frame_pipeline_stats(frame_pipeline_stats_t *dst)
+{
+    nowaymsg(dst == NULL, "Stats is NULL!");
+
+    dst->presented = stats.presented;
+    dst->dropped = stats.dropped;
+    dst->shown = __atomic_load_n(&stats.shown, __ATOMIC_RELAXED);
+    dst->wait_ns = stats.wait_ns;
+}
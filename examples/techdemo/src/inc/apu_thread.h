@@ -0,0 +1,42 @@
+/** @file apu_thread.h
+ * @brief Starting helper threads which leave the APU signal to the game thread
+ *
+ * The APU User Library refills audio from a SIGRTMAX handler. The kernel delivers a process-wide
+ *   signal to any thread which does not block it, so a helper thread (a mixer, a stream reader, a
+ *   controller sampler, a frame submitter) could take the refill and have its sleeps cut short.
+ *   Helper threads are therefore started with SIGRTMAX blocked, which keeps the handler on the
+ *   game thread.
+ */
+
+#ifndef _TECHDEMO_APU_THREAD_H_
+#define _TECHDEMO_APU_THREAD_H_
+
+#include <pthread.h>
+#include <signal.h>
+
+/** @brief Starts a thread with SIGRTMAX blocked, like pthread_create with default attributes
+ *
+ * The signal is blocked in the calling thread while the new thread is created, so the new thread
+ *   inherits the mask and can never take the signal, even before it starts running. The caller's
+ *   mask is restored afterwards.
+ *
+ * @param thread Receives the new thread.
+ * @param start Thread body.
+ * @param arg Argument of @p start.
+ * @return 0 on success; an error number, like pthread_create, on failure
+ */
+static inline int thread_start_without_apu_signal(pthread_t *thread, void *(*start)(void *),
+                                                  void *arg)
+{
+    sigset_t apu_signal, old_mask;
+    int result;
+
+    sigemptyset(&apu_signal);
+    sigaddset(&apu_signal, SIGRTMAX);
+    pthread_sigmask(SIG_BLOCK, &apu_signal, &old_mask);
+    result = pthread_create(thread, NULL, start, arg);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    return result;
+}
+
+#endif /* _TECHDEMO_APU_THREAD_H_ */
@@ -0,0 +1,120 @@
+/** @file asset_pack.h
+ * @brief Zero-parse loading of binary .fpak asset packs
+ *
+ * The PPU User Library loaders (@ref ppu_load_tilemap, @ref ppu_load_pattern and
+ *   @ref ppu_load_palette) parse text files one hex token at a time, and a game typically opens
+ *   dozens of them at startup. An asset pack bundles all of those assets into one binary file,
+ *   with every payload already in the format used by tile_t, pattern_t and palette_t.
+ *
+ * A pack is mmap'd read-only, and lookups return pointers directly into the mapping. There is no
+ *   parsing, no copying and no heap allocation: the returned data can be passed straight to the
+ *   ppu_write_x or vram_batch_x functions.
+ *
+ * Packs are built with user_tools/pack_assets.py. Each asset is named after its source file
+ *   without the extension (assets/scotty_front-0.pattern becomes "scotty_front-0"). Assets of
+ *   different types may share a name.
+ */
+
+#ifndef _TECHDEMO_ASSET_PACK_H_
+#define _TECHDEMO_ASSET_PACK_H_
+
+#include <fp-game/ppu.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ASSET_PACK_NAMELEN 32 ///< Maximum length of an asset name, including the NUL terminator
+
+/** @brief Asset types stored in a pack */
+typedef enum {
+    ASSET_TILEMAP = 1, ///< Array of tile_t, row by row
+    ASSET_PATTERN = 2, ///< Array of pattern_t, row by row (the layout ppu_write_pattern expects)
+    ASSET_PALETTE = 3, ///< A single palette_t
+    ASSET_CTILEMAP = 4 ///< A compressed tilemap (see ctilemap.h)
+} asset_type_e;
+
+/** @brief Table of contents entry of a pack, exactly as stored in the file */
+typedef struct {
+    char name[ASSET_PACK_NAMELEN]; ///< NUL-terminated asset name
+    uint32_t type;                 ///< One of asset_type_e
+    uint32_t offset;               ///< Byte offset of the payload from the start of the pack
+    uint32_t size;                 ///< Size of the payload in bytes
+    uint16_t width;                ///< Width in 8x8 tiles (1 for palettes)
+    uint16_t height;               ///< Height in 8x8 tiles (1 for palettes)
+} asset_pack_entry_t;
+
+/** @brief An open asset pack. Fill using @ref asset_pack_open. */
+typedef struct {
+    const uint8_t *base;              ///< Start of the mapped file
+    size_t size;                      ///< Size of the mapped file in bytes
+    const asset_pack_entry_t *toc;    ///< Table of contents, sorted by name, then type
+    unsigned count;                   ///< Number of entries in the table of contents
+} asset_pack_t;
+
+/** @brief Maps an asset pack into memory
+ *
+ * The caller of this function must call asset_pack_close when it no longer needs any data from
+ *   the pack to prevent resource leaks.
+ *
+ * @param pack Pack instance to fill.
+ * @param file Path of the .fpak file.
+ * @return 0 on success; -1 if the file could not be mapped or is not a valid asset pack
+ */
+int asset_pack_open(asset_pack_t *pack, const char *file);
+
+/** @brief Unmaps an asset pack. Pointers previously returned from the pack become invalid. */
+void asset_pack_close(asset_pack_t *pack);
+
+/** @brief Looks up an asset by name and type
+ *
+ * @param pack An open pack.
+ * @param name Name of the asset.
+ * @param type Expected type of the asset.
+ * @return The table of contents entry; NULL if there is no asset with that name and type
+ */
+const asset_pack_entry_t *asset_pack_find(const asset_pack_t *pack, const char *name,
+                                          asset_type_e type);
+
+/** @brief Looks up a tilemap
+ *
+ * @param pack An open pack.
+ * @param name Name of the tilemap.
+ * @param width If not NULL, set to the width of the tilemap in tiles.
+ * @param height If not NULL, set to the height of the tilemap in tiles.
+ * @return Pointer to width * height tile_t, row by row; NULL if not found
+ */
+const tile_t *asset_pack_tilemap(const asset_pack_t *pack, const char *name, unsigned *width,
+                                 unsigned *height);
+
+/** @brief Looks up a compressed tilemap
+ *
+ * The pack only checks that the tilemap is not empty: pass it to @ref ctilemap_open to check and
+ *   decode it.
+ *
+ * @param pack An open pack.
+ * @param name Name of the compressed tilemap.
+ * @param size Set to the size of the compressed tilemap in bytes.
+ * @return Pointer to the contents of the .ctilemap file; NULL if not found
+ */
+const void *asset_pack_ctilemap(const asset_pack_t *pack, const char *name, size_t *size);
+
+/** @brief Looks up a pattern
+ *
+ * @param pack An open pack.
+ * @param name Name of the pattern.
+ * @param width If not NULL, set to the width of the pattern in 8x8 tiles.
+ * @param height If not NULL, set to the height of the pattern in 8x8 tiles.
+ * @return Pointer to width * height pattern_t, ready for @ref ppu_write_pattern; NULL if not found
+ */
+const pattern_t *asset_pack_pattern(const asset_pack_t *pack, const char *name, unsigned *width,
+                                    unsigned *height);
+
+/** @brief Looks up a palette
+ *
+ * @param pack An open pack.
+ * @param name Name of the palette.
+ * @return Pointer to the palette; NULL if not found
+ */
+const palette_t *asset_pack_palette(const asset_pack_t *pack, const char *name);
+
+#endif /* _TECHDEMO_ASSET_PACK_H_ */
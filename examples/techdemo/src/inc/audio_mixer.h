@@ -0,0 +1,83 @@
+/** @file audio_mixer.h
+ * @brief Multi-voice software audio mixer
+ *
+ * The APU plays a single stream of samples. The mixer plays up to AUDIO_MIXER_VOICES sounds at
+ *   once on top of it: each voice plays one sample buffer (once or looping) or one audio stream
+ *   (see audio_stream.h), at its own volume.
+ *
+ * Mixing happens on a dedicated thread, one APU_BUF_MAX block at a time, and finished blocks are
+ *   queued in the audio ring (see audio_ring.h). The APU callback therefore only copies finished
+ *   samples, and the game thread only starts and stops voices. Voices are summed at 16 bits and
+ *   saturated back to 8 bits (with NEON or SSE2 where available), so loud overlapping sounds clip
+ *   instead of wrapping around.
+ *
+ * When all voices are busy, a new sound takes over (steals) the voice playing the lowest priority
+ *   sound, provided that priority is not higher than the new sound's. Among equal priorities, the
+ *   sound which has been playing the longest is stolen.
+ *
+ * The audio_mixer functions may only be called from one thread (usually the game loop).
+ */
+
+#ifndef _TECHDEMO_AUDIO_MIXER_H_
+#define _TECHDEMO_AUDIO_MIXER_H_
+
+#include "audio_stream.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define AUDIO_MIXER_VOICES 16        ///< Number of sounds which can play at once
+#define AUDIO_MIXER_VOLUME_MAX 256   ///< Volume at which a sound plays unchanged
+
+/** @brief Handle of a playing sound. Stays safe to use after the sound ended or was stolen. */
+typedef int audio_voice_t;
+
+/** @brief Enables the APU and starts the mixer thread
+ *
+ * Enables the audio ring, which must not already be enabled. The caller of this function must
+ *   call audio_mixer_disable before program exit to prevent resource leaks.
+ *
+ * @return 0 on success; -1 on error
+ */
+int audio_mixer_enable(void);
+
+/** @brief Stops the mixer thread and disables the APU */
+void audio_mixer_disable(void);
+
+/** @brief Starts playing a sound
+ *
+ * @param samples 8-bit signed PCM samples at APU_SAMPLE_RATE. Must stay valid while the sound
+ *                plays.
+ * @param len Number of samples. Must be at least 1.
+ * @param volume Volume, from 0 (silent) to AUDIO_MIXER_VOLUME_MAX (unchanged).
+ * @param priority Priority when voices are stolen. Higher values are more important.
+ * @param loop If non-zero, the sound repeats until stopped.
+ * @return A handle to the playing sound; -1 if all voices play higher priority sounds
+ */
+audio_voice_t audio_mixer_play(const int8_t *samples, size_t len, unsigned volume,
+                               unsigned priority, int loop);
+
+/** @brief Starts playing an audio stream
+ *
+ * The sound ends when the stream ends, or never if the stream loops. The stream must stay open
+ *   while it plays.
+ *
+ * @param stream An open audio stream, not played by any other voice.
+ * @param volume Volume, from 0 (silent) to AUDIO_MIXER_VOLUME_MAX (unchanged).
+ * @param priority Priority when voices are stolen. Higher values are more important.
+ * @return A handle to the playing sound; -1 if all voices play higher priority sounds
+ */
+audio_voice_t audio_mixer_play_stream(audio_stream_t *stream, unsigned volume, unsigned priority);
+
+/** @brief Stops a sound. Does nothing if the sound already ended, or if @p voice is -1. */
+void audio_mixer_stop(audio_voice_t voice);
+
+/** @brief Changes the volume of a sound. Does nothing if the sound already ended. */
+void audio_mixer_set_volume(audio_voice_t voice, unsigned volume);
+
+/** @brief Checks whether a sound is still playing
+ * @return 1 if the sound is playing; 0 if it ended, was stopped or was stolen
+ */
+int audio_mixer_playing(audio_voice_t voice);
+
+#endif /* _TECHDEMO_AUDIO_MIXER_H_ */
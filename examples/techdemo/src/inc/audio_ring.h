@@ -0,0 +1,60 @@
+/** @file audio_ring.h
+ * @brief Lock-free single-producer/single-consumer ring of APU samples
+ *
+ * @ref apu_enable calls its callback from a SIGRTMAX signal handler, asking for up to APU_BUF_MAX
+ *   samples at a time. Games then have to share state with code running in a signal handler, and
+ *   the only synchronization available is @ref apu_callback_disable, which delays (and, if held
+ *   for too long, drops) audio.
+ *
+ * The audio ring turns this around. The game (or a mixer thread) writes samples into a ring at
+ *   its own pace, and the ring installs its own APU callback which copies the next samples out of
+ *   the ring. Producer and consumer only share two counters, updated with atomic acquire/release
+ *   operations, so neither side ever blocks or needs to disable the callback, and the game code
+ *   runs no code in signal context.
+ *
+ * Samples are never dropped: @ref audio_ring_write only accepts as many samples as there is room
+ *   for, and the rest can be written once the APU has consumed more. If the ring runs dry, the APU
+ *   plays silence until new samples arrive.
+ *
+ * There is a single producer: all writes must come from the same thread.
+ */
+
+#ifndef _TECHDEMO_AUDIO_RING_H_
+#define _TECHDEMO_AUDIO_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Capacity of the ring in samples (64ms at 32KHz). Must be a power of two. Enough to ride out
+ *    several missed game frames, while keeping the latency of new sounds low. */
+#define AUDIO_RING_SIZE 2048
+
+/** @brief Enables the APU, played from the audio ring
+ *
+ * Replaces @ref apu_enable. The caller of this function must call audio_ring_disable before
+ *   program exit to prevent resource leaks.
+ *
+ * @return 0 on success; -1 on error
+ */
+int audio_ring_enable(void);
+
+/** @brief Disables the APU and empties the ring. Replaces @ref apu_disable. */
+void audio_ring_disable(void);
+
+/** @brief Gets the number of samples which can currently be written without blocking
+ * @return Free space in the ring, in samples
+ */
+size_t audio_ring_space(void);
+
+/** @brief Appends samples to the ring
+ *
+ * Never blocks. If the ring does not have room for all @p len samples, only the first
+ *   @ref audio_ring_space samples are written.
+ *
+ * @param samples 8-bit signed PCM samples at APU_SAMPLE_RATE.
+ * @param len Number of samples in @p samples.
+ * @return Number of samples written
+ */
+size_t audio_ring_write(const int8_t *samples, size_t len);
+
+#endif /* _TECHDEMO_AUDIO_RING_H_ */
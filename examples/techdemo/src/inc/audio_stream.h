@@ -0,0 +1,76 @@
+/** @file audio_stream.h
+ * @brief Streaming playback of IMA-ADPCM compressed audio files
+ *
+ * Audio linked into the game binary (see bins/) stays resident in RAM for the whole game, which is
+ *   fine for short sound effects but not for minutes of music. An audio stream plays an .adpcm
+ *   file (made with user_tools/pcm_to_adpcm.py) from disk instead.
+ *
+ * Each stream has a reader thread which reads and decodes the file one block at a time, keeping
+ *   up to AUDIO_STREAM_WINDOW decoded samples ready ahead of playback. Only that window is
+ *   resident, no matter how long the file is. Streams are played through the audio mixer with
+ *   @ref audio_mixer_play_stream.
+ *
+ * The reader and the player only share two counters, updated with atomic acquire/release
+ *   operations, like the audio ring. If the reader falls behind, the stream plays silence until it
+ *   catches up.
+ */
+
+#ifndef _TECHDEMO_AUDIO_STREAM_H_
+#define _TECHDEMO_AUDIO_STREAM_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Decoded samples prefetched ahead of playback (256ms at 32KHz). Must be a power of two. */
+#define AUDIO_STREAM_WINDOW 8192
+
+/** Largest number of samples per block supported in .adpcm files */
+#define AUDIO_STREAM_BLOCK_MAX 4096
+
+/** @brief An open audio stream. Must not be moved or copied while open. */
+typedef struct {
+    int fd;
+    int loop;
+    uint32_t sample_count;
+    uint32_t block_samples;
+    uint32_t block_count;
+    uint32_t next_block;     // next block to be decoded by the reader
+    pthread_t reader;
+    int running;             // cleared to stop the reader
+    int finished;            // set by the reader once the last block was decoded
+    uint32_t head;           // decoded samples, written by the reader only
+    uint32_t tail;           // played samples, written by the player only
+    int8_t window[AUDIO_STREAM_WINDOW];
+} audio_stream_t;
+
+/** @brief Opens an .adpcm file and starts prefetching it
+ *
+ * The caller of this function must call audio_stream_close before program exit to prevent
+ *   resource leaks.
+ *
+ * @param stream The stream to be opened.
+ * @param file Path of the .adpcm file.
+ * @param loop If non-zero, the stream restarts from the beginning once it ends.
+ * @return 0 on success; -1 if the file could not be opened or is not a valid .adpcm file
+ */
+int audio_stream_open(audio_stream_t *stream, const char *file, int loop);
+
+/** @brief Stops the reader thread and closes the file
+ *
+ * The stream must not be playing: stop it with @ref audio_mixer_stop first.
+ */
+void audio_stream_close(audio_stream_t *stream);
+
+/** @brief Takes the next decoded samples out of the stream
+ *
+ * Never blocks. Called by the audio mixer; games do not need to call it themselves.
+ *
+ * @param stream An open stream.
+ * @param samples Buffer receiving up to @p len 8-bit signed PCM samples.
+ * @param len Size of @p samples.
+ * @return Number of samples taken (0 if the reader is behind); -1 if the stream has ended
+ */
+int audio_stream_read(audio_stream_t *stream, int8_t *samples, size_t len);
+
+#endif /* _TECHDEMO_AUDIO_STREAM_H_ */
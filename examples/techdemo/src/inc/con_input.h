@@ -0,0 +1,79 @@
+/** @file con_input.h
+ * @brief Controller input sampled in the background, as a queue of timestamped button events
+ *
+ * Calling @ref get_con_state once per frame has two problems: a button pressed and released
+ *   between two calls is never seen, and every game has to keep the previous state around to tell
+ *   when a button went down. Controller input instead samples the controller from a thread at a
+ *   fixed rate (1KHz by default), much faster than frames, and queues an event with a
+ *   CLOCK_MONOTONIC timestamp whenever buttons change.
+ *
+ * Once per frame, @ref con_input_update takes the events queued since the last frame. After it:
+ *   * @ref con_input_state gives the latest controller state, like get_con_state.
+ *   * @ref con_input_pressed_this_frame and @ref con_input_released_this_frame tell whether a
+ *     button went down or up during the frame, even if it was released again before the frame
+ *     ended.
+ *   * @ref con_input_events gives the frame's events themselves, e.g. to measure input latency.
+ *
+ * The sampler and the game share a lock-free single-producer/single-consumer ring, so neither side
+ *   ever blocks the other. If the game does not call @ref con_input_update for so long that the
+ *   ring fills up, the sampler keeps the change and queues it as soon as there is room again: the
+ *   state is never wrong, only events in between are merged (see @ref con_input_dropped).
+ */
+
+#ifndef _TECHDEMO_CON_INPUT_H_
+#define _TECHDEMO_CON_INPUT_H_
+
+#include <stdint.h>
+
+#define CON_INPUT_RATE_HZ 1000   ///< Default sample rate: a 1ms input resolution
+#define CON_INPUT_QUEUE_SIZE 256 ///< Events the ring holds. Must be a power of two.
+
+/** @brief A change of controller buttons */
+typedef struct {
+    uint64_t timestamp_ns; ///< CLOCK_MONOTONIC time of the sample which saw the change
+    uint16_t changed;      ///< Buttons which changed (CON_BUT_x masks)
+    uint16_t state;        ///< Controller state after the change, active low as in con.h
+} con_event_t;
+
+/** @brief Starts sampling the controller
+ *
+ * The caller of this function must call con_input_disable before program exit to prevent
+ *   resource leaks.
+ *
+ * @param rate_hz Samples per second. Must be in [1, 100000]. See @ref CON_INPUT_RATE_HZ.
+ * @return 0 on success; -1 if the controller could not be read or the thread not started
+ */
+int con_input_enable(unsigned rate_hz);
+
+/** @brief Stops sampling the controller */
+void con_input_disable(void);
+
+/** @brief Takes the events queued since the last update. Call once per frame.
+ * @return Number of events taken; -1 if the controller could not be read since the last update,
+ *         or if the sampler thread stopped on an error (it then stays stopped until re-enabled)
+ */
+int con_input_update(void);
+
+/** @brief Gets the controller state after the last update, in the format of get_con_state */
+int con_input_state(void);
+
+/** @brief Checks whether any of @p buttons was pressed during the last frame
+ * @param buttons CON_BUT_x masks, or'ed together.
+ */
+int con_input_pressed_this_frame(int buttons);
+
+/** @brief Checks whether any of @p buttons was released during the last frame
+ * @param buttons CON_BUT_x masks, or'ed together.
+ */
+int con_input_released_this_frame(int buttons);
+
+/** @brief Gets the events taken by the last update, oldest first
+ * @param events Set to the events. Valid until the next update.
+ * @return Number of events
+ */
+unsigned con_input_events(const con_event_t **events);
+
+/** @brief Gets the number of samples whose change had to wait because the ring was full */
+uint64_t con_input_dropped(void);
+
+#endif /* _TECHDEMO_CON_INPUT_H_ */
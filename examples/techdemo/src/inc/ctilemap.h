@@ -0,0 +1,75 @@
+/** @file ctilemap.h
+ * @brief Compressed tilemaps, decoded a row at a time straight into Tile RAM writes
+ *
+ * A plain tilemap is 2 bytes per tile: 8KB for one 64x64 layer, and much more for a level larger
+ *   than a layer. Level maps repeat themselves a lot, so a compressed tilemap (.ctilemap) stores
+ *   the map as a grid of metatiles (square blocks of 1x1, 2x2 or 4x4 tiles), each kept once in a
+ *   dictionary, and run-length encodes every row of dictionary indices. The techdemo's 64x64 map
+ *   shrinks from 8KB to under 1KB.
+ *
+ * Compressed tilemaps are made with user_tools/compress_tilemap.py (from a Tiled .csv or a
+ *   .tilemap), which also documents the file layout, and can be stored in an asset pack (see
+ *   @ref asset_pack_ctilemap). @ref ctilemap_open checks the whole encoding once, without copying
+ *   or allocating anything. Decoding then reads the map in place: @ref ctilemap_decode_row expands
+ *   any span of one tile row, skipping the runs before it, and @ref ctilemap_write_layer records a
+ *   rectangle of the map into a tile layer row by row, through a single 64-tile buffer on the
+ *   stack. The whole map is never expanded in memory.
+ */
+
+#ifndef _TECHDEMO_CTILEMAP_H_
+#define _TECHDEMO_CTILEMAP_H_
+
+#include <fp-game/ppu.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief An open compressed tilemap. Fill using @ref ctilemap_open. */
+typedef struct {
+    unsigned width;           ///< Map width in tiles
+    unsigned height;          ///< Map height in tiles
+    unsigned block;           ///< Metatile width and height in tiles: 1, 2 or 4
+    unsigned index_size;      ///< Bytes per dictionary index: 1 or 2
+    unsigned dict_count;      ///< Number of metatiles in the dictionary
+    const uint8_t *dict;      ///< Dictionary: block * block tile_t per metatile, row by row
+    const uint8_t *row_table; ///< One u32 offset into runs per row of metatiles, plus the end
+    const uint8_t *runs;      ///< Run-length encoded metatile indices
+} ctilemap_t;
+
+/** @brief Checks a compressed tilemap and sets up decoding from it
+ *
+ * @param map Map instance to fill. Points into @p data, which must stay valid while it is in use.
+ * @param data Contents of a .ctilemap file.
+ * @param size Size of @p data in bytes.
+ * @return 0 on success; -1 if @p data is not a valid compressed tilemap
+ */
+int ctilemap_open(ctilemap_t *map, const void *data, size_t size);
+
+/** @brief Decodes part of a tile row
+ *
+ * @param map An open map.
+ * @param x Map column of the first tile.
+ * @param y Map row.
+ * @param count Number of tiles. [x, x + count) must lie within the map.
+ * @param tiles Receives count tiles.
+ */
+void ctilemap_decode_row(const ctilemap_t *map, unsigned x, unsigned y, unsigned count,
+                         tile_t *tiles);
+
+/** @brief Records a rectangle of the map into a tile layer
+ *
+ * Like @ref tilemap_stream_update, map tile (x, y) is written to layer tile (x % 64, y % 64).
+ *   Each row goes through @ref vram_batch_tiles_horizontal, so call between
+ *   @ref vram_batch_begin and @ref vram_batch_update.
+ *
+ * @param map An open map.
+ * @param layer Must be either LAYER_BG or LAYER_FG.
+ * @param x Map column of the left edge.
+ * @param y Map row of the top edge.
+ * @param width Width in tiles, at most 64. The rectangle must lie within the map.
+ * @param height Height in tiles, at most 64.
+ */
+void ctilemap_write_layer(const ctilemap_t *map, layer_e layer, unsigned x, unsigned y,
+                          unsigned width, unsigned height);
+
+#endif /* _TECHDEMO_CTILEMAP_H_ */
@@ -0,0 +1,97 @@
+/** @file frame_pacer.h
+ * @brief Sleeping, frame-paced replacement for polling ppu_update
+ *
+ * @ref ppu_update only returns 0 or -1 (busy), so waiting for the next frame usually means spinning
+ *   on it, which keeps a CPU core at 100% doing nothing. The frame pacer predicts when the PPU will
+ *   accept the next frame instead: every accepted frame re-locks a 60Hz timer to the moment the
+ *   PPU accepted it, and the pacer sleeps until shortly before the next predicted frame boundary.
+ *   Only then is the update attempted, with short sleeps between retries if the PPU is still busy.
+ *
+ * The timer is a file descriptor (see @ref frame_pacer_fd) which becomes readable at each frame
+ *   boundary, so games which already wait on other file descriptors can poll()/epoll() on it.
+ *   Simple games can call @ref frame_pacer_present_wait at the end of their game loop instead of
+ *   polling ppu_update.
+ *
+ * The update function to call is passed in, so the pacer works with both @ref ppu_update and
+ *   @ref vram_batch_update.
+ */
+
+#ifndef _TECHDEMO_FRAME_PACER_H_
+#define _TECHDEMO_FRAME_PACER_H_
+
+#include <stdint.h>
+
+#define FRAME_PERIOD_NS 16666667 ///< Length of one PPU frame (60Hz) in nanoseconds
+
+/** @brief Frame statistics reported by the pacer */
+typedef struct {
+    uint64_t frames;       ///< Number of frames accepted by the PPU since the pacer was enabled
+    uint64_t missed;       ///< Number of frame periods which passed without a frame being accepted
+    uint64_t timestamp_ns; ///< CLOCK_MONOTONIC time at which the last frame was accepted
+} frame_info_t;
+
+/** @brief Enables the frame pacer
+ *
+ * The caller of this function must call frame_pacer_disable before program exit to prevent
+ *   resource leaks.
+ *
+ * @return 0 on success; -1 on error
+ */
+int frame_pacer_enable(void);
+
+/** @brief Disables the frame pacer, closing its file descriptor */
+void frame_pacer_disable(void);
+
+/** @brief Gets the pacer's file descriptor
+ *
+ * The descriptor becomes readable (POLLIN) when the PPU is expected to accept the next frame, or
+ *   when a busy update should be retried. It stays readable until @ref frame_pacer_present is
+ *   called.
+ *
+ * @pre The pacer is enabled. See @ref frame_pacer_enable.
+ * @return A pollable file descriptor. Do not read from or close it.
+ */
+int frame_pacer_fd(void);
+
+/** @brief Sleeps until the PPU is expected to accept the next frame
+ *
+ * @pre The pacer is enabled. See @ref frame_pacer_enable.
+ * @param timeout_ms Maximum time to sleep, in milliseconds. Negative values never time out.
+ * @return 0 if the frame boundary was reached; -1 on timeout
+ */
+int frame_pacer_wait(int timeout_ms);
+
+/** @brief Tries to send a frame once, without blocking
+ *
+ * Calls @p update (for example @ref ppu_update or @ref vram_batch_update) a single time. If the
+ *   frame was accepted, the frame statistics are updated and the pacer's timer is re-locked to
+ *   the next frame boundary. If the PPU was busy, the timer is set to a short retry interval.
+ *
+ * @pre The pacer is enabled. See @ref frame_pacer_enable.
+ * @param update Function which submits the frame. Must return 0 on success or -1 if PPU busy.
+ * @return 0 if the frame was accepted; -1 if PPU busy
+ */
+int frame_pacer_present(int (*update)(void));
+
+/** @brief Sleeps until the PPU accepts the frame
+ *
+ * The sleeping equivalent of `while (update() != 0);`.
+ *
+ * @pre The pacer is enabled. See @ref frame_pacer_enable.
+ * @param update Function which submits the frame. Must return 0 on success or -1 if PPU busy.
+ * @param timeout_ms Maximum time to sleep, in milliseconds. Negative values never time out.
+ * @return 0 if the frame was accepted; -1 on timeout
+ */
+int frame_pacer_present_wait(int (*update)(void), int timeout_ms);
+
+/** @brief Gets the current frame statistics
+ *
+ * May be called from any thread, for example by the game while a frame pipeline's submission
+ *   thread presents the frames (see frame_pipeline.h). Each field is read atomically, but a frame
+ *   may be accepted between the reads, so the fields can be one frame apart.
+ *
+ * @param info Location to copy the statistics to.
+ */
+void frame_pacer_info(frame_info_t *info);
+
+#endif /* _TECHDEMO_FRAME_PACER_H_ */
@@ -0,0 +1,78 @@
+/** @file frame_pipeline.h
+ * @brief Pipelined frame submission: build the next frame while a thread sends the last one
+ *
+ * With @ref vram_batch_update, the game thread sends every change itself and then waits for the
+ *   PPU to accept the frame, so the game's logic and the upload never overlap. The frame pipeline
+ *   hands each recorded frame to a submission thread instead:
+ *   1. @ref frame_pipeline_begin starts recording a frame (replacing @ref vram_batch_begin).
+ *   2. The game records its changes with the vram_batch_x functions as usual.
+ *   3. @ref frame_pipeline_present takes the changes out of the batch (see @ref vram_batch_take)
+ *      into one of two frame buffers, and returns. The game can start on the next frame at once.
+ *   4. The submission thread sends the frame, then sleeps until the PPU accepts it (with the frame
+ *      pacer, see frame_pacer.h).
+ *
+ * While the thread sends frame N, the game builds frame N + 1. If the game gets two frames ahead,
+ *   the back-pressure mode decides what happens:
+ *   * FRAME_PIPELINE_BLOCK: @ref frame_pipeline_present sleeps until a buffer is free. The game
+ *     runs at the PPU's rate, at most two frames ahead of the display.
+ *   * FRAME_PIPELINE_DROP: @ref frame_pipeline_present returns -1 at once. The frame is not
+ *     lost: its changes stay recorded, and the next @ref frame_pipeline_begin keeps them, so they
+ *     are sent with the next frame which gets through.
+ *
+ * The game thread and the submission thread share the two buffers through a pair of semaphores,
+ *   and never take a lock.
+ *
+ * @attention While the pipeline is enabled, only the submission thread may call ppu_x functions
+ *   and the frame pacer. The game records through vram_batch only.
+ */
+
+#ifndef _TECHDEMO_FRAME_PIPELINE_H_
+#define _TECHDEMO_FRAME_PIPELINE_H_
+
+#include <stdint.h>
+
+/** @brief What @ref frame_pipeline_present does when both frame buffers are in use */
+typedef enum {
+    FRAME_PIPELINE_BLOCK, ///< Wait for the submission thread
+    FRAME_PIPELINE_DROP   ///< Return -1 and carry the frame's changes over to the next one
+} frame_pipeline_mode_e;
+
+/** @brief Frame pipeline statistics */
+typedef struct {
+    uint64_t presented; ///< Frames handed to the submission thread
+    uint64_t dropped;   ///< Presents which returned -1 in FRAME_PIPELINE_DROP mode
+    uint64_t shown;     ///< Frames accepted by the PPU
+    uint64_t wait_ns;   ///< Time the game thread spent waiting in FRAME_PIPELINE_BLOCK mode
+} frame_pipeline_stats_t;
+
+/** @brief Starts the submission thread
+ *
+ * The caller of this function must call frame_pipeline_disable before program exit to prevent
+ *   resource leaks.
+ *
+ * @pre The PPU and the frame pacer are enabled. See @ref ppu_enable and @ref frame_pacer_enable.
+ * @return 0 on success; -1 if the thread could not be started
+ */
+int frame_pipeline_enable(frame_pipeline_mode_e mode);
+
+/** @brief Waits until every presented frame was accepted by the PPU, then stops the thread
+ *
+ * Changes carried over from a dropped present are sent first.
+ */
+void frame_pipeline_disable(void);
+
+/** @brief Starts recording a new frame. Replaces @ref vram_batch_begin.
+ *
+ * If the last present was dropped, its changes are kept and this frame records on top of them.
+ */
+void frame_pipeline_begin(void);
+
+/** @brief Hands the recorded frame to the submission thread
+ * @return 0 if the frame was handed over; -1 if it was dropped (FRAME_PIPELINE_DROP mode only)
+ */
+int frame_pipeline_present(void);
+
+/** @brief Gets the pipeline statistics since it was enabled */
+void frame_pipeline_stats(frame_pipeline_stats_t *stats);
+
+#endif /* _TECHDEMO_FRAME_PIPELINE_H_ */
@@ -0,0 +1,89 @@
+/** @file metatile.h
+ * @brief Metatiles: blocks of tiles defined once and stamped into tile layers in one call
+ *
+ * Levels are usually drawn in blocks of tiles (2x2 for 16x16 pixels, 4x4 for 32x32) rather than in
+ *   single tiles. Writing a block with @ref vram_batch_tiles_horizontal takes one call per tile
+ *   row, each one checked on its own, and neighbouring blocks cut the same rows into many short
+ *   writes.
+ *
+ * A metatile set holds block definitions instead:
+ *   1. @ref metatile_define registers a block of up to 8x8 tiles once, and returns its ID.
+ *   2. @ref metatile_stamp places a block at any tile position of LAYER_BG or LAYER_FG, wrapping
+ *      around the layer's edges. Stamping only copies the block's tiles into the set's own image
+ *      of each layer, and marks them in a 64-bit mask per layer row.
+ *   3. @ref metatile_flush records every row's marked tiles into vram_batch, as one write per
+ *      unbroken span (spans wrapping past column 63 included), and clears the marks.
+ *
+ * All stamps of a frame therefore reach vram_batch as the fewest row spans which cover them: a
+ *   screen of 4x4 blocks (40x30 tiles) is 30 writes rather than 300. A tile stamped twice in a
+ *   frame is only written once, with the later block's tile.
+ */
+
+#ifndef _TECHDEMO_METATILE_H_
+#define _TECHDEMO_METATILE_H_
+
+#include "vram_layout.h"
+
+#include <fp-game/ppu.h>
+
+#include <stdint.h>
+
+#define METATILE_MAX_SIZE 8 ///< Largest metatile width and height, in tiles
+
+/** @brief One metatile definition */
+typedef struct {
+    const tile_t *tiles; ///< width * height tiles, row by row
+    unsigned width;      ///< Width in tiles
+    unsigned height;     ///< Height in tiles
+} metatile_def_t;
+
+/** @brief A set of metatiles, with the stamps recorded since the last flush */
+typedef struct {
+    metatile_def_t *defs;
+    unsigned capacity;
+    unsigned count;                      ///< Number of metatiles defined
+    tile_t *image;                       ///< Stamped tiles of BG, then FG, row by row
+    uint64_t dirty[2][TILELAYER_HEIGHT]; ///< Bit x set if tile x of the row is stamped
+    uint64_t dirty_rows[2];              ///< Bit y set if row y has stamps
+} metatile_set_t;
+
+/** @brief Sets up a set for up to @p capacity metatiles
+ *
+ * The caller of this function must call metatile_destroy to prevent memory leaks.
+ *
+ * @return 0 on success; -1 if out of memory
+ */
+int metatile_init(metatile_set_t *set, unsigned capacity);
+
+/** @brief Frees the set's memory. Stamps which were not flushed are dropped. */
+void metatile_destroy(metatile_set_t *set);
+
+/** @brief Defines a metatile
+ *
+ * @param set A set up metatile set.
+ * @param tiles @p width * @p height tiles, row by row. Must stay valid while the set is in use.
+ * @param width Width in tiles, 1 to METATILE_MAX_SIZE.
+ * @param height Height in tiles, 1 to METATILE_MAX_SIZE.
+ * @return ID of the metatile; -1 if the set is full
+ */
+int metatile_define(metatile_set_t *set, const tile_t *tiles, unsigned width, unsigned height);
+
+/** @brief Stamps a metatile into a tile layer, until the next @ref metatile_flush
+ *
+ * @param set A set up metatile set.
+ * @param id ID of a defined metatile.
+ * @param layer Must be either LAYER_BG or LAYER_FG.
+ * @param x_i Layer column of the metatile's left edge. The metatile wraps around past column 63.
+ * @param y_i Layer row of the metatile's top edge. The metatile wraps around past row 63.
+ */
+void metatile_stamp(metatile_set_t *set, int id, layer_e layer, unsigned x_i, unsigned y_i);
+
+/** @brief Records every tile stamped since the last flush into vram_batch
+ *
+ * Call between @ref vram_batch_begin and @ref vram_batch_update, after the frame's stamps.
+ *
+ * @return Number of row spans recorded
+ */
+unsigned metatile_flush(metatile_set_t *set);
+
+#endif /* _TECHDEMO_METATILE_H_ */
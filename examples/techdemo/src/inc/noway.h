@@ -0,0 +1,40 @@
+/** @file noway.h
+ * @brief Argument checking for the techdemo helper modules
+ *
+ * Mirrors the behaviour of the FP-GAme User Library: invalid arguments print a console warning
+ *   and abort the program, so bugs in game code are found early instead of corrupting VRAM.
+ *
+ * Checks in per-sprite or per-tile hot paths use @ref nowaydebug instead, which compiles to
+ *   nothing when NDEBUG is defined, like assert().
+ */
+
+#ifndef _TECHDEMO_NOWAY_H_
+#define _TECHDEMO_NOWAY_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** @brief Aborts the program with @p msg if @p cond is true */
+#define nowaymsg(cond, msg) \
+    noway_check((cond) ? 1 : 0, (msg), __FILE__, __LINE__, __func__, #cond)
+
+/** @brief Aborts the program if @p cond is true */
+#define noway(cond) nowaymsg(cond, "No way! I can't believe this!")
+
+/** @brief Like @ref nowaymsg, but only checked in debug builds (without NDEBUG) */
+#ifdef NDEBUG
+#define nowaydebug(cond, msg) ((void)0)
+#else
+#define nowaydebug(cond, msg) nowaymsg(cond, msg)
+#endif
+
+static inline void noway_check(int cond, const char *msg, const char *file, int line,
+                               const char *func, const char *expr)
+{
+    if (!cond) return;
+
+    fprintf(stderr, "%s\nIn %s on line %d in %s(), %s was true!\n", msg, file, line, func, expr);
+    abort();
+}
+
+#endif /* _TECHDEMO_NOWAY_H_ */
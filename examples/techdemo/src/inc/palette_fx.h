@@ -0,0 +1,88 @@
+/** @file palette_fx.h
+ * @brief Palette effects: fades, color cycling and global brightness/tint
+ *
+ * Fades, flashes and water cycles all come down to changing palettes every frame. Instead of
+ *   building new palette_t structs in game code and writing each one, a game sets its palettes
+ *   here once and describes the effects:
+ *   * @ref palette_fx_fade blends one palette toward a target palette over a number of frames.
+ *   * @ref palette_fx_cycle rotates a range of colors in one palette (water, lava, conveyors).
+ *   * @ref palette_fx_brightness and @ref palette_fx_tint apply to all 64 palettes at once, for
+ *     screen fades, flashes and day/night tinting. Both can also change over a number of frames.
+ *
+ * @ref palette_fx_update advances every effect by one frame, recomputes the colors of all 64
+ *   palettes (with SSE2 or NEON where available) and records the palettes whose colors changed
+ *   with vram_batch. Neighbouring changed palettes are recorded as one write, so a screen-wide fade
+ *   costs one write per frame instead of 64.
+ *
+ * An optional budget caps how many palettes are recorded per frame. Palettes over the budget are
+ *   recorded in later frames, oldest first.
+ *
+ * Palettes are numbered like Palette RAM: layer LAYER_BG, LAYER_FG and LAYER_SPR select a section,
+ *   exactly like @ref ppu_write_palette. Games must not write palettes with vram_batch_palette
+ *   while using this module.
+ */
+
+#ifndef _TECHDEMO_PALETTE_FX_H_
+#define _TECHDEMO_PALETTE_FX_H_
+
+#include <fp-game/ppu.h>
+
+#include <stdint.h>
+
+#define PALETTE_FX_LEVEL_MAX 256 ///< Brightness of an unchanged palette, and the strongest tint
+
+/** @brief Sets every palette to black, and stops all effects. Brightness is reset to maximum. */
+void palette_fx_reset(void);
+
+/** @brief Sets the colors of a palette, stopping its fade if it had one */
+void palette_fx_set(const palette_t *palette, layer_e layer, unsigned palette_id);
+
+/** @brief Blends a palette from its current colors to @p target over @p frames frames
+ * @param target The colors to end up with. Copied, so it need not stay valid.
+ * @param layer Palette RAM section, see @ref ppu_write_palette.
+ * @param palette_id Palette in that section.
+ * @param frames Length of the fade. 0 sets @p target immediately.
+ */
+void palette_fx_fade(const palette_t *target, layer_e layer, unsigned palette_id,
+                     unsigned frames);
+
+/** @brief Rotates colors color[first] to color[first + len - 1] of a palette by one every
+ *   @p delay frames. Each color moves up by one, and the last wraps around to the first.
+ *
+ * Cycling is applied on top of fades. A @p len of 0 or 1 stops cycling.
+ *
+ * @param delay Frames per step. Must be >= 1.
+ */
+void palette_fx_cycle(layer_e layer, unsigned palette_id, unsigned first, unsigned len,
+                      unsigned delay);
+
+/** @brief Scales every color of every palette toward black over @p frames frames
+ * @param level Target brightness. Range [0, PALETTE_FX_LEVEL_MAX], where 0 is black.
+ * @param frames Length of the fade. 0 applies @p level immediately.
+ */
+void palette_fx_brightness(unsigned level, unsigned frames);
+
+/** @brief Blends every color of every palette toward @p color over @p frames frames
+ *
+ * The tint is applied after brightness, so a white tint over a dark screen is a flash. The tint
+ *   color changes over the same frames, starting from the tint color shown when this is called,
+ *   so a new color can be set part-way through another tint.
+ *
+ * @param color 24-bit color, like palette_t::color.
+ * @param amount Target strength. Range [0, PALETTE_FX_LEVEL_MAX], where 0 is no tint.
+ * @param frames Length of the change. 0 applies @p amount immediately.
+ */
+void palette_fx_tint(uint32_t color, unsigned amount, unsigned frames);
+
+/** @brief Caps how many palettes are recorded per frame. 0 (the default) means no cap. */
+void palette_fx_set_budget(unsigned count);
+
+/** @brief Advances all effects by one frame and records the palettes which changed
+ *
+ * Call once per frame between @ref vram_batch_begin and @ref vram_batch_update.
+ *
+ * @return Number of palettes recorded
+ */
+unsigned palette_fx_update(void);
+
+#endif /* _TECHDEMO_PALETTE_FX_H_ */
@@ -0,0 +1,48 @@
+/** @file pattern_alloc.h
+ * @brief Runtime allocation of rectangular blocks of Pattern RAM
+ *
+ * Pattern RAM is a 32x32 grid of 8x8 patterns. Instead of placing every graphic by hand with
+ *   @ref ppu_pattern_addr, a game can allocate blocks of 1x1 to 4x4 patterns (the sprite sizes) at
+ *   runtime, and free them again once they are no longer needed.
+ *
+ * Blocks may wrap around the right and bottom edges of Pattern RAM, exactly like
+ *   @ref ppu_write_pattern writes and sprites read them, so every free cell can be used. Blocks are
+ *   placed first-fit, scanning rows from the top-left.
+ *
+ * Graphics which are placed by hand (like the techdemo's world tiles) can be kept out of the
+ *   allocator's way with @ref pattern_alloc_reserve. Pattern address 0 is reserved from the start,
+ *   as tiles which point at it are transparent by convention.
+ */
+
+#ifndef _TECHDEMO_PATTERN_ALLOC_H_
+#define _TECHDEMO_PATTERN_ALLOC_H_
+
+#include <fp-game/ppu.h>
+
+#define PATTERN_BLOCK_MAX 4 ///< Largest block width and height, in patterns
+
+/** @brief Frees all of Pattern RAM, except pattern address 0 */
+void pattern_alloc_reset(void);
+
+/** @brief Marks a hand-placed block as used, so it is never allocated
+ * @param pattern_addr Top-left pattern of the block. Must be a valid pattern address.
+ * @param width Width in patterns. Range [1, 32].
+ * @param height Height in patterns. Range [1, 32].
+ */
+void pattern_alloc_reserve(pattern_addr_t pattern_addr, unsigned width, unsigned height);
+
+/** @brief Allocates a block of patterns
+ * @param width Width in patterns. Range [1, PATTERN_BLOCK_MAX].
+ * @param height Height in patterns. Range [1, PATTERN_BLOCK_MAX].
+ * @param pattern_addr Set to the top-left pattern of the block on success.
+ * @return 0 on success; -1 if no free block of that size is left
+ */
+int pattern_alloc(unsigned width, unsigned height, pattern_addr_t *pattern_addr);
+
+/** @brief Frees an allocated or reserved block. Must match the block exactly. */
+void pattern_free(pattern_addr_t pattern_addr, unsigned width, unsigned height);
+
+/** @brief Gets the number of free patterns (not necessarily in one block) */
+unsigned pattern_alloc_free_count(void);
+
+#endif /* _TECHDEMO_PATTERN_ALLOC_H_ */
@@ -0,0 +1,76 @@
+/** @file pattern_cache.h
+ * @brief Pages graphics into Pattern RAM on demand, evicting the least recently used
+ *
+ * Pattern RAM only holds 1024 patterns, far fewer than a game with many animated characters has.
+ *   A pattern cache keeps a pool of graphics in regular memory (for example pointers into an asset
+ *   pack) and only uploads the ones in use, allocating their Pattern RAM with pattern_alloc.h:
+ *   * @ref pattern_cache_acquire returns where a graphic is in Pattern RAM, uploading it first if
+ *     needed, and adds a reference to it.
+ *   * @ref pattern_cache_release drops the reference. A graphic without references stays in
+ *     Pattern RAM, so acquiring it again is free, until its space is needed for another graphic.
+ *     Unreferenced graphics are then evicted, least recently released first.
+ *
+ * For an animated sprite, release the previous frame and acquire the next one each time the
+ *   animation advances. Uploads are recorded with vram_batch (see vram_batch.h), so they reach the
+ *   PPU with the frame that first uses them.
+ */
+
+#ifndef _TECHDEMO_PATTERN_CACHE_H_
+#define _TECHDEMO_PATTERN_CACHE_H_
+
+#include <fp-game/ppu.h>
+#include <stdint.h>
+
+/** @brief A graphic in the pool: a block of patterns, row by row, like @ref ppu_write_pattern */
+typedef struct {
+    const pattern_t *patterns;
+    unsigned width;   ///< Width in patterns. Range [1, PATTERN_BLOCK_MAX].
+    unsigned height;  ///< Height in patterns. Range [1, PATTERN_BLOCK_MAX].
+} pattern_source_t;
+
+/** @brief Cache state of one graphic in the pool */
+typedef struct {
+    pattern_addr_t pattern_addr;  ///< Where the graphic is, if resident
+    uint16_t refs;                ///< Number of references
+    uint8_t resident;             ///< Whether the graphic is in Pattern RAM
+    int prev, next;               ///< Neighbours in the LRU list, -1 at the ends
+} pattern_cache_slot_t;
+
+/** @brief A pattern cache over a pool of graphics */
+typedef struct {
+    const pattern_source_t *pool;
+    unsigned count;
+    pattern_cache_slot_t *slots;
+    int lru_head;                 ///< Least recently released unreferenced graphic, or -1
+    int lru_tail;                 ///< Most recently released unreferenced graphic, or -1
+    unsigned hits;                ///< Acquires of resident graphics
+    unsigned uploads;             ///< Acquires which had to upload the graphic
+    unsigned evictions;           ///< Graphics evicted to make room
+} pattern_cache_t;
+
+/** @brief Sets up a cache over a pool of graphics. Nothing is uploaded yet.
+ *
+ * The caller of this function must call pattern_cache_destroy to prevent memory leaks.
+ *
+ * @param cache The cache to set up.
+ * @param pool The graphics. Must stay valid while the cache is in use.
+ * @param count Number of graphics in @p pool.
+ * @return 0 on success; -1 if out of memory
+ */
+int pattern_cache_init(pattern_cache_t *cache, const pattern_source_t *pool, unsigned count);
+
+/** @brief Frees the Pattern RAM of all resident graphics and the cache's memory */
+void pattern_cache_destroy(pattern_cache_t *cache);
+
+/** @brief Adds a reference to a graphic, uploading it if it is not resident
+ * @param cache A set up cache.
+ * @param id Index of the graphic in the pool.
+ * @param pattern_addr Set to the top-left pattern of the graphic in Pattern RAM on success.
+ * @return 0 on success; -1 if Pattern RAM is full of referenced graphics
+ */
+int pattern_cache_acquire(pattern_cache_t *cache, unsigned id, pattern_addr_t *pattern_addr);
+
+/** @brief Drops a reference to a graphic. The graphic stays resident until evicted. */
+void pattern_cache_release(pattern_cache_t *cache, unsigned id);
+
+#endif /* _TECHDEMO_PATTERN_CACHE_H_ */
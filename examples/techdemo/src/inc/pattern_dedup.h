@@ -0,0 +1,92 @@
+/** @file pattern_dedup.h
+ * @brief Mirror-aware deduplication of patterns and sprite frames
+ *
+ * Pattern RAM only holds 1024 patterns, but tiles and sprites can draw any pattern mirrored in X,
+ *   Y or both. Art often repeats itself: the same 8x8 tile flipped to make corners, or a walking
+ *   animation whose frames repeat or are mirrors of each other. Every one of those copies takes a
+ *   slot of Pattern RAM if uploaded as it is.
+ *
+ * This module keeps one copy of each:
+ *   * @ref pattern_dedup_patterns deduplicates a set of 8x8 patterns, and
+ *     @ref pattern_dedup_tiles rewrites tilemaps to point at the kept patterns with the mirror bits
+ *     which turn them back into the originals.
+ *   * @ref pattern_dedup_frames does the same for sprite frames (blocks of up to 4x4 patterns,
+ *     mirrored as a whole like the PPU mirrors sprites). The game then draws frame i as kept frame
+ *     map[i].index, with its own mirror bits XORed with map[i].mirror.
+ *
+ * Each pattern or frame is hashed under all four mirror transforms and looked up in a hash table
+ *   of the ones kept so far, so a set is deduplicated in time proportional to its size. The first
+ *   of a group of duplicates is the one kept.
+ *
+ * Mirror bits compose by XOR: drawing with MIRROR_X a pattern which is itself stored mirrored in Y
+ *   shows the original mirrored in XY.
+ */
+
+#ifndef _TECHDEMO_PATTERN_DEDUP_H_
+#define _TECHDEMO_PATTERN_DEDUP_H_
+
+#include "pattern_cache.h"
+
+#include <fp-game/ppu.h>
+
+/** @brief Where a pattern or frame went after deduplication */
+typedef struct {
+    unsigned index;   ///< Index of the kept pattern or frame which draws it
+    mirror_e mirror;  ///< Mirror bits which turn the kept one back into it
+} pattern_dedup_map_t;
+
+/** @brief Mirrors a pattern
+ * @param src Pattern to mirror.
+ * @param mirror How to mirror it.
+ * @param dst Receives the mirrored pattern. Must not overlap @p src.
+ */
+void pattern_mirror(const pattern_t *src, mirror_e mirror, pattern_t *dst);
+
+/** @brief Deduplicates a set of 8x8 patterns
+ *
+ * Pattern i of the set is drawn by kept pattern map[i].index, mirrored by map[i].mirror. Kept
+ *   patterns keep their order. They are meant for consecutive pattern addresses, which are also
+ *   consecutive in VRAM, so a single @ref vram_batch_vram of count * sizeof(pattern_t) bytes at
+ *   vram_pattern_offset(to) uploads them all.
+ *
+ * @param patterns The set. It may hold more patterns than Pattern RAM, for example every tile of a
+ *                 level, as long as the kept ones fit where they are uploaded.
+ * @param count Number of patterns in the set.
+ * @param kept Receives the kept patterns, at most @p count. May be @p patterns itself.
+ * @param map Receives one entry per pattern of the set.
+ * @return Number of kept patterns; -1 if out of memory
+ */
+int pattern_dedup_patterns(const pattern_t *patterns, unsigned count, pattern_t *kept,
+                           pattern_dedup_map_t *map);
+
+/** @brief Rewrites tiles to point at deduplicated patterns
+ *
+ * Tiles pointing at pattern address from + i, for i < count, are rewritten to point at address
+ *   to + map[i].index, with their mirror bits XORed with map[i].mirror. Other tiles are copied as
+ *   they are.
+ *
+ * @param map Map filled by @ref pattern_dedup_patterns.
+ * @param count Number of entries in @p map.
+ * @param from Pattern address of the first pattern of the set, as the tiles use it.
+ * @param to Pattern address the kept patterns are uploaded to.
+ * @param src Tiles to rewrite, for example a tilemap from an asset pack.
+ * @param dst Receives the rewritten tiles. May be @p src itself.
+ * @param len Number of tiles.
+ */
+void pattern_dedup_tiles(const pattern_dedup_map_t *map, unsigned count, pattern_addr_t from,
+                         pattern_addr_t to, const tile_t *src, tile_t *dst, unsigned len);
+
+/** @brief Deduplicates a table of sprite frames, in place
+ *
+ * Frames only match frames of the same size. Afterwards, frames[0] to frames[n - 1] are the kept
+ *   frames, in their original order, and frame i of the original table is drawn by kept frame
+ *   map[i].index mirrored by map[i].mirror.
+ *
+ * @param frames The frame table. Each frame is at most 4x4 patterns.
+ * @param count Number of frames.
+ * @param map Receives one entry per frame of the original table.
+ * @return Number of kept frames n; -1 if out of memory
+ */
+int pattern_dedup_frames(pattern_source_t *frames, unsigned count, pattern_dedup_map_t *map);
+
+#endif /* _TECHDEMO_PATTERN_DEDUP_H_ */
@@ -0,0 +1,144 @@
+/** @file sprite_packed.h
+ * @brief Builds and edits sprites in the native Sprite RAM format
+ *
+ * A sprite_t is convenient to fill in, but has to be packed and validated field by field every
+ *   time it is written. Sprite RAM stores each sprite as a 32-bit entry word (pattern, palette,
+ *   y, x) in one array and an 8-bit extra data entry (mirror, height, width, priority) in
+ *   another (see vram_layout.h). Games with many sprites can keep their sprites in that format
+ *   instead:
+ *   * Build the words and extras once, with @ref sprite_pack_word and @ref sprite_pack_extra, or
+ *     @ref sprite_pack from a sprite_t.
+ *   * Change single fields in place from then on, for example @ref sprite_word_set_position for
+ *     movement and @ref sprite_word_set_pattern for animation.
+ *   * Record them with @ref vram_batch_sprites_packed, which copies them as they are. Extras can
+ *     be skipped when only words changed.
+ *
+ * Arguments are only checked in debug builds. Without NDEBUG, an invalid field aborts the program
+ *   like the rest of the techdemo helpers. With NDEBUG, it is masked to the width of its field.
+ */
+
+#ifndef _TECHDEMO_SPRITE_PACKED_H_
+#define _TECHDEMO_SPRITE_PACKED_H_
+
+#include <fp-game/ppu.h>
+
+#include "noway.h"
+#include "vram_layout.h"
+
+#include <stdint.h>
+
+/** @brief Builds a Sprite RAM entry word
+ * @param pattern_addr Top-left pattern of the sprite's graphics.
+ * @param palette_id Sprite palette. Range [0, SPRLAYER_MAX_PALETTES - 1].
+ * @param x X coordinate. Range [0, SPRITE_MAXX].
+ * @param y Y coordinate. Range [0, SPRITE_MAXY].
+ */
+static inline uint32_t sprite_pack_word(pattern_addr_t pattern_addr, unsigned palette_id,
+                                        unsigned x, unsigned y)
+{
+    nowaydebug(pattern_addr >= PATTERNRAM_WIDTH * PATTERNRAM_HEIGHT, "Pattern address malformed!");
+    nowaydebug(palette_id >= SPRLAYER_MAX_PALETTES, "Palette ID out of range!");
+    nowaydebug(x > SPRITE_MAXX, "Sprite x coord. out of range!");
+    nowaydebug(y > SPRITE_MAXY, "Sprite y coord. out of range!");
+
+    return ((pattern_addr & SPRITE_WORD_PATTERN_MASK) << SPRITE_WORD_PATTERN_SHIFT) |
+           ((palette_id & SPRITE_WORD_PALETTE_MASK) << SPRITE_WORD_PALETTE_SHIFT) |
+           ((y & SPRITE_WORD_Y_MASK) << SPRITE_WORD_Y_SHIFT) |
+           ((x & SPRITE_WORD_X_MASK) << SPRITE_WORD_X_SHIFT);
+}
+
+/** @brief Builds a Sprite RAM extra data entry
+ * @param width Width in patterns. Range [1, 4].
+ * @param height Height in patterns. Range [1, 4].
+ * @param mirror Mirroring of the sprite's graphics.
+ * @param prio Layer the sprite is drawn in.
+ */
+static inline uint8_t sprite_pack_extra(unsigned width, unsigned height, mirror_e mirror,
+                                        render_prio_e prio)
+{
+    nowaydebug(width == 0 || width > 4, "Sprite width must be in range [1, 4]!");
+    nowaydebug(height == 0 || height > 4, "Sprite height must be in range [1, 4]!");
+    nowaydebug(mirror > MIRROR_XY, "Mirror argument malformed!");
+    nowaydebug(prio > PRIO_IN_FRONT, "Sprite Priority exceeds maximum (2)!");
+
+    return (uint8_t)((((unsigned)mirror & SPRITE_EXTRA_MIRROR_MASK) << SPRITE_EXTRA_MIRROR_SHIFT) |
+                     (((height - 1) & SPRITE_EXTRA_HEIGHT_MASK) << SPRITE_EXTRA_HEIGHT_SHIFT) |
+                     (((width - 1) & SPRITE_EXTRA_WIDTH_MASK) << SPRITE_EXTRA_WIDTH_SHIFT) |
+                     (((unsigned)prio & SPRITE_EXTRA_PRIO_MASK) << SPRITE_EXTRA_PRIO_SHIFT));
+}
+
+/** @brief Packs @p sprite into its entry word and extra data entry */
+static inline void sprite_pack(const sprite_t *sprite, uint32_t *word, uint8_t *extra)
+{
+    *word = sprite_pack_word(sprite->pattern_addr, sprite->palette_id, sprite->x, sprite->y);
+    *extra = sprite_pack_extra(sprite->width, sprite->height, sprite->mirror, sprite->prio);
+}
+
+/** @brief Gets the x coordinate of an entry word */
+static inline unsigned sprite_word_x(uint32_t word)
+{
+    return (word >> SPRITE_WORD_X_SHIFT) & SPRITE_WORD_X_MASK;
+}
+
+/** @brief Gets the y coordinate of an entry word */
+static inline unsigned sprite_word_y(uint32_t word)
+{
+    return (word >> SPRITE_WORD_Y_SHIFT) & SPRITE_WORD_Y_MASK;
+}
+
+/** @brief Gets the pattern address of an entry word */
+static inline pattern_addr_t sprite_word_pattern(uint32_t word)
+{
+    return (word >> SPRITE_WORD_PATTERN_SHIFT) & SPRITE_WORD_PATTERN_MASK;
+}
+
+/** @brief Moves the sprite of an entry word. See @ref sprite_pack_word for the ranges. */
+static inline void sprite_word_set_position(uint32_t *word, unsigned x, unsigned y)
+{
+    nowaydebug(x > SPRITE_MAXX, "Sprite x coord. out of range!");
+    nowaydebug(y > SPRITE_MAXY, "Sprite y coord. out of range!");
+
+    *word = (*word & ~((SPRITE_WORD_X_MASK << SPRITE_WORD_X_SHIFT) |
+                       (SPRITE_WORD_Y_MASK << SPRITE_WORD_Y_SHIFT))) |
+            ((x & SPRITE_WORD_X_MASK) << SPRITE_WORD_X_SHIFT) |
+            ((y & SPRITE_WORD_Y_MASK) << SPRITE_WORD_Y_SHIFT);
+}
+
+/** @brief Changes the graphics (for example the animation frame) of an entry word */
+static inline void sprite_word_set_pattern(uint32_t *word, pattern_addr_t pattern_addr)
+{
+    nowaydebug(pattern_addr >= PATTERNRAM_WIDTH * PATTERNRAM_HEIGHT, "Pattern address malformed!");
+
+    *word = (*word & ~(SPRITE_WORD_PATTERN_MASK << SPRITE_WORD_PATTERN_SHIFT)) |
+            ((pattern_addr & SPRITE_WORD_PATTERN_MASK) << SPRITE_WORD_PATTERN_SHIFT);
+}
+
+/** @brief Changes the palette of an entry word */
+static inline void sprite_word_set_palette(uint32_t *word, unsigned palette_id)
+{
+    nowaydebug(palette_id >= SPRLAYER_MAX_PALETTES, "Palette ID out of range!");
+
+    *word = (*word & ~(SPRITE_WORD_PALETTE_MASK << SPRITE_WORD_PALETTE_SHIFT)) |
+            ((palette_id & SPRITE_WORD_PALETTE_MASK) << SPRITE_WORD_PALETTE_SHIFT);
+}
+
+/** @brief Changes the mirroring of an extra data entry */
+static inline void sprite_extra_set_mirror(uint8_t *extra, mirror_e mirror)
+{
+    nowaydebug(mirror > MIRROR_XY, "Mirror argument malformed!");
+
+    *extra = (uint8_t)((*extra & ~(SPRITE_EXTRA_MIRROR_MASK << SPRITE_EXTRA_MIRROR_SHIFT)) |
+                       (((unsigned)mirror & SPRITE_EXTRA_MIRROR_MASK)
+                        << SPRITE_EXTRA_MIRROR_SHIFT));
+}
+
+/** @brief Changes the priority of an extra data entry */
+static inline void sprite_extra_set_prio(uint8_t *extra, render_prio_e prio)
+{
+    nowaydebug(prio > PRIO_IN_FRONT, "Sprite Priority exceeds maximum (2)!");
+
+    *extra = (uint8_t)((*extra & ~(SPRITE_EXTRA_PRIO_MASK << SPRITE_EXTRA_PRIO_SHIFT)) |
+                       (((unsigned)prio & SPRITE_EXTRA_PRIO_MASK) << SPRITE_EXTRA_PRIO_SHIFT));
+}
+
+#endif /* _TECHDEMO_SPRITE_PACKED_H_ */
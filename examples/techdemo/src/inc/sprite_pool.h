@@ -0,0 +1,68 @@
+/** @file sprite_pool.h
+ * @brief Virtual sprites, packed into the 64 hardware sprites every frame
+ *
+ * Sprite RAM holds 64 sprites, and a game which writes it directly has to assign sprite IDs
+ *   itself, keep them in drawing order and rewrite them as objects come and go. The sprite pool
+ *   holds up to SPRITE_POOL_SIZE sprites behind stable handles instead. Once per frame,
+ *   @ref sprite_pool_submit:
+ *   1. Culls sprites which are entirely off screen.
+ *   2. Sorts the rest into drawing order: where sprites overlap, the lowest sprite ID is drawn on
+ *      top, so front (PRIO_IN_FRONT) sprites come first, then middle, then back ones. Within a
+ *      priority, lower depths come first. Sprites with the same priority and depth keep the order
+ *      in which they were added.
+ *   3. Packs the first 64 into Sprite RAM, and hides the unused sprite IDs.
+ *   4. Records only the range of sprite IDs which changed since the last submit with vram_batch.
+ *
+ * If more than 64 sprites are on screen, the ones sorted last are not shown. In multiplex mode,
+ *   the shown sprites rotate instead, so every sprite is shown in most frames and the overflow
+ *   flickers rather than disappears.
+ *
+ * Games must not write Sprite RAM themselves while using the pool.
+ */
+
+#ifndef _TECHDEMO_SPRITE_POOL_H_
+#define _TECHDEMO_SPRITE_POOL_H_
+
+#include <fp-game/ppu.h>
+
+#define SPRITE_POOL_SIZE 256 ///< Number of sprites the pool can hold
+
+/** @brief Handle of a sprite in the pool. Stays safe to use after the sprite is removed. */
+typedef int sprite_handle_t;
+
+/** @brief Removes every sprite from the pool and turns multiplexing off */
+void sprite_pool_reset(void);
+
+/** @brief Adds a sprite to the pool
+ * @param sprite Initial sprite data, with x and y relative to the top-left of the screen.
+ * @param depth Drawing order among sprites of the same priority. Lower depths are drawn on top.
+ * @return Handle of the new sprite; -1 if the pool is full
+ */
+sprite_handle_t sprite_pool_add(const sprite_t *sprite, int depth);
+
+/** @brief Removes a sprite from the pool. Does nothing if @p handle was already removed. */
+void sprite_pool_remove(sprite_handle_t handle);
+
+/** @brief Gets the data of a sprite, for the game to change
+ *
+ * Changes are shown from the next @ref sprite_pool_submit on, which validates them in debug builds.
+ *
+ * @return The sprite data; NULL if @p handle was removed
+ */
+sprite_t *sprite_pool_get(sprite_handle_t handle);
+
+/** @brief Changes the drawing order of a sprite. See @ref sprite_pool_add. */
+void sprite_pool_set_depth(sprite_handle_t handle, int depth);
+
+/** @brief Turns rotating the shown sprites when more than 64 are on screen on or off */
+void sprite_pool_set_multiplex(int enable);
+
+/** @brief Packs the sprites into Sprite RAM, recording the changes with vram_batch
+ *
+ * Call once per frame between @ref vram_batch_begin and @ref vram_batch_update.
+ *
+ * @return Number of sprites on screen, including any which could not be shown this frame
+ */
+unsigned sprite_pool_submit(void);
+
+#endif /* _TECHDEMO_SPRITE_POOL_H_ */
@@ -0,0 +1,80 @@
+/** @file tile_anim.h
+ * @brief Animated tiles, by swapping the patterns they point at on a schedule
+ *
+ * Tiles which animate (water, flowers, blinking lights) all point at a few pattern addresses. The
+ *   tiles never change: animating them means writing the next frame's graphics into those pattern
+ *   addresses. A tile animation scheduler takes care of the timing:
+ *   * @ref tile_anim_add registers a pattern address with its frames and how many frames of
+ *     gameplay each one is shown for. Its first frame is recorded right away.
+ *   * @ref tile_anim_update advances the clock by one frame and records the next frame of every
+ *     animated pattern whose current frame has run out.
+ *
+ * Patterns are recorded with vram_batch, so they never block, and animated patterns which change
+ *   in the same frame and sit next to each other in Pattern RAM are sent in one write.
+ *
+ * Animations are kept on a timing wheel: each update only looks at the animations due in that
+ *   frame, so the cost of an update grows with the number of patterns which change, not with the
+ *   number of animations.
+ */
+
+#ifndef _TECHDEMO_TILE_ANIM_H_
+#define _TECHDEMO_TILE_ANIM_H_
+
+#include <fp-game/ppu.h>
+
+#define TILE_ANIM_WHEEL_SIZE 256 ///< Number of frames ahead the timing wheel covers in one turn
+
+/** @brief One animated pattern address */
+typedef struct {
+    pattern_addr_t pattern_addr;
+    const pattern_t *const *frames;  ///< The graphics of each frame
+    const unsigned *durations;       ///< How many frames of gameplay each frame is shown for
+    unsigned count;                  ///< Number of frames, 0 if the slot is free
+    unsigned frame;                  ///< Frame shown now
+    unsigned due;                    ///< Tick at which the next frame is shown
+    int prev, next;                  ///< Neighbours in the wheel bucket, or in the free list
+} tile_anim_slot_t;
+
+/** @brief A tile animation scheduler */
+typedef struct {
+    tile_anim_slot_t *slots;
+    unsigned capacity;
+    int free_head;                   ///< First free slot, or -1
+    int wheel[TILE_ANIM_WHEEL_SIZE]; ///< First slot of each bucket, or -1
+    unsigned now;                    ///< Number of updates so far
+} tile_anim_t;
+
+/** @brief Sets up a scheduler for up to @p capacity animations
+ *
+ * The caller of this function must call tile_anim_destroy to prevent memory leaks.
+ *
+ * @return 0 on success; -1 if out of memory
+ */
+int tile_anim_init(tile_anim_t *anim, unsigned capacity);
+
+/** @brief Frees the scheduler's memory */
+void tile_anim_destroy(tile_anim_t *anim);
+
+/** @brief Animates the pattern at @p pattern_addr, and records its first frame
+ * @param anim A set up scheduler.
+ * @param pattern_addr Pattern address the animation is written to.
+ * @param frames @p count patterns, one per frame. Must stay valid while the animation runs.
+ * @param durations @p count frame lengths, each >= 1. Must stay valid while the animation runs.
+ * @param count Number of frames. Must be >= 1.
+ * @return ID of the animation; -1 if the scheduler is full
+ */
+int tile_anim_add(tile_anim_t *anim, pattern_addr_t pattern_addr, const pattern_t *const *frames,
+                  const unsigned *durations, unsigned count);
+
+/** @brief Stops an animation. Its pattern address keeps the frame shown last. */
+void tile_anim_remove(tile_anim_t *anim, int id);
+
+/** @brief Advances all animations by one frame and records the patterns which changed
+ *
+ * Call once per frame between @ref vram_batch_begin and @ref vram_batch_update.
+ *
+ * @return Number of patterns recorded
+ */
+unsigned tile_anim_update(tile_anim_t *anim);
+
+#endif /* _TECHDEMO_TILE_ANIM_H_ */
@@ -0,0 +1,69 @@
+/** @file tilemap_stream.h
+ * @brief Scrolling over tilemaps larger than a tile layer
+ *
+ * A tile layer holds 64x64 tiles (512x512 pixels), so a game which loads its whole level into the
+ *   layer has to clamp the camera at the layer's edges. A tilemap stream instead treats the layer
+ *   as a 64x64 window which slides over a map of any size: map tile (x, y) is always stored at
+ *   layer tile (x % 64, y % 64), and the layer scroll is the camera position modulo 512. When the
+ *   camera moves, the window follows it and only the newly exposed rows and columns of the map
+ *   are written, overwriting the ones which fell out on the opposite side.
+ *
+ * The window is kept centered on the screen, which leaves about 11 columns and 16 rows of map
+ *   preloaded on each side. Preloading is spread over frames: at most lines_per_frame rows or
+ *   columns are written per update, except when the screen itself would show tiles which are not
+ *   loaded yet (a fast camera, or the first update). Each row or column is 64 tiles.
+ *
+ * All writes go through vram_batch (see vram_batch.h), and the map is only read, so it can point
+ *   straight into an asset pack (see @ref asset_pack_tilemap).
+ */
+
+#ifndef _TECHDEMO_TILEMAP_STREAM_H_
+#define _TECHDEMO_TILEMAP_STREAM_H_
+
+#include <fp-game/ppu.h>
+
+/** @brief A map streamed into a tile layer */
+typedef struct {
+    const tile_t *map;          ///< Map tiles, row by row
+    unsigned map_width;         ///< Map width in tiles
+    unsigned map_height;        ///< Map height in tiles
+    layer_e layer;              ///< Tile layer the map is streamed into
+    unsigned lines_per_frame;   ///< Preloaded rows and columns written per update, at most
+    unsigned window_width;      ///< Width of the window in tiles (64, or less for a narrow map)
+    unsigned window_height;     ///< Height of the window in tiles (64, or less for a short map)
+    unsigned window_x;          ///< Map column at the left edge of the loaded window
+    unsigned window_y;          ///< Map row at the top edge of the loaded window
+    int loaded;                 ///< Whether the window has been loaded yet
+} tilemap_stream_t;
+
+/** @brief Sets up streaming of a map into a tile layer
+ *
+ * Nothing is written until the first @ref tilemap_stream_update, which loads the whole window.
+ *
+ * @param stream The stream to set up.
+ * @param map Map tiles, row by row. Must stay valid while the stream is in use.
+ * @param map_width Map width in tiles. The map must be at least as large as the screen.
+ * @param map_height Map height in tiles.
+ * @param layer Must be either LAYER_BG or LAYER_FG.
+ * @param lines_per_frame Rows and columns which may be preloaded per update. 1 or 2 keep up with a
+ *                        camera moving 8 or 16 pixels per frame without falling back on the
+ *                        screen's own rows and columns.
+ */
+void tilemap_stream_init(tilemap_stream_t *stream, const tile_t *map, unsigned map_width,
+                         unsigned map_height, layer_e layer, unsigned lines_per_frame);
+
+/** @brief Moves the camera, recording the scroll and any rows and columns needed
+ *
+ * Call once per frame between @ref vram_batch_begin and @ref vram_batch_update. Records the
+ *   layer's scroll, so the game must not record a scroll for that layer itself.
+ *
+ * @param stream A set up stream.
+ * @param camera_x Map position, in pixels, shown at the left edge of the screen. Must leave the
+ *                 screen within the map.
+ * @param camera_y Map position, in pixels, shown at the top edge of the screen. Must leave the
+ *                 screen within the map.
+ * @return Number of rows and columns written
+ */
+unsigned tilemap_stream_update(tilemap_stream_t *stream, unsigned camera_x, unsigned camera_y);
+
+#endif /* _TECHDEMO_TILEMAP_STREAM_H_ */
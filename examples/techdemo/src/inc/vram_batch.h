@@ -0,0 +1,153 @@
+/** @file vram_batch.h
+ * @brief Recorded VRAM command list for the FP-GAme PPU
+ *
+ * Every ppu_write_x call in the PPU User Library is its own device write, and each one can fail
+ *   with -1 while the PPU is busy. A game which writes many objects per frame ends up polling
+ *   dozens of calls.
+ *
+ * This module records a frame's worth of writes in user space instead:
+ *   1. @ref vram_batch_begin starts a new frame.
+ *   2. The vram_batch_x record functions (which mirror the ppu_write_x and ppu_set_x functions)
+ *      copy their data into a local VRAM image. They never fail.
+ *   3. @ref vram_batch_update sends every part of the image which changed since the last submit,
+ *      merging nearby changes so that each merged range costs a single @ref ppu_write_vram. It
+ *      then applies any scroll, bgcolor and layer-enable setting which changed, and finally calls
+ *      @ref ppu_update.
+ *
+ * A shadow copy of the PPU's VRAM buffer is kept alongside the image, and changes are tracked in
+ *   32B chunks. Rewriting data which is already in VRAM (the same sprite or scroll every frame, for
+ *   example) therefore costs nothing at submit time.
+ *
+ * If the PPU is busy part-way through, the submit functions return -1 and remember what has
+ *   already been sent. Polling them again resumes where they left off.
+ *
+ * Instead of submitting, @ref vram_batch_take can move a frame's changes into a @ref vram_frame_t,
+ *   to be sent later (or by another thread) with @ref vram_frame_submit. See frame_pipeline.h.
+ *
+ * @attention The first submit uploads the entire image, since the module cannot know what VRAM
+ *   held before. After that, all VRAM writes must go through this module: writes made directly
+ *   with the ppu_write_x functions are not reflected in the shadow.
+ * @attention Invalid arguments abort the program, exactly like the PPU User Library functions.
+ */
+
+#ifndef _TECHDEMO_VRAM_BATCH_H_
+#define _TECHDEMO_VRAM_BATCH_H_
+
+#include "vram_layout.h"
+
+#include <fp-game/ppu.h>
+
+#include <stdint.h>
+
+#define VRAM_FRAME_MAX_RANGES 512 ///< Most VRAM ranges one frame's changes are merged into
+
+/** @brief Indices of the settings in vram_frame_t */
+typedef enum {
+    VRAM_FRAME_BGSCROLL,
+    VRAM_FRAME_FGSCROLL,
+    VRAM_FRAME_BGCOLOR,
+    VRAM_FRAME_LAYER_ENABLE,
+    VRAM_FRAME_SETTINGS
+} vram_frame_setting_e;
+
+/** @brief The changes of one frame, taken out of the batch to be submitted later
+ *
+ * Holds copies of the changed VRAM ranges and the changed settings, so it stays valid while the
+ *   game records the next frame. About 70KiB, so keep it out of the stack.
+ */
+typedef struct {
+    uint8_t data[VRAM_BSIZE];                     ///< Bytes of every range, back to back
+    uint32_t range_offset[VRAM_FRAME_MAX_RANGES]; ///< VRAM offset of each range
+    uint32_t range_len[VRAM_FRAME_MAX_RANGES];    ///< Length of each range
+    unsigned range_count;
+    unsigned data_len;
+    unsigned settings[VRAM_FRAME_SETTINGS];       ///< Scroll (y << 16 | x), bgcolor, layer mask
+    unsigned settings_mask;                       ///< Bit i is set if settings[i] must be sent
+    unsigned sent_ranges;                         ///< Ranges already sent, to resume when busy
+    unsigned sent_data;                           ///< Bytes of data already sent
+} vram_frame_t;
+
+/** @brief Starts recording a new frame, dropping anything recorded but not yet submitted */
+void vram_batch_begin(void);
+
+/** @brief Records a @ref ppu_write_vram. See that function for the argument descriptions. */
+void vram_batch_vram(const void *buf, size_t len, off_t offset);
+
+/** @brief Records a @ref ppu_write_tiles_horizontal. Same arguments, wrap-around and repeats. */
+void vram_batch_tiles_horizontal(const tile_t *tiles, unsigned len, layer_e layer, unsigned x_i,
+                                 unsigned y_i, unsigned count);
+
+/** @brief Records a @ref ppu_write_tiles_vertical. Same arguments, wrap-around and repeats. */
+void vram_batch_tiles_vertical(const tile_t *tiles, unsigned len, layer_e layer, unsigned x_i,
+                               unsigned y_i, unsigned count);
+
+/** @brief Records a @ref ppu_write_pattern. Patterns wrap around the edges of Pattern RAM. */
+void vram_batch_pattern(const pattern_t *pattern, unsigned width, unsigned height,
+                        pattern_addr_t pattern_addr);
+
+/** @brief Records a @ref ppu_write_palette */
+void vram_batch_palette(const palette_t *palette, layer_e layer_id, unsigned palette_id);
+
+/** @brief Records a @ref ppu_write_sprites */
+void vram_batch_sprites(const sprite_t *sprites, unsigned len, unsigned sprite_id_i);
+
+/** @brief Records sprites already packed into the Sprite RAM format (see sprite_packed.h)
+ *
+ * The entries are copied as they are, without validation.
+ *
+ * @param words Entry words of sprites @p sprite_id_i to @p sprite_id_i + @p len - 1.
+ * @param extras Extra data entries of the same sprites, or NULL to leave them unchanged.
+ * @param len Number of sprites.
+ * @param sprite_id_i First sprite ID.
+ */
+void vram_batch_sprites_packed(const uint32_t *words, const uint8_t *extras, unsigned len,
+                               unsigned sprite_id_i);
+
+/** @brief Records a @ref ppu_set_bgcolor. Only the latest color is applied, if it changed. */
+void vram_batch_bgcolor(unsigned color);
+
+/** @brief Records a @ref ppu_set_scroll. Only the latest scroll is applied, if it changed. */
+void vram_batch_scroll(layer_e tile_layer, unsigned scroll_x, unsigned scroll_y);
+
+/** @brief Records a @ref ppu_set_layer_enable. Only the latest mask is applied, if it changed. */
+void vram_batch_layer_enable(unsigned enable_mask);
+
+/** @brief Sends all recorded changes to the PPU's VRAM buffer, without calling ppu_update
+ *
+ * Useful for committing assets loaded at startup before entering the game loop.
+ *
+ * @pre PPU is currently locked by this process. See @ref ppu_enable.
+ * @return 0 once everything recorded has been sent; -1 if PPU busy (poll again to resume)
+ */
+int vram_batch_submit(void);
+
+/** @brief Submits all recorded changes, then requests they be rendered with @ref ppu_update
+ *
+ * Replaces the usual "poll every ppu_write_x, then poll ppu_update" sequence at the end of a
+ *   game loop iteration with a single polled call.
+ *
+ * @pre PPU is currently locked by this process. See @ref ppu_enable.
+ * @return 0 on success; -1 if PPU busy (poll again to resume)
+ */
+int vram_batch_update(void);
+
+/** @brief Moves everything recorded since the last submit or take into @p frame
+ *
+ * Afterwards, the batch treats the changes as submitted: the next frame's changes are relative to
+ *   this one. Frames must therefore be submitted in the order they were taken, and none may be
+ *   skipped. Never fails and never touches the PPU.
+ *
+ * @param frame Frame to fill in. Anything it held is replaced.
+ */
+void vram_batch_take(vram_frame_t *frame);
+
+/** @brief Sends a frame taken with @ref vram_batch_take to the PPU's VRAM buffer
+ *
+ * Like @ref vram_batch_submit, this does not call ppu_update.
+ *
+ * @pre PPU is currently locked by this process. See @ref ppu_enable.
+ * @return 0 once the whole frame has been sent; -1 if PPU busy (poll again to resume)
+ */
+int vram_frame_submit(vram_frame_t *frame);
+
+#endif /* _TECHDEMO_VRAM_BATCH_H_ */
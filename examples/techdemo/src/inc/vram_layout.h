@@ -0,0 +1,117 @@
+/** @file vram_layout.h
+ * @brief Byte-level layout of the PPU's VRAM, as written by the FP-GAme User Library
+ *
+ * ppu.h exposes the section offsets of VRAM. This header adds the entry sizes and bit packing of
+ *   each section so that helper modules can build VRAM images in user space and hand them to
+ *   @ref ppu_write_vram in large chunks, instead of going through one ppu_write_x call (and one
+ *   device write) per object.
+ *
+ * VRAM is 64KiB:
+ *   0x0000: Tile RAM. 64x64 tile_t for the background layer, then 64x64 for the foreground layer.
+ *   0x4000: Pattern RAM. 32x32 pattern_t in row-major order.
+ *   0xC000: Palette RAM. 16 BG, 16 FG and 32 sprite palettes of 16 colors (color 0 is unused).
+ *   0xD000: Sprite RAM. 64 4B sprite entries, then 64 1B "extra data" entries at 0xD100.
+ */
+
+#ifndef _TECHDEMO_VRAM_LAYOUT_H_
+#define _TECHDEMO_VRAM_LAYOUT_H_
+
+#include <fp-game/ppu.h>
+
+#include <stdint.h>
+
+#define VRAM_BSIZE 0x10000         ///< Size (in Bytes) of VRAM
+#define TILERAM_LAYER_BSIZE 0x2000 ///< Size (in Bytes) of a single tile layer in Tile RAM
+#define PATTERNRAM_WIDTH 32        ///< Width (in patterns) of Pattern RAM
+#define PATTERNRAM_HEIGHT 32       ///< Height (in patterns) of Pattern RAM
+#define PALETTE_BSIZE 64           ///< Size (in Bytes) of one palette slot in Palette RAM
+#define PALETTE_COLOR_BOFFSET 4    ///< Byte offset of palette_t::color[0] within a palette slot
+#define SPRITE_MAXCOUNT 64         ///< Number of sprite entries in Sprite RAM
+#define SPRITE_BSIZE 4             ///< Size (in Bytes) of one sprite entry
+#define SPRITE_MAXX 511            ///< Largest legal sprite x coordinate
+#define SPRITE_MAXY 255            ///< Largest legal sprite y coordinate
+#define SCREEN_WIDTH 320           ///< Width (in pixels) of the screen
+#define SCREEN_HEIGHT 240          ///< Height (in pixels) of the screen
+#define TILE_PX 8                  ///< Width and height (in pixels) of a tile or pattern
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+/** @brief Packs a pattern address, like @ref ppu_pattern_addr (y, x from MSB to LSB) */
+static inline pattern_addr_t vram_pattern_addr(unsigned x, unsigned y)
+{
+    return (y << 5) | x;
+}
+
+/** @brief Packs a tile, like @ref ppu_make_tile (pattern address, palette, mirror from MSB) */
+static inline tile_t vram_tile(pattern_addr_t pattern_addr, unsigned palette_id, mirror_e mirror)
+{
+    return (tile_t)((pattern_addr << 6) | (palette_id << 2) | mirror);
+}
+
+/** @brief VRAM byte offset of tile ( @p x, @p y ) of tile layer @p layer (LAYER_BG or LAYER_FG) */
+static inline uint32_t vram_tile_offset(layer_e layer, unsigned x, unsigned y)
+{
+    uint32_t section = (layer == LAYER_FG) ? TILERAM_FGOFFSET : 0;
+
+    return section + (y * TILELAYER_WIDTH + x) * sizeof(tile_t);
+}
+
+/** @brief VRAM byte offset of the pattern at @p pattern_addr */
+static inline uint32_t vram_pattern_offset(pattern_addr_t pattern_addr)
+{
+    return VRAM_PATTERNOFFSET + pattern_addr * TILEPATTERN_BSIZE;
+}
+
+/** @brief VRAM byte offset of color 1 of palette @p palette_id of @p layer
+ *
+ * Follows @ref ppu_write_palette: LAYER_SPR selects the sprite section, LAYER_FG the foreground
+ *   section, and anything else the background section.
+ */
+static inline uint32_t vram_palette_offset(layer_e layer, unsigned palette_id)
+{
+    uint32_t section = (layer == LAYER_SPR) ? PALETTERAM_SPROFFSET :
+                       (layer == LAYER_FG)  ? PALETTERAM_FGOFFSET : PALETTERAM_BGOFFSET;
+
+    return VRAM_PALETTEOFFSET + section + palette_id * PALETTE_BSIZE + PALETTE_COLOR_BOFFSET;
+}
+
+// Bit fields of a Sprite RAM entry word, from LSB to MSB
+#define SPRITE_WORD_X_SHIFT 0
+#define SPRITE_WORD_X_MASK 0x1FFu
+#define SPRITE_WORD_Y_SHIFT 9
+#define SPRITE_WORD_Y_MASK 0xFFu
+#define SPRITE_WORD_PALETTE_SHIFT 17
+#define SPRITE_WORD_PALETTE_MASK 0x1Fu
+#define SPRITE_WORD_PATTERN_SHIFT 22
+#define SPRITE_WORD_PATTERN_MASK 0x3FFu
+
+// Bit fields of a Sprite RAM extra data entry, from LSB to MSB. Width and height are stored - 1.
+#define SPRITE_EXTRA_PRIO_SHIFT 0
+#define SPRITE_EXTRA_PRIO_MASK 0x3u
+#define SPRITE_EXTRA_WIDTH_SHIFT 2
+#define SPRITE_EXTRA_WIDTH_MASK 0x3u
+#define SPRITE_EXTRA_HEIGHT_SHIFT 4
+#define SPRITE_EXTRA_HEIGHT_MASK 0x3u
+#define SPRITE_EXTRA_MIRROR_SHIFT 6
+#define SPRITE_EXTRA_MIRROR_MASK 0x3u
+
+/** @brief Packs the Sprite RAM entry of @p sprite (pattern, palette, y, x from MSB to LSB) */
+static inline uint32_t vram_sprite_word(const sprite_t *sprite)
+{
+    return ((uint32_t)sprite->pattern_addr << SPRITE_WORD_PATTERN_SHIFT) |
+           ((uint32_t)sprite->palette_id << SPRITE_WORD_PALETTE_SHIFT) |
+           ((uint32_t)sprite->y << SPRITE_WORD_Y_SHIFT) |
+           ((uint32_t)sprite->x << SPRITE_WORD_X_SHIFT);
+}
+
+/** @brief Packs the extra data entry of @p sprite (mirror, height-1, width-1, prio) */
+static inline uint8_t vram_sprite_extra(const sprite_t *sprite)
+{
+    return (uint8_t)((sprite->mirror << SPRITE_EXTRA_MIRROR_SHIFT) |
+                     ((sprite->height - 1) << SPRITE_EXTRA_HEIGHT_SHIFT) |
+                     ((sprite->width - 1) << SPRITE_EXTRA_WIDTH_SHIFT) |
+                     (sprite->prio << SPRITE_EXTRA_PRIO_SHIFT));
+}
+
+#endif /* _TECHDEMO_VRAM_LAYOUT_H_ */
@@ -4,11 +4,24 @@
  * Author: Joseph Yankel
  */
 
-#include <fp-game/apu.h>
 #include <fp-game/ppu.h>
 #include <fp-game/con.h>
 
-#include <stdlib.h>
+#include "asset_pack.h"
+#include "audio_mixer.h"
+#include "con_input.h"
+#include "ctilemap.h"
+#include "frame_pacer.h"
+#include "frame_pipeline.h"
+#include "metatile.h"
+#include "palette_fx.h"
+#include "pattern_alloc.h"
+#include "pattern_cache.h"
+#include "pattern_dedup.h"
+#include "sprite_pool.h"
+#include "tile_anim.h"
+#include "vram_batch.h"
+
 #include <stdio.h>
 
 // scotty's animation delay (slightly slower than 8 fps)
@@ -17,12 +30,15 @@
 // world tiles animation delay (around 2 fps)
 #define WORLD_ANIM_DELAY 30
 
+// length of the fade in from black at startup (half a second)
+#define FADE_IN_FRAMES 30
+
 // Palette IDs
 #define THE_MALL_PALETTE_ID 0
 #define SCOTTY_PALLETE_ID 0
 
-// Sprite IDs
-#define SCOTTY_SPRITE_ID 0
+// Drawing order among sprites of the same priority
+#define SCOTTY_DEPTH 0
 
 // Max scroll values for tile layer (Don't let scotty cross the edges of our 320x240 screen!)
 #define MAX_TILE_SCROLL_X (512 - 320)
@@ -32,74 +48,96 @@
 #define SCOTTY_CENTER_X ((320 - 16)>>1)
 #define SCOTTY_CENTER_Y ((240 - 16)>>1)
 
-#define MIN(a, b) (((a) < (b)) ? (a) : (b))
-
 // Animation states for Scotty. Determines which way he is facing.
 typedef enum { SCOTTY_FRONT=0, SCOTTY_BACK=1, SCOTTY_RSIDE=2, SCOTTY_LSIDE=3 } scotty_state_e;
 
-static unsigned bark_btn_pressed = 0;
-static unsigned start_new_bark = 0;
-
-// the filenames for all mall patterns in order of their position in Pattern RAM
-const char *the_mall_pattern_fns[] = {
-    "assets/1-grass-0.pattern",
-    "assets/2-grass_angled-0.pattern",
-    "assets/3-grass_horizontal-0.pattern",
-    "assets/4-grass_corner-0.pattern",
-    "assets/5-grass_vertical-0.pattern",
-    "assets/6-gravel.pattern",
-    "assets/7-pavement.pattern",
-    "assets/8-pink_bush_base-0.pattern",
-    "assets/9-pink_bush_branch-0.pattern"
+// Mixer priority of scotty's bark
+#define BARK_PRIORITY 1
+
+// all game assets, packed from the text files in assets/ with user_tools/pack_assets.py
+#define ASSET_PACK_FILE "assets/techdemo.fpak"
+
+// the names of all mall patterns in order of their position in Pattern RAM
+const char *the_mall_pattern_names[] = {
+    "1-grass-0",
+    "2-grass_angled-0",
+    "3-grass_horizontal-0",
+    "4-grass_corner-0",
+    "5-grass_vertical-0",
+    "6-gravel",
+    "7-pavement",
+    "8-pink_bush_base-0",
+    "9-pink_bush_branch-0"
 };
 
-// the filenames for all dynamic patterns (used to animate world tiles)
-const char *the_mall_anim_pattern_fns[] = {
-    "assets/1-grass-0.pattern",
-    "assets/1-grass-1.pattern",
-    "assets/2-grass_angled-0.pattern",
-    "assets/2-grass_angled-1.pattern",
-    "assets/3-grass_horizontal-0.pattern",
-    "assets/3-grass_horizontal-1.pattern",
-    "assets/4-grass_corner-0.pattern",
-    "assets/4-grass_corner-1.pattern",
-    "assets/5-grass_vertical-0.pattern",
-    "assets/5-grass_vertical-1.pattern",
-    "assets/8-pink_bush_base-0.pattern",
-    "assets/8-pink_bush_base-1.pattern",
-    "assets/9-pink_bush_branch-0.pattern",
-    "assets/9-pink_bush_branch-1.pattern"
+// the names of all dynamic patterns (used to animate world tiles)
+const char *the_mall_anim_pattern_names[] = {
+    "1-grass-0",
+    "1-grass-1",
+    "2-grass_angled-0",
+    "2-grass_angled-1",
+    "3-grass_horizontal-0",
+    "3-grass_horizontal-1",
+    "4-grass_corner-0",
+    "4-grass_corner-1",
+    "5-grass_vertical-0",
+    "5-grass_vertical-1",
+    "8-pink_bush_base-0",
+    "8-pink_bush_base-1",
+    "9-pink_bush_branch-0",
+    "9-pink_bush_branch-1"
 };
 
-// the filenames for all scotty sprite frames in order of their position in Pattern RAM
-const char *scotty_pattern_fns[] = {
-    "assets/scotty_front-0.pattern",
-    "assets/scotty_front-1.pattern",
-    "assets/scotty_front-2.pattern",
-    "assets/scotty_front-3.pattern",
-    "assets/scotty_back-0.pattern",
-    "assets/scotty_back-1.pattern",
-    "assets/scotty_back-2.pattern",
-    "assets/scotty_back-3.pattern",
-    "assets/scotty_side-0.pattern",
-    "assets/scotty_side-1.pattern",
-    "assets/scotty_side-2.pattern",
-    "assets/scotty_side-3.pattern"
+// the names of all scotty sprite frames in order of their position in Pattern RAM
+const char *scotty_pattern_names[] = {
+    "scotty_front-0",
+    "scotty_front-1",
+    "scotty_front-2",
+    "scotty_front-3",
+    "scotty_back-0",
+    "scotty_back-1",
+    "scotty_back-2",
+    "scotty_back-3",
+    "scotty_side-0",
+    "scotty_side-1",
+    "scotty_side-2",
+    "scotty_side-3"
 };
 
+// looks up a width x height pattern in the asset pack, printing an error if it is missing
+const pattern_t *find_pattern(const asset_pack_t *pack, const char *name, unsigned width,
+                              unsigned height)
+{
+    unsigned pattern_width, pattern_height;
+    const pattern_t *pattern = asset_pack_pattern(pack, name, &pattern_width, &pattern_height);
+
+    if (pattern == NULL || pattern_width != width || pattern_height != height)
+    {
+        printf("Pattern %s missing from asset pack!\n", name);
+        return NULL;
+    }
+    return pattern;
+}
+
 // load and write static tiles, static palettes, and initial patterns for both sprite and world.
-int load_the_mall()
+// All VRAM writes go through vram_batch, which keeps a shadow copy of VRAM so that only real
+//   changes are uploaded each frame. The asset pack is mapped into memory, so its contents can be
+//   written to VRAM directly without any loading or parsing.
+int load_the_mall(const asset_pack_t *pack)
 {
     // === load background tilemap ===
-    tile_t *the_mall_tiles;
-    if ((the_mall_tiles = malloc(64 * 64 * sizeof(tile_t))) == NULL)
+    // the tilemap is stored compressed, and decoded one row at a time as it is recorded
+    size_t the_mall_size;
+    const void *the_mall_data = asset_pack_ctilemap(pack, "the_mall", &the_mall_size);
+    ctilemap_t the_mall_tiles;
+    if (the_mall_data == NULL ||
+        ctilemap_open(&the_mall_tiles, the_mall_data, the_mall_size) != 0 ||
+        the_mall_tiles.width != 64 || the_mall_tiles.height != 64)
     {
-        printf("Malloc Tiles Failed!\n");
+        printf("Tilemap the_mall missing from asset pack!\n");
         return -1;
     }
-    ppu_load_tilemap(the_mall_tiles, 64*64, "assets/the_mall.tilemap");
-    ppu_write_vram(the_mall_tiles, 64*64*sizeof(tile_t), 0);
-    free(the_mall_tiles); // unload tiles to save resources
+    ctilemap_write_layer(&the_mall_tiles, LAYER_BG, 0, 0, 64, 64);
 
     // === load the foreground pink bush ===
     tile_t pink_bush_base_tile = ppu_make_tile(
@@ -112,59 +150,47 @@ int load_the_mall()
         THE_MALL_PALETTE_ID,
         MIRROR_NONE
     );
-    // the pink bush contains 4 rows of 5 branch tiles each, one of which will be overwritten with
-    //   the base tile
-    for (unsigned i = 0; i < 4; i++)
+    // the pink bush is a 5x4 metatile of branch tiles, with the base tile in the middle of its
+    //   bottom row. Stamping it records all of its rows at once when the set is flushed.
+    tile_t pink_bush_tiles[4*5];
+    for (unsigned i = 0; i < 4*5; i++) pink_bush_tiles[i] = pink_bush_branch_tile;
+    pink_bush_tiles[3*5 + 2] = pink_bush_base_tile;
+
+    metatile_set_t world_blocks;
+    if (metatile_init(&world_blocks, 1) == -1)
     {
-        ppu_write_tiles_horizontal(&pink_bush_branch_tile, 1, LAYER_FG, 48, 26+i, 5);
+        printf("Metatile Init Failed!\n");
+        return -1;
     }
-    ppu_write_tiles_horizontal(&pink_bush_base_tile, 1, LAYER_FG, 50, 29, 1);
+    int pink_bush = metatile_define(&world_blocks, pink_bush_tiles, 5, 4);
+    metatile_stamp(&world_blocks, pink_bush, LAYER_FG, 48, 26);
+    metatile_flush(&world_blocks);
+    metatile_destroy(&world_blocks);
 
     // === load palettes ===
-    palette_t *palettes;
-    if ((palettes = malloc(2*sizeof(palette_t))) == NULL)
+    const palette_t *the_mall_palette = asset_pack_palette(pack, "the_mall");
+    const palette_t *scotty_palette = asset_pack_palette(pack, "scotty");
+    if (the_mall_palette == NULL || scotty_palette == NULL)
     {
-        printf("Malloc Palettes Failed!\n");
+        printf("Palettes missing from asset pack!\n");
         return -1;
     }
-    ppu_load_palette(&palettes[0], "assets/the_mall.palette");
-    ppu_load_palette(&palettes[1], "assets/scotty.palette");
-    ppu_write_palette(&palettes[0], LAYER_BG, THE_MALL_PALETTE_ID);
-    ppu_write_palette(&palettes[0], LAYER_FG, THE_MALL_PALETTE_ID);
-    ppu_write_palette(&palettes[1], LAYER_SPR, SCOTTY_PALLETE_ID);
-    free(palettes); // unload palette to save resources (minimal)
+    // palettes go through palette_fx, which records them once palette_fx_update is called
+    palette_fx_set(the_mall_palette, LAYER_BG, THE_MALL_PALETTE_ID);
+    palette_fx_set(the_mall_palette, LAYER_FG, THE_MALL_PALETTE_ID);
+    palette_fx_set(scotty_palette, LAYER_SPR, SCOTTY_PALLETE_ID);
 
     // === load static world patterns ===
-    pattern_t *the_mall_pattern;
-    // First, load all world tiles in one 9x1 chunk located at (1,0) (first tile is transparent)
-    if ((the_mall_pattern = malloc(1*1*sizeof(pattern_t))) == NULL)
-    {
-        printf("Malloc Patterns Failed!\n");
-        return -1;
-    }
+    // load all world tiles in one 9x1 chunk located at (1,0) (first tile is transparent)
     for (unsigned i = 0; i < 9; i++)
     {
-        printf("Loading pattern: %s\n", the_mall_pattern_fns[i]);
-        ppu_load_pattern(the_mall_pattern, the_mall_pattern_fns[i], 1, 1);
-        ppu_write_pattern(the_mall_pattern, 1, 1, ppu_pattern_addr(i+1,0));
+        const pattern_t *the_mall_pattern = find_pattern(pack, the_mall_pattern_names[i], 1, 1);
+        if (the_mall_pattern == NULL) return -1;
+        vram_batch_pattern(the_mall_pattern, 1, 1, ppu_pattern_addr(i+1,0));
     }
-    free(the_mall_pattern);
 
-    // === load scotty ===
-    // load scotty frames (4 front, 4 back, 4 side) sequentially starting at (0,1).
-    pattern_t *scotty_pattern;
-    if ((scotty_pattern = malloc(2*2*sizeof(pattern_t))) == NULL)
-    {
-        printf("Malloc Cloud Pattern Failed!\n");
-        return -1;
-    }
-    for (unsigned i = 0; i < 12; i++)
-    {
-        printf("Loading pattern: %s\n", scotty_pattern_fns[i]);
-        ppu_load_pattern(scotty_pattern, scotty_pattern_fns[i], 2, 2);
-        ppu_write_pattern(scotty_pattern, 2, 2, ppu_pattern_addr(2*i, 1));
-    }
-    free(scotty_pattern);
+    // keep the rest of Pattern RAM free for graphics paged in at runtime (scotty's frames)
+    pattern_alloc_reserve(ppu_pattern_addr(0,0), 10, 1);
 
     return 0;
 }
@@ -224,27 +250,44 @@ void update_scrolling(int input, unsigned *world_scroll_x, unsigned *world_scrol
     }
 }
 
-// calculates the pattern address for scotty's current animation frame
-pattern_addr_t calc_scotty_pattern(unsigned scotty_frame, scotty_state_e scotty_state)
+// calculates the index in scotty_pattern_names of scotty's current animation frame
+unsigned calc_scotty_frame_id(unsigned scotty_frame, scotty_state_e scotty_state)
 {
     // the last two states should display the same pattern (scotty_side), just mirrored
     unsigned scotty_state_offset = (scotty_state == SCOTTY_LSIDE) ? 2 : scotty_state;
 
-    return ppu_pattern_addr(2*4*(scotty_state_offset) + 2*scotty_frame, 1);
+    return 4*scotty_state_offset + scotty_frame;
 }
 
-// updates scotty's sprite data
-void scotty_update(sprite_t *scotty_sprite, unsigned scotty_frame, scotty_state_e scotty_state,
-                   unsigned x, unsigned y)
+// updates scotty's sprite data. Only the frame on screen is kept in Pattern RAM: the pattern
+//   cache pages each frame in when scotty's animation reaches it. Frames which duplicate another
+//   one (possibly mirrored) were removed from the cache's pool, and are drawn through the map.
+int scotty_update(sprite_t *scotty_sprite, pattern_cache_t *scotty_cache,
+                  const pattern_dedup_map_t *scotty_frame_map, unsigned scotty_frame,
+                  scotty_state_e scotty_state, unsigned x, unsigned y)
 {
-    scotty_sprite->pattern_addr = calc_scotty_pattern(scotty_frame, scotty_state);
+    static int shown_frame_id = -1;
+    const pattern_dedup_map_t *frame = &scotty_frame_map[calc_scotty_frame_id(scotty_frame,
+                                                                              scotty_state)];
+
+    if ((int)frame->index != shown_frame_id)
+    {
+        if (pattern_cache_acquire(scotty_cache, frame->index, &scotty_sprite->pattern_addr) == -1)
+        {
+            return -1;
+        }
+        if (shown_frame_id != -1) pattern_cache_release(scotty_cache, shown_frame_id);
+        shown_frame_id = frame->index;
+    }
+
     scotty_sprite->mirror = (scotty_state == SCOTTY_LSIDE) ? MIRROR_X : MIRROR_NONE;
+    scotty_sprite->mirror ^= frame->mirror;
     scotty_sprite->x = x;
     scotty_sprite->y = y;
+    return 0;
 }
 
 // animate scotty by changing state and frame id based on a timer/delay and input direction
-// Does not write or block like animate_world does
 void animate_scotty(int input, unsigned *scotty_frame, scotty_state_e *scotty_state)
 {
     static unsigned scotty_anim_timer = SCOTTY_ANIM_DELAY;
@@ -290,96 +333,115 @@ void animate_scotty(int input, unsigned *scotty_frame, scotty_state_e *scotty_st
     }
 }
 
-// animate world by changing the patterns of specific world tiles (BLOCKS UNTIL WRITE)
-void animate_world(pattern_t *anim_patterns)
-{
-    static unsigned world_anim_timer = WORLD_ANIM_DELAY;
-    static unsigned world_anim_frame = 0;
-
-    // play world animation
-    if (world_anim_timer == 0)
-    {
-        world_anim_frame = !world_anim_frame; // toggle which animation frame we are using
-        world_anim_timer = WORLD_ANIM_DELAY;  // reset timer
-
-        // write all animated tiles:
-        // start by writing dynamic patterns 1-5
-        for (unsigned i = 0; i < 5; i++)
-        {
-            while (ppu_write_pattern(&anim_patterns[2*i + world_anim_frame], 1, 1, ppu_pattern_addr(i+1,0)) != 0);
-        }
-        // end with writing dynamic patterns 8 and 9
-        while (ppu_write_pattern(&anim_patterns[10+world_anim_frame], 1, 1, ppu_pattern_addr(8,0)) != 0);
-        while (ppu_write_pattern(&anim_patterns[12+world_anim_frame], 1, 1, ppu_pattern_addr(9,0)) != 0);
-    }
-    else
-    {
-        world_anim_timer--;
-    }
-}
-
-void apu_callback(const int8_t **buf, int *len)
+// starts scotty's bark, cutting off the previous bark if it is still playing. The mixer thread
+//   plays it from there, so the game loop does not need to keep the bark going.
+void play_bark(void)
 {
-    static size_t bark_loc = 0; // location within the scotty_bark raw audio samples
-    int8_t silent_buf [] = {0};
+    static audio_voice_t bark_voice = -1;
 
     extern const int8_t _binary_bins_scottybark_bin_start[];
     extern const int8_t _binary_bins_scottybark_bin_end[];
     size_t bark_bin_size = (size_t) (((uintptr_t) _binary_bins_scottybark_bin_end)
                            - ((uintptr_t) _binary_bins_scottybark_bin_start));
 
-    // Handle any queued bark (doesn't matter if bark_done or not):
-    if (start_new_bark)
-    {
-        start_new_bark = 0;
+    audio_mixer_stop(bark_voice);
+    bark_voice = audio_mixer_play(_binary_bins_scottybark_bin_start, bark_bin_size,
+                                  AUDIO_MIXER_VOLUME_MAX, BARK_PRIORITY, 0);
+}
 
-        // reset bark waveform
-        bark_loc = 0;
+int main(void)
+{
+    ppu_enable();
+    if (audio_mixer_enable() == -1)
+    {
+        printf("Audio Mixer Enable Failed!\n");
+        return -1;
     }
-
-    if (bark_loc >= bark_bin_size)
+    if (frame_pacer_enable() == -1)
     {
-        // The waveform is finished playing. This is the done state!
-
-        // This will set the buffer to 0s, causing silence.
-        *len = 0;
-
-        // Buffer should not be used, but the APU Library mandates that we cannot send NULL, so send
-        //   anything else:
-        *buf = silent_buf;
+        printf("Frame Pacer Enable Failed!\n");
+        return -1;
     }
-    else
+    if (con_input_enable(CON_INPUT_RATE_HZ) == -1)
     {
-        *buf = &_binary_bins_scottybark_bin_start[bark_loc];
-        *len = MIN(bark_bin_size - bark_loc, APU_BUF_MAX);
-        bark_loc += APU_BUF_MAX;
+        printf("Controller Input Enable Failed!\n");
+        return -1;
     }
-}
 
-int main(void)
-{
-    ppu_enable();
-    apu_enable(apu_callback);
+    asset_pack_t pack;
+    if (asset_pack_open(&pack, ASSET_PACK_FILE) == -1)
+    {
+        printf("Asset Pack %s Failed To Open!\n", ASSET_PACK_FILE);
+        return -1;
+    }
 
-    if (load_the_mall() == -1) return -1;
+    if (load_the_mall(&pack) == -1) return -1;
 
     // Animated world tiles. These will get written to Pattern RAM to play an animation without
     //   needing to write tons of tiles in Tile RAM.
-    pattern_t *anim_patterns;
-    if ((anim_patterns = malloc(14 * sizeof(pattern_t))) == NULL)
+    const pattern_t *anim_patterns[14];
+    for (unsigned i = 0; i < 14; i++)
     {
-        printf("Malloc Tiles Failed!\n");
+        if ((anim_patterns[i] = find_pattern(&pack, the_mall_anim_pattern_names[i], 1, 1)) == NULL)
+        {
+            return -1;
+        }
+    }
+    // these point into the asset pack, which we will close after we exit from the game loop
+
+    // Dynamic patterns 1-5, 8 and 9 each flip between two frames, with the tile animation
+    //   scheduler recording whichever patterns change into each frame's batch
+    static const unsigned world_anim_durations[2] = {WORLD_ANIM_DELAY, WORLD_ANIM_DELAY};
+    tile_anim_t world_anim;
+    if (tile_anim_init(&world_anim, 7) == -1)
+    {
+        printf("Tile Animation Init Failed!\n");
         return -1;
     }
-    for (unsigned i = 0; i < 14; i++)
+    for (unsigned i = 0; i < 7; i++)
     {
-        printf("Loading pattern: %s\n", the_mall_anim_pattern_fns[i]);
-        ppu_load_pattern(&anim_patterns[i], the_mall_anim_pattern_fns[i], 1, 1);
+        unsigned x = (i < 5) ? i + 1 : i + 3;
+        tile_anim_add(&world_anim, ppu_pattern_addr(x, 0), &anim_patterns[2*i],
+                      world_anim_durations, 2);
+    }
+
+    // Scotty's animation frames (4 front, 4 back, 4 side), paged into Pattern RAM on demand
+    pattern_source_t scotty_frames[12];
+    for (unsigned i = 0; i < 12; i++)
+    {
+        scotty_frames[i].patterns = find_pattern(&pack, scotty_pattern_names[i], 2, 2);
+        scotty_frames[i].width = 2;
+        scotty_frames[i].height = 2;
+        if (scotty_frames[i].patterns == NULL) return -1;
+    }
+    // keep one copy of frames which repeat (scotty_side-2 is scotty_side-0)
+    pattern_dedup_map_t scotty_frame_map[12];
+    int scotty_frame_count = pattern_dedup_frames(scotty_frames, 12, scotty_frame_map);
+    pattern_cache_t scotty_cache;
+    if (scotty_frame_count == -1 ||
+        pattern_cache_init(&scotty_cache, scotty_frames, scotty_frame_count) == -1)
+    {
+        printf("Pattern Cache Init Failed!\n");
+        return -1;
     }
-    // we will free these tiles after we exit from the game loop
 
     // Enable all tile layers
-    ppu_set_layer_enable(LAYER_BG | LAYER_FG | LAYER_SPR);
+    vram_batch_layer_enable(LAYER_BG | LAYER_FG | LAYER_SPR);
+
+    // Start out black, then fade in once the game loop runs
+    palette_fx_brightness(0, 0);
+    palette_fx_update();
+    palette_fx_brightness(PALETTE_FX_LEVEL_MAX, FADE_IN_FRAMES);
+
+    // Send the loaded world and the layer enable to VRAM before the first frame is recorded
+    while (vram_batch_submit() != 0);
+
+    // From here on, frames are sent by the pipeline's thread while the next one is built
+    if (frame_pipeline_enable(FRAME_PIPELINE_BLOCK) == -1)
+    {
+        printf("Frame Pipeline Enable Failed!\n");
+        return -1;
+    }
 
     // Create sprite for game character
     unsigned scotty_frame = 0;
@@ -387,41 +449,45 @@ int main(void)
     unsigned scotty_x = 0;
     unsigned scotty_y = 0;
     sprite_t scotty_sprite;
+    scotty_sprite.pattern_addr = 0;
     scotty_sprite.palette_id = SCOTTY_PALLETE_ID;
+    scotty_sprite.x = scotty_x;
+    scotty_sprite.y = scotty_y;
+    scotty_sprite.mirror = MIRROR_NONE;
     scotty_sprite.height = 2;
     scotty_sprite.width = 2;
     scotty_sprite.prio = PRIO_IN_MIDDLE;
+    sprite_handle_t scotty = sprite_pool_add(&scotty_sprite, SCOTTY_DEPTH);
 
     // world scroll
     unsigned world_scroll_x = 0;
     unsigned world_scroll_y = 0;
 
+    // scotty greets the player with a bark
+    play_bark();
+
     // Game loop capped at 60Hz
     unsigned exit_button_pressed = 0;
     int input;
     while (!exit_button_pressed)
     {
-        // update input
-        if ((input = get_con_state()) < 0)
+        // take the button changes sampled since the last frame
+        if (con_input_update() == -1)
         {
             printf("Input Update Failed!\n");
             return -1;
         }
+        input = con_input_state();
+
+        // start recording this frame's VRAM changes
+        frame_pipeline_begin();
 
         // === main logic ===
         // check if the exit button is pressed
-        exit_button_pressed = CON_IS_PRESSED(input, CON_BUT_START);
+        exit_button_pressed = con_input_pressed_this_frame(CON_BUT_START);
 
-        // make scotty bark if the B button is pressed
-        if (bark_btn_pressed == 0 && CON_IS_PRESSED(input, CON_BUT_B))
-        {
-            bark_btn_pressed = 1;
-            start_new_bark = 1;
-        }
-        else if (!CON_IS_PRESSED(input, CON_BUT_B))
-        {
-            bark_btn_pressed = 0;
-        }
+        // make scotty bark if the B button went down, even if it was only tapped mid-frame
+        if (con_input_pressed_this_frame(CON_BUT_B)) play_bark();
 
         // update tile layer scrolls and scotty's position based on input
         update_scrolling(input, &world_scroll_x, &world_scroll_y, &scotty_x, &scotty_y);
@@ -430,22 +496,33 @@ int main(void)
         animate_scotty(input, &scotty_frame, &scotty_state);
 
         // perform local sprite updates
-        scotty_update(&scotty_sprite, scotty_frame, scotty_state, scotty_x, scotty_y);
+        if (scotty_update(sprite_pool_get(scotty), &scotty_cache, scotty_frame_map, scotty_frame,
+                          scotty_state, scotty_x, scotty_y) == -1)
+        {
+            printf("Pattern RAM Full!\n");
+            return -1;
+        }
         
-        // buffer changes to VRAM
-        animate_world(anim_patterns); // does not return until VRAM is written
-        while (ppu_set_scroll(LAYER_BG, world_scroll_x, world_scroll_y) != 0);
-        while (ppu_set_scroll(LAYER_FG, world_scroll_x, world_scroll_y) != 0);
-        while (ppu_write_sprites(&scotty_sprite, 1, SCOTTY_SPRITE_ID) != 0);
+        // record changes to VRAM
+        tile_anim_update(&world_anim);
+        palette_fx_update();
+        vram_batch_scroll(LAYER_BG, world_scroll_x, world_scroll_y);
+        vram_batch_scroll(LAYER_FG, world_scroll_x, world_scroll_y);
+        sprite_pool_submit();
         // ==================
 
-        // render VRAM changes
-        while(ppu_update() != 0);
+        // hand the recorded VRAM changes to the pipeline, sleeping if it is two frames ahead
+        frame_pipeline_present();
     }
 
     // cleanup and exit
-    free(anim_patterns);
+    frame_pipeline_disable();
+    tile_anim_destroy(&world_anim);
+    pattern_cache_destroy(&scotty_cache);
+    asset_pack_close(&pack);
+    con_input_disable();
+    frame_pacer_disable();
     ppu_disable();
-    apu_disable();
+    audio_mixer_disable();
     return 0;
 }
\ No newline at end of file
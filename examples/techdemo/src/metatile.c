@@ -0,0 +1,191 @@
+/* Metatile stamping. See metatile.h for usage.
+ *
+ * Stamps are copied into an image of each layer, and marked in one 64-bit mask per layer row
+ *   (bit x for column x), plus one mask per layer of the rows holding any marks. Flushing walks
+ *   the marked rows only, and cuts each row's mask into runs of set bits.
+ *
+ * A run may wrap around from column 63 to column 0. To keep it in one span, each row is scanned
+ *   starting just after a clear bit, so no run is ever split by the start of the scan. Spans which
+ *   do not wrap are written straight from the image row. Wrapped spans are gathered into a
+ *   64-tile buffer first, since the image row is not contiguous across them.
+ */
+
+#include "metatile.h"
+#include "noway.h"
+#include "vram_batch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ROW_FULL (~(uint64_t)0)
+
+static unsigned layer_index(layer_e layer)
+{
+    return (layer == LAYER_FG) ? 1 : 0;
+}
+
+static tile_t *image_row(metatile_set_t *set, unsigned l, unsigned y)
+{
+    return &set->image[(l * TILELAYER_HEIGHT + y) * TILELAYER_WIDTH];
+}
+
+int metatile_init(metatile_set_t *set, unsigned capacity)
+{
+    nowaymsg(set == NULL, "Metatile set is NULL!");
+    nowaymsg(capacity == 0, "Metatile capacity must be at least 1!");
+
+    if ((set->defs = calloc(capacity, sizeof(metatile_def_t))) == NULL) return -1;
+    if ((set->image = malloc(2 * TILELAYER_HEIGHT * TILELAYER_WIDTH * sizeof(tile_t))) == NULL)
+    {
+        free(set->defs);
+        set->defs = NULL;
+        return -1;
+    }
+
+    set->capacity = capacity;
+    set->count = 0;
+    memset(set->dirty, 0, sizeof(set->dirty));
+    memset(set->dirty_rows, 0, sizeof(set->dirty_rows));
+    return 0;
+}
+
+void metatile_destroy(metatile_set_t *set)
+{
+    nowaymsg(set == NULL, "Metatile set is NULL!");
+
+    free(set->defs);
+    free(set->image);
+    set->defs = NULL;
+    set->image = NULL;
+}
+
+int metatile_define(metatile_set_t *set, const tile_t *tiles, unsigned width, unsigned height)
+{
+    metatile_def_t *def;
+
+    nowaymsg(set == NULL || set->defs == NULL, "Metatile set is not set up!");
+    nowaymsg(tiles == NULL, "Metatile tiles are NULL!");
+    nowaymsg(width == 0 || width > METATILE_MAX_SIZE || height == 0 || height > METATILE_MAX_SIZE,
+             "Metatile must be 1x1 to 8x8 tiles!");
+
+    if (set->count == set->capacity) return -1;
+
+    def = &set->defs[set->count];
+    def->tiles = tiles;
+    def->width = width;
+    def->height = height;
+    return (int)set->count++;
+}
+
+void metatile_stamp(metatile_set_t *set, int id, layer_e layer, unsigned x_i, unsigned y_i)
+{
+    const metatile_def_t *def;
+    unsigned l, first;
+    uint64_t mask;
+
+    nowaymsg(set == NULL || set->defs == NULL, "Metatile set is not set up!");
+    nowaymsg(id < 0 || (unsigned)id >= set->count, "Metatile ID is not defined!");
+    nowaymsg(layer != LAYER_BG && layer != LAYER_FG, "Layer must be LAYER_BG or LAYER_FG!");
+    nowaymsg(x_i >= TILELAYER_WIDTH || y_i >= TILELAYER_HEIGHT,
+             "Metatile position out of bounds!");
+
+    def = &set->defs[id];
+    l = layer_index(layer);
+
+    // the metatile covers the same columns in each of its rows: build their mask once, rotated
+    //   so that it wraps around past column 63
+    mask = ((uint64_t)1 << def->width) - 1;
+    mask = (mask << x_i) | ((x_i == 0) ? 0 : mask >> (TILELAYER_WIDTH - x_i));
+    first = TILELAYER_WIDTH - x_i;
+
+    for (unsigned row = 0; row < def->height; row++)
+    {
+        unsigned y = (y_i + row) % TILELAYER_HEIGHT;
+        const tile_t *src = &def->tiles[row * def->width];
+        tile_t *dst = image_row(set, l, y);
+
+        if (def->width <= first)
+        {
+            memcpy(&dst[x_i], src, def->width * sizeof(tile_t));
+        }
+        else
+        {
+            memcpy(&dst[x_i], src, first * sizeof(tile_t));
+            memcpy(dst, &src[first], (def->width - first) * sizeof(tile_t));
+        }
+        set->dirty[l][y] |= mask;
+        set->dirty_rows[l] |= (uint64_t)1 << y;
+    }
+}
+
+// Records the marked tiles of one row as one write per run, and returns the number of runs
+static unsigned flush_row(metatile_set_t *set, unsigned l, unsigned y)
+{
+    layer_e layer = l ? LAYER_FG : LAYER_BG;
+    const tile_t *src = image_row(set, l, y);
+    uint64_t mask = set->dirty[l][y];
+    tile_t span[TILELAYER_WIDTH];
+    unsigned start, spans = 0;
+
+    if (mask == ROW_FULL)
+    {
+        vram_batch_tiles_horizontal(src, TILELAYER_WIDTH, layer, 0, y, TILELAYER_WIDTH);
+        return 1;
+    }
+
+    // start scanning just after a clear bit, so no run is cut by the start of the scan
+    start = (__builtin_ctzll(~mask) + 1) % TILELAYER_WIDTH;
+    for (unsigned i = 0; i < TILELAYER_WIDTH;)
+    {
+        unsigned x = (start + i) % TILELAYER_WIDTH;
+        unsigned len = 0;
+
+        if (!((mask >> x) & 1))
+        {
+            i++;
+            continue;
+        }
+        while (i < TILELAYER_WIDTH && ((mask >> ((start + i) % TILELAYER_WIDTH)) & 1))
+        {
+            len++;
+            i++;
+        }
+        if (x + len <= TILELAYER_WIDTH)
+        {
+            vram_batch_tiles_horizontal(&src[x], len, layer, x, y, len);
+        }
+        else
+        {
+            unsigned first = TILELAYER_WIDTH - x;
+
+            memcpy(span, &src[x], first * sizeof(tile_t));
+            memcpy(&span[first], src, (len - first) * sizeof(tile_t));
+            vram_batch_tiles_horizontal(span, len, layer, x, y, len);
+        }
+        spans++;
+    }
+    return spans;
+}
+
+unsigned metatile_flush(metatile_set_t *set)
+{
+    unsigned spans = 0;
+
+    nowaymsg(set == NULL || set->defs == NULL, "Metatile set is not set up!");
+
+    for (unsigned l = 0; l < 2; l++)
+    {
+        uint64_t rows = set->dirty_rows[l];
+
+        while (rows != 0)
+        {
+            unsigned y = __builtin_ctzll(rows);
+
+            spans += flush_row(set, l, y);
+            set->dirty[l][y] = 0;
+            rows &= rows - 1;
+        }
+        set->dirty_rows[l] = 0;
+    }
+    return spans;
+}
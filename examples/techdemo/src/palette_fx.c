@@ -0,0 +1,349 @@
+/* Palette effects. See palette_fx.h for usage.
+ *
+ * All colors are kept in arrays laid out exactly like Palette RAM: 64 slots of 16 words, where
+ *   word 0 of each slot is unused and words 1-15 are the palette's colors. A frame goes through
+ *   three stages:
+ *   base:  Each palette's own colors, blended between fade_from and fade_to while it fades.
+ *   stage: base with color cycling applied.
+ *   out:   stage scaled toward black by the brightness, then blended toward the tint.
+ * The tint color ramps along with its amount: a new tint starts from the color shown at the time,
+ *   so changing the color part-way through a tint does not jump.
+ * out is compared against the last recorded colors (shown), and runs of changed slots are
+ *   recorded straight from out, since it already has the Palette RAM layout. shown starts out
+ *   black, like the VRAM image of vram_batch.
+ *
+ * Every blend goes through blend_words, which works on all four bytes of each color word in
+ *   parallel. It has SSE2 (any x86-64) and NEON versions, plus a plain C version which is used on
+ *   other targets or when built with PALETTE_FX_NO_SIMD. All versions produce the same colors.
+ */
+
+#include "palette_fx.h"
+#include "noway.h"
+#include "vram_batch.h"
+#include "vram_layout.h"
+
+#include <string.h>
+
+#if !defined(PALETTE_FX_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define PALETTE_FX_SSE2
+#elif !defined(PALETTE_FX_NO_SIMD) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PALETTE_FX_NEON
+#endif
+
+#define PALETTES (2 * PALETTERAM_TILEMAX + PALETTERAM_SPRITEMAX)
+#define SLOT_WORDS (PALETTE_BSIZE / 4)
+#define WORDS (PALETTES * SLOT_WORDS)
+
+// A value which moves linearly toward a target over a number of frames
+typedef struct {
+    unsigned from, to;
+    unsigned elapsed, frames;
+} ramp_t;
+
+typedef struct {
+    unsigned fading;
+    ramp_t fade;             // fade progress, from 0 to PALETTE_FX_LEVEL_MAX
+    unsigned cycle_first;    // first cycled word in the slot
+    unsigned cycle_len;
+    unsigned cycle_delay;
+    unsigned cycle_timer;
+    unsigned cycle_step;
+} palette_state_t;
+
+static uint32_t base[WORDS], fade_from[WORDS], fade_to[WORDS];
+static uint32_t stage[WORDS], out[WORDS], shown[WORDS];
+static uint32_t black[WORDS], tint_words[WORDS];
+static palette_state_t palettes[PALETTES];
+
+static ramp_t brightness = {PALETTE_FX_LEVEL_MAX, PALETTE_FX_LEVEL_MAX, 0, 0};
+static ramp_t tint;
+static ramp_t tint_color;      // progress from tint_from to tint_to, from 0 to PALETTE_FX_LEVEL_MAX
+static uint32_t tint_from, tint_to;
+static unsigned budget;
+static unsigned next_palette;  // where the next budgeted scan for changed palettes starts
+static unsigned stale = 1;     // out must be recomputed even if no effect is running
+
+// (a * (256 - weight) + b * weight) / 256, for each byte of a single color word
+static uint32_t blend_color(uint32_t a, uint32_t b, unsigned weight)
+{
+    uint32_t word = 0;
+
+    for (unsigned shift = 0; shift < 32; shift += 8)
+    {
+        unsigned ca = (a >> shift) & 0xFF;
+        unsigned cb = (b >> shift) & 0xFF;
+        word |= (uint32_t)((ca * (PALETTE_FX_LEVEL_MAX - weight) + cb * weight) >> 8) << shift;
+    }
+    return word;
+}
+
+// dst = (a * (256 - weight) + b * weight) / 256, for each byte of n words. n must be a multiple
+//   of 4.
+static void blend_words(uint32_t *dst, const uint32_t *a, const uint32_t *b, unsigned weight,
+                        unsigned n)
+{
+    unsigned i = 0;
+
+#if defined(PALETTE_FX_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wa = _mm_set1_epi16(PALETTE_FX_LEVEL_MAX - weight);
+    const __m128i wb = _mm_set1_epi16(weight);
+    for (; i < n; i += 4)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *)&a[i]);
+        __m128i vb = _mm_loadu_si128((const __m128i *)&b[i]);
+        // at most 255 * 256 per lane, so the sums fit unsigned 16-bit lanes
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+        _mm_storeu_si128((__m128i *)&dst[i],
+                         _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+#elif defined(PALETTE_FX_NEON)
+    const uint16_t wa = PALETTE_FX_LEVEL_MAX - weight;
+    for (; i < n; i += 4)
+    {
+        uint8x16_t va = vreinterpretq_u8_u32(vld1q_u32(&a[i]));
+        uint8x16_t vb = vreinterpretq_u8_u32(vld1q_u32(&b[i]));
+        uint16x8_t lo = vmlaq_n_u16(vmulq_n_u16(vmovl_u8(vget_low_u8(va)), wa),
+                                    vmovl_u8(vget_low_u8(vb)), weight);
+        uint16x8_t hi = vmlaq_n_u16(vmulq_n_u16(vmovl_u8(vget_high_u8(va)), wa),
+                                    vmovl_u8(vget_high_u8(vb)), weight);
+        vst1q_u32(&dst[i], vreinterpretq_u32_u8(vcombine_u8(vshrn_n_u16(lo, 8),
+                                                            vshrn_n_u16(hi, 8))));
+    }
+#else
+    for (; i < n; i++) dst[i] = blend_color(a[i], b[i], weight);
+#endif
+}
+
+static unsigned palette_index(layer_e layer, unsigned palette_id)
+{
+    if (layer == LAYER_SPR)
+    {
+        nowaymsg(palette_id >= PALETTERAM_SPRITEMAX, "Attempting to access palette out of bounds!");
+        return 2 * PALETTERAM_TILEMAX + palette_id;
+    }
+
+    nowaymsg(palette_id >= PALETTERAM_TILEMAX, "Attempting to access palette out of bounds!");
+    return ((layer == LAYER_FG) ? PALETTERAM_TILEMAX : 0) + palette_id;
+}
+
+static void copy_palette(uint32_t *slot, const palette_t *palette)
+{
+    slot[0] = 0;
+    memcpy(&slot[1], palette->color, sizeof(palette->color));
+}
+
+static void ramp_start(ramp_t *ramp, unsigned from, unsigned to, unsigned frames)
+{
+    ramp->from = from;
+    ramp->to = to;
+    ramp->elapsed = 0;
+    ramp->frames = frames;
+}
+
+// Current value of a ramp. Finished ramps (and ramps of 0 frames) are at their target.
+static unsigned ramp_value(const ramp_t *ramp)
+{
+    if (ramp->elapsed >= ramp->frames) return ramp->to;
+    return ramp->from + ((int)ramp->to - (int)ramp->from) * (int)ramp->elapsed / (int)ramp->frames;
+}
+
+// Advances a ramp by one frame. Returns whether its value may have changed.
+static unsigned ramp_advance(ramp_t *ramp)
+{
+    if (ramp->elapsed >= ramp->frames) return 0;
+    ramp->elapsed++;
+    return 1;
+}
+
+void palette_fx_reset(void)
+{
+    memset(base, 0, sizeof(base));
+    memset(palettes, 0, sizeof(palettes));
+    ramp_start(&brightness, PALETTE_FX_LEVEL_MAX, PALETTE_FX_LEVEL_MAX, 0);
+    ramp_start(&tint, 0, 0, 0);
+    ramp_start(&tint_color, PALETTE_FX_LEVEL_MAX, PALETTE_FX_LEVEL_MAX, 0);
+    tint_from = tint_to = 0;
+    budget = 0;
+    stale = 1;
+}
+
+void palette_fx_set(const palette_t *palette, layer_e layer, unsigned palette_id)
+{
+    unsigned p = palette_index(layer, palette_id);
+
+    nowaymsg(palette == NULL, "Palette is NULL!");
+
+    copy_palette(&base[p * SLOT_WORDS], palette);
+    palettes[p].fading = 0;
+    stale = 1;
+}
+
+void palette_fx_fade(const palette_t *target, layer_e layer, unsigned palette_id,
+                     unsigned frames)
+{
+    unsigned p = palette_index(layer, palette_id);
+
+    nowaymsg(target == NULL, "Palette is NULL!");
+
+    if (frames == 0)
+    {
+        palette_fx_set(target, layer, palette_id);
+        return;
+    }
+
+    // fade from whatever the palette shows right now, even part-way through another fade
+    memcpy(&fade_from[p * SLOT_WORDS], &base[p * SLOT_WORDS], PALETTE_BSIZE);
+    copy_palette(&fade_to[p * SLOT_WORDS], target);
+    palettes[p].fading = 1;
+    ramp_start(&palettes[p].fade, 0, PALETTE_FX_LEVEL_MAX, frames);
+}
+
+void palette_fx_cycle(layer_e layer, unsigned palette_id, unsigned first, unsigned len,
+                      unsigned delay)
+{
+    palette_state_t *state = &palettes[palette_index(layer, palette_id)];
+
+    nowaymsg(first + len > SLOT_WORDS - 1, "Cycled colors exceed the palette!");
+    nowaymsg(delay == 0, "Cycle delay must be at least 1 frame!");
+
+    state->cycle_first = first + 1;
+    state->cycle_len = (len > 1) ? len : 0;
+    state->cycle_delay = delay;
+    state->cycle_timer = 0;
+    state->cycle_step = 0;
+    stale = 1;
+}
+
+void palette_fx_brightness(unsigned level, unsigned frames)
+{
+    nowaymsg(level > PALETTE_FX_LEVEL_MAX, "Brightness out of range!");
+
+    ramp_start(&brightness, ramp_value(&brightness), level, frames);
+    stale = 1;
+}
+
+void palette_fx_tint(uint32_t color, unsigned amount, unsigned frames)
+{
+    nowaymsg(amount > PALETTE_FX_LEVEL_MAX, "Tint amount out of range!");
+
+    // start from the color shown right now, unless no tint is shown at all
+    tint_from = (ramp_value(&tint) == 0) ? color :
+                blend_color(tint_from, tint_to, ramp_value(&tint_color));
+    tint_to = color;
+    ramp_start(&tint_color, 0, PALETTE_FX_LEVEL_MAX, frames);
+    ramp_start(&tint, ramp_value(&tint), amount, frames);
+    stale = 1;
+}
+
+void palette_fx_set_budget(unsigned count)
+{
+    budget = count;
+}
+
+// Advances the per-palette effects and rebuilds base and stage. Returns whether anything moved.
+static unsigned update_palettes(void)
+{
+    unsigned moved = 0;
+
+    for (unsigned p = 0; p < PALETTES; p++)
+    {
+        palette_state_t *state = &palettes[p];
+        uint32_t *slot = &stage[p * SLOT_WORDS];
+
+        if (state->fading)
+        {
+            ramp_advance(&state->fade);
+            blend_words(&base[p * SLOT_WORDS], &fade_from[p * SLOT_WORDS], &fade_to[p * SLOT_WORDS],
+                        ramp_value(&state->fade), SLOT_WORDS);
+            if (state->fade.elapsed >= state->fade.frames) state->fading = 0;
+            moved = 1;
+        }
+
+        memcpy(slot, &base[p * SLOT_WORDS], PALETTE_BSIZE);
+        if (state->cycle_len == 0) continue;
+
+        if (++state->cycle_timer >= state->cycle_delay)
+        {
+            state->cycle_timer = 0;
+            state->cycle_step = (state->cycle_step + 1) % state->cycle_len;
+            moved = 1;
+        }
+        for (unsigned k = 0; k < state->cycle_len; k++)
+        {
+            unsigned to = state->cycle_first + (k + state->cycle_step) % state->cycle_len;
+            slot[to] = base[p * SLOT_WORDS + state->cycle_first + k];
+        }
+    }
+    return moved;
+}
+
+unsigned palette_fx_update(void)
+{
+    unsigned recorded = 0;
+    unsigned run_start = 0, run_len = 0;
+
+    // ramps are advanced unconditionally, so all of them run every frame
+    stale |= ramp_advance(&brightness);
+    stale |= ramp_advance(&tint);
+    stale |= ramp_advance(&tint_color);
+    stale |= update_palettes();
+
+    if (stale)
+    {
+        unsigned level = ramp_value(&brightness);
+        unsigned amount = ramp_value(&tint);
+        uint32_t color = blend_color(tint_from, tint_to, ramp_value(&tint_color));
+
+        if (tint_words[1] != color)
+        {
+            for (unsigned i = 0; i < WORDS; i++) tint_words[i] = color;
+        }
+
+        blend_words(out, stage, black, PALETTE_FX_LEVEL_MAX - level, WORDS);
+        if (amount != 0) blend_words(out, out, tint_words, amount, WORDS);
+        stale = 0;
+    }
+
+    // record runs of changed palettes, starting where the last budgeted frame stopped
+    for (unsigned i = 0; i < PALETTES; i++)
+    {
+        unsigned p = (next_palette + i) % PALETTES;
+        unsigned changed = memcmp(&out[p * SLOT_WORDS], &shown[p * SLOT_WORDS], PALETTE_BSIZE) != 0;
+
+        if (changed && budget != 0 && recorded == budget)
+        {
+            next_palette = p;
+            break;
+        }
+        if (changed && run_len != 0 && run_start + run_len == p)
+        {
+            run_len++;
+        }
+        else
+        {
+            if (run_len != 0)
+            {
+                vram_batch_vram(&out[run_start * SLOT_WORDS], run_len * PALETTE_BSIZE,
+                                VRAM_PALETTEOFFSET + run_start * PALETTE_BSIZE);
+            }
+            run_start = p;
+            run_len = changed;
+        }
+        if (!changed) continue;
+
+        memcpy(&shown[p * SLOT_WORDS], &out[p * SLOT_WORDS], PALETTE_BSIZE);
+        recorded++;
+    }
+    if (run_len != 0)
+    {
+        vram_batch_vram(&out[run_start * SLOT_WORDS], run_len * PALETTE_BSIZE,
+                        VRAM_PALETTEOFFSET + run_start * PALETTE_BSIZE);
+    }
+    return recorded;
+}
@@ -0,0 +1,126 @@
+/* Pattern RAM allocator. See pattern_alloc.h for usage.
+ *
+ * Each row of Pattern RAM is one 32-bit occupancy word, bit x set if pattern x is used. A block
+ *   of width w at column x is the w-bit mask rotated left by x, which handles the wrap-around at
+ *   the right edge; rows wrap around modulo 32.
+ */
+
+#include "pattern_alloc.h"
+#include "noway.h"
+#include "vram_layout.h"
+
+#include <stdint.h>
+
+#if PATTERNRAM_WIDTH != 32
+#error "The occupancy words assume Pattern RAM is 32 patterns wide"
+#endif
+
+static uint32_t used[PATTERNRAM_HEIGHT];
+static int initialized = 0;
+
+// Occupancy mask of a width-pattern wide block starting at column x
+static uint32_t row_mask(unsigned x, unsigned width)
+{
+    uint32_t mask = (width == 32) ? UINT32_MAX : (1u << width) - 1;
+
+    return (x == 0) ? mask : (mask << x) | (mask >> (32 - x));
+}
+
+static int block_free(unsigned x, unsigned y, unsigned width, unsigned height)
+{
+    uint32_t mask = row_mask(x, width);
+
+    for (unsigned j = 0; j < height; j++)
+    {
+        if (used[(y + j) % PATTERNRAM_HEIGHT] & mask) return 0;
+    }
+    return 1;
+}
+
+static void mark_block(unsigned x, unsigned y, unsigned width, unsigned height, int in_use)
+{
+    uint32_t mask = row_mask(x, width);
+
+    for (unsigned j = 0; j < height; j++)
+    {
+        if (in_use) used[(y + j) % PATTERNRAM_HEIGHT] |= mask;
+        else used[(y + j) % PATTERNRAM_HEIGHT] &= ~mask;
+    }
+}
+
+static void check_block(pattern_addr_t pattern_addr, unsigned width, unsigned height)
+{
+    nowaymsg(pattern_addr >= PATTERNRAM_WIDTH * PATTERNRAM_HEIGHT, "Pattern address malformed!");
+    nowaymsg(width == 0 || width > PATTERNRAM_WIDTH || height == 0 || height > PATTERNRAM_HEIGHT,
+             "Pattern block size out of range!");
+}
+
+void pattern_alloc_reset(void)
+{
+    for (unsigned y = 0; y < PATTERNRAM_HEIGHT; y++) used[y] = 0;
+    used[0] = 1;
+    initialized = 1;
+}
+
+void pattern_alloc_reserve(pattern_addr_t pattern_addr, unsigned width, unsigned height)
+{
+    check_block(pattern_addr, width, height);
+    if (!initialized) pattern_alloc_reset();
+
+    mark_block(pattern_addr % PATTERNRAM_WIDTH, pattern_addr / PATTERNRAM_WIDTH, width, height, 1);
+}
+
+int pattern_alloc(unsigned width, unsigned height, pattern_addr_t *pattern_addr)
+{
+    nowaymsg(width == 0 || width > PATTERN_BLOCK_MAX || height == 0 || height > PATTERN_BLOCK_MAX,
+             "Pattern block size out of range!");
+    nowaymsg(pattern_addr == NULL, "Pattern address is NULL!");
+    if (!initialized) pattern_alloc_reset();
+
+    for (unsigned y = 0; y < PATTERNRAM_HEIGHT; y++)
+    {
+        // skip full rows quickly
+        if (used[y] == UINT32_MAX) continue;
+
+        for (unsigned x = 0; x < PATTERNRAM_WIDTH; x++)
+        {
+            if (used[y] & (1u << x)) continue;
+            if (!block_free(x, y, width, height)) continue;
+
+            mark_block(x, y, width, height, 1);
+            *pattern_addr = ppu_pattern_addr(x, y);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void pattern_free(pattern_addr_t pattern_addr, unsigned width, unsigned height)
+{
+    unsigned x = pattern_addr % PATTERNRAM_WIDTH;
+    unsigned y = pattern_addr / PATTERNRAM_WIDTH;
+    uint32_t mask;
+
+    check_block(pattern_addr, width, height);
+    mask = row_mask(x, width);
+    for (unsigned j = 0; j < height; j++)
+    {
+        nowaymsg((used[(y + j) % PATTERNRAM_HEIGHT] & mask) != mask,
+                 "Freeing a pattern block which is not in use!");
+    }
+
+    mark_block(x, y, width, height, 0);
+}
+
+unsigned pattern_alloc_free_count(void)
+{
+    unsigned count = 0;
+
+    if (!initialized) pattern_alloc_reset();
+
+    for (unsigned y = 0; y < PATTERNRAM_HEIGHT; y++)
+    {
+        count += PATTERNRAM_WIDTH - __builtin_popcount(used[y]);
+    }
+    return count;
+}
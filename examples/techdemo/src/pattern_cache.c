@@ -0,0 +1,129 @@
+/* Pattern cache. See pattern_cache.h for usage.
+ *
+ * Resident graphics without references form a doubly linked LRU list through the slots, so
+ *   acquiring, releasing and evicting are all constant time. Graphics with references are never
+ *   in the list and so are never evicted.
+ */
+
+#include "pattern_cache.h"
+#include "noway.h"
+#include "pattern_alloc.h"
+#include "vram_batch.h"
+
+#include <stdlib.h>
+
+static void lru_remove(pattern_cache_t *cache, int id)
+{
+    pattern_cache_slot_t *slot = &cache->slots[id];
+
+    if (slot->prev == -1) cache->lru_head = slot->next;
+    else cache->slots[slot->prev].next = slot->next;
+    if (slot->next == -1) cache->lru_tail = slot->prev;
+    else cache->slots[slot->next].prev = slot->prev;
+    slot->prev = slot->next = -1;
+}
+
+static void lru_append(pattern_cache_t *cache, int id)
+{
+    pattern_cache_slot_t *slot = &cache->slots[id];
+
+    slot->prev = cache->lru_tail;
+    slot->next = -1;
+    if (cache->lru_tail == -1) cache->lru_head = id;
+    else cache->slots[cache->lru_tail].next = id;
+    cache->lru_tail = id;
+}
+
+static void evict(pattern_cache_t *cache, int id)
+{
+    pattern_cache_slot_t *slot = &cache->slots[id];
+
+    lru_remove(cache, id);
+    pattern_free(slot->pattern_addr, cache->pool[id].width, cache->pool[id].height);
+    slot->resident = 0;
+}
+
+int pattern_cache_init(pattern_cache_t *cache, const pattern_source_t *pool, unsigned count)
+{
+    nowaymsg(cache == NULL, "Pattern cache is NULL!");
+    nowaymsg(pool == NULL || count == 0, "Pattern pool is empty!");
+    for (unsigned i = 0; i < count; i++)
+    {
+        nowaymsg(pool[i].patterns == NULL, "Pattern pool entry is NULL!");
+        nowaymsg(pool[i].width == 0 || pool[i].width > PATTERN_BLOCK_MAX ||
+                 pool[i].height == 0 || pool[i].height > PATTERN_BLOCK_MAX,
+                 "Pattern pool entry size out of range!");
+    }
+
+    if ((cache->slots = calloc(count, sizeof(pattern_cache_slot_t))) == NULL) return -1;
+    for (unsigned i = 0; i < count; i++) cache->slots[i].prev = cache->slots[i].next = -1;
+
+    cache->pool = pool;
+    cache->count = count;
+    cache->lru_head = cache->lru_tail = -1;
+    cache->hits = cache->uploads = cache->evictions = 0;
+    return 0;
+}
+
+void pattern_cache_destroy(pattern_cache_t *cache)
+{
+    nowaymsg(cache == NULL || cache->slots == NULL, "Pattern cache is not set up!");
+
+    for (unsigned i = 0; i < cache->count; i++)
+    {
+        pattern_cache_slot_t *slot = &cache->slots[i];
+
+        if (slot->resident)
+        {
+            pattern_free(slot->pattern_addr, cache->pool[i].width, cache->pool[i].height);
+        }
+    }
+    free(cache->slots);
+    cache->slots = NULL;
+}
+
+int pattern_cache_acquire(pattern_cache_t *cache, unsigned id, pattern_addr_t *pattern_addr)
+{
+    pattern_cache_slot_t *slot;
+    const pattern_source_t *source;
+
+    nowaymsg(cache == NULL || cache->slots == NULL, "Pattern cache is not set up!");
+    nowaymsg(id >= cache->count, "Pattern pool id out of range!");
+    nowaymsg(pattern_addr == NULL, "Pattern address is NULL!");
+
+    slot = &cache->slots[id];
+    source = &cache->pool[id];
+
+    if (slot->resident)
+    {
+        if (slot->refs == 0) lru_remove(cache, id);
+        cache->hits++;
+    }
+    else
+    {
+        // evict the coldest graphics until a block of the right size is free
+        while (pattern_alloc(source->width, source->height, &slot->pattern_addr) == -1)
+        {
+            if (cache->lru_head == -1) return -1;
+            evict(cache, cache->lru_head);
+            cache->evictions++;
+        }
+        vram_batch_pattern(source->patterns, source->width, source->height, slot->pattern_addr);
+        slot->resident = 1;
+        cache->uploads++;
+    }
+
+    nowaymsg(slot->refs == UINT16_MAX, "Too many references to one graphic!");
+    slot->refs++;
+    *pattern_addr = slot->pattern_addr;
+    return 0;
+}
+
+void pattern_cache_release(pattern_cache_t *cache, unsigned id)
+{
+    nowaymsg(cache == NULL || cache->slots == NULL, "Pattern cache is not set up!");
+    nowaymsg(id >= cache->count, "Pattern pool id out of range!");
+    nowaymsg(cache->slots[id].refs == 0, "Releasing a graphic without references!");
+
+    if (--cache->slots[id].refs == 0) lru_append(cache, id);
+}
@@ -0,0 +1,191 @@
+/* Pattern and sprite frame deduplication. See pattern_dedup.h for usage.
+ *
+ * Both kinds of set are handled as blocks of patterns: a single pattern is a 1x1 block. Each
+ *   block is mirrored four ways into a scratch block, and each of those is looked up in an open
+ *   addressing hash table of the blocks kept so far. Mirroring is its own inverse, so a block
+ *   which equals kept block k once mirrored by m is drawn by k mirrored by m.
+ *
+ * Mirroring a block flips the order of its patterns as well as each pattern, exactly like the PPU
+ *   draws a mirrored sprite.
+ */
+
+#include "pattern_dedup.h"
+#include "noway.h"
+#include "pattern_alloc.h"
+#include "vram_layout.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK_PATTERNS (PATTERN_BLOCK_MAX * PATTERN_BLOCK_MAX)
+
+typedef struct {
+    uint32_t hash;
+    int index;        ///< Kept block, or -1 if the slot is empty
+} table_slot_t;
+
+static uint32_t reverse_nibbles(uint32_t v)
+{
+    v = ((v & 0x0F0F0F0Fu) << 4) | ((v >> 4) & 0x0F0F0F0Fu);
+    v = ((v & 0x00FF00FFu) << 8) | ((v >> 8) & 0x00FF00FFu);
+    return (v << 16) | (v >> 16);
+}
+
+void pattern_mirror(const pattern_t *src, mirror_e mirror, pattern_t *dst)
+{
+    nowaymsg(src == NULL || dst == NULL, "Pattern is NULL!");
+
+    // a pixel row holds the left-most pixel in its least significant nibble
+    for (unsigned r = 0; r < 8; r++)
+    {
+        uint32_t row = src->pxrow[(mirror & MIRROR_Y) ? 7 - r : r];
+
+        dst->pxrow[r] = (mirror & MIRROR_X) ? reverse_nibbles(row) : row;
+    }
+}
+
+static void block_mirror(const pattern_source_t *block, mirror_e mirror, pattern_t *dst)
+{
+    for (unsigned ty = 0; ty < block->height; ty++)
+    {
+        for (unsigned tx = 0; tx < block->width; tx++)
+        {
+            unsigned sx = (mirror & MIRROR_X) ? block->width - 1 - tx : tx;
+            unsigned sy = (mirror & MIRROR_Y) ? block->height - 1 - ty : ty;
+
+            pattern_mirror(&block->patterns[sy * block->width + sx], mirror,
+                           &dst[ty * block->width + tx]);
+        }
+    }
+}
+
+// FNV-1a over the pixel rows, with the size mixed in so differently shaped blocks rarely collide
+static uint32_t block_hash(const pattern_t *patterns, unsigned width, unsigned height)
+{
+    uint32_t hash = 2166136261u ^ (width << 8 | height);
+
+    for (unsigned i = 0; i < width * height; i++)
+    {
+        for (unsigned r = 0; r < 8; r++) hash = (hash ^ patterns[i].pxrow[r]) * 16777619u;
+    }
+    return hash;
+}
+
+// Deduplicates blocks in place. Returns the number of kept blocks, or -1 if out of memory.
+static int dedup_blocks(pattern_source_t *blocks, unsigned count, pattern_dedup_map_t *map)
+{
+    table_slot_t *table;
+    unsigned size = 1, kept = 0;
+
+    // at most half full, so probe sequences stay short
+    while (size < 2 * count) size *= 2;
+    if ((table = malloc(size * sizeof(table_slot_t))) == NULL) return -1;
+    for (unsigned s = 0; s < size; s++) table[s].index = -1;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        pattern_source_t block = blocks[i];
+        unsigned patterns = block.width * block.height;
+        pattern_t mirrored[BLOCK_PATTERNS];
+        int found = -1;
+        unsigned m, s;
+        uint32_t hash;
+
+        for (m = MIRROR_NONE; m <= MIRROR_XY && found == -1; m++)
+        {
+            block_mirror(&block, (mirror_e)m, mirrored);
+            hash = block_hash(mirrored, block.width, block.height);
+            for (s = hash & (size - 1); table[s].index != -1; s = (s + 1) & (size - 1))
+            {
+                const pattern_source_t *other = &blocks[table[s].index];
+
+                if (table[s].hash == hash && other->width == block.width &&
+                    other->height == block.height &&
+                    memcmp(other->patterns, mirrored, patterns * sizeof(pattern_t)) == 0)
+                {
+                    found = table[s].index;
+                    break;
+                }
+            }
+        }
+
+        if (found != -1)
+        {
+            map[i].index = found;
+            map[i].mirror = (mirror_e)(m - 1);
+            continue;
+        }
+
+        // no match: keep it as it is
+        hash = block_hash(block.patterns, block.width, block.height);
+        for (s = hash & (size - 1); table[s].index != -1; s = (s + 1) & (size - 1));
+        table[s].hash = hash;
+        table[s].index = kept;
+        blocks[kept] = block;
+        map[i].index = kept++;
+        map[i].mirror = MIRROR_NONE;
+    }
+
+    free(table);
+    return kept;
+}
+
+int pattern_dedup_patterns(const pattern_t *patterns, unsigned count, pattern_t *kept,
+                           pattern_dedup_map_t *map)
+{
+    pattern_source_t *blocks;
+    int n;
+
+    nowaymsg(patterns == NULL || kept == NULL || map == NULL, "Pattern set is NULL!");
+
+    if ((blocks = malloc((count ? count : 1) * sizeof(pattern_source_t))) == NULL) return -1;
+    for (unsigned i = 0; i < count; i++)
+    {
+        blocks[i].patterns = &patterns[i];
+        blocks[i].width = 1;
+        blocks[i].height = 1;
+    }
+
+    // kept block k comes from pattern i >= k, so copying in order never overwrites a later source
+    if ((n = dedup_blocks(blocks, count, map)) != -1)
+    {
+        for (int k = 0; k < n; k++) memmove(&kept[k], blocks[k].patterns, sizeof(pattern_t));
+    }
+    free(blocks);
+    return n;
+}
+
+void pattern_dedup_tiles(const pattern_dedup_map_t *map, unsigned count, pattern_addr_t from,
+                         pattern_addr_t to, const tile_t *src, tile_t *dst, unsigned len)
+{
+    nowaymsg(map == NULL || src == NULL || dst == NULL, "Tile rewrite argument is NULL!");
+
+    for (unsigned i = 0; i < len; i++)
+    {
+        tile_t tile = src[i];
+        unsigned i_set = (tile >> 6) - from;
+
+        // addresses below from wrap around to large offsets, outside the set
+        if (i_set < count)
+        {
+            tile = vram_tile(to + map[i_set].index, (tile >> 2) & 0xF,
+                             (mirror_e)((tile & 0x3) ^ map[i_set].mirror));
+        }
+        dst[i] = tile;
+    }
+}
+
+int pattern_dedup_frames(pattern_source_t *frames, unsigned count, pattern_dedup_map_t *map)
+{
+    nowaymsg(frames == NULL || map == NULL, "Frame table is NULL!");
+    for (unsigned i = 0; i < count; i++)
+    {
+        nowaymsg(frames[i].patterns == NULL, "Frame patterns are NULL!");
+        nowaymsg(frames[i].width == 0 || frames[i].width > PATTERN_BLOCK_MAX ||
+                 frames[i].height == 0 || frames[i].height > PATTERN_BLOCK_MAX,
+                 "Frames must be 1x1 to 4x4 patterns!");
+    }
+
+    return dedup_blocks(frames, count, map);
+}
@@ -0,0 +1,206 @@
+/* Virtual sprite pool. See sprite_pool.h for usage.
+ *
+ * Sprites are validated when added. After that, the game edits them directly, so they are only
+ *   validated again (while packing) in debug builds.
+ *
+ * Each submit packs the shown sprites into a local copy of Sprite RAM (entry words and extra data
+ *   bytes), then compares it against the copy from the last submit. Only the span from the first
+ *   to the last changed sprite ID is recorded, as one write for the entry words and one for the
+ *   extra data, which vram_batch merges into the frame's uploads.
+ */
+
+#include "sprite_pool.h"
+#include "noway.h"
+#include "sprite_packed.h"
+#include "vram_batch.h"
+#include "vram_layout.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Sprite coordinates wrap around at these values, like the PPU draws them
+#define SPRITE_WRAP_X 512
+#define SPRITE_WRAP_Y 256
+
+// Unused sprite IDs get a 1x1 sprite just past the bottom-right corner of the screen
+#define HIDDEN_WORD (((uint32_t)SCREEN_HEIGHT << 9) | SCREEN_WIDTH)
+#define HIDDEN_EXTRA 0
+
+typedef struct {
+    sprite_t sprite;
+    int depth;
+    uint32_t serial;      // when the sprite was added, to keep sorting stable
+    uint16_t generation;  // bumped on removal, so stale handles stop matching
+    uint8_t used;
+} entry_t;
+
+static entry_t entries[SPRITE_POOL_SIZE];
+static uint32_t next_serial;
+static int multiplex;
+static unsigned rotation;  // position in the sorted on-screen sprites shown first when multiplexing
+
+static uint32_t shown_words[SPRITE_MAXCOUNT];
+static uint8_t shown_extras[SPRITE_MAXCOUNT];
+static int shown_valid;    // 0 until the first submit, which records every sprite ID
+
+static entry_t *lookup(sprite_handle_t handle)
+{
+    entry_t *entry;
+
+    if (handle < 0) return NULL;
+    entry = &entries[handle % SPRITE_POOL_SIZE];
+    if (!entry->used || entry->generation != handle / SPRITE_POOL_SIZE) return NULL;
+    return entry;
+}
+
+static void check_sprite(const sprite_t *s)
+{
+    nowaymsg(s->pattern_addr >= PATTERNRAM_WIDTH * PATTERNRAM_HEIGHT, "Pattern address malformed!");
+    nowaymsg(s->palette_id >= SPRLAYER_MAX_PALETTES, "Palette ID out of range!");
+    nowaymsg(s->y > SPRITE_MAXY, "Sprite y coord. out of range!");
+    nowaymsg(s->x > SPRITE_MAXX, "Sprite x coord. out of range!");
+    nowaymsg(s->mirror > MIRROR_XY, "Mirror argument malformed!");
+    nowaymsg(s->height == 0 || s->height > 4, "Sprite height must be in range [1, 4]!");
+    nowaymsg(s->width == 0 || s->width > 4, "Sprite width must be in range [1, 4]!");
+    nowaymsg(s->prio > PRIO_IN_FRONT, "Sprite Priority exceeds maximum (2)!");
+}
+
+// A sprite is on screen if it starts on screen or wraps around onto its left or top edge
+static int on_screen(const sprite_t *s)
+{
+    return (s->x < SCREEN_WIDTH || s->x + s->width * 8u > SPRITE_WRAP_X) &&
+           (s->y < SCREEN_HEIGHT || s->y + s->height * 8u > SPRITE_WRAP_Y);
+}
+
+// Drawing order: front priority first, then lowest depth, then first added
+static int compare_order(const void *a, const void *b)
+{
+    const entry_t *ea = &entries[*(const uint16_t *)a];
+    const entry_t *eb = &entries[*(const uint16_t *)b];
+
+    if (ea->sprite.prio != eb->sprite.prio) return (ea->sprite.prio > eb->sprite.prio) ? -1 : 1;
+    if (ea->depth != eb->depth) return (ea->depth < eb->depth) ? -1 : 1;
+    if (ea->serial != eb->serial) return (ea->serial < eb->serial) ? -1 : 1;
+    return 0;
+}
+
+void sprite_pool_reset(void)
+{
+    for (unsigned i = 0; i < SPRITE_POOL_SIZE; i++)
+    {
+        if (entries[i].used) sprite_pool_remove(entries[i].generation * SPRITE_POOL_SIZE + i);
+    }
+    multiplex = 0;
+    rotation = 0;
+    shown_valid = 0;
+}
+
+sprite_handle_t sprite_pool_add(const sprite_t *sprite, int depth)
+{
+    nowaymsg(sprite == NULL, "Sprite is NULL!");
+    check_sprite(sprite);
+
+    for (unsigned i = 0; i < SPRITE_POOL_SIZE; i++)
+    {
+        entry_t *entry = &entries[i];
+
+        if (entry->used) continue;
+
+        entry->sprite = *sprite;
+        entry->depth = depth;
+        entry->serial = next_serial++;
+        entry->used = 1;
+        return (sprite_handle_t)entry->generation * SPRITE_POOL_SIZE + i;
+    }
+    return -1;
+}
+
+void sprite_pool_remove(sprite_handle_t handle)
+{
+    entry_t *entry = lookup(handle);
+
+    if (entry == NULL) return;
+
+    entry->used = 0;
+    entry->generation = (entry->generation + 1) & 0x7FFF;
+}
+
+sprite_t *sprite_pool_get(sprite_handle_t handle)
+{
+    entry_t *entry = lookup(handle);
+
+    return (entry == NULL) ? NULL : &entry->sprite;
+}
+
+void sprite_pool_set_depth(sprite_handle_t handle, int depth)
+{
+    entry_t *entry = lookup(handle);
+
+    nowaymsg(entry == NULL, "Sprite handle is stale!");
+    entry->depth = depth;
+}
+
+void sprite_pool_set_multiplex(int enable)
+{
+    multiplex = enable;
+    rotation = 0;
+}
+
+unsigned sprite_pool_submit(void)
+{
+    uint16_t order[SPRITE_POOL_SIZE];
+    uint32_t words[SPRITE_MAXCOUNT];
+    uint8_t extras[SPRITE_MAXCOUNT];
+    unsigned count = 0, shown = 0, first = 0;
+    int changed_i = -1, changed_j = -1;
+
+    for (unsigned i = 0; i < SPRITE_POOL_SIZE; i++)
+    {
+        if (!entries[i].used) continue;
+        if (on_screen(&entries[i].sprite)) order[count++] = i;
+    }
+    qsort(order, count, sizeof(order[0]), compare_order);
+
+    if (count > SPRITE_MAXCOUNT && multiplex)
+    {
+        // show a window of 64 sprites which moves on by 64 every frame. The part of the window
+        //   which wrapped around to the front of the order is sorted first, so the shown sprites
+        //   keep their drawing order.
+        unsigned start = rotation % count;
+        unsigned wrapped = (start + SPRITE_MAXCOUNT > count) ? start + SPRITE_MAXCOUNT - count : 0;
+
+        for (unsigned i = 0; i < wrapped; i++, shown++)
+        {
+            sprite_pack(&entries[order[i]].sprite, &words[shown], &extras[shown]);
+        }
+        first = start;
+        rotation = start + SPRITE_MAXCOUNT;
+    }
+    for (unsigned i = first; i < count && shown < SPRITE_MAXCOUNT; i++, shown++)
+    {
+        sprite_pack(&entries[order[i]].sprite, &words[shown], &extras[shown]);
+    }
+    for (; shown < SPRITE_MAXCOUNT; shown++)
+    {
+        words[shown] = HIDDEN_WORD;
+        extras[shown] = HIDDEN_EXTRA;
+    }
+
+    for (int id = 0; id < SPRITE_MAXCOUNT; id++)
+    {
+        if (shown_valid && words[id] == shown_words[id] && extras[id] == shown_extras[id]) continue;
+
+        if (changed_i == -1) changed_i = id;
+        changed_j = id;
+        shown_words[id] = words[id];
+        shown_extras[id] = extras[id];
+    }
+    shown_valid = 1;
+
+    if (changed_i != -1)
+    {
+        vram_batch_sprites_packed(&words[changed_i], &extras[changed_i], changed_j - changed_i + 1,
+                                  changed_i);
+    }
+    return count;
+}
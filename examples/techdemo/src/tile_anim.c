@@ -0,0 +1,150 @@
+/* Tile animation scheduler. See tile_anim.h for usage.
+ *
+ * The timing wheel is an array of TILE_ANIM_WHEEL_SIZE buckets. An animation whose next frame is
+ *   due at tick t sits in bucket t % TILE_ANIM_WHEEL_SIZE, in a doubly linked list through the
+ *   slots (so removing an animation is constant time). Each update only walks the bucket of the
+ *   current tick. Frames longer than one turn of the wheel stay in their bucket until their tick
+ *   actually comes around.
+ */
+
+#include "tile_anim.h"
+#include "noway.h"
+#include "vram_batch.h"
+#include "vram_layout.h"
+
+#include <stdlib.h>
+
+static unsigned bucket_of(unsigned tick)
+{
+    return tick % TILE_ANIM_WHEEL_SIZE;
+}
+
+static void bucket_insert(tile_anim_t *anim, int id)
+{
+    tile_anim_slot_t *slot = &anim->slots[id];
+    int *head = &anim->wheel[bucket_of(slot->due)];
+
+    slot->prev = -1;
+    slot->next = *head;
+    if (*head != -1) anim->slots[*head].prev = id;
+    *head = id;
+}
+
+static void bucket_remove(tile_anim_t *anim, int id)
+{
+    tile_anim_slot_t *slot = &anim->slots[id];
+
+    if (slot->prev == -1) anim->wheel[bucket_of(slot->due)] = slot->next;
+    else anim->slots[slot->prev].next = slot->next;
+    if (slot->next != -1) anim->slots[slot->next].prev = slot->prev;
+    slot->prev = slot->next = -1;
+}
+
+int tile_anim_init(tile_anim_t *anim, unsigned capacity)
+{
+    nowaymsg(anim == NULL, "Tile animation scheduler is NULL!");
+    nowaymsg(capacity == 0, "Tile animation capacity must be at least 1!");
+
+    if ((anim->slots = calloc(capacity, sizeof(tile_anim_slot_t))) == NULL) return -1;
+
+    // every slot starts out in the free list
+    for (unsigned i = 0; i < capacity; i++)
+    {
+        anim->slots[i].prev = -1;
+        anim->slots[i].next = (i + 1 < capacity) ? (int)i + 1 : -1;
+    }
+    for (unsigned b = 0; b < TILE_ANIM_WHEEL_SIZE; b++) anim->wheel[b] = -1;
+
+    anim->capacity = capacity;
+    anim->free_head = 0;
+    anim->now = 0;
+    return 0;
+}
+
+void tile_anim_destroy(tile_anim_t *anim)
+{
+    nowaymsg(anim == NULL || anim->slots == NULL, "Tile animation scheduler is not set up!");
+
+    free(anim->slots);
+    anim->slots = NULL;
+}
+
+int tile_anim_add(tile_anim_t *anim, pattern_addr_t pattern_addr, const pattern_t *const *frames,
+                  const unsigned *durations, unsigned count)
+{
+    tile_anim_slot_t *slot;
+    int id;
+
+    nowaymsg(anim == NULL || anim->slots == NULL, "Tile animation scheduler is not set up!");
+    nowaymsg(pattern_addr >= PATTERNRAM_WIDTH * PATTERNRAM_HEIGHT, "Pattern address malformed!");
+    nowaymsg(frames == NULL || durations == NULL || count == 0, "Tile animation has no frames!");
+    for (unsigned i = 0; i < count; i++)
+    {
+        nowaymsg(frames[i] == NULL, "Tile animation frame is NULL!");
+        nowaymsg(durations[i] == 0, "Tile animation frame duration must be at least 1!");
+    }
+
+    if ((id = anim->free_head) == -1) return -1;
+
+    slot = &anim->slots[id];
+    anim->free_head = slot->next;
+
+    slot->pattern_addr = pattern_addr;
+    slot->frames = frames;
+    slot->durations = durations;
+    slot->count = count;
+    slot->frame = 0;
+    slot->due = anim->now + durations[0];
+    bucket_insert(anim, id);
+
+    vram_batch_pattern(frames[0], 1, 1, pattern_addr);
+    return id;
+}
+
+void tile_anim_remove(tile_anim_t *anim, int id)
+{
+    nowaymsg(anim == NULL || anim->slots == NULL, "Tile animation scheduler is not set up!");
+    nowaymsg(id < 0 || (unsigned)id >= anim->capacity || anim->slots[id].count == 0,
+             "Tile animation ID is not in use!");
+
+    bucket_remove(anim, id);
+    anim->slots[id].count = 0;
+    anim->slots[id].next = anim->free_head;
+    anim->free_head = id;
+}
+
+unsigned tile_anim_update(tile_anim_t *anim)
+{
+    unsigned recorded = 0;
+    int id;
+
+    nowaymsg(anim == NULL || anim->slots == NULL, "Tile animation scheduler is not set up!");
+
+    anim->now++;
+
+    // detach the current bucket first: animations may be put straight back into it
+    id = anim->wheel[bucket_of(anim->now)];
+    anim->wheel[bucket_of(anim->now)] = -1;
+
+    while (id != -1)
+    {
+        tile_anim_slot_t *slot = &anim->slots[id];
+        int next = slot->next;
+
+        if (slot->due == anim->now)
+        {
+            const pattern_t *shown = slot->frames[slot->frame];
+
+            slot->frame = (slot->frame + 1) % slot->count;
+            slot->due = anim->now + slot->durations[slot->frame];
+            if (slot->frames[slot->frame] != shown)
+            {
+                vram_batch_pattern(slot->frames[slot->frame], 1, 1, slot->pattern_addr);
+                recorded++;
+            }
+        }
+        bucket_insert(anim, id);
+        id = next;
+    }
+    return recorded;
+}
@@ -0,0 +1,165 @@
+/* Tilemap streaming. See tilemap_stream.h for usage.
+ *
+ * The layer always holds exactly the map rectangle [window_x, window_x + window_width) x
+ *   [window_y, window_y + window_height). Moving the window by one column writes the column it
+ *   gains over the column it loses (they share the same layer column, modulo 64), and likewise for
+ *   rows. A move of a whole window or more shares nothing with the old window, so the window is
+ *   simply reloaded.
+ */
+
+#include "tilemap_stream.h"
+#include "noway.h"
+#include "vram_batch.h"
+#include "vram_layout.h"
+
+#define LAYER_PX_WIDTH (TILELAYER_WIDTH * TILE_PX)
+#define LAYER_PX_HEIGHT (TILELAYER_HEIGHT * TILE_PX)
+
+// Tiles which can be at least partly on screen at once
+#define VISIBLE_COLS (SCREEN_WIDTH / TILE_PX + 1)
+#define VISIBLE_ROWS (SCREEN_HEIGHT / TILE_PX + 1)
+
+// Preloaded tiles left of and above the screen, when the window is centered on it
+#define MARGIN_COLS ((TILELAYER_WIDTH - VISIBLE_COLS) / 2)
+#define MARGIN_ROWS ((TILELAYER_HEIGHT - VISIBLE_ROWS) / 2)
+
+static unsigned distance(unsigned a, unsigned b)
+{
+    return (a > b) ? a - b : b - a;
+}
+
+// Where the window should start along one axis: centered on the screen, but inside the map
+static unsigned window_target(unsigned camera_tile, unsigned margin, unsigned map_size,
+                              unsigned window_size)
+{
+    if (camera_tile < margin) return 0;
+    return MIN(camera_tile - margin, map_size - window_size);
+}
+
+// Writes map column x, for the rows of the window
+static void load_column(const tilemap_stream_t *stream, unsigned x)
+{
+    tile_t column[TILELAYER_HEIGHT];
+
+    for (unsigned i = 0; i < stream->window_height; i++)
+    {
+        column[i] = stream->map[(stream->window_y + i) * stream->map_width + x];
+    }
+    vram_batch_tiles_vertical(column, stream->window_height, stream->layer, x % TILELAYER_WIDTH,
+                              stream->window_y % TILELAYER_HEIGHT, stream->window_height);
+}
+
+// Writes map row y, for the columns of the window
+static void load_row(const tilemap_stream_t *stream, unsigned y)
+{
+    vram_batch_tiles_horizontal(&stream->map[y * stream->map_width + stream->window_x],
+                                stream->window_width, stream->layer,
+                                stream->window_x % TILELAYER_WIDTH, y % TILELAYER_HEIGHT,
+                                stream->window_width);
+}
+
+// Moves the window one column toward target_x, writing the column it gains
+static void step_x(tilemap_stream_t *stream, unsigned target_x)
+{
+    if (target_x > stream->window_x)
+    {
+        load_column(stream, stream->window_x + stream->window_width);
+        stream->window_x++;
+    }
+    else
+    {
+        stream->window_x--;
+        load_column(stream, stream->window_x);
+    }
+}
+
+// Moves the window one row toward target_y, writing the row it gains
+static void step_y(tilemap_stream_t *stream, unsigned target_y)
+{
+    if (target_y > stream->window_y)
+    {
+        load_row(stream, stream->window_y + stream->window_height);
+        stream->window_y++;
+    }
+    else
+    {
+        stream->window_y--;
+        load_row(stream, stream->window_y);
+    }
+}
+
+// Checks whether every map tile on screen is in the window
+static int screen_loaded(const tilemap_stream_t *stream, unsigned camera_tx, unsigned camera_ty)
+{
+    unsigned end_x = MIN(camera_tx + VISIBLE_COLS, stream->map_width);
+    unsigned end_y = MIN(camera_ty + VISIBLE_ROWS, stream->map_height);
+
+    return camera_tx >= stream->window_x && end_x <= stream->window_x + stream->window_width &&
+           camera_ty >= stream->window_y && end_y <= stream->window_y + stream->window_height;
+}
+
+void tilemap_stream_init(tilemap_stream_t *stream, const tile_t *map, unsigned map_width,
+                         unsigned map_height, layer_e layer, unsigned lines_per_frame)
+{
+    nowaymsg(stream == NULL, "Tilemap stream is NULL!");
+    nowaymsg(map == NULL, "Map is NULL!");
+    nowaymsg(map_width * TILE_PX < SCREEN_WIDTH || map_height * TILE_PX < SCREEN_HEIGHT,
+             "Map is smaller than the screen!");
+    nowaymsg(layer != LAYER_BG && layer != LAYER_FG, "Layer must be LAYER_BG or LAYER_FG!");
+
+    stream->map = map;
+    stream->map_width = map_width;
+    stream->map_height = map_height;
+    stream->layer = layer;
+    stream->lines_per_frame = lines_per_frame;
+    stream->window_width = MIN(map_width, TILELAYER_WIDTH);
+    stream->window_height = MIN(map_height, TILELAYER_HEIGHT);
+    stream->window_x = 0;
+    stream->window_y = 0;
+    stream->loaded = 0;
+}
+
+unsigned tilemap_stream_update(tilemap_stream_t *stream, unsigned camera_x, unsigned camera_y)
+{
+    unsigned camera_tx, camera_ty, target_x, target_y;
+    unsigned lines = 0;
+
+    nowaymsg(stream == NULL || stream->map == NULL, "Tilemap stream is not set up!");
+    nowaymsg(camera_x > stream->map_width * TILE_PX - SCREEN_WIDTH ||
+             camera_y > stream->map_height * TILE_PX - SCREEN_HEIGHT,
+             "Camera shows tiles outside of the map!");
+
+    camera_tx = camera_x / TILE_PX;
+    camera_ty = camera_y / TILE_PX;
+    target_x = window_target(camera_tx, MARGIN_COLS, stream->map_width, stream->window_width);
+    target_y = window_target(camera_ty, MARGIN_ROWS, stream->map_height, stream->window_height);
+
+    if (!stream->loaded || distance(target_x, stream->window_x) >= stream->window_width ||
+        distance(target_y, stream->window_y) >= stream->window_height)
+    {
+        stream->window_x = target_x;
+        stream->window_y = target_y;
+        for (unsigned i = 0; i < stream->window_height; i++) load_row(stream, target_y + i);
+        stream->loaded = 1;
+        lines = stream->window_height;
+    }
+
+    // Preload within the budget, but never leave tiles on screen unloaded. The axis which is
+    //   further behind goes first.
+    while ((stream->window_x != target_x || stream->window_y != target_y) &&
+           (lines < stream->lines_per_frame || !screen_loaded(stream, camera_tx, camera_ty)))
+    {
+        if (distance(target_x, stream->window_x) >= distance(target_y, stream->window_y))
+        {
+            step_x(stream, target_x);
+        }
+        else
+        {
+            step_y(stream, target_y);
+        }
+        lines++;
+    }
+
+    vram_batch_scroll(stream->layer, camera_x % LAYER_PX_WIDTH, camera_y % LAYER_PX_HEIGHT);
+    return lines;
+}
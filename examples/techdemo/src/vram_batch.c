@@ -0,0 +1,469 @@
+/* Recorded VRAM command list with a shadow copy of VRAM. See vram_batch.h for usage.
+ *
+ * Two 64KiB copies of VRAM are kept in user space:
+ *   vram_image:  What VRAM should contain once everything recorded so far is submitted.
+ *   vram_shadow: What the PPU's VRAM buffer contains right now (everything already submitted).
+ *
+ * Recording writes into vram_image and marks the 32B chunks it touched (one bit per chunk).
+ *   Submitting compares each touched chunk against vram_shadow and only uploads chunks whose bytes
+ *   really changed. A chunk which is not touched always matches the shadow, so changed chunks
+ *   separated by a short clean gap are merged into one ppu_write_vram.
+ *
+ * The contents of the PPU's VRAM buffer are unknown until the first submit, which therefore
+ *   uploads the entire image. From then on, the shadow is exact as long as every VRAM write goes
+ *   through this module.
+ *
+ * vram_batch_take finds the same merged ranges, but copies them into a vram_frame_t instead of
+ *   uploading them, and updates the shadow straight away: the shadow then describes VRAM as it
+ *   will be once every taken frame has been submitted, in order.
+ */
+
+#include "vram_batch.h"
+#include "vram_layout.h"
+#include "noway.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// Dirty tracking granularity. Matches both pattern_t and the Cortex-A9 L1 cache line size.
+#define VRAM_CHUNK_BSIZE 32
+#define VRAM_CHUNKS (VRAM_BSIZE / VRAM_CHUNK_BSIZE)
+
+// Largest run of clean chunks which will be uploaded anyway to merge two changed ranges. Copying a
+//   few hundred extra bytes is cheaper than an extra device write.
+#define VRAM_MERGE_GAP_CHUNKS 4
+
+// Merged ranges are separated by more than VRAM_MERGE_GAP_CHUNKS clean chunks
+#if VRAM_CHUNKS / (VRAM_MERGE_GAP_CHUNKS + 2) + 1 > VRAM_FRAME_MAX_RANGES
+#error "VRAM_FRAME_MAX_RANGES is too small for the merge gap"
+#endif
+
+static uint8_t vram_image[VRAM_BSIZE];
+static uint8_t vram_shadow[VRAM_BSIZE];
+static uint32_t vram_touched[VRAM_CHUNKS / 32];
+static unsigned shadow_valid;
+
+// A setting which the PPU User Library applies with an ioctl rather than a VRAM write. Only the
+//   latest recorded value matters, and it is only sent when it differs from the applied value.
+typedef struct {
+    unsigned value;   // Latest recorded value
+    unsigned pending; // A value was recorded since the last submit
+    unsigned applied; // Value last sent to the PPU
+    unsigned valid;   // applied holds a value which was actually sent
+} ppu_setting_t;
+
+static ppu_setting_t set_bgcolor, set_layer_mask, set_scroll[2];
+
+static inline unsigned chunk_touched(unsigned chunk)
+{
+    return (vram_touched[chunk >> 5] >> (chunk & 31)) & 1;
+}
+
+static inline void chunk_clear(unsigned chunk)
+{
+    vram_touched[chunk >> 5] &= ~(1u << (chunk & 31));
+}
+
+// Copies len bytes into the local VRAM image and marks the chunks they touch
+static void record(const void *buf, uint32_t len, uint32_t offset)
+{
+    if (len == 0) return;
+
+    memcpy(&vram_image[offset], buf, len);
+    for (uint32_t c = offset / VRAM_CHUNK_BSIZE; c <= (offset + len - 1) / VRAM_CHUNK_BSIZE; c++)
+    {
+        vram_touched[c >> 5] |= 1u << (c & 31);
+    }
+}
+
+// Finds the first touched chunk at or after chunk whose contents differ from the shadow. Touched
+//   chunks which turn out to match the shadow are untouched along the way. Returns VRAM_CHUNKS if
+//   there is no such chunk.
+static unsigned next_changed_chunk(unsigned chunk)
+{
+    while (chunk < VRAM_CHUNKS)
+    {
+        uint32_t word = vram_touched[chunk >> 5] >> (chunk & 31);
+        if (word == 0)
+        {
+            chunk = (chunk | 31) + 1;
+            continue;
+        }
+        chunk += __builtin_ctz(word);
+
+        uint32_t offset = chunk * VRAM_CHUNK_BSIZE;
+        if (memcmp(&vram_image[offset], &vram_shadow[offset], VRAM_CHUNK_BSIZE) != 0) break;
+        chunk_clear(chunk);
+        chunk++;
+    }
+
+    return MIN(chunk, VRAM_CHUNKS);
+}
+
+static void setting_record(ppu_setting_t *setting, unsigned value)
+{
+    setting->value = value;
+    setting->pending = 1;
+}
+
+// Returns true if the setting has a recorded value which still needs to be sent
+static int setting_changed(const ppu_setting_t *setting)
+{
+    return setting->pending && (!setting->valid || setting->value != setting->applied);
+}
+
+static void setting_applied(ppu_setting_t *setting)
+{
+    setting->applied = setting->value;
+    setting->valid = 1;
+    setting->pending = 0;
+}
+
+static void check_tile_args(const tile_t *tiles, unsigned len, layer_e layer, unsigned x_i,
+                            unsigned y_i)
+{
+    nowaymsg(tiles == NULL, "Tile array is NULL!");
+    nowaymsg(len == 0, "Tile array length cannot be 0!");
+    nowaymsg(layer != LAYER_BG && layer != LAYER_FG, "Incorrect layer to write tiles to!");
+    nowaymsg(x_i >= TILELAYER_WIDTH, "Initial write position out of bounds!");
+    nowaymsg(y_i >= TILELAYER_HEIGHT, "Initial write position out of bounds!");
+}
+
+void vram_batch_begin(void)
+{
+    // Roll the image back to the shadow wherever something was recorded but never submitted.
+    for (unsigned c = 0; c < VRAM_CHUNKS; c++)
+    {
+        if (!chunk_touched(c)) continue;
+        memcpy(&vram_image[c * VRAM_CHUNK_BSIZE], &vram_shadow[c * VRAM_CHUNK_BSIZE],
+               VRAM_CHUNK_BSIZE);
+    }
+    memset(vram_touched, 0, sizeof(vram_touched));
+
+    set_bgcolor.pending = 0;
+    set_layer_mask.pending = 0;
+    set_scroll[0].pending = 0;
+    set_scroll[1].pending = 0;
+}
+
+void vram_batch_vram(const void *buf, size_t len, off_t offset)
+{
+    nowaymsg(buf == NULL, "VRAM buffer is NULL!");
+    nowaymsg(offset < 0 || (size_t)offset > VRAM_BSIZE || len > VRAM_BSIZE - (size_t)offset,
+             "PPU vram write goes out of VRAM bounds!");
+
+    record(buf, len, offset);
+}
+
+void vram_batch_tiles_horizontal(const tile_t *tiles, unsigned len, layer_e layer, unsigned x_i,
+                                 unsigned y_i, unsigned count)
+{
+    check_tile_args(tiles, len, layer, x_i, y_i);
+    len = MIN(len, TILELAYER_WIDTH);
+    count = MIN(count, TILELAYER_WIDTH);
+
+    for (unsigned i = 0, j = 0; i < count; i++)
+    {
+        record(&tiles[j], sizeof(tile_t),
+               vram_tile_offset(layer, (x_i + i) % TILELAYER_WIDTH, y_i));
+        j = (j == len - 1) ? 0 : j + 1;
+    }
+}
+
+void vram_batch_tiles_vertical(const tile_t *tiles, unsigned len, layer_e layer, unsigned x_i,
+                               unsigned y_i, unsigned count)
+{
+    check_tile_args(tiles, len, layer, x_i, y_i);
+    len = MIN(len, TILELAYER_HEIGHT);
+    count = MIN(count, TILELAYER_HEIGHT);
+
+    for (unsigned i = 0, j = 0; i < count; i++)
+    {
+        record(&tiles[j], sizeof(tile_t),
+               vram_tile_offset(layer, x_i, (y_i + i) % TILELAYER_HEIGHT));
+        j = (j == len - 1) ? 0 : j + 1;
+    }
+}
+
+void vram_batch_pattern(const pattern_t *pattern, unsigned width, unsigned height,
+                        pattern_addr_t pattern_addr)
+{
+    nowaymsg(pattern == NULL, "Pattern array is NULL!");
+    nowaymsg(width == 0, "Pattern width cannot be 0!");
+    nowaymsg(height == 0, "Pattern height cannot be 0!");
+    nowaymsg(pattern_addr >= PATTERNRAM_WIDTH * PATTERNRAM_HEIGHT, "Pattern address malformed!");
+
+    unsigned x_i = pattern_addr % PATTERNRAM_WIDTH;
+    unsigned y_i = pattern_addr / PATTERNRAM_WIDTH;
+
+    for (unsigned y = 0; y < height; y++)
+    {
+        for (unsigned x = 0; x < width; x++)
+        {
+            pattern_addr_t addr = ppu_pattern_addr((x_i + x) % PATTERNRAM_WIDTH,
+                                                   (y_i + y) % PATTERNRAM_HEIGHT);
+            record(&pattern[y * width + x], sizeof(pattern_t), vram_pattern_offset(addr));
+        }
+    }
+}
+
+void vram_batch_palette(const palette_t *palette, layer_e layer_id, unsigned palette_id)
+{
+    nowaymsg(palette == NULL, "Palette is NULL!");
+    if (layer_id == LAYER_SPR)
+    {
+        nowaymsg(palette_id >= PALETTERAM_SPRITEMAX, "Attempting to access palette out of bounds!");
+    }
+    else
+    {
+        nowaymsg(palette_id >= PALETTERAM_TILEMAX, "Attempting to access palette out of bounds!");
+    }
+
+    record(palette, sizeof(palette_t), vram_palette_offset(layer_id, palette_id));
+}
+
+void vram_batch_sprites(const sprite_t *sprites, unsigned len, unsigned sprite_id_i)
+{
+    nowaymsg(sprites == NULL, "Sprite Array is NULL!");
+    nowaymsg(sprite_id_i + len > SPRITE_MAXCOUNT, "Sprite write would exceed Sprite RAM bounds!");
+
+    for (unsigned i = 0; i < len; i++)
+    {
+        const sprite_t *s = &sprites[i];
+        nowaymsg(s->pattern_addr >= PATTERNRAM_WIDTH * PATTERNRAM_HEIGHT,
+                 "Pattern address malformed!");
+        nowaymsg(s->palette_id >= SPRLAYER_MAX_PALETTES, "Palette ID out of range!");
+        nowaymsg(s->y > SPRITE_MAXY, "Sprite y coord. out of range!");
+        nowaymsg(s->x > SPRITE_MAXX, "Sprite x coord. out of range!");
+        nowaymsg(s->mirror > MIRROR_XY, "Mirror argument malformed!");
+        nowaymsg(s->height == 0 || s->height > 4, "Sprite height must be in range [1, 4]!");
+        nowaymsg(s->width == 0 || s->width > 4, "Sprite width must be in range [1, 4]!");
+        nowaymsg(s->prio > PRIO_IN_FRONT, "Sprite Priority exceeds maximum (2)!");
+
+        uint32_t word = vram_sprite_word(s);
+        uint8_t extra = vram_sprite_extra(s);
+        record(&word, SPRITE_BSIZE, VRAM_SPRITESOFFSET + (sprite_id_i + i) * SPRITE_BSIZE);
+        record(&extra, 1, VRAM_SPRITESOFFSET + SPRRAM_EXTRAOFFSET + sprite_id_i + i);
+    }
+}
+
+void vram_batch_sprites_packed(const uint32_t *words, const uint8_t *extras, unsigned len,
+                               unsigned sprite_id_i)
+{
+    nowaymsg(words == NULL, "Sprite Array is NULL!");
+    nowaymsg(sprite_id_i + len > SPRITE_MAXCOUNT, "Sprite write would exceed Sprite RAM bounds!");
+
+    record(words, len * SPRITE_BSIZE, VRAM_SPRITESOFFSET + sprite_id_i * SPRITE_BSIZE);
+    if (extras != NULL) record(extras, len, VRAM_SPRITESOFFSET + SPRRAM_EXTRAOFFSET + sprite_id_i);
+}
+
+void vram_batch_bgcolor(unsigned color)
+{
+    setting_record(&set_bgcolor, color);
+}
+
+void vram_batch_scroll(layer_e tile_layer, unsigned scroll_x, unsigned scroll_y)
+{
+    nowaymsg(tile_layer != LAYER_BG && tile_layer != LAYER_FG,
+             "Incorrect layer to scroll! Only the BG and FG layers scroll.");
+    nowaymsg(scroll_x > 511 || scroll_y > 511, "Scroll out of range!");
+
+    setting_record(&set_scroll[tile_layer == LAYER_FG], (scroll_y << 16) | scroll_x);
+}
+
+void vram_batch_layer_enable(unsigned enable_mask)
+{
+    setting_record(&set_layer_mask, enable_mask);
+}
+
+// Extends the changed range starting at chunk first with every changed chunk close enough to be
+//   merged into the same write. Returns the last chunk of the range, and the first changed chunk
+//   after it in *next.
+static unsigned merge_range(unsigned first, unsigned *next)
+{
+    unsigned last = first;
+
+    while ((*next = next_changed_chunk(last + 1)) < VRAM_CHUNKS &&
+           *next - last - 1 <= VRAM_MERGE_GAP_CHUNKS)
+    {
+        last = *next;
+    }
+    return last;
+}
+
+// Marks a range as sent: the shadow now holds the image's bytes
+static void retire_range(unsigned first, unsigned last)
+{
+    uint32_t offset = first * VRAM_CHUNK_BSIZE;
+
+    memcpy(&vram_shadow[offset], &vram_image[offset], (last - first + 1) * VRAM_CHUNK_BSIZE);
+    for (unsigned c = first; c <= last; c++) chunk_clear(c);
+}
+
+// Uploads every changed chunk, merging nearby changes into a single write
+static int submit_changes(void)
+{
+    unsigned first = next_changed_chunk(0);
+
+    while (first < VRAM_CHUNKS)
+    {
+        unsigned next;
+        unsigned last = merge_range(first, &next);
+
+        uint32_t offset = first * VRAM_CHUNK_BSIZE;
+        uint32_t len = (last - first + 1) * VRAM_CHUNK_BSIZE;
+        if (ppu_write_vram(&vram_image[offset], len, offset) != 0) return -1;
+
+        // Sent ranges are retired immediately, so a busy PPU only costs a retry of the range
+        //   which failed.
+        retire_range(first, last);
+
+        first = next;
+    }
+
+    return 0;
+}
+
+int vram_batch_submit(void)
+{
+    if (!shadow_valid)
+    {
+        if (ppu_write_vram(vram_image, VRAM_BSIZE, 0) != 0) return -1;
+        memcpy(vram_shadow, vram_image, VRAM_BSIZE);
+        memset(vram_touched, 0, sizeof(vram_touched));
+        shadow_valid = 1;
+    }
+    else if (submit_changes() != 0)
+    {
+        return -1;
+    }
+
+    for (unsigned i = 0; i < 2; i++)
+    {
+        if (!setting_changed(&set_scroll[i])) continue;
+        if (ppu_set_scroll(i ? LAYER_FG : LAYER_BG, set_scroll[i].value & 0xFFFF,
+                           set_scroll[i].value >> 16) != 0) return -1;
+        setting_applied(&set_scroll[i]);
+    }
+
+    if (setting_changed(&set_bgcolor))
+    {
+        if (ppu_set_bgcolor(set_bgcolor.value) != 0) return -1;
+        setting_applied(&set_bgcolor);
+    }
+
+    if (setting_changed(&set_layer_mask))
+    {
+        if (ppu_set_layer_enable(set_layer_mask.value) != 0) return -1;
+        setting_applied(&set_layer_mask);
+    }
+
+    return 0;
+}
+
+int vram_batch_update(void)
+{
+    if (vram_batch_submit() != 0) return -1;
+    return ppu_update();
+}
+
+// Moves a recorded setting into a frame, if it still needs to be sent
+static void take_setting(vram_frame_t *frame, ppu_setting_t *setting, unsigned index)
+{
+    if (!setting_changed(setting)) return;
+
+    frame->settings[index] = setting->value;
+    frame->settings_mask |= 1u << index;
+    setting_applied(setting);
+}
+
+static void frame_add_range(vram_frame_t *frame, uint32_t offset, uint32_t len)
+{
+    memcpy(&frame->data[frame->data_len], &vram_image[offset], len);
+    frame->range_offset[frame->range_count] = offset;
+    frame->range_len[frame->range_count] = len;
+    frame->range_count++;
+    frame->data_len += len;
+}
+
+void vram_batch_take(vram_frame_t *frame)
+{
+    nowaymsg(frame == NULL, "Frame is NULL!");
+
+    frame->range_count = 0;
+    frame->data_len = 0;
+    frame->settings_mask = 0;
+    frame->sent_ranges = 0;
+    frame->sent_data = 0;
+
+    if (!shadow_valid)
+    {
+        frame_add_range(frame, 0, VRAM_BSIZE);
+        memcpy(vram_shadow, vram_image, VRAM_BSIZE);
+        memset(vram_touched, 0, sizeof(vram_touched));
+        shadow_valid = 1;
+    }
+    else
+    {
+        unsigned first = next_changed_chunk(0);
+
+        while (first < VRAM_CHUNKS)
+        {
+            unsigned next;
+            unsigned last = merge_range(first, &next);
+
+            frame_add_range(frame, first * VRAM_CHUNK_BSIZE,
+                            (last - first + 1) * VRAM_CHUNK_BSIZE);
+            retire_range(first, last);
+            first = next;
+        }
+    }
+
+    take_setting(frame, &set_scroll[0], VRAM_FRAME_BGSCROLL);
+    take_setting(frame, &set_scroll[1], VRAM_FRAME_FGSCROLL);
+    take_setting(frame, &set_bgcolor, VRAM_FRAME_BGCOLOR);
+    take_setting(frame, &set_layer_mask, VRAM_FRAME_LAYER_ENABLE);
+}
+
+int vram_frame_submit(vram_frame_t *frame)
+{
+    nowaymsg(frame == NULL, "Frame is NULL!");
+
+    // ranges and settings are retired as they are sent, so a busy PPU only costs a retry
+    for (; frame->sent_ranges < frame->range_count; frame->sent_ranges++)
+    {
+        uint32_t len = frame->range_len[frame->sent_ranges];
+
+        if (ppu_write_vram(&frame->data[frame->sent_data], len,
+                           frame->range_offset[frame->sent_ranges]) != 0)
+        {
+            return -1;
+        }
+        frame->sent_data += len;
+    }
+
+    for (unsigned i = 0; i < VRAM_FRAME_SETTINGS; i++)
+    {
+        unsigned value = frame->settings[i];
+        int result;
+
+        if (!(frame->settings_mask & (1u << i))) continue;
+        if (i == VRAM_FRAME_BGSCROLL || i == VRAM_FRAME_FGSCROLL)
+        {
+            result = ppu_set_scroll((i == VRAM_FRAME_FGSCROLL) ? LAYER_FG : LAYER_BG,
+                                    value & 0xFFFF, value >> 16);
+        }
+        else if (i == VRAM_FRAME_BGCOLOR)
+        {
+            result = ppu_set_bgcolor(value);
+        }
+        else
+        {
+            result = ppu_set_layer_enable(value);
+        }
+        if (result != 0) return -1;
+        frame->settings_mask &= ~(1u << i);
+    }
+
+    return 0;
+}
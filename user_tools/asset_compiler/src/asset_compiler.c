@@ -0,0 +1,942 @@
+/* Batch asset compiler for FP-GAme: converts a manifest of Piskel and Tiled exports into a single
+ *   .fpak asset pack, on every core, skipping whatever has not changed since the last build.
+ *
+ * Usage (from user_tools/asset_compiler):
+ *   asset_compiler [-j <threads>] <manifest> <dest filename no extension>
+ *
+ * Each manifest line is one entry. Paths are relative to the manifest, and # starts a comment:
+ *   <file.gpl>                             A palette, named after the file.
+ *   <file.c> <palette>                     The patterns of every frame of a Piskel export, named
+ *                                          like c_to_pattern.py names its files.
+ *   <file.csv> <palette ID>                A Tiled tilemap, named after the file.
+ *   ctilemap <file.csv> <palette ID>
+ *   ctilemap <file.tilemap>                A Tiled tilemap or a .tilemap file, compressed like
+ *                                          compress_tilemap.py and named after the file. See
+ *                                          ctilemap.c.
+ *   tileset <name> <palette> <palette ID> <x> <y> <file.c>...
+ *                                          Every unique 8x8 pattern of the Piskel exports, mirrors
+ *                                          included, as one pattern sheet <name> to be written at
+ *                                          Pattern RAM (x, y), plus a tilemap of every frame
+ *                                          pointing into the sheet. See tileset.c.
+ * <palette> is the name of a palette of the manifest.
+ *
+ * Palettes are converted first, then every other entry is a job for a pool of threads. A job's
+ *   outputs are cached in <dest>.cache, keyed by a hash of the entry, its source files and its
+ *   palette, so a rebuild only converts the entries whose inputs changed. Identical payloads are
+ *   stored once in the pack, and the pack is only rewritten if its contents changed.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "asset_compiler.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define COMPILER_VERSION "asset_compiler 1" ///< Change to invalidate every cache entry
+#define CACHE_MAGIC "FPAC"
+#define PACK_MAGIC "FPAK"
+#define PACK_VERSION 1
+#define PACK_ALIGN 32
+#define HEADER_BSIZE 16
+#define ENTRY_BSIZE 48
+#define MAX_TOKENS 260
+#define MAX_THREADS 64
+#define PATH_LEN 4096
+
+typedef enum {
+    ENTRY_PALETTE,
+    ENTRY_PATTERN,
+    ENTRY_TILEMAP,
+    ENTRY_TILESET,
+    ENTRY_CTILEMAP
+} entry_kind_e;
+
+typedef struct {
+    entry_kind_e kind;
+    unsigned line;              ///< Line of the manifest, for error messages
+    char **tokens;              ///< Tokens of the line, with paths made relative to the manifest
+    unsigned token_count;
+    palette_lut_t palette;      ///< Palette entries: the palette, once converted
+    const palette_lut_t *uses;  ///< Pattern and tileset entries: the palette they use
+    uint64_t key;               ///< Cache key
+    int cached;                 ///< Whether the outputs came from the cache
+    output_list_t outputs;
+    tileset_stats_t stats;
+    unsigned block;             ///< Compressed tilemap entries: the block size kept
+    char error[ERROR_LEN];
+} job_t;
+
+typedef struct {
+    job_t *jobs;
+    unsigned *order;            ///< Indices of the jobs to run
+    unsigned count;
+    unsigned next;              ///< Next index into order, taken atomically
+    const char *cache_dir;
+} pool_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    for (size_t i = 0; i < len; i++) hash = (hash ^ p[i]) * 0x100000001B3ull;
+    return hash;
+}
+
+int output_add(output_list_t *list, const char *name, asset_type_e type, unsigned width,
+               unsigned height, uint8_t *data, size_t size, char *error)
+{
+    output_t *out;
+
+    if (strlen(name) >= NAME_LEN)
+    {
+        snprintf(error, ERROR_LEN, "Asset name %s is longer than %d characters!", name,
+                 NAME_LEN - 1);
+        free(data);
+        return -1;
+    }
+    if (list->count == list->capacity)
+    {
+        unsigned capacity = list->capacity ? list->capacity * 2 : 8;
+        output_t *grown = realloc(list->items, capacity * sizeof(output_t));
+
+        if (grown == NULL)
+        {
+            snprintf(error, ERROR_LEN, "Out of memory!");
+            free(data);
+            return -1;
+        }
+        list->items = grown;
+        list->capacity = capacity;
+    }
+
+    out = &list->items[list->count++];
+    snprintf(out->name, NAME_LEN, "%s", name);
+    out->type = type;
+    out->width = width;
+    out->height = height;
+    out->data = data;
+    out->size = size;
+    out->hash = hash_bytes(FNV_OFFSET, data, size);
+    return 0;
+}
+
+void output_list_free(output_list_t *list)
+{
+    for (unsigned i = 0; i < list->count; i++) free(list->items[i].data);
+    free(list->items);
+    list->items = NULL;
+    list->count = list->capacity = 0;
+}
+
+// Asset name of a source file: its file name without the extension
+static void base_name(const char *path, char *name, size_t len)
+{
+    const char *slash = strrchr(path, '/');
+    const char *start = slash ? slash + 1 : path;
+    const char *dot = strrchr(start, '.');
+    size_t n = dot ? (size_t)(dot - start) : strlen(start);
+
+    snprintf(name, len, "%.*s", (int)n, start);
+}
+
+static int has_ext(const char *path, const char *ext)
+{
+    size_t len = strlen(path), ext_len = strlen(ext);
+
+    return len > ext_len && strcmp(path + len - ext_len, ext) == 0;
+}
+
+static int parse_uint(const char *s, unsigned max, unsigned *value)
+{
+    char *end;
+    unsigned long v = strtoul(s, &end, 0);
+
+    if (*s == '\0' || *end != '\0' || v > max) return -1;
+    *value = v;
+    return 0;
+}
+
+/* === Cache === */
+
+static void cache_path(const pool_t *pool, uint64_t key, char *path)
+{
+    snprintf(path, PATH_LEN, "%s/%016llx", pool->cache_dir, (unsigned long long)key);
+}
+
+// Loads a job's outputs from the cache. Any unreadable or malformed entry is treated as a miss.
+static int cache_load(const pool_t *pool, job_t *job)
+{
+    char path[PATH_LEN];
+    size_t size, pos = 8;
+    uint8_t *data;
+    unsigned count;
+
+    cache_path(pool, job->key, path);
+    if ((data = (uint8_t *)read_file(path, &size)) == NULL) return -1;
+    if (size < 8 || memcmp(data, CACHE_MAGIC, 4) != 0) goto miss;
+
+    count = get_u32(data + 4);
+    for (unsigned i = 0; i < count; i++)
+    {
+        char name[NAME_LEN];
+        uint32_t len;
+        uint8_t *payload;
+
+        if (size - pos < NAME_LEN + 16) goto miss;
+        memcpy(name, data + pos, NAME_LEN);
+        name[NAME_LEN - 1] = '\0';
+        len = get_u32(data + pos + NAME_LEN + 12);
+        if (size - pos - NAME_LEN - 16 < len || (payload = malloc(len ? len : 1)) == NULL)
+        {
+            goto miss;
+        }
+        memcpy(payload, data + pos + NAME_LEN + 16, len);
+        if (output_add(&job->outputs, name, get_u32(data + pos + NAME_LEN),
+                       get_u32(data + pos + NAME_LEN + 4), get_u32(data + pos + NAME_LEN + 8),
+                       payload, len, job->error) != 0)
+        {
+            goto miss;
+        }
+        pos += NAME_LEN + 16 + len;
+    }
+    free(data);
+    return 0;
+
+miss:
+    output_list_free(&job->outputs);
+    job->error[0] = '\0';
+    free(data);
+    return -1;
+}
+
+// Stores a job's outputs in the cache. Failing to is not an error: the next build converts again.
+static void cache_store(const pool_t *pool, const job_t *job)
+{
+    char path[PATH_LEN], tmp[PATH_LEN + 16];
+    uint8_t header[NAME_LEN + 16];
+    FILE *f;
+    int ok;
+
+    cache_path(pool, job->key, path);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if ((f = fopen(tmp, "wb")) == NULL) return;
+
+    // written to a temporary file and renamed, so an interrupted build never leaves half an entry
+    memcpy(header, CACHE_MAGIC, 4);
+    put_u32(header + 4, job->outputs.count);
+    ok = fwrite(header, 1, 8, f) == 8;
+    for (unsigned i = 0; ok && i < job->outputs.count; i++)
+    {
+        const output_t *out = &job->outputs.items[i];
+
+        memset(header, 0, sizeof(header));
+        memcpy(header, out->name, strlen(out->name));
+        put_u32(header + NAME_LEN, out->type);
+        put_u32(header + NAME_LEN + 4, out->width);
+        put_u32(header + NAME_LEN + 8, out->height);
+        put_u32(header + NAME_LEN + 12, out->size);
+        ok = fwrite(header, 1, sizeof(header), f) == sizeof(header) &&
+             fwrite(out->data, 1, out->size, f) == out->size;
+    }
+    if (fclose(f) != 0 || !ok || rename(tmp, path) != 0) remove(tmp);
+}
+
+// Removes every cache entry which this build did not use
+static void cache_prune(const pool_t *pool, const job_t *jobs, unsigned count)
+{
+    DIR *dir = opendir(pool->cache_dir);
+    struct dirent *ent;
+
+    if (dir == NULL) return;
+    while ((ent = readdir(dir)) != NULL)
+    {
+        char path[PATH_LEN];
+        int used = 0;
+
+        if (strlen(ent->d_name) != 16 || strspn(ent->d_name, "0123456789abcdef") != 16) continue;
+        for (unsigned i = 0; i < count && !used; i++)
+        {
+            char name[17];
+
+            snprintf(name, sizeof(name), "%016llx", (unsigned long long)jobs[i].key);
+            used = jobs[i].kind != ENTRY_PALETTE && strcmp(name, ent->d_name) == 0;
+        }
+        if (used) continue;
+        snprintf(path, sizeof(path), "%s/%s", pool->cache_dir, ent->d_name);
+        remove(path);
+    }
+    closedir(dir);
+}
+
+/* === Jobs === */
+
+// Reads a source file and adds it to the job's cache key
+static char *read_source(job_t *job, const char *path, size_t *size)
+{
+    char *text = read_file(path, size);
+
+    if (text == NULL) snprintf(job->error, ERROR_LEN, "Could not read %s!", path);
+    else job->key = hash_bytes(job->key, text, *size);
+    return text;
+}
+
+static int run_palette(job_t *job)
+{
+    char name[NAME_LEN + 1];
+    size_t size;
+    char *text = read_source(job, job->tokens[0], &size);
+    uint8_t *payload;
+
+    if (text == NULL) return -1;
+    if (convert_gpl(text, &job->palette, job->error) != 0)
+    {
+        free(text);
+        return -1;
+    }
+    free(text);
+    if ((payload = malloc(PALETTE_BSIZE)) == NULL)
+    {
+        snprintf(job->error, ERROR_LEN, "Out of memory!");
+        return -1;
+    }
+    palette_pack(&job->palette, payload);
+    base_name(job->tokens[0], name, sizeof(name));
+    return output_add(&job->outputs, name, TYPE_PALETTE, 1, 1, payload, PALETTE_BSIZE,
+                      job->error);
+}
+
+static int convert_pattern(job_t *job, const char *text)
+{
+    char base[NAME_LEN + 1];
+    image_t image;
+
+    if (convert_piskel(text, job->uses, &image, job->error) != 0) return -1;
+    if (image.width > 32 || image.height > 32)
+    {
+        snprintf(job->error, ERROR_LEN, "Patterns can be at most 32x32 pixels!");
+        free(image.pixels);
+        return -1;
+    }
+
+    base_name(job->tokens[0], base, sizeof(base));
+    for (unsigned f = 0; f < image.frames; f++)
+    {
+        char name[NAME_LEN + 16];
+        size_t size = (size_t)(image.width / 8) * (image.height / 8) * PATTERN_BSIZE;
+        uint8_t *payload = malloc(size);
+
+        if (payload == NULL)
+        {
+            snprintf(job->error, ERROR_LEN, "Out of memory!");
+            free(image.pixels);
+            return -1;
+        }
+        image_pack_patterns(&image, f, payload);
+        if (image.frames == 1) snprintf(name, sizeof(name), "%s", base);
+        else snprintf(name, sizeof(name), "%s-%u", base, f);
+        if (output_add(&job->outputs, name, TYPE_PATTERN, image.width / 8, image.height / 8,
+                       payload, size, job->error) != 0)
+        {
+            free(image.pixels);
+            return -1;
+        }
+    }
+    free(image.pixels);
+    return 0;
+}
+
+static int convert_tilemap(job_t *job, const char *text, unsigned palette_id)
+{
+    char name[NAME_LEN + 1];
+    unsigned width, height;
+    uint8_t *tiles = convert_csv(text, palette_id, &width, &height, job->error);
+
+    if (tiles == NULL) return -1;
+    base_name(job->tokens[0], name, sizeof(name));
+    return output_add(&job->outputs, name, TYPE_TILEMAP, width, height, tiles,
+                      (size_t)width * height * 2, job->error);
+}
+
+static int convert_ctilemap(job_t *job, const char *text, unsigned palette_id)
+{
+    char name[NAME_LEN + 1];
+    unsigned width, height;
+    size_t size;
+    uint8_t *tiles, *payload;
+
+    if (has_ext(job->tokens[1], ".csv"))
+    {
+        tiles = convert_csv(text, palette_id, &width, &height, job->error);
+    }
+    else
+    {
+        tiles = convert_tilemap_text(text, &width, &height, job->error);
+    }
+    if (tiles == NULL) return -1;
+
+    payload = ctilemap_encode(tiles, width, height, &size, &job->block, job->error);
+    free(tiles);
+    if (payload == NULL) return -1;
+    base_name(job->tokens[1], name, sizeof(name));
+    return output_add(&job->outputs, name, TYPE_CTILEMAP, width, height, payload, size,
+                      job->error);
+}
+
+static int convert_tileset(job_t *job, char **texts, unsigned count, unsigned palette_id,
+                           unsigned x, unsigned y)
+{
+    image_t *images = calloc(count, sizeof(image_t));
+    char (*names)[NAME_LEN + 1] = calloc(count, sizeof(*names));
+    const char **name_ptrs = calloc(count, sizeof(char *));
+    unsigned converted = 0;
+    int result = -1;
+
+    if (images == NULL || names == NULL || name_ptrs == NULL)
+    {
+        snprintf(job->error, ERROR_LEN, "Out of memory!");
+        goto done;
+    }
+    for (; converted < count; converted++)
+    {
+        const char *path = job->tokens[6 + converted];
+
+        if (convert_piskel(texts[converted], job->uses, &images[converted], job->error) != 0)
+        {
+            size_t len = strlen(job->error);
+
+            snprintf(job->error + len, ERROR_LEN - len, " (%s)", path);
+            goto done;
+        }
+        base_name(path, names[converted], sizeof(names[converted]));
+        name_ptrs[converted] = names[converted];
+    }
+    result = tileset_build(job->tokens[1], images, name_ptrs, count, palette_id, x, y,
+                           &job->outputs, &job->stats, job->error);
+
+done:
+    for (unsigned i = 0; i < converted; i++) free(images[i].pixels);
+    free(images);
+    free(names);
+    free(name_ptrs);
+    return result;
+}
+
+// Converts one non-palette entry, or loads its outputs from the cache
+static int run_job(const pool_t *pool, job_t *job)
+{
+    const char *const *args = (const char *const *)job->tokens;
+    unsigned first_source, source_count, palette_id = 0, x = 0, y = 0;
+    char **texts;
+    int result = -1;
+
+    // the key covers the compiler version, the whole entry, its palette and its sources
+    job->key = hash_bytes(FNV_OFFSET, COMPILER_VERSION, sizeof(COMPILER_VERSION));
+    for (unsigned i = 0; i < job->token_count; i++)
+    {
+        job->key = hash_bytes(job->key, args[i], strlen(args[i]) + 1);
+    }
+    if (job->uses != NULL) job->key = hash_bytes(job->key, job->uses->colors,
+                                                 sizeof(job->uses->colors));
+
+    switch (job->kind)
+    {
+        case ENTRY_TILEMAP:
+            if (parse_uint(args[1], PALETTE_ID_MAX, &palette_id) != 0)
+            {
+                snprintf(job->error, ERROR_LEN, "Palette ID must be 0 to %d!", PALETTE_ID_MAX);
+                return -1;
+            }
+            first_source = 0;
+            source_count = 1;
+            break;
+        case ENTRY_TILESET:
+            if (parse_uint(args[3], PALETTE_ID_MAX, &palette_id) != 0 ||
+                parse_uint(args[4], PATTERNRAM_WIDTH - 1, &x) != 0 ||
+                parse_uint(args[5], PATTERNRAM_HEIGHT - 1, &y) != 0)
+            {
+                snprintf(job->error, ERROR_LEN, "Expected a palette ID of 0 to %d and a Pattern "
+                         "RAM position of (0, 0) to (%d, %d)!", PALETTE_ID_MAX,
+                         PATTERNRAM_WIDTH - 1, PATTERNRAM_HEIGHT - 1);
+                return -1;
+            }
+            first_source = 6;
+            source_count = job->token_count - 6;
+            break;
+        case ENTRY_CTILEMAP:
+            if (job->token_count == 3 && parse_uint(args[2], PALETTE_ID_MAX, &palette_id) != 0)
+            {
+                snprintf(job->error, ERROR_LEN, "Palette ID must be 0 to %d!", PALETTE_ID_MAX);
+                return -1;
+            }
+            first_source = 1;
+            source_count = 1;
+            break;
+        default:
+            first_source = 0;
+            source_count = 1;
+            break;
+    }
+
+    if ((texts = calloc(source_count, sizeof(char *))) == NULL)
+    {
+        snprintf(job->error, ERROR_LEN, "Out of memory!");
+        return -1;
+    }
+    for (unsigned i = 0; i < source_count; i++)
+    {
+        size_t size;
+
+        if ((texts[i] = read_source(job, args[first_source + i], &size)) == NULL) goto done;
+    }
+
+    if (cache_load(pool, job) == 0)
+    {
+        job->cached = 1;
+        result = 0;
+        goto done;
+    }
+
+    switch (job->kind)
+    {
+        case ENTRY_PATTERN: result = convert_pattern(job, texts[0]); break;
+        case ENTRY_TILEMAP: result = convert_tilemap(job, texts[0], palette_id); break;
+        case ENTRY_TILESET:
+            result = convert_tileset(job, texts, source_count, palette_id, x, y);
+            break;
+        case ENTRY_CTILEMAP: result = convert_ctilemap(job, texts[0], palette_id); break;
+        default: break;
+    }
+    if (result == 0) cache_store(pool, job);
+
+done:
+    for (unsigned i = 0; i < source_count; i++) free(texts[i]);
+    free(texts);
+    return result;
+}
+
+static void *worker(void *arg)
+{
+    pool_t *pool = arg;
+    unsigned i;
+
+    while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->count)
+    {
+        job_t *job = &pool->jobs[pool->order[i]];
+
+        if (job->kind == ENTRY_PALETTE) run_palette(job);
+        else run_job(pool, job);
+    }
+    return NULL;
+}
+
+// Runs the jobs in pool->order on up to `threads` threads, including this one
+static void run_pool(pool_t *pool, unsigned threads)
+{
+    pthread_t tids[MAX_THREADS];
+    unsigned started = 0;
+
+    pool->next = 0;
+    if (threads > pool->count) threads = pool->count;
+    while (started + 1 < threads && pthread_create(&tids[started], NULL, worker, pool) == 0)
+    {
+        started++;
+    }
+    worker(pool);
+    for (unsigned i = 0; i < started; i++) pthread_join(tids[i], NULL);
+}
+
+/* === Manifest === */
+
+static int manifest_error(const char *manifest, unsigned line, const char *msg)
+{
+    printf("%s:%u: %s\n", manifest, line, msg);
+    return -1;
+}
+
+// Splits the manifest into jobs. Paths are prefixed with the manifest's folder.
+static int manifest_read(const char *manifest, job_t **jobs_out, unsigned *count_out)
+{
+    size_t size;
+    char *text = read_file(manifest, &size);
+    const char *slash = strrchr(manifest, '/');
+    int dir_len = slash ? (int)(slash - manifest + 1) : 0;
+    job_t *jobs = NULL;
+    unsigned count = 0, line = 0;
+
+    if (text == NULL)
+    {
+        printf("Could not read %s!\n", manifest);
+        return -1;
+    }
+
+    for (char *l = text, *next; l != NULL; l = next)
+    {
+        char *tokens[MAX_TOKENS], *save_token, *hash;
+        unsigned n = 0, first_path;
+        job_t *job;
+        job_t *grown;
+
+        if ((next = strchr(l, '\n')) != NULL) *next++ = '\0';
+        hash = strchr(l, '#');
+        line++;
+        if (hash != NULL) *hash = '\0';
+        for (char *t = strtok_r(l, " \t\r", &save_token); t != NULL;
+             t = strtok_r(NULL, " \t\r", &save_token))
+        {
+            if (n == MAX_TOKENS) return manifest_error(manifest, line, "Too many files!");
+            tokens[n++] = t;
+        }
+        if (n == 0) continue;
+
+        if ((grown = realloc(jobs, (count + 1) * sizeof(job_t))) == NULL)
+        {
+            return manifest_error(manifest, line, "Out of memory!");
+        }
+        jobs = grown;
+        job = &jobs[count++];
+        memset(job, 0, sizeof(*job));
+        job->line = line;
+
+        if (strcmp(tokens[0], "tileset") == 0)
+        {
+            if (n < 7)
+            {
+                return manifest_error(manifest, line, "Expected tileset <name> <palette> "
+                                      "<palette ID> <x> <y> <file.c>...");
+            }
+            job->kind = ENTRY_TILESET;
+            first_path = 6;
+        }
+        else if (strcmp(tokens[0], "ctilemap") == 0)
+        {
+            if (!(n == 3 && has_ext(tokens[1], ".csv")) &&
+                !(n == 2 && has_ext(tokens[1], ".tilemap")))
+            {
+                return manifest_error(manifest, line, "Expected ctilemap <file.csv> <palette ID> "
+                                      "or ctilemap <file.tilemap>");
+            }
+            job->kind = ENTRY_CTILEMAP;
+            first_path = 1;
+        }
+        else if (has_ext(tokens[0], ".gpl") && n == 1)
+        {
+            job->kind = ENTRY_PALETTE;
+            first_path = 0;
+        }
+        else if (has_ext(tokens[0], ".c") && n == 2)
+        {
+            job->kind = ENTRY_PATTERN;
+            first_path = 0;
+        }
+        else if (has_ext(tokens[0], ".csv") && n == 2)
+        {
+            job->kind = ENTRY_TILEMAP;
+            first_path = 0;
+        }
+        else
+        {
+            return manifest_error(manifest, line, "Expected <file.gpl>, <file.c> <palette>, "
+                                  "<file.csv> <palette ID>, ctilemap <file> ... or tileset "
+                                  "<name> ...");
+        }
+
+        if ((job->tokens = calloc(n, sizeof(char *))) == NULL)
+        {
+            return manifest_error(manifest, line, "Out of memory!");
+        }
+        job->token_count = n;
+        for (unsigned i = 0; i < n; i++)
+        {
+            int is_path = (job->kind == ENTRY_TILESET) ? i >= first_path : i == first_path;
+            size_t len = strlen(tokens[i]) + (is_path ? dir_len : 0) + 1;
+
+            if ((job->tokens[i] = malloc(len)) == NULL)
+            {
+                return manifest_error(manifest, line, "Out of memory!");
+            }
+            if (is_path) snprintf(job->tokens[i], len, "%.*s%s", dir_len, manifest, tokens[i]);
+            else snprintf(job->tokens[i], len, "%s", tokens[i]);
+        }
+    }
+    free(text);
+
+    *jobs_out = jobs;
+    *count_out = count;
+    return 0;
+}
+
+// Points every pattern and tileset entry at the palette it names
+static int resolve_palettes(const char *manifest, job_t *jobs, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        const char *want;
+
+        if (jobs[i].kind == ENTRY_PATTERN) want = jobs[i].tokens[1];
+        else if (jobs[i].kind == ENTRY_TILESET) want = jobs[i].tokens[2];
+        else continue;
+
+        for (unsigned j = 0; j < count && jobs[i].uses == NULL; j++)
+        {
+            char name[NAME_LEN + 1];
+
+            if (jobs[j].kind != ENTRY_PALETTE) continue;
+            base_name(jobs[j].tokens[0], name, sizeof(name));
+            if (strcmp(name, want) == 0) jobs[i].uses = &jobs[j].palette;
+        }
+        if (jobs[i].uses == NULL)
+        {
+            char msg[ERROR_LEN];
+
+            snprintf(msg, sizeof(msg), "Palette %s is not in the manifest!", want);
+            return manifest_error(manifest, jobs[i].line, msg);
+        }
+    }
+    return 0;
+}
+
+/* === Pack === */
+
+static int output_order(const void *a, const void *b)
+{
+    const output_t *x = *(const output_t *const *)a;
+    const output_t *y = *(const output_t *const *)b;
+    int order = strcmp(x->name, y->name);
+
+    if (order != 0) return order;
+    return (x->type > y->type) - (x->type < y->type);
+}
+
+static size_t align(size_t size)
+{
+    return (size + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN;
+}
+
+// Lays out the pack in memory: header, table of contents sorted by name then type, and payloads.
+//   Outputs with identical payloads point at the same copy.
+static uint8_t *pack_build(output_t **outputs, unsigned count, size_t *size, unsigned *shared)
+{
+    uint32_t *offsets = malloc((count ? count : 1) * sizeof(uint32_t));
+    size_t toc_end = align(HEADER_BSIZE + (size_t)count * ENTRY_BSIZE), end = toc_end;
+    uint8_t *pack;
+
+    *shared = 0;
+    if (offsets == NULL) return NULL;
+    for (unsigned i = 0; i < count; i++)
+    {
+        unsigned j;
+
+        for (j = 0; j < i; j++)
+        {
+            if (outputs[j]->hash == outputs[i]->hash && outputs[j]->size == outputs[i]->size &&
+                memcmp(outputs[j]->data, outputs[i]->data, outputs[i]->size) == 0) break;
+        }
+        if (j < i)
+        {
+            offsets[i] = offsets[j];
+            (*shared)++;
+        }
+        else
+        {
+            offsets[i] = end;
+            end += align(outputs[i]->size);
+        }
+    }
+
+    if ((pack = calloc(1, end)) == NULL)
+    {
+        free(offsets);
+        return NULL;
+    }
+    memcpy(pack, PACK_MAGIC, 4);
+    put_u16(pack + 4, PACK_VERSION);
+    put_u16(pack + 6, count);
+    put_u32(pack + 8, HEADER_BSIZE);
+    for (unsigned i = 0; i < count; i++)
+    {
+        uint8_t *entry = pack + HEADER_BSIZE + i * ENTRY_BSIZE;
+
+        memcpy(entry, outputs[i]->name, strlen(outputs[i]->name));
+        put_u32(entry + 32, outputs[i]->type);
+        put_u32(entry + 36, offsets[i]);
+        put_u32(entry + 40, outputs[i]->size);
+        put_u16(entry + 44, outputs[i]->width);
+        put_u16(entry + 46, outputs[i]->height);
+        memcpy(pack + offsets[i], outputs[i]->data, outputs[i]->size);
+    }
+    free(offsets);
+    *size = end;
+    return pack;
+}
+
+// Writes the pack, unless the file already holds exactly these bytes
+static int pack_write(const char *path, const uint8_t *pack, size_t size, int *written)
+{
+    char tmp[PATH_LEN + 16];
+    size_t old_size;
+    char *old = read_file(path, &old_size);
+    FILE *f;
+    int ok;
+
+    *written = !(old != NULL && old_size == size && memcmp(old, pack, size) == 0);
+    free(old);
+    if (!*written) return 0;
+
+    // written to a temporary file and renamed, so a failed or interrupted build (or a game
+    //   which has the pack mapped) never sees half a pack
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if ((f = fopen(tmp, "wb")) == NULL) return -1;
+    ok = fwrite(pack, 1, size, f) == size;
+    if (fclose(f) != 0 || !ok || rename(tmp, path) != 0)
+    {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned threads = (cores > 0) ? (unsigned)cores : 1;
+    char pack_path[PATH_LEN], cache_dir[PATH_LEN];
+    job_t *jobs = NULL;
+    unsigned count = 0, total = 0, converted = 0, shared;
+    output_t **outputs;
+    pool_t pool;
+    uint8_t *pack;
+    size_t pack_size;
+    int failed = 0, written;
+    uint64_t start = now_ns();
+
+    if (argc == 5 && strcmp(argv[1], "-j") == 0 &&
+        parse_uint(argv[2], MAX_THREADS, &threads) == 0 && threads > 0)
+    {
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc != 3)
+    {
+        printf("Usage: %s [-j <threads>] <manifest> <dest filename no extension>\n", argv[0]);
+        return 2;
+    }
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    snprintf(pack_path, sizeof(pack_path), "%s.fpak", argv[2]);
+    snprintf(cache_dir, sizeof(cache_dir), "%s.cache", argv[2]);
+    if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST)
+    {
+        printf("Could not create %s!\n", cache_dir);
+        return 1;
+    }
+    if (manifest_read(argv[1], &jobs, &count) != 0) return 1;
+    if (resolve_palettes(argv[1], jobs, count) != 0) return 1;
+
+    pool.jobs = jobs;
+    pool.cache_dir = cache_dir;
+    if ((pool.order = malloc((count ? count : 1) * sizeof(unsigned))) == NULL) return 1;
+
+    // palettes first, since the other entries look their colors up
+    for (int pass = 0; pass < 2; pass++)
+    {
+        pool.count = 0;
+        for (unsigned i = 0; i < count; i++)
+        {
+            if ((jobs[i].kind == ENTRY_PALETTE) == (pass == 0)) pool.order[pool.count++] = i;
+        }
+        run_pool(&pool, threads);
+
+        for (unsigned i = 0; i < pool.count; i++)
+        {
+            const job_t *job = &jobs[pool.order[i]];
+
+            if (job->error[0] != '\0')
+            {
+                printf("%s:%u: %s\n", argv[1], job->line, job->error);
+                failed = 1;
+            }
+        }
+        if (failed) return 1;
+    }
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        total += jobs[i].outputs.count;
+        converted += !jobs[i].cached;
+        if (jobs[i].kind == ENTRY_TILESET && !jobs[i].cached)
+        {
+            printf("tileset %s: %u tiles -> %u patterns (%u mirrored duplicates)\n",
+                   jobs[i].tokens[1], jobs[i].stats.tiles, jobs[i].stats.unique,
+                   jobs[i].stats.mirrored);
+        }
+        if (jobs[i].kind == ENTRY_CTILEMAP && !jobs[i].cached)
+        {
+            const output_t *out = &jobs[i].outputs.items[0];
+
+            printf("ctilemap %s: %u bytes -> %zu bytes with %ux%u blocks\n", out->name,
+                   out->width * out->height * 2, out->size, jobs[i].block, jobs[i].block);
+        }
+    }
+    if ((outputs = malloc((total ? total : 1) * sizeof(output_t *))) == NULL) return 1;
+    total = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        for (unsigned j = 0; j < jobs[i].outputs.count; j++)
+        {
+            outputs[total++] = &jobs[i].outputs.items[j];
+        }
+    }
+
+    // the runtime binary searches the table of contents, so it must be sorted by name, then type
+    qsort(outputs, total, sizeof(output_t *), output_order);
+    for (unsigned i = 1; i < total; i++)
+    {
+        if (output_order(&outputs[i - 1], &outputs[i]) == 0)
+        {
+            printf("Error: Two assets of type %d are named %s!\n", outputs[i]->type,
+                   outputs[i]->name);
+            return 1;
+        }
+    }
+
+    if ((pack = pack_build(outputs, total, &pack_size, &shared)) == NULL ||
+        pack_write(pack_path, pack, pack_size, &written) != 0)
+    {
+        printf("Could not write %s!\n", pack_path);
+        return 1;
+    }
+    cache_prune(&pool, jobs, count);
+
+    printf("%s: %u assets (%u identical payloads shared), %zu bytes, %u of %u entries converted, "
+           "%s, %.1f ms on %u threads\n", pack_path, total, shared, pack_size, converted,
+           count, written ? "written" : "unchanged",
+           (double)(now_ns() - start) / 1000000.0, threads);
+
+    free(pack);
+    free(outputs);
+    free(pool.order);
+    for (unsigned i = 0; i < count; i++)
+    {
+        output_list_free(&jobs[i].outputs);
+        for (unsigned j = 0; j < jobs[i].token_count; j++) free(jobs[i].tokens[j]);
+        free(jobs[i].tokens);
+    }
+    free(jobs);
+    return 0;
+}
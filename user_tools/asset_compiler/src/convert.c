@@ -0,0 +1,382 @@
+/* Conversion of Piskel and Tiled exports into the runtime formats. See asset_compiler.h.
+ *
+ * These are the conversions of gpl_to_palette.py, c_to_pattern.py, tiled_csv_to_tilemap.py and
+ *   pack_assets.py, straight from the exported file to the packed payload with no text format in
+ *   between. Pixel colors are looked up in a hash table of the palette rather than searched for.
+ *
+ * Payloads are written a byte at a time in little-endian order, like the packs themselves, so the
+ *   output does not depend on the host.
+ */
+
+#include "asset_compiler.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LUT_SLOTS 32
+#define TILED_MIRROR_X 0x80000000ul
+#define TILED_MIRROR_Y 0x40000000ul
+#define TILED_ROTATE 0x20000000ul
+#define TILED_ID_MASK 0x1FFFFFFFul
+#define PATTERN_ADDR_MAX 0x3FF
+#define IMAGE_MAX_SIZE 512
+
+static unsigned lut_slot(uint32_t color)
+{
+    return (color * 0x9E3779B1u) >> 27;
+}
+
+// Returns the palette index of color, or -1 if it is not in the palette
+static int lut_find(const palette_lut_t *palette, uint32_t color)
+{
+    for (unsigned i = 0, s = lut_slot(color); i < LUT_SLOTS; i++, s = (s + 1) % LUT_SLOTS)
+    {
+        if (palette->slot_index[s] == -1) return -1;
+        if (palette->slot_color[s] == color) return palette->slot_index[s];
+    }
+    return -1;
+}
+
+static const char *next_line(const char *line)
+{
+    const char *end = strchr(line, '\n');
+
+    return (end == NULL) ? line + strlen(line) : end + 1;
+}
+
+char *read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    char *data = NULL;
+    long len;
+
+    if (f == NULL) return NULL;
+    if (fseek(f, 0, SEEK_END) == 0 && (len = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0 &&
+        (data = malloc(len + 1)) != NULL)
+    {
+        if (fread(data, 1, len, f) == (size_t)len)
+        {
+            data[len] = '\0';
+            *size = len;
+        }
+        else
+        {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(f);
+    return data;
+}
+
+int convert_gpl(const char *text, palette_lut_t *palette, char *error)
+{
+    unsigned count = 0;
+
+    memset(palette->slot_index, -1, sizeof(palette->slot_index));
+
+    // color lines are "R G B [name]"; the header lines and comments all start with a letter or #
+    for (const char *line = text; *line != '\0'; line = next_line(line))
+    {
+        unsigned r, g, b;
+
+        while (*line == ' ' || *line == '\t') line++;
+        if (!isdigit((unsigned char)*line)) continue;
+        if (sscanf(line, "%u %u %u", &r, &g, &b) != 3 || r > 255 || g > 255 || b > 255)
+        {
+            snprintf(error, ERROR_LEN, "Malformed color line %u!", count);
+            return -1;
+        }
+        if (count == PALETTE_COLORS)
+        {
+            snprintf(error, ERROR_LEN, "Palette must contain 16 colors, found more!");
+            return -1;
+        }
+        palette->colors[count++] = (r << 16) | (g << 8) | b;
+    }
+    if (count != PALETTE_COLORS)
+    {
+        snprintf(error, ERROR_LEN, "Palette must contain 16 colors, found %u!", count);
+        return -1;
+    }
+
+    // inserting in index order leaves repeated colors mapped to their lowest index
+    for (unsigned i = 0; i < PALETTE_COLORS; i++)
+    {
+        uint32_t color = palette->colors[i];
+        unsigned s = lut_slot(color);
+
+        if (lut_find(palette, color) != -1) continue;
+        while (palette->slot_index[s] != -1) s = (s + 1) % LUT_SLOTS;
+        palette->slot_color[s] = color;
+        palette->slot_index[s] = i;
+    }
+    return 0;
+}
+
+void palette_pack(const palette_lut_t *palette, uint8_t *out)
+{
+    // color 0 is the transparent color, which palette_t does not store
+    for (unsigned i = 1; i < PALETTE_COLORS; i++) put_u32(out + (i - 1) * 4, palette->colors[i]);
+}
+
+// Reads the number after "<anything>_<key> " in a Piskel #define
+static int piskel_define(const char *text, const char *key, unsigned *value)
+{
+    const char *p = strstr(text, key);
+    char *end;
+
+    if (p == NULL) return -1;
+    *value = strtoul(p + strlen(key), &end, 10);
+    return (end == p + strlen(key)) ? -1 : 0;
+}
+
+int convert_piskel(const char *text, const palette_lut_t *palette, image_t *image, char *error)
+{
+    const char *p;
+    size_t count, n = 0;
+
+    if (piskel_define(text, "_FRAME_COUNT ", &image->frames) != 0 ||
+        piskel_define(text, "_FRAME_WIDTH ", &image->width) != 0 ||
+        piskel_define(text, "_FRAME_HEIGHT ", &image->height) != 0)
+    {
+        snprintf(error, ERROR_LEN, "Missing FRAME_COUNT, FRAME_WIDTH or FRAME_HEIGHT!");
+        return -1;
+    }
+    if (image->frames == 0 || image->width == 0 || image->width % 8 != 0 ||
+        image->width > IMAGE_MAX_SIZE || image->height == 0 || image->height % 8 != 0 ||
+        image->height > IMAGE_MAX_SIZE)
+    {
+        snprintf(error, ERROR_LEN, "Frames must be a multiple of 8 pixels wide and high, up to %d!",
+                 IMAGE_MAX_SIZE);
+        return -1;
+    }
+
+    // the pixels are the 0xAABBGGRR constants of the data array, frame by frame, row by row
+    if ((p = strstr(text, "_data")) == NULL || (p = strchr(p, '{')) == NULL)
+    {
+        snprintf(error, ERROR_LEN, "Missing pixel data array!");
+        return -1;
+    }
+    count = (size_t)image->frames * image->width * image->height;
+    if ((image->pixels = malloc(count)) == NULL)
+    {
+        snprintf(error, ERROR_LEN, "Out of memory!");
+        return -1;
+    }
+
+    while (n < count && (p = strstr(p, "0x")) != NULL)
+    {
+        char *end;
+        uint32_t abgr = strtoul(p, &end, 16);
+        uint32_t color = ((abgr & 0xFF) << 16) | (abgr & 0xFF00) | ((abgr >> 16) & 0xFF);
+        int index = lut_find(palette, color);
+
+        if (index == -1)
+        {
+            size_t pixel = n % ((size_t)image->width * image->height);
+
+            snprintf(error, ERROR_LEN, "Couldn't find color for pixel (%zu, %zu) of frame %zu: "
+                     "%06X", pixel % image->width, pixel / image->width,
+                     n / ((size_t)image->width * image->height), (unsigned)color);
+            free(image->pixels);
+            return -1;
+        }
+        image->pixels[n++] = index;
+        p = end;
+    }
+    if (n != count)
+    {
+        snprintf(error, ERROR_LEN, "Expected %zu pixels, found %zu!", count, n);
+        free(image->pixels);
+        return -1;
+    }
+    return 0;
+}
+
+void image_pack_patterns(const image_t *image, unsigned frame, uint8_t *out)
+{
+    const uint8_t *pixels = image->pixels + (size_t)frame * image->width * image->height;
+
+    // pattern_t tiles are stored row by row, and each pixel row of a tile is one uint32_t with the
+    //   left-most pixel in the least significant nibble
+    for (unsigned ty = 0; ty < image->height / 8; ty++)
+    {
+        for (unsigned tx = 0; tx < image->width / 8; tx++)
+        {
+            for (unsigned row = 0; row < 8; row++)
+            {
+                const uint8_t *src = &pixels[(ty * 8 + row) * image->width + tx * 8];
+                uint32_t pxrow = 0;
+
+                for (unsigned x = 0; x < 8; x++) pxrow |= (uint32_t)src[x] << (4 * x);
+                put_u32(out, pxrow);
+                out += 4;
+            }
+        }
+    }
+}
+
+uint8_t *convert_csv(const char *text, unsigned palette_id, unsigned *width, unsigned *height,
+                     char *error)
+{
+    size_t capacity = 4096, count = 0;
+    uint8_t *tiles = malloc(capacity * 2);
+    const char *p = text;
+
+    *width = 0;
+    *height = 0;
+    while (tiles != NULL && *p != '\0')
+    {
+        unsigned row_width = 0;
+
+        // one line per tile row, entries separated by commas
+        while (*p != '\0' && *p != '\n')
+        {
+            char *end;
+            unsigned long long entry;
+            unsigned mirror;
+
+            while (*p == ' ' || *p == '\t' || *p == '\r' || *p == ',') p++;
+            if (*p == '\0' || *p == '\n') break;
+
+            entry = strtoull(p, &end, 10);
+            if (end == p)
+            {
+                snprintf(error, ERROR_LEN, "Malformed entry in row %u!", *height);
+                goto fail;
+            }
+            if (entry & TILED_ROTATE)
+            {
+                snprintf(error, ERROR_LEN, "Rotated tile at row %u column %u! Fix this by ensuring "
+                         "there are no rotated tiles.", *height, row_width);
+                goto fail;
+            }
+            if ((entry & TILED_ID_MASK) > PATTERN_ADDR_MAX)
+            {
+                snprintf(error, ERROR_LEN, "Pattern address out of range at row %u column %u!",
+                         *height, row_width);
+                goto fail;
+            }
+            mirror = ((entry & TILED_MIRROR_Y) ? 2 : 0) | ((entry & TILED_MIRROR_X) ? 1 : 0);
+
+            if (count == capacity)
+            {
+                uint8_t *grown = realloc(tiles, capacity * 4);
+
+                if (grown == NULL) goto fail;
+                tiles = grown;
+                capacity *= 2;
+            }
+            put_u16(&tiles[count++ * 2],
+                    ((entry & TILED_ID_MASK) << 6) | (palette_id << 2) | mirror);
+            row_width++;
+            p = end;
+        }
+        if (*p == '\n') p++;
+        if (row_width == 0) continue;
+
+        if (*height == 0) *width = row_width;
+        if (row_width != *width)
+        {
+            snprintf(error, ERROR_LEN, "Row %u has %u tiles, expected %u!", *height, row_width,
+                     *width);
+            goto fail;
+        }
+        (*height)++;
+    }
+    if (tiles == NULL)
+    {
+        snprintf(error, ERROR_LEN, "Out of memory!");
+        return NULL;
+    }
+    if (*height == 0)
+    {
+        snprintf(error, ERROR_LEN, "Malformed .csv file!");
+        goto fail;
+    }
+    return tiles;
+
+fail:
+    if (error[0] == '\0') snprintf(error, ERROR_LEN, "Out of memory!");
+    free(tiles);
+    return NULL;
+}
+
+uint8_t *convert_tilemap_text(const char *text, unsigned *width, unsigned *height, char *error)
+{
+    size_t capacity = 4096, count = 0;
+    uint8_t *tiles = malloc(capacity * 2);
+    const char *p = text;
+
+    *width = 0;
+    *height = 0;
+    while (tiles != NULL && *p != '\0')
+    {
+        unsigned row_width = 0;
+
+        // one line per tile row, entries "(pattern_addr,palette_id,mirror)" in hex
+        while (*p != '\0' && *p != '\n')
+        {
+            unsigned long field[3];
+            int used = -1;
+
+            while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+            if (*p == '\0' || *p == '\n') break;
+
+            if (sscanf(p, "(%lx,%lx,%lx)%n", &field[0], &field[1], &field[2], &used) != 3 ||
+                used < 0)
+            {
+                snprintf(error, ERROR_LEN, "Malformed entry in row %u!", *height);
+                goto fail;
+            }
+            if (field[0] > PATTERN_ADDR_MAX || field[1] > PALETTE_ID_MAX || field[2] > 3)
+            {
+                snprintf(error, ERROR_LEN, "Entry out of range at row %u column %u!", *height,
+                         row_width);
+                goto fail;
+            }
+
+            if (count == capacity)
+            {
+                uint8_t *grown = realloc(tiles, capacity * 4);
+
+                if (grown == NULL) goto fail;
+                tiles = grown;
+                capacity *= 2;
+            }
+            put_u16(&tiles[count++ * 2], (field[0] << 6) | (field[1] << 2) | field[2]);
+            row_width++;
+            p += used;
+        }
+        if (*p == '\n') p++;
+        if (row_width == 0) continue;
+
+        if (*height == 0) *width = row_width;
+        if (row_width != *width)
+        {
+            snprintf(error, ERROR_LEN, "Row %u has %u tiles, expected %u!", *height, row_width,
+                     *width);
+            goto fail;
+        }
+        (*height)++;
+    }
+    if (tiles == NULL)
+    {
+        snprintf(error, ERROR_LEN, "Out of memory!");
+        return NULL;
+    }
+    if (*height == 0)
+    {
+        snprintf(error, ERROR_LEN, "Empty .tilemap file!");
+        goto fail;
+    }
+    return tiles;
+
+fail:
+    if (error[0] == '\0') snprintf(error, ERROR_LEN, "Out of memory!");
+    free(tiles);
+    return NULL;
+}
@@ -0,0 +1,237 @@
+/* Tilemap compression into the .ctilemap format. See asset_compiler.h.
+ *
+ * This is the encoder of compress_tilemap.py, which documents the format, and it makes the same
+ *   bytes: the map is cut into BxB blocks (padded with its last row and column), each new block is
+ *   added to the dictionary in the order it is first seen, and every row of blocks is run-length
+ *   encoded. Blocks of 1x1, 2x2 and 4x4 tiles are tried, and the smallest result is kept (the
+ *   smaller block on a tie).
+ *
+ * Blocks are looked up in a hash table of the dictionary instead of a Python dict, so one pass
+ *   over the map is enough.
+ */
+
+#include "asset_compiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CTILEMAP_MAGIC "FPTM"
+#define CTILEMAP_VERSION 1
+#define CTILEMAP_HEADER_BSIZE 16
+#define CTILEMAP_MAX_ENTRIES 0xFFFF
+#define CTILEMAP_MAX_SIZE 0xFFFF
+#define RUN_MAX 128
+#define BLOCK_MAX 4
+
+static uint8_t *put_index(uint8_t *p, unsigned index, unsigned index_size)
+{
+    if (index_size == 1)
+    {
+        *p = index;
+        return p + 1;
+    }
+    put_u16(p, index);
+    return p + 2;
+}
+
+// Run-length encodes one row of block indices into out, and returns the end of the row's runs.
+//   Literals are held back until a run (or the end of the row) ends them.
+static uint8_t *encode_runs(const uint16_t *indices, unsigned count, unsigned index_size,
+                            uint8_t *out)
+{
+    unsigned literals = 0; // pending literals, which end just before i
+
+    for (unsigned i = 0; i <= count;)
+    {
+        unsigned run = 0;
+
+        if (i < count)
+        {
+            run = 1;
+            while (i + run < count && run < RUN_MAX && indices[i + run] == indices[i]) run++;
+        }
+
+        // a run of two only pays off when it does not split a literal run
+        if (i == count || run >= 3 || (run == 2 && literals == 0))
+        {
+            for (unsigned l = i - literals; l < i; l += RUN_MAX)
+            {
+                unsigned chunk = (i - l < RUN_MAX) ? i - l : RUN_MAX;
+
+                *out++ = chunk - 1;
+                for (unsigned j = 0; j < chunk; j++)
+                {
+                    out = put_index(out, indices[l + j], index_size);
+                }
+            }
+            literals = 0;
+            if (i == count) break;
+            *out++ = 0x7F + run;
+            out = put_index(out, indices[i], index_size);
+        }
+        else
+        {
+            literals += run;
+        }
+        i += run;
+    }
+    return out;
+}
+
+static uint32_t block_hash(const uint16_t *block, unsigned len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (unsigned i = 0; i < len; i++) hash = (hash ^ block[i]) * 16777619u;
+    return hash;
+}
+
+// Encodes the map with BxB blocks. Returns NULL if the dictionary would overflow (with no error)
+//   or if out of memory (with a message in error).
+static uint8_t *encode(const uint16_t *tiles, unsigned width, unsigned height, unsigned block,
+                       size_t *size, char *error)
+{
+    unsigned grid_width = (width + block - 1) / block, grid_height = (height + block - 1) / block;
+    unsigned block_len = block * block, entries = 0, table_slots = 1, index_size;
+    size_t blocks = (size_t)grid_width * grid_height;
+    uint16_t *dict = malloc(blocks * block_len * sizeof(uint16_t));
+    uint16_t *grid = malloc(blocks * sizeof(uint16_t));
+    int32_t *table = NULL;
+    uint8_t *data = NULL, *p, *row_table, *runs;
+
+    while (table_slots < 2 * blocks) table_slots *= 2;
+    if (dict == NULL || grid == NULL || (table = malloc(table_slots * sizeof(int32_t))) == NULL)
+    {
+        snprintf(error, ERROR_LEN, "Out of memory!");
+        goto done;
+    }
+    memset(table, 0xFF, table_slots * sizeof(int32_t));
+
+    for (unsigned by = 0; by < grid_height; by++)
+    {
+        for (unsigned bx = 0; bx < grid_width; bx++)
+        {
+            uint16_t *key = &dict[(size_t)entries * block_len];
+            unsigned slot;
+
+            // padding repeats the last row and column, which keeps edge blocks likely to match
+            for (unsigned y = 0; y < block; y++)
+            {
+                unsigned row = (by * block + y < height) ? by * block + y : height - 1;
+
+                for (unsigned x = 0; x < block; x++)
+                {
+                    unsigned col = (bx * block + x < width) ? bx * block + x : width - 1;
+
+                    key[y * block + x] = tiles[(size_t)row * width + col];
+                }
+            }
+
+            slot = block_hash(key, block_len) & (table_slots - 1);
+            while (table[slot] != -1 &&
+                   memcmp(&dict[(size_t)table[slot] * block_len], key,
+                          block_len * sizeof(uint16_t)) != 0)
+            {
+                slot = (slot + 1) & (table_slots - 1);
+            }
+            if (table[slot] == -1)
+            {
+                if (entries == CTILEMAP_MAX_ENTRIES) goto done;
+                table[slot] = entries++;
+            }
+            grid[(size_t)by * grid_width + bx] = table[slot];
+        }
+    }
+
+    // every index costs at most one control byte on top of itself, in a literal or a run
+    index_size = (entries <= 0x100) ? 1 : 2;
+    *size = CTILEMAP_HEADER_BSIZE + (size_t)entries * block_len * 2 +
+            ((size_t)grid_height + 1) * 4 + blocks * (index_size + 1);
+    if ((data = malloc(*size)) == NULL)
+    {
+        snprintf(error, ERROR_LEN, "Out of memory!");
+        goto done;
+    }
+
+    memcpy(data, CTILEMAP_MAGIC, 4);
+    put_u16(data + 4, CTILEMAP_VERSION);
+    put_u16(data + 6, width);
+    put_u16(data + 8, height);
+    data[10] = block;
+    data[11] = index_size;
+    put_u16(data + 12, entries);
+    put_u16(data + 14, 0);
+    p = data + CTILEMAP_HEADER_BSIZE;
+    for (size_t i = 0; i < (size_t)entries * block_len; i++, p += 2) put_u16(p, dict[i]);
+
+    // the row table comes before the runs, so fill it in as the runs are written
+    row_table = p;
+    runs = p = row_table + ((size_t)grid_height + 1) * 4;
+    for (unsigned by = 0; by < grid_height; by++)
+    {
+        put_u32(row_table + by * 4, p - runs);
+        p = encode_runs(&grid[(size_t)by * grid_width], grid_width, index_size, p);
+    }
+    put_u32(row_table + grid_height * 4, p - runs);
+    *size = p - data;
+
+done:
+    free(dict);
+    free(grid);
+    free(table);
+    return data;
+}
+
+uint8_t *ctilemap_encode(const uint8_t *tiles, unsigned width, unsigned height, size_t *size,
+                         unsigned *block, char *error)
+{
+    static const unsigned block_sizes[] = { 1, 2, BLOCK_MAX };
+    uint16_t *values;
+    uint8_t *best = NULL;
+
+    if (width > CTILEMAP_MAX_SIZE || height > CTILEMAP_MAX_SIZE)
+    {
+        snprintf(error, ERROR_LEN, "Tilemap is larger than %ux%u tiles!", CTILEMAP_MAX_SIZE,
+                 CTILEMAP_MAX_SIZE);
+        return NULL;
+    }
+    if ((values = malloc((size_t)width * height * sizeof(uint16_t))) == NULL)
+    {
+        snprintf(error, ERROR_LEN, "Out of memory!");
+        return NULL;
+    }
+    for (size_t i = 0; i < (size_t)width * height; i++) values[i] = get_u16(&tiles[i * 2]);
+
+    for (unsigned i = 0; i < sizeof(block_sizes) / sizeof(block_sizes[0]); i++)
+    {
+        size_t encoded_size;
+        uint8_t *encoded = encode(values, width, height, block_sizes[i], &encoded_size, error);
+
+        if (error[0] != '\0')
+        {
+            free(best);
+            best = NULL;
+            break;
+        }
+        if (encoded != NULL && (best == NULL || encoded_size < *size))
+        {
+            free(best);
+            best = encoded;
+            *size = encoded_size;
+            *block = block_sizes[i];
+        }
+        else
+        {
+            free(encoded);
+        }
+    }
+    free(values);
+
+    if (best == NULL && error[0] == '\0')
+    {
+        snprintf(error, ERROR_LEN, "Tilemap has more than %u different blocks!",
+                 CTILEMAP_MAX_ENTRIES);
+    }
+    return best;
+}
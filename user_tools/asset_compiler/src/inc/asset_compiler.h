@@ -0,0 +1,204 @@
+/** @file asset_compiler.h
+ * @brief Shared types of the batch asset compiler
+ *
+ * The compiler reads a manifest of source art (Piskel .gpl and .c files, Tiled .csv files and
+ *   .tilemap files), turns each manifest entry into one or more assets in the runtime formats of
+ *   the PPU User Library, and writes them all into one .fpak asset pack (see asset_pack.h in
+ *   examples/techdemo/src/inc).
+ *
+ * Entries are independent jobs, run on a pool of threads. A job reads its sources, converts them
+ *   with the functions of convert.c, tileset.c and ctilemap.c, and fills a list of outputs.
+ *   Nothing is shared between jobs while they run, except for the palettes, which are all
+ *   converted first.
+ */
+
+#ifndef _ASSET_COMPILER_H_
+#define _ASSET_COMPILER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NAME_LEN 32        ///< Longest asset name, including the NUL terminator (as in packs)
+#define ERROR_LEN 256      ///< Longest error message of a job
+#define PALETTE_COLORS 16  ///< Colors in a Piskel palette, including the transparent color 0
+
+#define PATTERN_BSIZE 32   ///< Size of one pattern_t
+#define PALETTE_BSIZE 60   ///< Size of one palette_t (15 colors)
+#define PATTERNRAM_WIDTH 32
+#define PATTERNRAM_HEIGHT 32
+#define PALETTE_ID_MAX 15  ///< Largest palette ID a tile can use
+
+/** @brief Asset types, with the values stored in packs (asset_type_e) */
+typedef enum {
+    TYPE_TILEMAP = 1,
+    TYPE_PATTERN = 2,
+    TYPE_PALETTE = 3,
+    TYPE_CTILEMAP = 4
+} asset_type_e;
+
+/** @brief One asset made by a job */
+typedef struct {
+    char name[NAME_LEN];
+    asset_type_e type;
+    unsigned width;        ///< Width in 8x8 tiles (1 for palettes)
+    unsigned height;       ///< Height in 8x8 tiles (1 for palettes)
+    uint8_t *data;         ///< Payload, in the exact format of the pack
+    size_t size;
+    uint64_t hash;         ///< Hash of the payload, to share identical payloads in the pack
+} output_t;
+
+/** @brief The outputs of one job, grown as assets are added */
+typedef struct {
+    output_t *items;
+    unsigned count;
+    unsigned capacity;
+} output_list_t;
+
+/** @brief A 16-color palette read from a .gpl file, with a hash table from color to index
+ *
+ * The table has 32 slots for 16 colors, so lookups take one or two probes. Colors repeated in the
+ *   palette resolve to their lowest index, like c_to_pattern.py.
+ */
+typedef struct {
+    uint32_t colors[PALETTE_COLORS];  ///< 0xRRGGBB
+    uint32_t slot_color[32];
+    int8_t slot_index[32];            ///< Palette index of each slot, -1 if empty
+} palette_lut_t;
+
+/** @brief Frames of a Piskel .c file, as palette indices */
+typedef struct {
+    unsigned frames;
+    unsigned width;        ///< In pixels
+    unsigned height;       ///< In pixels
+    uint8_t *pixels;       ///< frames * height * width palette indices, frame by frame
+} image_t;
+
+/* === Hashing (asset_compiler.c) === */
+
+/** @brief 64-bit FNV-1a hash of @p len bytes, continued from @p hash (start from FNV_OFFSET) */
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t len);
+
+#define FNV_OFFSET 0xCBF29CE484222325ull
+
+/* === Little-endian fields of payloads, packs and cache entries === */
+
+static inline void put_u16(uint8_t *p, unsigned v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, v & 0xFFFF);
+    put_u16(p + 2, v >> 16);
+}
+
+static inline unsigned get_u16(const uint8_t *p)
+{
+    return p[0] | (unsigned)p[1] << 8;
+}
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* === Outputs (asset_compiler.c) === */
+
+/** @brief Adds an asset to @p list, taking ownership of @p data
+ * @return 0 on success; -1 with a message in @p error if the name is too long or out of memory
+ *         (@p data is freed)
+ */
+int output_add(output_list_t *list, const char *name, asset_type_e type, unsigned width,
+               unsigned height, uint8_t *data, size_t size, char *error);
+
+/** @brief Frees every output of @p list */
+void output_list_free(output_list_t *list);
+
+/* === Conversion (convert.c) === */
+
+/** @brief Reads a whole file into memory, NUL-terminated
+ * @return The contents (free with free); NULL if the file could not be read
+ */
+char *read_file(const char *path, size_t *size);
+
+/** @brief Parses a Piskel or GIMP .gpl palette of 16 colors
+ * @return 0 on success; -1 with a message in @p error
+ */
+int convert_gpl(const char *text, palette_lut_t *palette, char *error);
+
+/** @brief Packs a palette as a palette_t (colors 1 to 15) into @p out (PALETTE_BSIZE bytes) */
+void palette_pack(const palette_lut_t *palette, uint8_t *out);
+
+/** @brief Parses a Piskel .c export, mapping every color to its palette index
+ * @return 0 on success; -1 with a message in @p error
+ */
+int convert_piskel(const char *text, const palette_lut_t *palette, image_t *image, char *error);
+
+/** @brief Packs a width x height tile block of a frame as pattern_t, row by row
+ *
+ * @param image A converted image.
+ * @param frame Frame to pack.
+ * @param out Receives (width / 8) * (height / 8) patterns.
+ */
+void image_pack_patterns(const image_t *image, unsigned frame, uint8_t *out);
+
+/** @brief Parses a Tiled .csv export into tile_t, row by row
+ * @return The tiles (free with free); NULL with a message in @p error
+ */
+uint8_t *convert_csv(const char *text, unsigned palette_id, unsigned *width, unsigned *height,
+                     char *error);
+
+/** @brief Parses a .tilemap text file (as written by tiled_csv_to_tilemap.py) into tile_t
+ * @return The tiles (free with free); NULL with a message in @p error
+ */
+uint8_t *convert_tilemap_text(const char *text, unsigned *width, unsigned *height, char *error);
+
+/* === Tilesets (tileset.c) === */
+
+/** @brief Deduplication statistics of a tileset */
+typedef struct {
+    unsigned tiles;        ///< 8x8 tiles in all images
+    unsigned unique;       ///< Patterns kept
+    unsigned mirrored;     ///< Tiles which matched a kept pattern only once mirrored
+} tileset_stats_t;
+
+/** @brief Builds a tileset: one pattern sheet of every unique 8x8 pattern, and a tilemap per frame
+ *
+ * Tiles which equal an earlier tile, or an X, Y or XY mirror of one, share its pattern. The sheet
+ *   is placed in Pattern RAM at ( @p x, @p y ), PATTERNRAM_WIDTH - @p x patterns wide, and each
+ *   frame's tilemap points into it with the right mirror bits.
+ *
+ * @param name Name of the pattern sheet.
+ * @param images Converted images.
+ * @param names Base name of each image's tilemaps (a "-<frame>" suffix is added to multi-frame
+ *              images, like c_to_pattern.py).
+ * @param count Number of images.
+ * @param palette_id Palette ID of every tile.
+ * @param x Pattern RAM column of the sheet.
+ * @param y Pattern RAM row of the sheet.
+ * @param list Receives the sheet, then the tilemaps.
+ * @param stats Receives the deduplication statistics.
+ * @return 0 on success; -1 with a message in @p error
+ */
+int tileset_build(const char *name, const image_t *images, const char *const *names,
+                  unsigned count, unsigned palette_id, unsigned x, unsigned y,
+                  output_list_t *list, tileset_stats_t *stats, char *error);
+
+/* === Compressed tilemaps (ctilemap.c) === */
+
+/** @brief Compresses a tilemap into the .ctilemap format, exactly like compress_tilemap.py
+ *
+ * @param tiles @p width * @p height tile_t, row by row, as made by @ref convert_csv.
+ * @param width Width in tiles, at most 65535.
+ * @param height Height in tiles, at most 65535.
+ * @param size Receives the size of the result.
+ * @param block Receives the block size which was kept (1, 2 or 4).
+ * @param error Must hold an empty string.
+ * @return The .ctilemap payload (free with free); NULL with a message in @p error
+ */
+uint8_t *ctilemap_encode(const uint8_t *tiles, unsigned width, unsigned height, size_t *size,
+                         unsigned *block, char *error);
+
+#endif /* _ASSET_COMPILER_H_ */
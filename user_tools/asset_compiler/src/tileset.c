@@ -0,0 +1,143 @@
+/* Mirror-aware deduplication of 8x8 patterns into a tileset. See asset_compiler.h.
+ *
+ * Every tile of every frame is packed as a pattern_t, and the whole set is deduplicated at once
+ *   with pattern_dedup_patterns, the techdemo's own module (examples/techdemo/src/pattern_dedup.c),
+ *   so the compiler and games agree on which patterns are mirrors of each other. Each tile then
+ *   points at the kept pattern which draws it, with the mirror bits the module returned.
+ *
+ * Packed patterns are little-endian bytes, while pattern_t holds host-order uint32_t rows.
+ */
+
+#include "asset_compiler.h"
+#include "pattern_dedup.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int tileset_build(const char *name, const image_t *images, const char *const *names,
+                  unsigned count, unsigned palette_id, unsigned x, unsigned y,
+                  output_list_t *list, tileset_stats_t *stats, char *error)
+{
+    unsigned sheet_width = PATTERNRAM_WIDTH - x;
+    unsigned capacity = sheet_width * (PATTERNRAM_HEIGHT - y);
+    unsigned sheet_height, total = 0, t = 0;
+    uint8_t *packed = NULL, *sheet;
+    pattern_t *patterns = NULL;
+    pattern_dedup_map_t *map = NULL;
+    int kept;
+
+    memset(stats, 0, sizeof(*stats));
+    for (unsigned i = 0; i < count; i++)
+    {
+        total += (images[i].width / 8) * (images[i].height / 8) * images[i].frames;
+    }
+
+    // every tile of every frame, in order, as one set
+    if ((packed = malloc(PATTERN_BSIZE * (total ? total : 1))) == NULL ||
+        (patterns = malloc(sizeof(pattern_t) * (total ? total : 1))) == NULL ||
+        (map = malloc(sizeof(pattern_dedup_map_t) * (total ? total : 1))) == NULL)
+    {
+        snprintf(error, ERROR_LEN, "Out of memory!");
+        goto fail;
+    }
+    for (unsigned i = 0; i < count; i++)
+    {
+        unsigned tiles = (images[i].width / 8) * (images[i].height / 8);
+
+        for (unsigned f = 0; f < images[i].frames; f++, t += tiles)
+        {
+            image_pack_patterns(&images[i], f, &packed[t * PATTERN_BSIZE]);
+        }
+    }
+    for (unsigned p = 0; p < total; p++)
+    {
+        for (unsigned r = 0; r < 8; r++)
+        {
+            patterns[p].pxrow[r] = get_u32(&packed[p * PATTERN_BSIZE + r * 4]);
+        }
+    }
+
+    // kept patterns are written over the set itself, in order
+    if ((kept = pattern_dedup_patterns(patterns, total, patterns, map)) == -1)
+    {
+        snprintf(error, ERROR_LEN, "Out of memory!");
+        goto fail;
+    }
+    if ((unsigned)kept > capacity)
+    {
+        snprintf(error, ERROR_LEN, "More than %u unique patterns do not fit in Pattern RAM from "
+                 "(%u, %u)!", capacity, x, y);
+        goto fail;
+    }
+
+    // unused patterns of the sheet's last row stay transparent
+    sheet_height = ((unsigned)kept + sheet_width - 1) / sheet_width;
+    if (sheet_height == 0) sheet_height = 1;
+    if ((sheet = calloc(sheet_width * sheet_height, PATTERN_BSIZE)) == NULL)
+    {
+        snprintf(error, ERROR_LEN, "Out of memory!");
+        goto fail;
+    }
+    for (int k = 0; k < kept; k++)
+    {
+        for (unsigned r = 0; r < 8; r++)
+        {
+            put_u32(&sheet[k * PATTERN_BSIZE + r * 4], patterns[k].pxrow[r]);
+        }
+    }
+    if (output_add(list, name, TYPE_PATTERN, sheet_width, sheet_height, sheet,
+                   (size_t)sheet_width * sheet_height * PATTERN_BSIZE, error) != 0)
+    {
+        goto fail;
+    }
+
+    t = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        const image_t *image = &images[i];
+        unsigned tiles_wide = image->width / 8, tiles_high = image->height / 8;
+        unsigned tiles = tiles_wide * tiles_high;
+
+        for (unsigned f = 0; f < image->frames; f++)
+        {
+            char map_name[NAME_LEN + 16];
+            uint8_t *tilemap = malloc(tiles * 2);
+
+            if (tilemap == NULL)
+            {
+                snprintf(error, ERROR_LEN, "Out of memory!");
+                goto fail;
+            }
+            for (unsigned j = 0; j < tiles; j++, t++)
+            {
+                unsigned index = map[t].index;
+                unsigned addr = ((y + index / sheet_width) << 5) | (x + index % sheet_width);
+
+                put_u16(&tilemap[j * 2], (addr << 6) | (palette_id << 2) | map[t].mirror);
+                stats->mirrored += (map[t].mirror != MIRROR_NONE);
+            }
+
+            if (image->frames == 1) snprintf(map_name, sizeof(map_name), "%s", names[i]);
+            else snprintf(map_name, sizeof(map_name), "%s-%u", names[i], f);
+            if (output_add(list, map_name, TYPE_TILEMAP, tiles_wide, tiles_high, tilemap,
+                           tiles * 2, error) != 0)
+            {
+                goto fail;
+            }
+        }
+    }
+    stats->tiles = total;
+    stats->unique = kept;
+
+    free(packed);
+    free(patterns);
+    free(map);
+    return 0;
+
+fail:
+    free(packed);
+    free(patterns);
+    free(map);
+    return -1;
+}
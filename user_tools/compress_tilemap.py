@@ -0,0 +1,187 @@
+# Compresses a tilemap into a .ctilemap file for use with FP-GAme.
+# The input is either a .csv file exported from Tiled (in the format tiled_csv_to_tilemap.py
+#   expects, which also needs a palette_ID), or a .tilemap text file.
+#
+# Level maps repeat themselves a lot: large areas of one tile, and the same small groups of tiles
+#   (a 2x2 bush, a 4x4 building corner) over and over. A .ctilemap stores the map as a grid of
+#   metatiles, square blocks of BxB tiles, kept once each in a dictionary. Every row of blocks is a
+#   run-length encoded list of dictionary indices. The game decodes it one tile row at a time
+#   straight into Tile RAM writes, so the whole map is never expanded in memory. See ctilemap.h in
+#   examples/techdemo/src/inc.
+#
+# The script tries blocks of 1x1 (plain run-length encoding), 2x2 and 4x4 tiles and keeps the
+#   smallest result. A map whose size is not a multiple of the block size is padded with its last
+#   row and column; the padding is never decoded.
+#
+# File layout (all integers little-endian):
+# * Header (16B): magic "FPTM", u16 version, u16 width, u16 height (both in tiles), u8 block size B
+#   (1, 2 or 4), u8 index size (1 or 2 bytes), u16 dictionary entries, u16 reserved.
+# * Dictionary: B*B tile_t per entry, row by row within the block.
+# * Row table: one u32 per row of blocks, plus one for the end, giving the byte offset of each
+#   row's runs from the start of the run data.
+# * Run data. Each run starts with a control byte c:
+#   * c < 0x80: c + 1 literal indices follow.
+#   * c >= 0x80: one index follows, which repeats c - 0x7F times.
+
+import csv
+import os
+import struct
+import sys
+
+MAGIC = b"FPTM"
+VERSION = 1
+BLOCK_SIZES = (1, 2, 4)
+RUN_MAX = 128
+
+HEADER_FMT = "<4sHHHBBHH"
+
+def read_csv(path, palette_ID):
+    with open(path, 'r') as fr:
+        data_2d = [row for row in csv.reader(fr, delimiter=',') if len(row) != 0]
+
+    if len(data_2d) == 0 or len(data_2d[0]) == 0:
+        print("Error: Malformed .csv file!")
+        quit()
+
+    # Same decoding as tiled_csv_to_tilemap.py: the two MSBs are the horizontal and vertical
+    #   mirror, the third the (unsupported) rotation.
+    tiles = []
+    for row in range(len(data_2d)):
+        if len(data_2d[row]) != len(data_2d[0]):
+            print("Error: Row %d of %s has %d tiles, expected %d!" % (row, path,
+                  len(data_2d[row]), len(data_2d[0])))
+            quit()
+        for col in range(len(data_2d[row])):
+            entry = int(data_2d[row][col])
+            pattern_addr = entry & 0x1FFFFFFF
+            mirror = (((entry & 0x40000000) > 0) << 1) | ((entry & 0x80000000) > 0)
+            if entry & 0x20000000:
+                print("ERROR: Rotated Tile at row %d column %d!" % (row, col))
+                print("Fix this by ensuring there are no rotated tiles!")
+            tiles.append((pattern_addr << 6) | (int(palette_ID) << 2) | mirror)
+    return tiles, len(data_2d[0]), len(data_2d)
+
+def read_tilemap(path):
+    with open(path, 'r') as fr:
+        lines = [line.split() for line in fr if line.strip() != ""]
+
+    if len(lines) == 0:
+        print("Error: %s is empty!" % path)
+        quit()
+
+    tiles = []
+    for row in range(len(lines)):
+        if len(lines[row]) != len(lines[0]):
+            print("Error: Row %d of %s has %d tiles, expected %d!" % (row, path, len(lines[row]),
+                  len(lines[0])))
+            quit()
+        for entry in lines[row]:
+            pattern_addr, palette_id, mirror = [int(x, 16) for x in entry.strip("()").split(",")]
+            tiles.append((pattern_addr << 6) | (palette_id << 2) | mirror)
+    return tiles, len(lines[0]), len(lines)
+
+# Run-length encodes one row of block indices
+def encode_runs(indices, index_fmt):
+    out = bytearray()
+    literals = []
+
+    def flush_literals():
+        for i in range(0, len(literals), RUN_MAX):
+            chunk = literals[i:i + RUN_MAX]
+            out.append(len(chunk) - 1)
+            for index in chunk:
+                out.extend(struct.pack(index_fmt, index))
+        literals.clear()
+
+    i = 0
+    while i < len(indices):
+        run = 1
+        while i + run < len(indices) and run < RUN_MAX and indices[i + run] == indices[i]:
+            run += 1
+        # a run of two only pays off when it does not split a literal run
+        if run >= 3 or (run == 2 and len(literals) == 0):
+            flush_literals()
+            out.append(0x7F + run)
+            out.extend(struct.pack(index_fmt, indices[i]))
+        else:
+            literals.extend(indices[i:i + run])
+        i += run
+    flush_literals()
+    return out
+
+def encode(tiles, width, height, block):
+    grid_width = (width + block - 1) // block
+    grid_height = (height + block - 1) // block
+
+    dictionary = {}
+    entries = []
+    rows = []
+    for by in range(grid_height):
+        row = []
+        for bx in range(grid_width):
+            # padding repeats the last row and column, which keeps edge blocks likely to match
+            key = tuple(tiles[min(by*block + y, height - 1) * width + min(bx*block + x, width - 1)]
+                        for y in range(block) for x in range(block))
+            if key not in dictionary:
+                dictionary[key] = len(entries)
+                entries.append(key)
+            row.append(dictionary[key])
+        rows.append(row)
+
+    if len(entries) > 0xFFFF:
+        return None
+    index_size = 1 if len(entries) <= 0x100 else 2
+    index_fmt = "<B" if index_size == 1 else "<H"
+
+    runs = bytearray()
+    row_table = bytearray()
+    for row in rows:
+        row_table += struct.pack("<I", len(runs))
+        runs += encode_runs(row, index_fmt)
+    row_table += struct.pack("<I", len(runs))
+
+    data = struct.pack(HEADER_FMT, MAGIC, VERSION, width, height, block, index_size,
+                       len(entries), 0)
+    for entry in entries:
+        data += struct.pack("<%dH" % len(entry), *entry)
+    return data + row_table + runs
+
+def main(input_path, output_path, palette_ID):
+    ext = os.path.splitext(input_path)[1]
+    if ext == ".csv":
+        if palette_ID is None:
+            print("Error: A palette_ID is needed for .csv files!")
+            quit()
+        tiles, width, height = read_csv(input_path, palette_ID)
+    elif ext == ".tilemap":
+        tiles, width, height = read_tilemap(input_path)
+    else:
+        print("Error: Unsupported input %s! Expected a .csv or .tilemap file." % input_path)
+        quit()
+
+    if width > 0xFFFF or height > 0xFFFF:
+        print("Error: %s is larger than 65535x65535 tiles!" % input_path)
+        quit()
+
+    best = None
+    for block in BLOCK_SIZES:
+        data = encode(tiles, width, height, block)
+        if data is not None and (best is None or len(data) < len(best[1])):
+            best = (block, data)
+
+    if best is None:
+        print("Error: %s has more than 65535 different tiles!" % input_path)
+        quit()
+
+    with open(output_path + ".ctilemap", 'wb') as fw:
+        fw.write(best[1])
+
+    print("%dx%d tiles: %d bytes -> %d bytes with %dx%d blocks" % (width, height,
+          width * height * 2, len(best[1]), best[0], best[0]))
+
+if __name__ == "__main__":
+    if len(sys.argv) == 3 or len(sys.argv) == 4:
+        main(sys.argv[1], sys.argv[2], sys.argv[3] if len(sys.argv) == 4 else None)
+    else:
+        print("Expecting 2 or 3 arguments: <src .csv or .tilemap file>, <dest filename no "
+              "extension>, and <palette_ID> (.csv only)")
@@ -0,0 +1,159 @@
+# Packs .pattern, .palette and .tilemap text files into a single binary .fpak asset pack for use
+#   with FP-GAme. Compressed .ctilemap files (made with compress_tilemap.py) are packed as they are.
+# The payloads are stored in the exact in-memory formats used by the PPU User Library (pattern_t,
+#   palette_t and tile_t), so a game can mmap the pack and write its contents straight to VRAM
+#   without parsing any text at startup. See asset_pack.h in examples/techdemo/src/inc.
+#
+# Each asset is named after its file name without the extension. For example,
+#   assets/scotty_front-0.pattern is stored as "scotty_front-0". Assets of different types may
+#   share a name (the_mall.tilemap and the_mall.palette).
+#
+# Pack layout (all integers little-endian):
+# * Header (16B): magic "FPAK", u16 version, u16 entry count, u32 TOC offset, u32 reserved.
+# * Table of contents: one 48B entry per asset, sorted by name, then type:
+#   char name[32] (NUL-terminated), u32 type, u32 payload offset, u32 payload size, u16 width,
+#   u16 height. Width and height are in 8x8 tiles (patterns and tilemaps, compressed or not) and are
+#   1 for palettes.
+# * Payloads, each aligned to 32B.
+
+import os
+import struct
+import sys
+
+PACK_MAGIC = b"FPAK"
+PACK_VERSION = 1
+PACK_ALIGN = 32
+NAME_LEN = 32
+
+TYPE_TILEMAP = 1
+TYPE_PATTERN = 2
+TYPE_PALETTE = 3
+TYPE_CTILEMAP = 4
+
+HEADER_FMT = "<4sHHII"
+ENTRY_FMT = "<32sIIIHH"
+
+def read_pattern(path):
+    with open(path, 'r') as fr:
+        rows = [line.strip() for line in fr if line.strip() != ""]
+
+    if len(rows) == 0 or len(rows) % 8 != 0 or len(rows[0]) % 8 != 0:
+        print("Error: %s is not a whole number of 8x8 patterns!" % path)
+        quit()
+
+    width = len(rows[0]) // 8
+    height = len(rows) // 8
+
+    # pattern_t tiles are stored row by row. Each pixel row of a tile is one uint32_t with the
+    #   left-most pixel in the least significant nibble.
+    payload = bytearray()
+    for ty in range(height):
+        for tx in range(width):
+            for row in range(8):
+                pixels = rows[ty*8 + row][tx*8:tx*8 + 8]
+                pxrow = 0
+                for x in range(8):
+                    pxrow |= int(pixels[x], 16) << (4*x)
+                payload += struct.pack("<I", pxrow)
+    return payload, width, height
+
+def read_palette(path):
+    with open(path, 'r') as fr:
+        colors = [line.strip() for line in fr if line.strip() != ""]
+
+    if len(colors) != 16:
+        print("Error: %s must contain 16 colors!" % path)
+        quit()
+
+    # The first color is the transparent color, which is not stored in palette_t.
+    payload = bytearray()
+    for color in colors[1:]:
+        payload += struct.pack("<I", int(color, 16))
+    return payload, 1, 1
+
+def read_tilemap(path):
+    with open(path, 'r') as fr:
+        lines = [line.split() for line in fr if line.strip() != ""]
+
+    width = len(lines[0])
+    height = len(lines)
+
+    # tile_t is the pattern address, palette ID and mirror bits packed from MSB to LSB.
+    payload = bytearray()
+    for row in range(height):
+        if len(lines[row]) != width:
+            print("Error: Row %d of %s has %d tiles, expected %d!" % (row, path, len(lines[row]),
+                  width))
+            quit()
+        for entry in lines[row]:
+            pattern_addr, palette_id, mirror = [int(x, 16) for x in entry.strip("()").split(",")]
+            payload += struct.pack("<H", (pattern_addr << 6) | (palette_id << 2) | mirror)
+    return payload, width, height
+
+def read_ctilemap(path):
+    with open(path, 'rb') as fr:
+        payload = fr.read()
+
+    # only the header is checked here; the game checks the rest when it opens the tilemap
+    if len(payload) < 16 or payload[0:4] != b"FPTM":
+        print("Error: %s is not a compressed tilemap!" % path)
+        quit()
+
+    width, height = struct.unpack_from("<HH", payload, 6)
+    return payload, width, height
+
+READERS = {
+    ".tilemap": (TYPE_TILEMAP, read_tilemap),
+    ".pattern": (TYPE_PATTERN, read_pattern),
+    ".palette": (TYPE_PALETTE, read_palette),
+    ".ctilemap": (TYPE_CTILEMAP, read_ctilemap),
+}
+
+def align(size):
+    return (size + PACK_ALIGN - 1) // PACK_ALIGN * PACK_ALIGN
+
+def main(output_path, input_paths):
+    assets = {}
+    for path in input_paths:
+        name, ext = os.path.splitext(os.path.basename(path))
+        if ext not in READERS:
+            print("Error: Unsupported asset type %s! Expected .tilemap, .ctilemap, .pattern or "
+                  ".palette." % path)
+            quit()
+        if len(name.encode()) >= NAME_LEN:
+            print("Error: Asset name %s is longer than %d characters!" % (name, NAME_LEN - 1))
+            quit()
+
+        asset_type, reader = READERS[ext]
+        if (name, asset_type) in assets:
+            print("Error: Two %s assets are named %s!" % (ext, name))
+            quit()
+
+        payload, width, height = reader(path)
+        assets[(name, asset_type)] = (payload, width, height)
+
+    # The runtime binary searches the table of contents, so it must be sorted by name, then type.
+    keys = sorted(assets.keys(), key=lambda x: (x[0].encode(), x[1]))
+    toc_offset = struct.calcsize(HEADER_FMT)
+    offset = align(toc_offset + len(keys) * struct.calcsize(ENTRY_FMT))
+
+    toc = bytearray()
+    payloads = bytearray()
+    for name, asset_type in keys:
+        payload, width, height = assets[(name, asset_type)]
+        toc += struct.pack(ENTRY_FMT, name.encode(), asset_type, offset, len(payload), width,
+                           height)
+        payloads += payload + bytes(align(len(payload)) - len(payload))
+        offset += align(len(payload))
+
+    header = struct.pack(HEADER_FMT, PACK_MAGIC, PACK_VERSION, len(keys), toc_offset, 0)
+    prefix = header + toc
+    with open(output_path + ".fpak", 'wb') as fw:
+        fw.write(prefix + bytes(align(len(prefix)) - len(prefix)) + payloads)
+
+if __name__ == "__main__":
+    if len(sys.argv) >= 3:
+        main(sys.argv[1], sys.argv[2:])
+    else:
+        print("Expecting at least 2 arguments: <dest filename no extension> and one or more "
+              "<src .tilemap, .ctilemap, .pattern or .palette file>")
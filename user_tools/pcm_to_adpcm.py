@@ -0,0 +1,105 @@
+# Converts a raw 8-bit signed PCM file (.bin or .raw, 32KHz mono) to an IMA-ADPCM .adpcm file which
+#   can be streamed from disk with audio_stream.h in examples/techdemo/src/inc.
+# Each sample is stored in 4 bits, halving the size of the file. More importantly, streamed audio
+#   does not need to be linked into the game binary, so only a small window of it is ever resident.
+#
+# File layout (all integers little-endian):
+# * Header (16B): magic "FADP", u16 version, u16 samples per block, u32 sample count, u32 reserved.
+# * Blocks, all the same size: s16 initial predictor, u8 initial step index, u8 reserved, then one
+#   4-bit code per sample, the first sample in the low nibble. The last block is padded with zero
+#   codes. Blocks can be decoded independently, so a player can start or loop at any block.
+#
+# The decoder predicts 16-bit samples and plays the top 8 bits. The encoder aims for the middle of
+#   each 8-bit step, so samples which are predicted closely enough decode back exactly.
+
+import struct
+import sys
+
+ADPCM_MAGIC = b"FADP"
+ADPCM_VERSION = 1
+BLOCK_SAMPLES = 1024
+
+HEADER_FMT = "<4sHHII"
+BLOCK_HEADER_FMT = "<hBB"
+
+STEP_TABLE = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66,
+    73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449,
+    494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272,
+    2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493,
+    10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+]
+
+INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8]
+
+# Applies one 4-bit code to the decoder state, exactly as audio_stream.c does
+def decode_code(code, predictor, index):
+    step = STEP_TABLE[index]
+    diff = step >> 3
+    if code & 1:
+        diff += step >> 2
+    if code & 2:
+        diff += step >> 1
+    if code & 4:
+        diff += step
+
+    predictor = predictor - diff if code & 8 else predictor + diff
+    predictor = max(-32768, min(32767, predictor))
+    index = max(0, min(len(STEP_TABLE) - 1, index + INDEX_TABLE[code & 7]))
+    return predictor, index
+
+def encode_block(samples, index):
+    targets = [s*256 + 128 for s in samples]
+    predictor = targets[0]
+    block = bytearray(struct.pack(BLOCK_HEADER_FMT, predictor, index, 0))
+    codes = []
+
+    for target in targets:
+        step = STEP_TABLE[index]
+        diff = target - predictor
+        code = 0
+        if diff < 0:
+            code = 8
+            diff = -diff
+        if diff >= step:
+            code |= 4
+            diff -= step
+        if diff >= step >> 1:
+            code |= 2
+            diff -= step >> 1
+        if diff >= step >> 2:
+            code |= 1
+        codes.append(code)
+        predictor, index = decode_code(code, predictor, index)
+
+    codes += [0] * (BLOCK_SAMPLES - len(codes))
+    for i in range(0, BLOCK_SAMPLES, 2):
+        block.append(codes[i] | codes[i+1] << 4)
+    return block, index
+
+def main(src_path, dest_path):
+    with open(src_path, 'rb') as fr:
+        pcm = fr.read()
+    samples = list(struct.unpack("%db" % len(pcm), pcm))
+
+    if len(samples) == 0:
+        print("Error: %s contains no samples!" % src_path)
+        quit()
+
+    with open(dest_path, 'wb') as fw:
+        fw.write(struct.pack(HEADER_FMT, ADPCM_MAGIC, ADPCM_VERSION, BLOCK_SAMPLES, len(samples), 0))
+
+        index = 0
+        for start in range(0, len(samples), BLOCK_SAMPLES):
+            block, index = encode_block(samples[start:start + BLOCK_SAMPLES], index)
+            fw.write(block)
+
+    print("Encoded %d samples (%.2fs) from %d to %d bytes" % (len(samples), len(samples) / 32000,
+          len(samples), 16 + (len(samples) + BLOCK_SAMPLES - 1) // BLOCK_SAMPLES *
+          (4 + BLOCK_SAMPLES // 2)))
+
+if __name__ == "__main__":
+    if len(sys.argv) == 3:
+        main(sys.argv[1], sys.argv[2])
+    else:
+        print("Expecting 2 arguments: <src .bin or .raw file> and <dest .adpcm file>")